@@ -16,6 +16,7 @@
 #ifndef CH_BINAR_DATA_QUEUE_HPP
 #define CH_BINAR_DATA_QUEUE_HPP
 
+#include <atomic>
 #include "channel_base.hpp"
 
 template<unsigned short buffer_size = 64,
@@ -111,7 +112,7 @@ public:
       data_len[m_tail] = *p;
       len += sizeof(*p) + *p;
       if(m_num == buffer_size){
-	m_head = (m_head + 1) % data_size;
+	m_head = (m_head + 1) % buffer_size;
       }else{
 	m_num++;
       }      
@@ -160,4 +161,234 @@ public:
   }  
 };
 
+// ch_binary_data_ring is the variable length version of
+// ch_binary_data_queue. Each data is stored in a contiguous byte ring as
+// | <length (4byte)> | <data> | <padding to 4byte boundary> |, then the
+// memory is consumed only by the actual data length. A data never wraps
+// around the end of the ring; the remaining bytes are skipped with a
+// wrap marker instead.
+//
+// The producer writes the data in place with reserve()/commit(), and the
+// consumer decodes it in place with peek()/release(). These are for a
+// single producer and a single consumer, and are lock free. When the ring
+// has no space for the data, the data is dropped and counted (the oldest
+// one cannot be overwritten because the consumer may be reading it).
+template<unsigned int capacity = 16384>
+class ch_binary_data_ring: public ch_base
+{
+  static_assert((capacity & (capacity - 1)) == 0 && capacity >= 16,
+		"capacity of ch_binary_data_ring should be power of 2");
+protected:
+  static const unsigned int hdr_size = sizeof(unsigned int);
+  static const unsigned int wrap_marker = 0xFFFFFFFF;
+  static const unsigned int mask = capacity - 1;
+  
+  alignas(64) unsigned char m_buf[capacity];
+  alignas(64) atomic<unsigned int> m_head; // byte position, by consumer
+  alignas(64) atomic<unsigned int> m_tail; // byte position, by producer
+  atomic<int> m_num;
+  atomic<unsigned int> m_num_drops;
+  
+  // producer side state between reserve() and commit()
+  unsigned int m_rsv_skip, m_rsv_len;
+  // consumer side state between peek() and release()
+  unsigned int m_peek_size;
+  
+  static unsigned int rec_size(unsigned int len)
+  {
+    return hdr_size + ((len + hdr_size - 1) & ~(hdr_size - 1));
+  }
+
+  unsigned int & hdr_at(unsigned int pos)
+  {
+    return *((unsigned int*)(m_buf + (pos & mask)));
+  }
+  
+public:
+  ch_binary_data_ring(const char * name): ch_base(name),
+					  m_head(0), m_tail(0), m_num(0),
+					  m_num_drops(0), m_rsv_skip(0),
+					  m_rsv_len(0), m_peek_size(0)
+  {
+  }
+
+  virtual ~ch_binary_data_ring()
+  {
+  }
+
+  // returns a span of len bytes to be written by the producer, or NULL if
+  // the ring does not have enough space. The span is published by commit().
+  unsigned char * reserve(unsigned int len)
+  {
+    unsigned int sz = rec_size(len);
+    if(sz > capacity){
+      cerr << "in channel " << m_name << ".reserve(), data size " << len << " passed exceeded ring capacity " << capacity << endl;
+      return NULL;
+    }
+    
+    unsigned int tail = m_tail.load(memory_order_relaxed);
+    unsigned int head = m_head.load(memory_order_acquire);
+    unsigned int rem = capacity - (tail & mask);
+    unsigned int skip = (rem < sz ? rem : 0);
+    if(tail - head + skip + sz > capacity){
+      m_num_drops.fetch_add(1, memory_order_relaxed);
+      return NULL;
+    }
+    
+    m_rsv_skip = skip;
+    m_rsv_len = len;
+    return m_buf + ((tail + skip) & mask) + hdr_size;
+  }
+
+  // publishes len bytes (len <= reserved length) written to the span
+  // given by the last reserve().
+  void commit(unsigned int len)
+  {
+    if(len > m_rsv_len)
+      len = m_rsv_len;
+    
+    unsigned int tail = m_tail.load(memory_order_relaxed);
+    if(m_rsv_skip)
+      hdr_at(tail) = wrap_marker;
+    tail += m_rsv_skip;
+    hdr_at(tail) = len;
+    m_tail.store(tail + rec_size(len), memory_order_release);
+    m_num.fetch_add(1, memory_order_relaxed);
+    m_rsv_skip = m_rsv_len = 0;
+  }
+
+  // returns the span of the oldest data and its length, or NULL if the ring
+  // is empty. The span is valid until release().
+  const unsigned char * peek(unsigned int & len)
+  {
+    unsigned int head = m_head.load(memory_order_relaxed);
+    unsigned int tail = m_tail.load(memory_order_acquire);
+    if(head == tail){
+      len = 0;
+      return NULL;
+    }
+    
+    if(hdr_at(head) == wrap_marker){
+      head += capacity - (head & mask);
+      m_head.store(head, memory_order_release);
+    }
+    
+    len = hdr_at(head);
+    m_peek_size = rec_size(len);
+    return m_buf + (head & mask) + hdr_size;
+  }
+
+  // releases the span given by the last peek()
+  void release()
+  {
+    if(!m_peek_size)
+      return;
+    
+    m_head.store(m_head.load(memory_order_relaxed) + m_peek_size,
+		 memory_order_release);
+    m_num.fetch_sub(1, memory_order_relaxed);
+    m_peek_size = 0;
+  }
+
+  bool push(const unsigned char * data, unsigned int len)
+  {
+    unsigned char * p = reserve(len);
+    if(!p)
+      return false;
+    memcpy(p, data, len);
+    commit(len);
+    return true;
+  }
+
+  void pop(unsigned char * data, unsigned int & len)
+  {
+    const unsigned char * p = peek(len);
+    if(!p)
+      return;
+    memcpy(data, p, len);
+    release();
+  }
+  
+  int get_num_dat()
+  {
+    return m_num.load(memory_order_relaxed);
+  }
+
+  const unsigned int get_num_drops()
+  {
+    return m_num_drops.load(memory_order_relaxed);
+  }
+  
+  const unsigned int get_capacity()
+  {
+    return capacity;
+  }
+
+  // bytes used in the ring, including headers, paddings and skips
+  const unsigned int get_used_size()
+  {
+    return m_tail.load(memory_order_acquire) - m_head.load(memory_order_acquire);
+  }
+  
+  virtual size_t get_dsize()
+  {
+    // every data in the ring occupies more than its serialized size
+    return capacity + sizeof(unsigned short);
+  }
+  
+  virtual size_t write_buf(const char *buf)
+  {
+    // buffer layout (same as ch_binary_data_queue)
+    // | <number of data> | <data length 1> | <data 1> 
+    // | <data length 2> | <data 2> | ... | <data length n> | <data n> |
+    unsigned short num = *((unsigned short *)buf);
+    unsigned int len = sizeof(num);
+    for(int i = 0; i < num; i++){
+      const unsigned short * p = (const unsigned short*)(buf + len);
+      push((const unsigned char*)(p + 1), *p);
+      len += sizeof(*p) + *p;
+    }
+    return len;
+  }
+  
+  virtual size_t read_buf(char * buf)
+  {
+    unsigned short & num = *((unsigned short *)buf);
+    unsigned int len = sizeof(unsigned short);
+    const unsigned char * data;
+    unsigned int sz;
+    for(num = 0; (data = peek(sz)) != NULL; ++num){
+      unsigned short * p = (unsigned short*)(buf + len);
+      *p = (unsigned short) sz;
+      memcpy((unsigned char*)(p + 1), data, *p);
+      len += sizeof(unsigned short) + *p;
+      release();
+    }
+    return len;
+  }
+  
+  virtual void print(ostream & out)
+  {
+    out << "ch " << m_name
+	<< " ndata:" << get_num_dat()
+	<< " used:" << get_used_size() << "/" << capacity
+	<< " drops:" << get_num_drops() << endl;
+  }
+  
+  virtual int write(FILE * pf, long long tcur)
+  {
+    return 0;
+  }
+  
+  virtual int read(FILE * pf, long long tcur)
+  {
+    return 0;
+  }
+  
+  virtual bool log2txt(FILE * pbf, FILE * ptf)
+  {
+    return 0;
+  }  
+};
+
 #endif
@@ -16,6 +16,8 @@
 // along with ch_map.hpp.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "channel_base.hpp"
+#include "ch_state.hpp"
+#include "ch_wp.hpp"
 
 // contains map information - multiple layered, dynamically updatable map.
 // has insert, delete, configuration methods
@@ -28,8 +30,13 @@ protected:
   list<AWSMap2::LayerDataPtr> m_layer_datum[AWSMap2::lt_undef];
   
   AWSMap2::vec3 m_cecef; // x, y, z
+  
+  // own ship position followed by the waypoints not yet reached.
+  // given to AWSMap2::MapPrefetcher to load the map along the route.
+  list<AWSMap2::vec3> m_route;
+  bool m_route_update;
 public:
-  ch_map(const char * name):ch_base(name), bupdate(true), bready(false), m_resolution(10), m_range(10000), m_cecef()
+  ch_map(const char * name):ch_base(name), bupdate(true), bready(false), m_resolution(10), m_range(10000), m_cecef(), m_route_update(false)
   {
     m_blayer_type[AWSMap2::lt_coast_line] = true;
   }
@@ -110,6 +117,37 @@ public:
     return m_cecef;
   }
   
+  // set the route from own ship position in state and the waypoints in wp.
+  // wp should be locked by the caller.
+  void set_route(ch_state * state, ch_wp * wp)
+  {
+    long long t;
+    double x, y, z;
+    state->get_position_ecef(t, x, y, z);
+    m_route.clear();
+    m_route.push_back(AWSMap2::vec3(x, y, z));
+    
+    wp->begin();
+    for (int i = 0; i < wp->get_next() && !wp->is_end(); i++)
+      wp->next();
+    for (; !wp->is_end(); wp->next()){
+      s_wp & w = wp->cur();
+      m_route.push_back(AWSMap2::vec3(w.x, w.y, w.z));
+    }
+    m_route_update = true;
+  }
+
+  bool is_route_update()
+  {
+    return m_route_update;
+  }
+
+  const list<AWSMap2::vec3> & get_route()
+  {
+    m_route_update = false;
+    return m_route;
+  }
+  
   void set_layer_data(const AWSMap2::LayerType layer_type, list<AWSMap2::LayerDataPtr> & layer_data)
   {
     m_layer_datum[layer_type].clear();
@@ -16,10 +16,13 @@
 
 #ifndef CH_NMEA_HPP
 #define CH_NMEA_HPP
+#include <atomic>
 #include "ch_binary_data_queue.hpp"
 
 typedef ch_binary_data_queue<64, 256> ch_nmea_data;
 typedef ch_binary_data_queue<64, 128> ch_n2k_data;
+typedef ch_binary_data_ring<16384> ch_nmea_data_ring;
+typedef ch_binary_data_ring<8192> ch_n2k_data_ring;
 
 class ch_nmea: public ch_base
 {
@@ -123,4 +126,167 @@ public:
   }
 };
 
+// ch_nmea_spsc is the lock-free variant of ch_nmea for a single producer
+// filter and a single consumer filter. Head and tail are advanced with
+// atomic counters instead of the channel mutex, and a sentence pushed to
+// the full queue is dropped and counted as an overrun rather than
+// overwriting the oldest one.
+class ch_nmea_spsc: public ch_base
+{
+public:
+  static const int slot_size = 84;
+protected:
+  unsigned int m_capacity; // power of 2
+  unsigned int m_mask;
+  char * m_buf;
+  
+  alignas(64) atomic<unsigned int> m_head; // advanced by the consumer
+  alignas(64) atomic<unsigned int> m_tail; // advanced by the producer
+  alignas(64) atomic<unsigned int> m_overruns;
+
+  bool alloc(unsigned int capacity)
+  {
+    m_capacity = 1;
+    while(m_capacity < capacity)
+      m_capacity <<= 1;
+    m_mask = m_capacity - 1;
+    m_buf = new char[slot_size * m_capacity];
+    m_head = m_tail = 0;
+    return m_buf != NULL;
+  }
+
+  void release()
+  {
+    if(m_buf)
+      delete[] m_buf;
+    m_buf = NULL;
+  }
+
+  // copies the null terminated string to the slot. returns false if the
+  // string is longer than the slot.
+  bool copy_to_slot(char * p, const char * buf)
+  {
+    int len = 0;
+    for( ;*buf != '\0' && len < slot_size; buf++, p++, len++){
+      *p = *buf;
+    }
+
+    if(len == slot_size){
+      cerr << "Error in " << m_name << "::push(const char*). No null character in the string given " << endl;
+      return false;
+    }
+    *p = '\0';
+    return true;
+  }
+  
+public:
+  ch_nmea_spsc(const char * name, unsigned int capacity = 1024):
+    ch_base(name), m_capacity(0), m_mask(0), m_buf(NULL),
+    m_head(0), m_tail(0), m_overruns(0)
+  {
+    alloc(capacity);
+  }
+
+  virtual ~ch_nmea_spsc()
+  {
+    release();
+  }
+
+  // changes the capacity (rounded up to power of 2). The queued sentences
+  // are discarded. Should be called before the producer and the consumer
+  // start.
+  bool set_capacity(unsigned int capacity)
+  {
+    release();
+    return alloc(capacity);
+  }
+
+  const unsigned int get_capacity()
+  {
+    return m_capacity;
+  }
+
+  // number of the sentences dropped by push/push_n, because of the full
+  // queue or of no null character within the slot.
+  const unsigned int get_overruns()
+  {
+    return m_overruns.load(memory_order_relaxed);
+  }
+
+  const unsigned int get_num_nmeas()
+  {
+    return m_tail.load(memory_order_acquire) - m_head.load(memory_order_acquire);
+  }
+  
+  // called only by the producer
+  bool push(const char * buf)
+  {
+    return push_n(&buf, 1) == 1;
+  }
+
+  // pushes n sentences, returns the number of sentences pushed. The
+  // sentences not pushed, because of the full queue or too long, are
+  // counted as overruns.
+  int push_n(const char * const * bufs, int n)
+  {
+    unsigned int tail = m_tail.load(memory_order_relaxed);
+    unsigned int head = m_head.load(memory_order_acquire);
+    int npushed = 0;
+    for(int i = 0; i < n; i++){
+      if(tail - head == m_capacity){
+	m_overruns.fetch_add(n - i, memory_order_relaxed);
+	break;
+      }
+      
+      if(!copy_to_slot(m_buf + (tail & m_mask) * slot_size, bufs[i])){
+	m_overruns.fetch_add(1, memory_order_relaxed);
+	continue;
+      }
+      tail++;
+      npushed++;
+    }
+    m_tail.store(tail, memory_order_release);
+    return npushed;
+  }
+
+  // called only by the consumer
+  bool pop(char * buf)
+  {
+    return pop_n(buf, 1) == 1;
+  }
+
+  // pops at most n sentences into buf, slot_size bytes for each sentence.
+  // returns the number of sentences popped.
+  int pop_n(char * buf, int n)
+  {
+    unsigned int head = m_head.load(memory_order_relaxed);
+    unsigned int tail = m_tail.load(memory_order_acquire);
+    int npopped = 0;
+    for(; head != tail && npopped < n; head++, npopped++, buf += slot_size){
+      const char * p = m_buf + (head & m_mask) * slot_size;
+      strcpy(buf, p);
+    }
+    m_head.store(head, memory_order_release);
+    return npopped;
+  }
+  
+  virtual void print(ostream & out)
+  {
+    out << "ch " << m_name
+	<< " capacity:" << m_capacity
+	<< " nnmeas:" << get_num_nmeas()
+	<< " overruns:" << get_overruns() << endl;
+  }
+};
+
+// ch_nmea_spsc with the capacity given at compile time, registered to the
+// channel factory as nmea_spsc4k, nmea_spsc16k, as ch_ring is.
+template <unsigned int capacity> class ch_nmea_spsc_n: public ch_nmea_spsc
+{
+public:
+  ch_nmea_spsc_n(const char * name): ch_nmea_spsc(name, capacity)
+  {
+  }
+};
+
 #endif
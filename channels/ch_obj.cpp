@@ -13,6 +13,9 @@
 // You should have received a copy of the GNU General Public License
 // along with ch_obj.cpp.  If not, see <http://www.gnu.org/licenses/>.
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 #include "ch_obj.hpp"
 
 ////////////////////////// c_obj member (The base class of the objects in aws)
@@ -51,3 +54,485 @@ c_ais_obj::~c_ais_obj()
 }
 
 //////////////////////////////////////////////////// 
+//////////////////////////////////////////////////// s_obj_table member
+void s_obj_table::push_back(const unsigned int _id)
+{
+  id.push_back(_id);
+  dtype.push_back(0);
+  t.push_back(0);
+  xr.push_back(0);
+  yr.push_back(0);
+  vxr.push_back(0);
+  vyr.push_back(0);
+  vrx.push_back(0);
+  vry.push_back(0);
+  tcpa.push_back(0);
+  dcpa.push_back(0);
+  s0.push_back(0);
+  dsdt.push_back(0);
+}
+
+void s_obj_table::pop_back()
+{
+  id.pop_back();
+  dtype.pop_back();
+  t.pop_back();
+  xr.pop_back();
+  yr.pop_back();
+  vxr.pop_back();
+  vyr.pop_back();
+  vrx.pop_back();
+  vry.pop_back();
+  tcpa.pop_back();
+  dcpa.pop_back();
+  s0.pop_back();
+  dsdt.pop_back();
+}
+
+void s_obj_table::move(const int idst, const int isrc)
+{
+  id[idst] = id[isrc];
+  dtype[idst] = dtype[isrc];
+  t[idst] = t[isrc];
+  xr[idst] = xr[isrc];
+  yr[idst] = yr[isrc];
+  vxr[idst] = vxr[isrc];
+  vyr[idst] = vyr[isrc];
+  vrx[idst] = vrx[isrc];
+  vry[idst] = vry[isrc];
+  tcpa[idst] = tcpa[isrc];
+  dcpa[idst] = dcpa[isrc];
+  s0[idst] = s0[isrc];
+  dsdt[idst] = dsdt[isrc];
+}
+
+void s_obj_table::set(const int i, c_obj & obj)
+{
+  // TCPA/DCPA of the previous state is invalid until calc_tdcpa
+  double x = 0., y = 0., z = 0.;
+  float vx = 0.f, vy = 0.f, vz = 0.f;
+  int d = 0;
+  if(obj.get_pos_rel(x, y, z))
+    d |= EOD_POS_REL;
+  if(obj.get_vel_rel(vx, vy, vz))
+    d |= EOD_VEL_REL;
+  dtype[i] = d;
+  t[i] = obj.get_time();
+  xr[i] = (float)x;
+  yr[i] = (float)y;
+  vxr[i] = vx;
+  vyr[i] = vy;
+  obj.get_pos_sd(s0[i], dsdt[i]);
+}
+
+void s_obj_table::calc_tdcpa(const long long tcur, const float vx,
+			     const float vy)
+{
+  const int n = size();
+  int i = 0;
+  
+#if defined(__AVX__)
+  const __m256 vx8 = _mm256_set1_ps(vx), vy8 = _mm256_set1_ps(vy),
+    zero = _mm256_setzero_ps();
+  for(; i + 8 <= n; i += 8){
+    float dts[8];
+    for(int j = 0; j < 8; j++)
+      dts[j] = (float)((tcur - t[i + j]) / (double) SEC);
+    __m256 dt = _mm256_loadu_ps(dts);
+    __m256 vrx8 = _mm256_sub_ps(_mm256_loadu_ps(&vxr[i]), vx8);
+    __m256 vry8 = _mm256_sub_ps(_mm256_loadu_ps(&vyr[i]), vy8);
+    __m256 x = _mm256_add_ps(_mm256_mul_ps(vrx8, dt), _mm256_loadu_ps(&xr[i]));
+    __m256 y = _mm256_add_ps(_mm256_mul_ps(vry8, dt), _mm256_loadu_ps(&yr[i]));
+    __m256 v2 = _mm256_add_ps(_mm256_mul_ps(vrx8, vrx8),
+			      _mm256_mul_ps(vry8, vry8));
+    __m256 dot = _mm256_add_ps(_mm256_mul_ps(x, vrx8), _mm256_mul_ps(y, vry8));
+    __m256 tc = _mm256_div_ps(_mm256_sub_ps(zero, dot), v2);
+    tc = _mm256_and_ps(tc, _mm256_cmp_ps(v2, zero, _CMP_GT_OQ));
+    __m256 xc = _mm256_add_ps(_mm256_mul_ps(tc, vrx8), x);
+    __m256 yc = _mm256_add_ps(_mm256_mul_ps(tc, vry8), y);
+    __m256 dc = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(xc, xc),
+					     _mm256_mul_ps(yc, yc)));
+    _mm256_storeu_ps(&vrx[i], vrx8);
+    _mm256_storeu_ps(&vry[i], vry8);
+    _mm256_storeu_ps(&tcpa[i], tc);
+    _mm256_storeu_ps(&dcpa[i], dc);
+  }
+#endif
+  
+  for(; i < n; i++){
+    float dt = (float)((tcur - t[i]) / (double) SEC);
+    float _vrx = vxr[i] - vx, _vry = vyr[i] - vy;
+    float x = _vrx * dt + xr[i], y = _vry * dt + yr[i];
+    float v2 = _vrx * _vrx + _vry * _vry;
+    float tc = v2 > 0 ? -(x * _vrx + y * _vry) / v2 : 0.f;
+    float xc = tc * _vrx + x, yc = tc * _vry + y;
+    vrx[i] = _vrx;
+    vry[i] = _vry;
+    tcpa[i] = tc;
+    dcpa[i] = sqrt(xc * xc + yc * yc);
+  }
+
+  // rows without relative position or velocity have no TCPA/DCPA
+  for(i = 0; i < n; i++)
+    if((dtype[i] & (EOD_POS_REL | EOD_VEL_REL)) == (EOD_POS_REL | EOD_VEL_REL))
+      dtype[i] |= EOD_TDCPA;
+}
+
+void s_obj_table::predict(const long long tcur, float * x, float * y,
+			  float * s) const
+{
+  const int n = size();
+  int i = 0;
+  
+#if defined(__AVX__)
+  for(; i + 8 <= n; i += 8){
+    float dts[8];
+    for(int j = 0; j < 8; j++)
+      dts[j] = (float)((tcur - t[i + j]) * (1.0 / (double)SEC));
+    __m256 dt = _mm256_loadu_ps(dts);
+    _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(&xr[i]),
+					  _mm256_mul_ps(_mm256_loadu_ps(&vrx[i]), dt)));
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(&yr[i]),
+					  _mm256_mul_ps(_mm256_loadu_ps(&vry[i]), dt)));
+    _mm256_storeu_ps(s + i, _mm256_add_ps(_mm256_loadu_ps(&s0[i]),
+					  _mm256_mul_ps(dt, _mm256_loadu_ps(&dsdt[i]))));
+  }
+#endif
+  
+  for(; i < n; i++){
+    float dt = (float)((tcur - t[i]) * (1.0 / (double)SEC));
+    x[i] = xr[i] + vrx[i] * dt;
+    y[i] = yr[i] + vry[i] * dt;
+    s[i] = s0[i] + dt * dsdt[i];
+  }
+}
+
+///////////////////////////////////////////////////// ch_ais_obj member
+void ch_ais_obj::grid_add(const int i)
+{
+  vector<int> & c = cells[slots[i].cell];
+  slots[i].icell = (int)c.size();
+  c.push_back(i);
+}
+
+void ch_ais_obj::grid_remove(const int i)
+{
+  auto itr = cells.find(slots[i].cell);
+  vector<int> & c = itr->second;
+  int j = c.back();
+  c[slots[i].icell] = j;
+  slots[j].icell = slots[i].icell;
+  c.pop_back();
+  if(c.empty())
+    cells.erase(itr);
+  slots[i].icell = -1;
+}
+
+// the grid is anchored on the horizontal plane at (x, y, z) in ECEF.
+void ch_ais_obj::grid_build(const float x, const float y, const float z)
+{
+  double lat, lon, alt;
+  xgrid = x;
+  ygrid = y;
+  zgrid = z;
+  eceftoblh(xgrid, ygrid, zgrid, lat, lon, alt);
+  getwrldrot(lat, lon, Rgrid);
+  bgrid = true;
+  
+  cells.clear();
+  for(int i = 0; i < (int)objs.size(); i++){
+    slots[i].cell = get_cell_key(objs[i]);
+    grid_add(i);
+  }
+}
+
+// gives the targets in the cells covering the range from (x, y, z) in ECEF.
+// Some of them can be out of the range.
+void ch_ais_obj::grid_query(const float x, const float y, const float z,
+			    const float range, vector<int> & is)
+{
+  is.clear();
+  if(!bgrid ||
+     (x - xgrid) * (x - xgrid) + (y - ygrid) * (y - ygrid) +
+     (z - zgrid) * (z - zgrid) > AIS_GRID_REANCHOR * AIS_GRID_REANCHOR)
+    grid_build(x, y, z);
+  
+  // the margin covers the distortion of the plane
+  double xg, yg, zg;
+  eceftowrld(Rgrid, xgrid, ygrid, zgrid, x, y, z, xg, yg, zg);
+  double r = range * 1.01 + 100.;
+  long long k0 = get_cell_key(xg - r, yg - r), k1 = get_cell_key(xg + r, yg + r);
+  int cx0 = (int)(k0 >> 32), cy0 = (int)(k0 & 0xFFFFFFFFLL);
+  int cx1 = (int)(k1 >> 32), cy1 = (int)(k1 & 0xFFFFFFFFLL);
+  
+  // cells in the range are looked up, or occupied cells are scanned if
+  // they are fewer.
+  long long ncells = (long long)(cx1 - cx0 + 1) * (long long)(cy1 - cy0 + 1);
+  if(ncells > (long long)cells.size()){
+    for(auto itr = cells.begin(); itr != cells.end(); itr++){
+      int cx = (int)(itr->first >> 32), cy = (int)(itr->first & 0xFFFFFFFFLL);
+      if(cx < cx0 || cx > cx1 || cy < cy0 || cy > cy1)
+	continue;
+      is.insert(is.end(), itr->second.begin(), itr->second.end());
+    }
+    return;
+  }
+  
+  for(int cx = cx0; cx <= cx1; cx++){
+    for(int cy = cy0; cy <= cy1; cy++){
+      auto itr = cells.find(get_cell_key(cx, cy));
+      if(itr == cells.end())
+	continue;
+      is.insert(is.end(), itr->second.begin(), itr->second.end());
+    }
+  }
+}
+
+void ch_ais_obj::rel_add(const int i)
+{
+  if(slots[i].irel >= 0)
+    return;
+  slots[i].irel = (int)rels.size();
+  rels.push_back(i);
+}
+
+void ch_ais_obj::rel_remove(const int i)
+{
+  if(slots[i].irel < 0)
+    return;
+  int j = rels.back();
+  rels[slots[i].irel] = j;
+  slots[j].irel = slots[i].irel;
+  rels.pop_back();
+  slots[i].irel = -1;
+}
+
+void ch_ais_obj::calc_rel(const int i, const double * R, const float x,
+			  const float y, const float z, const float range)
+{
+  c_ais_obj & obj = objs[i];
+  obj.set_pos_rel_from_ecef(R, x, y, z);
+  obj.set_vel_ecef_from_blh(R);
+  obj.set_vel_rel_from_blh();
+  obj.set_pos_bd_from_rel();
+  slots[i].bdirty = false;
+  
+  if(range >= 0){
+    double xr, yr, zr;
+    obj.get_pos_rel(xr, yr, zr);
+    if(xr * xr + yr * yr + zr * zr > (double)range * (double)range){
+      obj.reset_rel();
+      obj.reset_bd();
+      obj.reset_tdcpa();
+      tbl.dtype[i] = 0;
+      rel_remove(i);
+      return;
+    }
+  }
+  obj.reset_tdcpa();
+  tbl.set(i, obj);
+  rel_add(i);
+}
+
+int ch_ais_obj::_push(const long long t, const unsigned int mmsi,
+		      double lat, double lon, float cog, float sog, float hdg)
+{
+  int i;
+  auto itr = index.find(mmsi);
+  if(itr != index.end()){
+    i = itr->second;
+    objs[i].update(t, lat, lon, cog, sog, hdg);
+    objs[i].set_ecef_from_blh();
+    tbl.dtype[i] = 0;
+    slots[i].bsync = true;
+  }else{
+    i = (int)objs.size();
+    objs.emplace_back(t, mmsi, lat, lon, cog, sog, hdg);
+    objs[i].set_ecef_from_blh();
+    s_slot s;
+    s.cell = 0;
+    s.icell = -1;
+    s.irel = -1;
+    s.bdirty = false;
+    s.bsync = true;
+    slots.push_back(s);
+    tbl.push_back(mmsi);
+    index.insert(unordered_map<unsigned int, int>::value_type(mmsi, i));
+  }
+  
+  if(bgrid){
+    long long cell = get_cell_key(objs[i]);
+    if(slots[i].icell < 0 || slots[i].cell != cell){
+      if(slots[i].icell >= 0)
+	grid_remove(i);
+      slots[i].cell = cell;
+      grid_add(i);
+    }
+  }
+  
+  if(!slots[i].bdirty){
+    slots[i].bdirty = true;
+    dirty.push_back(mmsi);
+  }
+  updates.push_back(mmsi);
+  return i;
+}
+
+int ch_ais_obj::_push(c_ais_obj & obj)
+{
+  double lat, lon, alt;
+  float cog, sog, roll, pitch, yaw;
+  obj.get_pos_blh(lat, lon, alt);
+  obj.get_vel_blh(cog, sog);
+  obj.get_att(roll, pitch, yaw);
+  return _push(obj.get_time(), obj.get_mmsi(), lat, lon, cog, sog, yaw);
+}
+
+void ch_ais_obj::_remove(const int i)
+{
+  const int last = (int)objs.size() - 1;
+  if(slots[i].icell >= 0)
+    grid_remove(i);
+  rel_remove(i);
+  index.erase(objs[i].get_mmsi());
+  
+  if(i != last){
+    objs[i] = objs[last];
+    slots[i] = slots[last];
+    tbl.move(i, last);
+    index[objs[i].get_mmsi()] = i;
+    if(slots[i].icell >= 0)
+      cells[slots[i].cell][slots[i].icell] = i;
+    if(slots[i].irel >= 0)
+      rels[slots[i].irel] = i;
+  }
+  objs.pop_back();
+  slots.pop_back();
+  tbl.pop_back();
+}
+
+void ch_ais_obj::update_rel_pos_and_vel(const double * R, const float x,
+					const float y, const float z,
+					const float range)
+{
+  lock();
+  bool bsame = brel && x == xrel && y == yrel && z == zrel && range == rrel
+    && memcmp(R, Rrel, sizeof(Rrel)) == 0;
+  
+  if(bsame){
+    // only the targets updated are calculated
+    for(int k = 0; k < (int)dirty.size(); k++){
+      auto itr = index.find(dirty[k]);
+      if(itr != index.end() && slots[itr->second].bdirty)
+	calc_rel(itr->second, R, x, y, z, range);
+    }
+  }else if(range < 0){
+    for(int i = 0; i < (int)objs.size(); i++)
+      calc_rel(i, R, x, y, z, range);
+  }else{
+    // targets in the range are calculated, and those calculated last time
+    // but not now lose their relative states.
+    vector<int> rels_prev;
+    rels_prev.swap(rels);
+    for(int k = 0; k < (int)rels_prev.size(); k++)
+      slots[rels_prev[k]].irel = -1;
+    
+    vector<int> is;
+    grid_query(x, y, z, range, is);
+    for(int k = 0; k < (int)is.size(); k++)
+      calc_rel(is[k], R, x, y, z, range);
+    
+    for(int k = 0; k < (int)rels_prev.size(); k++){
+      int i = rels_prev[k];
+      if(slots[i].irel >= 0)
+	continue;
+      objs[i].reset_rel();
+      objs[i].reset_bd();
+      objs[i].reset_tdcpa();
+      tbl.dtype[i] = 0;
+    }
+  }
+
+  // targets updated but out of the range have no relative states since
+  // the update.
+  for(int k = 0; k < (int)dirty.size(); k++){
+    auto itr = index.find(dirty[k]);
+    if(itr != index.end())
+      slots[itr->second].bdirty = false;
+  }
+  dirty.clear();
+  
+  brel = true;
+  memcpy(Rrel, R, sizeof(Rrel));
+  xrel = x;
+  yrel = y;
+  zrel = z;
+  rrel = range;
+  unlock();
+}
+
+void ch_ais_obj::find_in_range(const float x, const float y, const float z,
+			       const float range, vector<unsigned int> & mmsis)
+{
+  lock();
+  mmsis.clear();
+  vector<int> is;
+  grid_query(x, y, z, range, is);
+  double r2 = (double)range * (double)range;
+  for(int k = 0; k < (int)is.size(); k++){
+    double xt, yt, zt;
+    objs[is[k]].get_pos_ecef(xt, yt, zt);
+    xt -= x;
+    yt -= y;
+    zt -= z;
+    if(xt * xt + yt * yt + zt * zt <= r2)
+      mmsis.push_back(objs[is[k]].get_mmsi());
+  }
+  unlock();
+}
+
+void ch_ais_obj::remove_out(float range)
+{
+  lock();
+  // the distance is calculated in ECEF, since the relative states of the
+  // targets out of the range of update_rel_pos_and_vel are not calculated.
+  if(!brel){
+    unlock();
+    return;
+  }
+  
+  double r2 = (double)range * (double)range;
+  for(int i = 0; i < (int)objs.size();){
+    double x, y, z;
+    bool bpos = objs[i].get_pos_ecef(x, y, z);
+    x -= xrel;
+    y -= yrel;
+    z -= zrel;
+    if(!bpos || x * x + y * y + z * z > r2)
+      _remove(i);
+    else
+      i++;
+  }
+  unlock();
+}
+
+void ch_ais_obj::remove_old(const long long told)
+{
+  lock();
+  for(int i = 0; i < (int)objs.size();){
+    if(objs[i].get_time() < told)
+      _remove(i);
+    else
+      i++;
+  }
+  unlock();
+}
+
+void ch_ais_obj::calc_tdcpa(const long long t, float vx, float vy)
+{
+  lock();
+  tbl.calc_tdcpa(t, vx, vy);
+  for(int i = 0; i < (int)slots.size(); i++)
+    slots[i].bsync = false;
+  unlock();
+}
@@ -15,6 +15,9 @@
 // You should have received a copy of the GNU General Public License
 // along with ch_obj.h.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <deque>
+#include <unordered_map>
+
 #include "channel_base.hpp"
 #include "aws_coord.hpp"
 
@@ -390,10 +393,13 @@ public:
 	m_dtype = (e_obj_data_type)(m_dtype | EOD_POS_BD);
       }
       
-      m_tcpa = (float)(-D2 / (xr * vrx + yr * vry));
+      // time from t to, and distance at the closest point of approach.
+      // (s_obj_table::calc_tdcpa does the same for the table.)
+      float V2 = (float)(vrx * vrx + vry * vry);
+      m_tcpa = V2 > 0 ? (float)(-(xr * vrx + yr * vry) / V2) : 0.f;
       
-      float xcpa = (float)(m_tcpa * vrx + m_xr);
-      float ycpa = (float)(m_tcpa * vry + m_yr);
+      float xcpa = (float)(m_tcpa * vrx + xr);
+      float ycpa = (float)(m_tcpa * vry + yr);
       float dcpa2 = (float)(xcpa * xcpa + ycpa * ycpa);
       m_dcpa = (float)sqrt(dcpa2);
       m_dtype = (e_obj_data_type)(m_dtype | EOD_TDCPA);
@@ -411,11 +417,29 @@ public:
     
     return (m_dtype & EOD_TDCPA) != 0;
   }
+
+  // sets TCPA, DCPA and the relative velocity calculated outside.
+  void set_tdcpa(const float tcpa, const float dcpa,
+		 const float vrx, const float vry)
+  {
+    m_tcpa = tcpa;
+    m_dcpa = dcpa;
+    m_vrx = vrx;
+    m_vry = vry;
+    m_dtype = (e_obj_data_type)(m_dtype | EOD_TDCPA);
+  }
   
   void reset_tdcpa(){
     m_dtype = (e_obj_data_type)(m_dtype & ~EOD_TDCPA);
   }
   
+  // standard deviation of the initial fix, and its growth per second.
+  void get_pos_sd(float & s0, float & dsdt)
+  {
+    s0 = m_s0;
+    dsdt = m_dsdt;
+  }
+  
   bool get_prediction(const long long t, float & x, float & y, float & s)
   {
     if ((m_dtype & EOD_TDCPA) == 0)
@@ -591,6 +615,43 @@ public:
 };
 
 
+// Table of the relative kinematic states of the objects in SoA, for the
+// batch calculation of TCPA/DCPA and prediction. Rows are added and
+// removed by the owner channel; the row i is for its object i.
+struct s_obj_table
+{
+  vector<unsigned int> id;      // MMSI for AIS
+  vector<int> dtype;            // EOD_POS_REL, EOD_VEL_REL and EOD_TDCPA
+  vector<long long> t;          // time of the relative position
+  vector<float> xr, yr;         // relative position at t
+  vector<float> vxr, vyr;       // velocity in the relative coordinate
+  vector<float> vrx, vry;       // relative velocity to my own ship
+  vector<float> tcpa, dcpa;
+  vector<float> s0, dsdt;       // standard deviation of the position
+
+  int size() const
+  {
+    return (int)id.size();
+  }
+
+  void push_back(const unsigned int _id);
+  void pop_back();
+  void move(const int idst, const int isrc);
+  
+  // copies the relative states of the object to the row i. TCPA/DCPA of
+  // the row is cleared until the next calc_tdcpa.
+  void set(const int i, c_obj & obj);
+  
+  // calculates TCPA and DCPA of all the rows having relative position and
+  // velocity, at t with my own velocity (vx, vy).
+  void calc_tdcpa(const long long t, const float vx, const float vy);
+  
+  // predicts the positions (x, y) and their standard deviations s of all
+  // the rows at t. The rows without TCPA/DCPA are also calculated, check
+  // dtype for them.
+  void predict(const long long t, float * x, float * y, float * s) const;
+};
+
 // contains recent object list, expected object list
 // has insert, delete, and search method
 class ch_obj: public ch_base
@@ -651,26 +712,115 @@ public:
   }
 };
 
+// cell size of the grid indexing AIS targets (meter)
+#define AIS_GRID_CELL 4000.
+// the grid is re-anchored at my own ship when she goes farther than this
+// from the origin of the grid (meter).
+#define AIS_GRID_REANCHOR 50000.
+
+// AIS targets. Targets are pooled contiguously in objs and looked up by
+// MMSI with a hash. A removed target is filled with the last one in the
+// pool, so the order of iteration is not that of MMSI. The targets are
+// also indexed by the grid on the horizontal plane at the origin near my
+// own ship, for the queries in a range.
 class ch_ais_obj:public ch_base
 {
 protected:
-  map<unsigned int, c_ais_obj *> objs;
-  map<unsigned int, c_ais_obj *>::iterator itr;
-  list<c_ais_obj*> updates;
+  // per target states of the indices, in the same order as objs.
+  struct s_slot
+  {
+    long long cell; // key of the grid cell (valid only if bgrid)
+    int icell;      // index in the cell
+    int irel;       // index in rels, -1 if not there
+    bool bdirty;    // updated after the last update_rel_pos_and_vel
+    bool bsync;     // the object has TCPA/DCPA of the table
+  };
+  
+  deque<c_ais_obj> objs;
+  vector<s_slot> slots;
+  s_obj_table tbl;
+  unordered_map<unsigned int, int> index;
+  int icur;
+  
+  deque<unsigned int> updates; // MMSIs updated, to be read by read_buf
+  vector<unsigned int> dirty;  // MMSIs updated after update_rel_pos_and_vel
+
+  // grid index
+  bool bgrid;
+  double Rgrid[9];
+  double xgrid, ygrid, zgrid;
+  unordered_map<long long, vector<int> > cells;
+  
+  // targets relative states of which are calculated in the last
+  // update_rel_pos_and_vel, and its own ship state.
+  vector<int> rels;
+  bool brel;
+  double Rrel[9];
+  float xrel, yrel, zrel, rrel;
+  
   long long m_tfile;
+  
+  static long long get_cell_key(const int cx, const int cy)
+  {
+    return (long long)(((unsigned long long)(unsigned int)cx << 32) |
+		       (unsigned long long)(unsigned int)cy);
+  }
+  
+  static long long get_cell_key(const double xg, const double yg)
+  {
+    return get_cell_key((int)floor(xg * (1.0 / AIS_GRID_CELL)),
+			(int)floor(yg * (1.0 / AIS_GRID_CELL)));
+  }
+  
+  long long get_cell_key(c_ais_obj & obj)
+  {
+    double x, y, z, xg, yg, zg;
+    obj.get_pos_ecef(x, y, z);
+    eceftowrld(Rgrid, xgrid, ygrid, zgrid, x, y, z, xg, yg, zg);
+    return get_cell_key(xg, yg);
+  }
+  
+  void grid_add(const int i);
+  void grid_remove(const int i);
+  void grid_build(const float x, const float y, const float z);
+  void grid_query(const float x, const float y, const float z,
+		  const float range, vector<int> & is);
+  void rel_add(const int i);
+  void rel_remove(const int i);
+  void calc_rel(const int i, const double * R, const float x,
+		const float y, const float z, const float range);
+  
+  // adds or updates the target, returns the index in objs.
+  int _push(const long long t, const unsigned int mmsi,
+	    double lat, double lon, float cog, float sog, float hdg);
+  int _push(c_ais_obj & obj);
+  
+  // removes the target i, the last target is moved to i.
+  void _remove(const int i);
+
+  // copies TCPA/DCPA in the table to the object i
+  void sync(const int i)
+  {
+    if(slots[i].bsync)
+      return;
+    if(tbl.dtype[i] & EOD_TDCPA)
+      objs[i].set_tdcpa(tbl.tcpa[i], tbl.dcpa[i], tbl.vrx[i], tbl.vry[i]);
+    slots[i].bsync = true;
+  }
+  
 public:
-  ch_ais_obj(const char * name): ch_base(name), m_tfile(0)
+  ch_ais_obj(const char * name): ch_base(name), icur(0), bgrid(false),
+    brel(false), rrel(-1.f), m_tfile(0)
   {
-    itr = objs.begin();
   }
   
   virtual ~ch_ais_obj()
   {
     lock();
-    begin();
-    for (; !is_end(); next())
-      delete (itr->second);
     objs.clear();
+    slots.clear();
+    index.clear();
+    cells.clear();
     updates.clear();
     unlock();
   }
@@ -686,18 +836,7 @@ public:
       hdg = cog;
     
     lock();
-    itr = objs.find(mmsi);
-    if(itr != objs.end()){
-      c_ais_obj & obj = *(itr->second);      
-      obj.update(t, lat, lon, cog, sog, hdg);
-      obj.set_ecef_from_blh();
-      updates.push_back(&obj);
-    }else{
-      c_ais_obj * pobj = new c_ais_obj(t, mmsi, lat, lon, cog, sog, hdg);
-      objs.insert(map<unsigned int, c_ais_obj *>::value_type(mmsi, pobj));
-      pobj->set_ecef_from_blh();
-      updates.push_back(pobj);
-    }
+    _push(t, mmsi, lat, lon, cog, sog, hdg);
     unlock();
   }
   
@@ -708,91 +847,65 @@ public:
     unlock();
   }
   
+  // calculates relative position and velocity to my own ship at (x, y, z)
+  // in ECEF with rotation R. If range is given, only the targets in the
+  // range are calculated, and the others lose their relative states. If my
+  // own ship state and the range are the same as the last call, only the
+  // targets updated since then are calculated.
   void update_rel_pos_and_vel(const double * R, const float x,
-			      const float y, const float z)
-  {
-    lock();
-    for (itr = objs.begin(); itr != objs.end(); itr++){
-      c_ais_obj * pobj = itr->second;
-      
-      pobj->set_pos_rel_from_ecef(R, x, y, z);
-      pobj->set_vel_ecef_from_blh(R);
-      pobj->set_vel_rel_from_blh();
-      pobj->set_pos_bd_from_rel();
-    }
-    unlock();
-  }
+			      const float y, const float z,
+			      const float range = -1.f);
   
   void set_track(const int _id){
-    int id = 0;
-    for (itr = objs.begin(); itr != objs.end(); itr++){
-      c_ais_obj * pobj = itr->second;
-      if (id == _id){
-	pobj->set_tracking_id(0);
-      }else{
-	pobj->set_tracking_id(-1);
-      }
-      id++;
-    }
+    for (int i = 0; i < (int)objs.size(); i++)
+      objs[i].set_tracking_id(i == _id ? 0 : -1);
   }
   
   const int get_tracking_id(){
-    c_ais_obj & obj = *(itr->second);
-    return obj.get_tracking_id();
+    return objs[icur].get_tracking_id();
   }
   
-  void calc_tdcpa(const long long t, float vx, float vy)
+  // calculates TCPA and DCPA of the targets relative states of which
+  // are calculated in update_rel_pos_and_vel. They are calculated in the
+  // table, and copied to the object when it is accessed by cur().
+  void calc_tdcpa(const long long t, float vx, float vy);
+
+  // table of the targets, the row i of which is the i-th target in the
+  // iteration. Use it with lock/unlock.
+  const s_obj_table & get_table()
   {
-    lock();
-    for (itr = objs.begin(); itr != objs.end(); itr++){
-      c_ais_obj * pobj = itr->second;
-      pobj->calc_tdcpa(t, vx, vy);
-    }
-    unlock();
+    return tbl;
   }
   
-  void remove_out(float range)
+  // gives the MMSIs of the targets in the range from my own ship at
+  // (x, y, z) in ECEF. 
+  void find_in_range(const float x, const float y, const float z,
+		     const float range, vector<unsigned int> & mmsis);
+  
+  // finds the target of the mmsi and sets it current.
+  bool find(const unsigned int mmsi)
   {
-    lock();
-    float r2 = (float)(range * range);
-    for(itr = objs.begin(); itr != objs.end();){
-      c_ais_obj * pobj = itr->second;
-      double x, y, z;
-      pobj->get_pos_rel(x, y, z);
-      float d = (float)(x * x + y * y + z * z);
-      if(d > r2){
-	updates.remove(pobj);
-	delete itr->second;			
-	itr = objs.erase(itr);
-      }else{
-	itr++;
-      }
-    }
-    unlock();
+    auto itr = index.find(mmsi);
+    if(itr == index.end())
+      return false;
+    icur = itr->second;
+    return true;
   }
   
-  void remove_old(const long long told){
-    lock();
-    for(itr = objs.begin(); itr != objs.end();){
-      c_ais_obj * pobj = itr->second;
-      if(pobj->get_time() < told){
-	updates.remove(pobj);
-	itr = objs.erase(itr);
-	delete pobj;
-      }else{
-	itr++;
-      }
-    }
-    unlock();
-  }
+  // removes the targets farther than range from my own ship at the
+  // position given in the last update_rel_pos_and_vel call. Nothing is
+  // removed before the first call.
+  void remove_out(float range);
+  void remove_old(const long long told);
   
   // Note: 
-  // get_cur_state, is_end, is_begin, begin, end, next, prev do not lock mutex. 
-  // If you use them, lock/unlock methods should be called by their user.
+  // get_cur_state, is_end, is_begin, begin, end, next, prev, find do not
+  // lock mutex. If you use them, lock/unlock methods should be called by
+  // their user.
   
   bool get_cur_state(double & x, double & y, double & z,
 		     float & vx, float & vy, float & vz, float & yw){
-    c_ais_obj & obj = *(itr->second);
+    c_ais_obj & obj = objs[icur];
     bool flag = true;
     float r, p;
     if(obj.get_dtype() & EOD_POS_REL){
@@ -819,50 +932,52 @@ public:
   }
   
   bool get_tdcpa(float & tcpa, float & dcpa){
-    return (itr->second)->get_tdcpa(tcpa, dcpa);
+    tcpa = tbl.tcpa[icur];
+    dcpa = tbl.dcpa[icur];
+    return (tbl.dtype[icur] & EOD_TDCPA) != 0;
   }
   
   bool get_pos_bd(float & bear, float & dist)
   {
-    return (itr->second)->get_pos_bd(bear, dist);
+    return objs[icur].get_pos_bd(bear, dist);
   }
   
   bool get_prediction(const long long t, float & x, float & y, float & s)
   {
-    return (itr->second)->get_prediction(t, x, y, s);
+    sync(icur);
+    return objs[icur].get_prediction(t, x, y, s);
   }
   
   bool is_end(){
-    bool r = itr == objs.end();
-    return r;
+    return icur >= (int)objs.size();
   }
   
   bool is_begin(){
-    bool r = itr == objs.begin();
-    return r;
+    return icur == 0;
   }
   
   void begin(){
-    itr = objs.begin();
+    icur = 0;
   }
   
   void end(){
-    itr = objs.end();
+    icur = (int)objs.size();
   }
   
   c_ais_obj & cur()
   {
-    return *(itr->second);
+    sync(icur);
+    return objs[icur];
   }
   
   void next(){
-    if(objs.end() != itr)
-      itr++;
+    if(icur < (int)objs.size())
+      icur++;
   }
   
   void prev(){
-    if(objs.begin() != itr)
-      itr--;
+    if(icur > 0)
+      icur--;
   }
   
   int get_num_objs(){
@@ -882,20 +997,8 @@ public:
     c_ais_obj obj_new;
     
     obj_new.write_buf(buf);
-    if(obj_new.get_mmsi() != 0){
-      itr = objs.find(obj_new.get_mmsi());
-      if(itr != objs.end()){
-	c_ais_obj & obj = *(itr->second);
-	obj.update(obj_new);
-	obj.set_ecef_from_blh();
-	updates.push_back(itr->second);
-      }else{
-	c_ais_obj * pobj = new c_ais_obj(obj_new);
-	objs.insert(map<unsigned int, c_ais_obj *>::value_type(pobj->get_mmsi(), pobj));
-	pobj->set_ecef_from_blh();
-	updates.push_back(pobj);
-      }
-    }
+    if(obj_new.get_mmsi() != 0)
+      _push(obj_new);
     unlock();
     return get_dsize();
   }
@@ -903,13 +1006,17 @@ public:
   virtual size_t read_buf(char * buf)
   {
     lock();
-    if(updates.size()){
-      c_ais_obj * pobj = *(updates.begin());
+    bool bread = false;
+    while(updates.size() && !bread){
+      auto itr = index.find(updates.front());
       updates.pop_front();
-      pobj->read_buf(buf);
-    }else{
-      c_ais_obj::read_buf_null(buf);
+      if(itr == index.end()) // removed after the update
+	continue;
+      objs[itr->second].read_buf(buf);
+      bread = true;
     }
+    if(!bread)
+      c_ais_obj::read_buf_null(buf);
     unlock();
     return get_dsize();
   }
@@ -921,8 +1028,8 @@ public:
     if(pf){
       lock();
       long long tnew = m_tfile;
-      for(itr = objs.begin(); itr != objs.end(); itr++){
-	c_ais_obj & obj = *(itr->second);
+      for(int i = 0; i < (int)objs.size(); i++){
+	c_ais_obj & obj = objs[i];
 	if(obj.get_time() > m_tfile){
 	  tnew = max(tnew, obj.get_time());
 	  sz += obj.write(pf);
@@ -943,18 +1050,7 @@ public:
       while(m_tfile < tcur && !feof(pf)){
 	obj.read(pf);
 	m_tfile = obj.get_time();
-	itr = objs.find(obj.get_mmsi());
-	if(itr != objs.end()){
-	  c_ais_obj & obj = *(itr->second);
-	  obj.update(obj);
-	  obj.set_ecef_from_blh();
-	  updates.push_back(itr->second);
-	}else{
-	  c_ais_obj * pobj = new c_ais_obj(obj);
-	  objs.insert(map<unsigned int, c_ais_obj *>::value_type(obj.get_mmsi(), pobj));
-	  pobj->set_ecef_from_blh();
-	  updates.push_back(pobj);
-	}				
+	_push(obj);
       }
       unlock();
     }
@@ -26,5 +26,8 @@ bool f_sample::proc()
   auto sample_message = msg_builder.CreateString(msg_str);
   auto msg_loc = CreateSampleMsg(msg_builder, sample_message, f64, f32, u32, s32, u16, s16, u8, s8);
   FinishSampleMsgBuffer(msg_builder, msg_loc);
+
+  if(blog)
+    olog.write(get_time(), msg_builder.GetBufferPointer(), msg_builder.GetSize());
   return true;  
 }
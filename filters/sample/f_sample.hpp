@@ -51,10 +51,13 @@ private:
 
   flatbuffers::FlatBufferBuilder msg_builder;
   char * msg;
+
+  bool blog;  // logs the message with c_log
+  c_log olog;
 public:
   // 3) constructor should have an instance name as a c-string. In the body, parameters and tables are to be registered for inter-filter communication.
   f_sample(const char * fname): f_base(fname), tbl(nullptr), ch(nullptr), f64(0.0), u64(0), s64(0), f32(0.0f), u32(0), s32(0), s16(0), u16(0),
-				s8(0), u8(0), b(false), e(Foo), init_force_fail(false), msg_builder(1024), msg(NULL)
+				s8(0), u8(0), b(false), e(Foo), init_force_fail(false), msg_builder(1024), msg(NULL), blog(false)
   {
     cstr[0] = '\0';
     
@@ -77,6 +80,9 @@ public:
     register_fpar("str", cstr, sizeof(cstr), "String parameter example.");
     register_fpar("e", (int*)&e, (int)(Bar + 1), str_etype, "Enum type example.");
     register_fpar("init_force_fail", &init_force_fail, "Force init_run failed to test fail-case at run command.");
+    register_fpar("log", &blog, "Log the message (y or n, set before run). The log is written in the log path with the filter name as the prefix.");
+    // log writing mode and the counters. (e.g. "logAsync", "logDrops")
+    register_fpar_log("log", &olog);
   }
   
   virtual bool init_run(){    
@@ -85,12 +91,17 @@ public:
 
     if(init_force_fail)
       return false;
+
+    if(blog && !olog.init(get_log_path(), get_name()))
+      return false;
     
     return true;
   }
 
   // override this function if you need to do something in stopping filter thread
   virtual void destroy_run(){
+    if(blog)
+      olog.destroy();
   }
 
   // 5) implement your filter body. this function is called in the loop of fthread.  
@@ -221,6 +221,14 @@ protected:
   // time zone in minute
   int m_time_zone_minute;
 
+  // number of worker threads executing filters
+  // (0: a thread per filter, negative: number of cores)
+  int m_num_workers;
+  c_work_stealing_pool m_pool;
+
+  // dispatches filters in the order of channel wiring (pooled mode only)
+  bool m_bgraph;
+
   map<string, unique_ptr<c_filter_lib>> filter_libs;
   map<string, f_base*> filters;
   map<string, t_base*> tbls;  
@@ -0,0 +1,228 @@
+// Copyright(c) 2020 Yohei Matsumoto, All right reserved.
+
+// aws_ais_bits.hpp is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// aws_ais_bits.hpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with aws_ais_bits.hpp.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AWS_AIS_BITS_HPP
+#define AWS_AIS_BITS_HPP
+
+// AIS payload kernels. The armored payload string is converted to 6bit
+// values (ais_dearmor), and packed into a contiguous big endian bit buffer
+// (ais_pack6). Fields are then extracted at fixed bit offsets with
+// ais_get_ubits/ais_get_sbits without any per-bit loop.
+// SSE2/AVX2 and SSSE3 paths are selected at compile time (-march=native in
+// release build), with scalar fallbacks.
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// maximum payload length in characters, and the size of the bit buffer.
+// The bit buffer has 16 bytes of margin for vector stores and 64bit loads.
+#define AIS_MAX_PL_CHARS 256
+#define AIS_BITS_SIZE (AIS_MAX_PL_CHARS * 6 / 8 + 16)
+
+// converts armored characters to 6bit values, one char at a time.
+// Characters out of the armoring table are masked to 6bit as well.
+inline void ais_dearmor_scalar(const char * str, char * c6, int len)
+{
+  for(int i = 0; i < len; i++){
+    c6[i] = str[i] - 48;
+    if(c6[i] > 40)
+      c6[i] -= 8;
+    c6[i] &= 0x3F;
+  }
+}
+
+// converts armored characters to 6bit values. The results are always in
+// [0, 64), same as ais_dearmor_scalar.
+inline void ais_dearmor(const char * str, char * c6, int len)
+{
+  int i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256i v48 = _mm256_set1_epi8(48);
+    const __m256i v40 = _mm256_set1_epi8(40);
+    const __m256i v8 = _mm256_set1_epi8(8);
+    const __m256i v3f = _mm256_set1_epi8(0x3F);
+    for(; i + 32 <= len; i += 32){
+      __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+      v = _mm256_sub_epi8(v, v48);
+      v = _mm256_sub_epi8(v, _mm256_and_si256(_mm256_cmpgt_epi8(v, v40), v8));
+      v = _mm256_and_si256(v, v3f);
+      _mm256_storeu_si256((__m256i*)(c6 + i), v);
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i v48 = _mm_set1_epi8(48);
+    const __m128i v40 = _mm_set1_epi8(40);
+    const __m128i v8 = _mm_set1_epi8(8);
+    const __m128i v3f = _mm_set1_epi8(0x3F);
+    for(; i + 16 <= len; i += 16){
+      __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+      v = _mm_sub_epi8(v, v48);
+      v = _mm_sub_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(v, v40), v8));
+      v = _mm_and_si128(v, v3f);
+      _mm_storeu_si128((__m128i*)(c6 + i), v);
+    }
+  }
+#endif
+  ais_dearmor_scalar(str + i, c6 + i, len - i);
+}
+
+// packs 6bit values into big endian bit stream. bits should have
+// AIS_BITS_SIZE bytes. Returns the number of bits.
+inline int ais_pack6(const char * c6, int len, unsigned char * bits)
+{
+  int i = 0, j = 0;
+#if defined(__SSSE3__)
+  {
+    // 16 values -> 12 bytes. [a b c d] -> a<<18 | b<<12 | c<<6 | d
+    const __m128i m1 = _mm_set1_epi16(0x0140);
+    const __m128i m2 = _mm_set1_epi32(0x00011000);
+    const __m128i shf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+				      -1, -1, -1, -1);
+    for(; i + 16 <= len; i += 16, j += 12){
+      __m128i v = _mm_loadu_si128((const __m128i*)(c6 + i));
+      v = _mm_maddubs_epi16(v, m1);
+      v = _mm_madd_epi16(v, m2);
+      v = _mm_shuffle_epi8(v, shf);
+      _mm_storeu_si128((__m128i*)(bits + j), v);
+    }
+  }
+#endif
+  for(; i + 4 <= len; i += 4, j += 3){
+    unsigned int w = ((c6[i] & 0x3F) << 18) | ((c6[i + 1] & 0x3F) << 12) |
+      ((c6[i + 2] & 0x3F) << 6) | (c6[i + 3] & 0x3F);
+    bits[j] = (unsigned char)(w >> 16);
+    bits[j + 1] = (unsigned char)(w >> 8);
+    bits[j + 2] = (unsigned char) w;
+  }
+
+  // remaining 0 to 3 values, zero padded
+  unsigned int w = 0;
+  for(int k = 0; k < 4; k++)
+    w = (w << 6) | (i + k < len ? (c6[i + k] & 0x3F) : 0);
+  bits[j] = (unsigned char)(w >> 16);
+  bits[j + 1] = (unsigned char)(w >> 8);
+  bits[j + 2] = (unsigned char) w;
+  memset(bits + j + 3, 0, 8);
+  return len * 6;
+}
+
+inline uint64_t ais_load_be64(const unsigned char * p)
+{
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  return w;
+}
+
+// extracts len (1 to 32) bits at bit position pos as unsigned value
+inline unsigned int ais_get_ubits(const unsigned char * bits, int pos, int len)
+{
+  uint64_t w = ais_load_be64(bits + (pos >> 3)) << (pos & 7);
+  return (unsigned int)(w >> (64 - len));
+}
+
+// extracts len (1 to 32) bits at bit position pos as two's complement value
+inline int ais_get_sbits(const unsigned char * bits, int pos, int len)
+{
+  int64_t w = (int64_t)(ais_load_be64(bits + (pos >> 3)) << (pos & 7));
+  return (int)(w >> (64 - len));
+}
+
+// extracts len bits at bit position pos from 6bit values, bit by bit.
+inline unsigned int ais_get_c6_ubits(const char * c6, int pos, int len)
+{
+  unsigned int v = 0;
+  for(int i = pos; i < pos + len; i++)
+    v = (v << 1) | ((c6[i / 6] >> (5 - i % 6)) & 1);
+  return v;
+}
+
+// fields of message 1, 2, 3 (class A position report)
+struct s_ais_pos_a
+{
+  unsigned char type, repeat, status, accuracy, second, maneuver, raim;
+  signed char turn;
+  unsigned int mmsi, radio;
+  unsigned short speed, course, heading;
+  int lon, lat; // 1/10000 minute
+
+  void dec(const unsigned char * bits)
+  {
+    type = (unsigned char) ais_get_ubits(bits, 0, 6);
+    repeat = (unsigned char) ais_get_ubits(bits, 6, 2);
+    mmsi = ais_get_ubits(bits, 8, 30);
+    status = (unsigned char) ais_get_ubits(bits, 38, 4);
+    turn = (signed char) ais_get_sbits(bits, 42, 8);
+    speed = (unsigned short) ais_get_ubits(bits, 50, 10);
+    accuracy = (unsigned char) ais_get_ubits(bits, 60, 1);
+    lon = ais_get_sbits(bits, 61, 28);
+    lat = ais_get_sbits(bits, 89, 27);
+    course = (unsigned short) ais_get_ubits(bits, 116, 12);
+    heading = (unsigned short) ais_get_ubits(bits, 128, 9);
+    second = (unsigned char) ais_get_ubits(bits, 137, 6);
+    maneuver = (unsigned char) ais_get_ubits(bits, 143, 2);
+    raim = (unsigned char) ais_get_ubits(bits, 148, 1);
+    radio = ais_get_ubits(bits, 149, 19);
+  }
+};
+
+// fields of message 18 (class B position report)
+struct s_ais_pos_b
+{
+  unsigned char type, repeat, accuracy, second, raim;
+  bool cs, disp, dsc, band, msg22, assigned;
+  unsigned int mmsi, radio;
+  unsigned short speed, course, heading;
+  int lon, lat; // 1/10000 minute
+
+  void dec(const unsigned char * bits)
+  {
+    type = (unsigned char) ais_get_ubits(bits, 0, 6);
+    repeat = (unsigned char) ais_get_ubits(bits, 6, 2);
+    mmsi = ais_get_ubits(bits, 8, 30);
+    speed = (unsigned short) ais_get_ubits(bits, 46, 10);
+    accuracy = (unsigned char) ais_get_ubits(bits, 56, 1);
+    lon = ais_get_sbits(bits, 57, 28);
+    lat = ais_get_sbits(bits, 85, 27);
+    course = (unsigned short) ais_get_ubits(bits, 112, 12);
+    heading = (unsigned short) ais_get_ubits(bits, 124, 9);
+    second = (unsigned char) ais_get_ubits(bits, 133, 6);
+    cs = ais_get_ubits(bits, 141, 1) != 0;
+    disp = ais_get_ubits(bits, 142, 1) != 0;
+    dsc = ais_get_ubits(bits, 143, 1) != 0;
+    band = ais_get_ubits(bits, 144, 1) != 0;
+    msg22 = ais_get_ubits(bits, 145, 1) != 0;
+    assigned = ais_get_ubits(bits, 146, 1) != 0;
+    raim = (unsigned char) ais_get_ubits(bits, 147, 1);
+    radio = ais_get_ubits(bits, 148, 20);
+  }
+};
+
+#endif
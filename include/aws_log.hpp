@@ -25,8 +25,424 @@ namespace fs = filesystem;
 #include <algorithm>
 #include <regex>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+// Block compressed log format. The file starts with the magic
+// "AWSLOGZ1", and is followed by blocks each of which consists of
+// s_log_block_header and the deflated records in the raw format.
+struct s_log_block_header
+{
+  long long tfirst, tlast; // time of the first and the last records
+  unsigned int num_recs;   // number of records in the block
+  unsigned int size_raw;   // size of the records before compression
+  unsigned int size_comp;  // size of the compressed data
+};
+
+inline const char *log_block_magic()
+{
+  return "AWSLOGZ1";
+}
+
+// c_log_file_map maps a log file written by c_log into memory and holds the
+// time-to-offset index of the records. For the raw format, the index is
+// saved as a sidecar file "<prefix>_<t>.idx" beside the log file, and is
+// rebuilt by scanning the records when the sidecar is missing or does not
+// match the log file (size and modification time, and the time stamps of
+// the first and the last records). For the block compressed format, the index of
+// the blocks is built from the block headers, and a block is inflated when
+// its records are accessed.
+class c_log_file_map
+{
+private:
+  int fd;
+  unsigned char *addr;
+  size_t size;
+  long long mtime; // modification time of the log file in nano seconds
+  bool bcomp;
+
+  vector<long long> times;            // record time stamps (ascending)
+  vector<unsigned long long> offsets; // record offsets (points the time field)
+
+  struct s_block
+  {
+    long long tfirst, tlast;
+    size_t offset;  // offset to the header
+    int irec_first; // index of the first record in the file
+    int num_recs;
+  };
+  vector<s_block> blocks;
+
+  // inflated block
+  int iblock_cached;
+  vector<unsigned char> block_raw;
+  vector<long long> block_times;
+  vector<unsigned long long> block_offsets;
+
+  struct s_idx_header
+  {
+    char magic[8];
+    long long size_log;  // size of the log file
+    long long mtime_log; // modification time of the log file
+    long long num_recs;
+  };
+
+  static const char *idx_magic()
+  {
+    return "AWSLIDX2";
+  }
+
+  // returns true if the first and the last record time stamps in the index
+  // are those in the mapped log file.
+  bool check_index()
+  {
+    if (times.empty())
+      return true;
+    const size_t sz_hdr = sizeof(long long) + sizeof(unsigned int);
+    long long t;
+    for (int irec : {0, (int)times.size() - 1})
+    {
+      if (offsets[irec] + sz_hdr > size)
+        return false;
+      memcpy(&t, addr + offsets[irec], sizeof(t));
+      if (t != times[irec])
+        return false;
+    }
+    return true;
+  }
+
+  bool load_index(const string &fname_idx)
+  {
+    ifstream fidx(fname_idx, ios_base::binary);
+    if (!fidx.is_open())
+      return false;
+
+    s_idx_header hdr;
+    fidx.read((char *)&hdr, sizeof(hdr));
+    if (!fidx || strncmp(hdr.magic, idx_magic(), 8) != 0 ||
+        hdr.size_log != (long long)size || hdr.mtime_log != mtime ||
+        hdr.num_recs < 0)
+      return false;
+
+    times.resize(hdr.num_recs);
+    offsets.resize(hdr.num_recs);
+    fidx.read((char *)times.data(), sizeof(long long) * hdr.num_recs);
+    fidx.read((char *)offsets.data(), sizeof(unsigned long long) * hdr.num_recs);
+    if (!fidx || !check_index())
+    {
+      times.clear();
+      offsets.clear();
+      return false;
+    }
+    return true;
+  }
+
+  void save_index(const string &fname_idx)
+  {
+    ofstream fidx(fname_idx, ios_base::binary);
+    if (!fidx.is_open())
+      return; // read only media, the index is kept only in memory.
+
+    s_idx_header hdr;
+    memcpy(hdr.magic, idx_magic(), 8);
+    hdr.size_log = (long long)size;
+    hdr.mtime_log = mtime;
+    hdr.num_recs = (long long)times.size();
+    fidx.write((const char *)&hdr, sizeof(hdr));
+    fidx.write((const char *)times.data(), sizeof(long long) * times.size());
+    fidx.write((const char *)offsets.data(), sizeof(unsigned long long) * offsets.size());
+  }
+
+  // scans the records in buf. Scanning stops at the truncated record or
+  // the record breaking the time order.
+  static void scan_records(const unsigned char *buf, const size_t len,
+                           vector<long long> &ts, vector<unsigned long long> &ofss,
+                           size_t ofs = 0)
+  {
+    const size_t sz_hdr = sizeof(long long) + sizeof(unsigned int);
+    while (ofs + sz_hdr <= len)
+    {
+      long long t;
+      unsigned int sz;
+      memcpy(&t, buf + ofs, sizeof(t));
+      memcpy(&sz, buf + ofs + sizeof(t), sizeof(sz));
+      if (ofs + sz_hdr + sz > len)
+      {
+        cerr << "Truncated record found at " << ofs << endl;
+        break;
+      }
+
+      if (!ts.empty() && t < ts.back())
+      {
+        cerr << "Timestamp is not consistent. Previous timestamp is " << ts.back() << " and now " << t << endl;
+        break;
+      }
+
+      ts.push_back(t);
+      ofss.push_back((unsigned long long)ofs);
+      ofs += sz_hdr + sz;
+    }
+  }
+
+  void build_index()
+  {
+    times.clear();
+    offsets.clear();
+    scan_records(addr, size, times, offsets);
+  }
+
+  // scans the block headers. Scanning stops at the truncated block.
+  void build_block_index()
+  {
+    blocks.clear();
+    size_t ofs = 8;
+    int irec = 0;
+    while (ofs + sizeof(s_log_block_header) <= size)
+    {
+      s_log_block_header hdr;
+      memcpy(&hdr, addr + ofs, sizeof(hdr));
+      if (ofs + sizeof(hdr) + hdr.size_comp > size)
+      {
+        cerr << "Truncated block found at " << ofs << endl;
+        break;
+      }
+
+      if (!blocks.empty() && hdr.tfirst < blocks.back().tlast)
+      {
+        cerr << "Timestamp is not consistent. Previous timestamp is " << blocks.back().tlast << " and now " << hdr.tfirst << endl;
+        break;
+      }
+
+      s_block blk;
+      blk.tfirst = hdr.tfirst;
+      blk.tlast = hdr.tlast;
+      blk.offset = ofs;
+      blk.irec_first = irec;
+      blk.num_recs = (int)hdr.num_recs;
+      blocks.push_back(blk);
+      irec += blk.num_recs;
+      ofs += sizeof(hdr) + hdr.size_comp;
+    }
+  }
+
+  bool inflate_block(const int iblock)
+  {
+    if (iblock == iblock_cached)
+      return true;
+
+    s_log_block_header hdr;
+    memcpy(&hdr, addr + blocks[iblock].offset, sizeof(hdr));
+    block_raw.resize(hdr.size_raw);
+    uLongf len = hdr.size_raw;
+    if (uncompress(block_raw.data(), &len,
+                   addr + blocks[iblock].offset + sizeof(hdr),
+                   hdr.size_comp) != Z_OK)
+    {
+      cerr << "Failed to inflate block at " << blocks[iblock].offset << endl;
+      len = 0;
+    }
+
+    block_times.clear();
+    block_offsets.clear();
+    scan_records(block_raw.data(), len, block_times, block_offsets);
+    // the records lost in the broken block are treated as empty
+    while ((int)block_times.size() < blocks[iblock].num_recs)
+    {
+      block_times.push_back(blocks[iblock].tlast);
+      block_offsets.push_back((unsigned long long)block_raw.size());
+    }
+    iblock_cached = iblock;
+    return true;
+  }
+
+  // returns the block containing the irec-th record
+  int find_block(const int irec)
+  {
+    if (iblock_cached >= 0 && blocks[iblock_cached].irec_first <= irec &&
+        irec < blocks[iblock_cached].irec_first + blocks[iblock_cached].num_recs)
+      return iblock_cached;
+
+    int lo = 0, hi = (int)blocks.size() - 1;
+    while (lo < hi)
+    {
+      int mid = (lo + hi + 1) >> 1;
+      if (blocks[mid].irec_first <= irec)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    return lo;
+  }
+
+public:
+  c_log_file_map() : fd(-1), addr(nullptr), size(0), mtime(0), bcomp(false),
+                     iblock_cached(-1)
+  {
+  }
+
+  ~c_log_file_map()
+  {
+    close();
+  }
+
+  // returns true if the file is in the block compressed format.
+  static bool is_block_file(const string &fname_log)
+  {
+    char magic[8];
+    ifstream f(fname_log, ios_base::binary);
+    f.read(magic, 8);
+    return f && strncmp(magic, log_block_magic(), 8) == 0;
+  }
+
+  bool open(const string &fname_log, const string &fname_idx)
+  {
+    close();
+    fd = ::open(fname_log.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      close();
+      return false;
+    }
+
+    size = (size_t)st.st_size;
+    mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    if (size > 0)
+    {
+      void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED)
+      {
+        close();
+        return false;
+      }
+      addr = (unsigned char *)p;
+      madvise(addr, size, MADV_SEQUENTIAL);
+    }
+
+    bcomp = size >= 8 && strncmp((const char *)addr, log_block_magic(), 8) == 0;
+    if (bcomp)
+    {
+      build_block_index();
+    }
+    else if (!load_index(fname_idx))
+    {
+      build_index();
+      save_index(fname_idx);
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (addr)
+      munmap(addr, size);
+    addr = nullptr;
+    size = 0;
+    mtime = 0;
+
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+
+    times.clear();
+    offsets.clear();
+    blocks.clear();
+    iblock_cached = -1;
+    bcomp = false;
+  }
+
+  bool is_open()
+  {
+    return fd >= 0;
+  }
+
+  const int get_num_records()
+  {
+    if (bcomp)
+    {
+      if (blocks.empty())
+        return 0;
+      return blocks.back().irec_first + blocks.back().num_recs;
+    }
+    return (int)times.size();
+  }
+
+  const long long get_time(const int irec)
+  {
+    if (bcomp)
+    {
+      int iblock = find_block(irec);
+      inflate_block(iblock);
+      return block_times[irec - blocks[iblock].irec_first];
+    }
+    return times[irec];
+  }
+
+  // returns the index of the first record with time stamp t or later.
+  // get_num_records() is returned if there is no such record.
+  const int find(const long long t)
+  {
+    if (bcomp)
+    {
+      // the first block whose last record is at t or later
+      auto itr = lower_bound(blocks.begin(), blocks.end(), t,
+                             [](const s_block &blk, const long long t)
+                             { return blk.tlast < t; });
+      if (itr == blocks.end())
+        return get_num_records();
+      int iblock = (int)(itr - blocks.begin());
+      inflate_block(iblock);
+      return itr->irec_first +
+             (int)(lower_bound(block_times.begin(), block_times.end(), t) -
+                   block_times.begin());
+    }
+    return (int)(lower_bound(times.begin(), times.end(), t) - times.begin());
+  }
+
+  // returns the pointer to the irec-th record's data in the mapped region
+  // (or in the inflated block for the block compressed format).
+  const unsigned char *get_data(const int irec, unsigned int &buf_size)
+  {
+    const unsigned char *p;
+    if (bcomp)
+    {
+      int iblock = find_block(irec);
+      inflate_block(iblock);
+      unsigned long long ofs = block_offsets[irec - blocks[iblock].irec_first];
+      if (ofs >= block_raw.size())
+      {
+        buf_size = 0;
+        return block_raw.data();
+      }
+      p = block_raw.data() + ofs + sizeof(long long);
+    }
+    else
+    {
+      p = addr + offsets[irec] + sizeof(long long);
+    }
+    memcpy(&buf_size, p, sizeof(buf_size));
+    return p + sizeof(buf_size);
+  }
+};
+
+class f_base;
+
 class c_log
 {
+  friend class f_base; // f_base::register_fpar_log() refers the parameters
 private:
   string path;
   string prefix;
@@ -42,6 +458,393 @@ private:
   ofstream *ofile;
   ifstream *ifile;
 
+  // memory mapped read mode
+  bool bmmap;
+  c_log_file_map *mfile;
+  int current_record_index;
+
+  // asynchronous write mode. write() only pushes records to the ring buffer,
+  // and the writer thread drains them in batches, rotates files and fsyncs.
+  bool basync;             // enables the mode (set before init())
+  unsigned int size_ring;  // ring buffer size in bytes (power of 2)
+  int intvl_sync;          // fsync interval in msec (0: never fsync)
+  bool bblock;             // blocks write() if the ring is full, else drops
+  atomic<unsigned long long> num_drops;  // number of records dropped
+  atomic<unsigned long long> num_stalls; // number of write() blocked
+  // copies of the counters exposed as filter parameters
+  // (see f_base::register_fpar_log() and update_par_stats())
+  unsigned long long num_drops_par, num_stalls_par;
+  unsigned int size_ring_used_max; // maximum ring usage in bytes
+
+  unsigned char *ring;
+  unsigned long long ring_mask;
+  atomic<unsigned long long> ring_head; // bytes pushed by write()
+  atomic<unsigned long long> ring_tail; // bytes popped by the writer thread
+
+  thread *wthread;
+  atomic<bool> bwactive;
+  // cnd_ring wakes the writer thread when the ring is half full or write()
+  // waits for space, and wakes write() waiting for space after draining.
+  mutex mtx_ring;
+  condition_variable cnd_ring;
+  int num_push_waits;            // number of write() waiting for space
+
+  int ofd;                       // file written by the writer thread
+  bool bofd_failed;              // the last open of the file failed
+  long long wtimestamp;          // last time written by the writer thread
+  unsigned char *batch;          // aligned batch buffer
+  unsigned int size_batch;
+  unsigned int num_batch;
+  unsigned int num_batch_recs;   // records completed in the batch
+
+  static const unsigned int size_align = 4096;
+
+  // block compressed write mode. records are deflated in blocks of
+  // num_block_recs records. (see s_log_block_header)
+  bool bcomp;                  // enables the mode (set before init())
+  unsigned int num_block_recs; // number of records in a block
+  int level_comp;              // zlib compression level
+  s_log_block_header block_hdr;
+  vector<unsigned char> block_raw;
+  vector<unsigned char> block_comp;
+
+  // writes data to the current file in either sync or async mode.
+  void write_out(const unsigned char *buf, const unsigned int len)
+  {
+    if (basync)
+      append_batch_buf(buf, len);
+    else
+      ofile->write((const char *)buf, len);
+    total_size += len;
+  }
+
+  bool open_new_file(const long long t)
+  {
+    bool res = basync ? open_new_write_fd(t) : open_new_write_file(t);
+    total_size = 0;
+    if (res && bcomp)
+      write_out((const unsigned char *)log_block_magic(), 8);
+    return res;
+  }
+
+  // the record is assumed to be appended to block_raw.
+  void add_block_record(const long long t)
+  {
+    if (block_hdr.num_recs == 0)
+      block_hdr.tfirst = t;
+    block_hdr.tlast = t;
+    block_hdr.num_recs++;
+  }
+
+  void flush_block()
+  {
+    if (block_hdr.num_recs == 0)
+      return;
+
+    uLongf len = compressBound(block_raw.size());
+    block_comp.resize(sizeof(block_hdr) + len);
+    if (compress2(block_comp.data() + sizeof(block_hdr), &len,
+                  block_raw.data(), block_raw.size(), level_comp) != Z_OK)
+    {
+      cerr << "Failed to deflate block of " << prefix << endl;
+      num_drops += block_hdr.num_recs;
+    }
+    else
+    {
+      block_hdr.size_raw = (unsigned int)block_raw.size();
+      block_hdr.size_comp = (unsigned int)len;
+      memcpy(block_comp.data(), &block_hdr, sizeof(block_hdr));
+      write_out(block_comp.data(), sizeof(block_hdr) + len);
+      if (basync)
+        num_batch_recs += block_hdr.num_recs;
+    }
+    block_raw.clear();
+    block_hdr.num_recs = 0;
+  }
+
+  void ring_copy_in(unsigned long long pos, const unsigned char *src,
+                    const unsigned int len)
+  {
+    unsigned int ofs = (unsigned int)(pos & ring_mask);
+    unsigned int len0 = min(len, size_ring - ofs);
+    memcpy(ring + ofs, src, len0);
+    memcpy(ring, src + len0, len - len0);
+  }
+
+  void ring_copy_out(unsigned long long pos, unsigned char *dst,
+                     const unsigned int len)
+  {
+    unsigned int ofs = (unsigned int)(pos & ring_mask);
+    unsigned int len0 = min(len, size_ring - ofs);
+    memcpy(dst, ring + ofs, len0);
+    memcpy(dst + len0, ring, len - len0);
+  }
+
+  bool push_ring(const long long t, const unsigned char *buf,
+                 const unsigned int buf_size)
+  {
+    const unsigned int sz_rec = sizeof(t) + sizeof(buf_size) + buf_size;
+    if (sz_rec > size_ring)
+    {
+      num_drops++;
+      return false;
+    }
+
+    unsigned long long head = ring_head.load(memory_order_relaxed);
+    unsigned long long used = head - ring_tail.load(memory_order_acquire);
+    if (used + sz_rec > size_ring)
+    {
+      if (!bblock)
+      {
+        num_drops++;
+        return false;
+      }
+
+      num_stalls++;
+      unique_lock<mutex> lk(mtx_ring);
+      num_push_waits++;
+      cnd_ring.notify_all();
+      cnd_ring.wait(lk, [&]
+                    { used = head - ring_tail.load(memory_order_acquire);
+                      return used + sz_rec <= size_ring; });
+      num_push_waits--;
+    }
+
+    ring_copy_in(head, (const unsigned char *)&t, sizeof(t));
+    ring_copy_in(head + sizeof(t), (const unsigned char *)&buf_size,
+                 sizeof(buf_size));
+    ring_copy_in(head + sizeof(t) + sizeof(buf_size), buf, buf_size);
+    ring_head.store(head + sz_rec, memory_order_release);
+
+    used += sz_rec;
+    size_ring_used_max = max(size_ring_used_max, (unsigned int)used);
+    if (used > (size_ring >> 1))
+      cnd_ring.notify_one();
+    return true;
+  }
+
+  bool open_new_write_fd(const long long t)
+  {
+    if (ofd >= 0)
+      ::close(ofd);
+
+    string fname = path + "/" + prefix + get_time_str(t);
+    ofd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    // reported once until the open succeeds, since it is retried for
+    // every record.
+    if (ofd < 0 && !bofd_failed)
+      cerr << "Failed to open " << fname << ". Records are dropped until a log file is opened." << endl;
+    bofd_failed = ofd < 0;
+    return ofd >= 0;
+  }
+
+  // writes the batch to the file. The records in the batch are counted as
+  // dropped if no file is opened or the write fails.
+  void flush_batch()
+  {
+    unsigned int ofs = 0;
+    bool bfailed = ofd < 0;
+    while (!bfailed && ofs < num_batch)
+    {
+      ssize_t res = ::write(ofd, batch + ofs, num_batch - ofs);
+      if (res < 0)
+      {
+        cerr << "Failed to write log " << prefix << endl;
+        bfailed = true;
+        break;
+      }
+      ofs += (unsigned int)res;
+    }
+    if (bfailed)
+      num_drops += num_batch_recs;
+    num_batch = 0;
+    num_batch_recs = 0;
+  }
+
+  void append_batch_buf(const unsigned char *buf, unsigned int len)
+  {
+    while (len > 0)
+    {
+      unsigned int len0 = min(len, size_batch - num_batch);
+      memcpy(batch + num_batch, buf, len0);
+      num_batch += len0;
+      buf += len0;
+      len -= len0;
+      if (num_batch == size_batch)
+        flush_batch();
+    }
+  }
+
+  void append_batch(unsigned long long pos, unsigned int len)
+  {
+    while (len > 0)
+    {
+      unsigned int len0 = min(len, size_batch - num_batch);
+      ring_copy_out(pos, batch + num_batch, len0);
+      num_batch += len0;
+      pos += len0;
+      len -= len0;
+      if (num_batch == size_batch)
+        flush_batch();
+    }
+  }
+
+  // moves all the records in the ring to the files.
+  void drain_ring()
+  {
+    unsigned long long head = ring_head.load(memory_order_acquire);
+    unsigned long long tail = ring_tail.load(memory_order_relaxed);
+    while (tail < head)
+    {
+      long long t;
+      unsigned int buf_size;
+      ring_copy_out(tail, (unsigned char *)&t, sizeof(t));
+      ring_copy_out(tail + sizeof(t), (unsigned char *)&buf_size,
+                    sizeof(buf_size));
+      const unsigned int sz_rec = sizeof(t) + sizeof(buf_size) + buf_size;
+
+      if (ofd < 0 || total_size + block_raw.size() + sz_rec > size_max)
+      {
+        flush_block();
+        flush_batch();
+        open_new_file(t);
+      }
+
+      if (bcomp)
+      {
+        size_t ofs = block_raw.size();
+        block_raw.resize(ofs + sz_rec);
+        ring_copy_out(tail, block_raw.data() + ofs, sz_rec);
+        add_block_record(t);
+        if (block_hdr.num_recs >= num_block_recs)
+          flush_block();
+      }
+      else
+      {
+        append_batch(tail, sz_rec);
+        num_batch_recs++;
+        total_size += sz_rec;
+      }
+      wtimestamp = t;
+      tail += sz_rec;
+      ring_tail.store(tail, memory_order_release);
+    }
+    flush_batch();
+
+    // wakes write() waiting for space. mtx_ring is taken not to lose the
+    // notification between write()'s check and wait.
+    {
+      lock_guard<mutex> lk(mtx_ring);
+    }
+    cnd_ring.notify_all();
+  }
+
+  static void swthread(c_log *log)
+  {
+    log->wthread_body();
+  }
+
+  void wthread_body()
+  {
+    auto tsync = chrono::steady_clock::now();
+    while (1)
+    {
+      bool bactive = bwactive.load();
+      {
+        unique_lock<mutex> lk(mtx_ring);
+        cnd_ring.wait_for(lk, chrono::milliseconds(10), [this]
+                          { return !bwactive.load() || num_push_waits > 0 ||
+                                   (ring_head.load() - ring_tail.load()) > (size_ring >> 1); });
+      }
+
+      drain_ring();
+
+      auto tcur = chrono::steady_clock::now();
+      bool bsync = intvl_sync > 0 &&
+                   tcur - tsync >= chrono::milliseconds(intvl_sync);
+      if (bsync || !bactive)
+      {
+        // pending block is written not to lose records over sync interval
+        flush_block();
+        flush_batch();
+      }
+
+      if (ofd >= 0 && bsync)
+      {
+        fsync(ofd);
+        tsync = tcur;
+      }
+
+      if (!bactive)
+        break;
+    }
+  }
+
+  bool start_async()
+  {
+    unsigned int sz = size_align;
+    while (sz < size_ring)
+      sz <<= 1;
+    size_ring = sz;
+    ring_mask = size_ring - 1;
+    ring = new unsigned char[size_ring];
+    ring_head = ring_tail = 0;
+
+    size_batch = (size_ring >> 2) & ~(size_align - 1);
+    if (size_batch == 0)
+      size_batch = size_align;
+    void *p = nullptr;
+    if (posix_memalign(&p, size_align, size_batch) != 0)
+    {
+      delete[] ring;
+      ring = nullptr;
+      return false;
+    }
+    batch = (unsigned char *)p;
+    num_batch = 0;
+    num_batch_recs = 0;
+
+    num_drops = 0;
+    num_stalls = 0;
+    num_push_waits = 0;
+    bofd_failed = false;
+    size_ring_used_max = 0;
+    wtimestamp = -1;
+    bwactive = true;
+    wthread = new thread(swthread, this);
+    return true;
+  }
+
+  void stop_async()
+  {
+    if (!wthread)
+      return;
+
+    bwactive = false;
+    cnd_ring.notify_all();
+    wthread->join();
+    delete wthread;
+    wthread = nullptr;
+
+    if (ofd >= 0)
+    {
+      fsync(ofd);
+      ::close(ofd);
+      ofd = -1;
+      // empty file tells the end time of the last file as in the sync mode.
+      if (wtimestamp > 0 && open_new_write_fd(wtimestamp + 1))
+      {
+        ::close(ofd);
+        ofd = -1;
+      }
+    }
+
+    delete[] ring;
+    ring = nullptr;
+    free(batch);
+    batch = nullptr;
+  }
+
   bool open_new_write_file(const long long t)
   {
     if (ofile)
@@ -96,6 +899,39 @@ private:
     return ifile->is_open();
   }
 
+  string get_idx_fname(const long long t)
+  {
+    char idx_str[32];
+    snprintf(idx_str, 32, "_%lld.idx", t);
+    return path + "/" + prefix + idx_str;
+  }
+
+  bool map_file(const int index)
+  {
+    if (!mfile)
+      mfile = new c_log_file_map;
+
+    current_timestamp_index = index;
+    current_record_index = 0;
+    string fname = path + "/" + prefix + get_time_str(time_stamps[index]);
+    cout << "Mapping " << fname << endl;
+    return mfile->open(fname, get_idx_fname(time_stamps[index]));
+  }
+
+  // makes current_record_index point a valid record, mapping following files
+  // if the current one is exhausted. returns false if no record remains.
+  bool map_valid_record()
+  {
+    while (current_record_index >= mfile->get_num_records())
+    {
+      if (current_timestamp_index + 1 >= (int)time_stamps.size())
+        return false;
+      map_file(current_timestamp_index + 1);
+    }
+    current_timestamp = mfile->get_time(current_record_index);
+    return true;
+  }
+
   const char *get_time_str(const long long t)
   {
     snprintf(time_str, 32, "_%lld.log", t);
@@ -143,13 +979,26 @@ private:
 public:
   c_log() : path(), prefix(), size_max(0), total_size(0),
             bread(false), current_timestamp_index(-1), current_timestamp(-1),
-            ifile(nullptr), ofile(nullptr)
+            ifile(nullptr), ofile(nullptr), bmmap(false), mfile(nullptr),
+            current_record_index(0), basync(false), size_ring(1 << 22),
+            intvl_sync(1000), bblock(false), num_drops(0), num_stalls(0),
+            num_drops_par(0), num_stalls_par(0),
+            size_ring_used_max(0), ring(nullptr), ring_mask(0), ring_head(0),
+            ring_tail(0), wthread(nullptr), bwactive(false), num_push_waits(0),
+            ofd(-1), bofd_failed(false),
+            wtimestamp(-1), batch(nullptr), size_batch(0), num_batch(0),
+            num_batch_recs(0),
+            bcomp(false), num_block_recs(256), level_comp(Z_BEST_SPEED)
   {
+    memset(&block_hdr, 0, sizeof(block_hdr));
   }
 
   ~c_log()
   {
+    stop_async();
+
     if (ofile){
+      flush_block();
       if(current_timestamp > 0)
 	open_new_write_file(current_timestamp + 1);
       delete ofile;
@@ -157,15 +1006,23 @@ public:
 
     if (ifile)
       delete ifile;
+
+    if (mfile)
+      delete mfile;
   }
 
+  // _bmmap enables memory mapped read mode. (only for _bread = true)
+  // In the mode, the log files are mapped in memory and indexed by time,
+  // then seek() and read_span() can be used.
   bool init(const string _path, const string _prefix,
-            bool _bread = false, const unsigned int _size_max = (1 << 30))
+            bool _bread = false, const unsigned int _size_max = (1 << 30),
+            const bool _bmmap = false)
   {
     path = _path;
     prefix = _prefix;
     size_max = _size_max;
     bread = _bread;
+    bmmap = _bmmap;
 
     string rstr(prefix);
     rstr += "_[0-9]+.log";
@@ -184,9 +1041,20 @@ public:
           unsigned int end_pos = fname.find(".log");
           long long t = atoll(fname.substr(start_pos, end_pos).c_str());
           time_stamps.push_back(t);
+          // block compressed files are read through c_log_file_map
+          if (!bmmap && c_log_file_map::is_block_file(p.path().string()))
+          {
+            cout << "Block compressed log found, memory mapped read mode is used." << endl;
+            bmmap = true;
+          }
         }
       }
     }
+    else if (basync)
+    {
+      if (!start_async())
+        return false;
+    }
     sort(time_stamps.begin(), time_stamps.end());
     cout << "Log Data " << rstr << endl;
     int index = 0;
@@ -201,10 +1069,50 @@ public:
   bool is_replay(){
     return bread;
   }
-  
+
+  // configures asynchronous write mode. should be called before init().
+  void set_async(const bool _basync, const unsigned int _size_ring = (1 << 22),
+                 const int _intvl_sync = 1000, const bool _bblock = false)
+  {
+    basync = _basync;
+    size_ring = _size_ring;
+    intvl_sync = _intvl_sync;
+    bblock = _bblock;
+  }
+
+  // configures block compressed write mode. should be called before init().
+  // The log files written in the mode can be read by c_log in read mode
+  // regardless of the setting.
+  void set_comp(const bool _bcomp, const unsigned int _num_block_recs = 256,
+                const int _level_comp = Z_BEST_SPEED)
+  {
+    bcomp = _bcomp;
+    num_block_recs = _num_block_recs;
+    level_comp = _level_comp;
+  }
+
+  const unsigned long long get_num_drops()
+  {
+    return num_drops.load();
+  }
+
+  const unsigned long long get_num_stalls()
+  {
+    return num_stalls.load();
+  }
+
+  // copies the counters to the variables registered as filter parameters.
+  void update_par_stats()
+  {
+    num_drops_par = num_drops.load();
+    num_stalls_par = num_stalls.load();
+  }
+
   void destroy()
   {
+    stop_async();
     if (ofile){
+      flush_block();
       if(current_timestamp > 0)
 	open_new_write_file(current_timestamp + 1);
       delete ofile;
@@ -213,6 +1121,9 @@ public:
     if (ifile)
       delete ifile;
     ifile = nullptr;
+    if (mfile)
+      delete mfile;
+    mfile = nullptr;
 
     current_timestamp_index = -1;
     current_timestamp = -1;
@@ -233,6 +1144,37 @@ public:
     if (bread)
       return false;
 
+    if (wthread)
+    {
+      if (!push_ring(t, buf, buf_size))
+        return false;
+      current_timestamp = t;
+      return true;
+    }
+
+    if (bcomp)
+    {
+      const unsigned int sz_rec = sizeof(t) + sizeof(buf_size) + buf_size;
+      if (!ofile || total_size + block_raw.size() + sz_rec > size_max)
+      {
+        if (ofile)
+          flush_block();
+        if (!open_new_file(t))
+          return false;
+      }
+
+      size_t ofs = block_raw.size();
+      block_raw.resize(ofs + sz_rec);
+      memcpy(block_raw.data() + ofs, &t, sizeof(t));
+      memcpy(block_raw.data() + ofs + sizeof(t), &buf_size, sizeof(buf_size));
+      memcpy(block_raw.data() + ofs + sizeof(t) + sizeof(buf_size), buf, buf_size);
+      add_block_record(t);
+      if (block_hdr.num_recs >= num_block_recs)
+        flush_block();
+      current_timestamp = t;
+      return true;
+    }
+
     if (!ofile ||
         (total_size + buf_size + sizeof(t) + sizeof(buf_size) > size_max))
     {
@@ -250,6 +1192,57 @@ public:
     return true;
   }
 
+  // seek moves the read position to the first record at t or later.
+  // (only for memory mapped read mode)
+  bool seek(const long long t)
+  {
+    if (!bread || !bmmap || time_stamps.empty())
+      return false;
+
+    if (!map_file(get_time_index(t)))
+      return false;
+
+    current_record_index = mfile->find(t);
+    return map_valid_record();
+  }
+
+  // read_span returns the record at t or earlier as the pointer to the
+  // mapped region without copying. The pointer is valid until the next
+  // read_span(), read(), seek() or destroy() call. (only for memory mapped
+  // read mode)
+  bool read_span(long long &t, const unsigned char *&buf,
+                 unsigned int &buf_size)
+  {
+    buf = nullptr;
+    buf_size = 0;
+    if (!bread || !bmmap)
+      return false;
+
+    if (current_timestamp_index == -1)
+    {
+      if (!seek(t))
+        return false;
+    }
+
+    // the position is advanced lazily so that the span returned by the
+    // previous call is not unmapped before this call.
+    if (!map_valid_record())
+      return false;
+
+    if (current_timestamp <= t)
+    {
+      buf = mfile->get_data(current_record_index, buf_size);
+      t = current_timestamp;
+      current_record_index++;
+    }
+    return true;
+  }
+
+  // read returns the next record if its time stamp is t or earlier, setting
+  // t to the record's time stamp. Otherwise buf_size is set to zero. In the
+  // memory mapped read mode, the first call starts at the first record with
+  // time stamp t or later (see seek()), while the stream mode starts at the
+  // head of the file containing t.
   bool read(long long &t, unsigned char *buf, unsigned int &buf_size)
   {
     if (!bread)
@@ -257,6 +1250,16 @@ public:
       return false;
     }
 
+    if (bmmap)
+    {
+      const unsigned char *p;
+      if (!read_span(t, p, buf_size))
+        return false;
+      if (buf_size)
+        memcpy(buf, p, buf_size);
+      return true;
+    }
+
     if (current_timestamp_index == -1)
     {
       if (!open_read_file(t))
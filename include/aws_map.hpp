@@ -17,7 +17,12 @@
 #define GR 1.61803398875 // golden ratio
 #define _AWS_MAP_DEBUG
 
+#include <atomic>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 #include "aws_png.hpp"
+#include "aws_thread.hpp"
 
 namespace AWSMap2 {  
   
@@ -220,7 +225,7 @@ namespace AWSMap2 {
     if (d1 < r2)
       return true;
     
-    double d2 = l2Norm2(v1, s);
+    double d2 = l2Norm2(v2, s);
     if (d2 < r2)
       return true;
     
@@ -250,8 +255,6 @@ namespace AWSMap2 {
     double invn02 = 1.0 / n02;
     vec3 d02 = (v2 - v0) * invn02;
     double t02 = dot(d02, s - v0);
-    d02 *= t02;
-    d02 += v0;
     if (t02 > 0.f && t02 < n02) {
       if (binside) // s is projected on both edge 01 and 02
 	return true;
@@ -267,8 +270,6 @@ namespace AWSMap2 {
     double invn12 = 1.0 / n12;
     vec3 d12 = (v2 - v1) * invn12;
     double t12 = dot(d12, s - v1);
-    d12 *= t12;
-    d12 += v1;
     if (t12 > 0.f && t12 < n12) {
       d12 *= t12;
       d12 += v1;
@@ -331,6 +332,178 @@ namespace AWSMap2 {
     return true;
   }
 
+  // Vertices of four triangles in SoA layout, used to test the four
+  // downlinks of a node (or the top level nodes four at a time) at once.
+  struct s_tri4{
+    double x[3][4], y[3][4], z[3][4]; // [vertex][triangle]
+
+    void set(const int itri, const vec3 & v0, const vec3 & v1,
+	     const vec3 & v2)
+    {
+      x[0][itri] = v0.x; y[0][itri] = v0.y; z[0][itri] = v0.z;
+      x[1][itri] = v1.x; y[1][itri] = v1.y; z[1][itri] = v1.z;
+      x[2][itri] = v2.x; y[2][itri] = v2.y; z[2][itri] = v2.z;
+    }
+
+    vec3 get(const int itri, const int ivtx) const
+    {
+      return vec3(x[ivtx][itri], y[ivtx][itri], z[ivtx][itri]);
+    }
+  };
+
+#if defined(__AVX__)
+  inline __m256d dot_pd(const __m256d ax, const __m256d ay, const __m256d az,
+			const __m256d bx, const __m256d by, const __m256d bz)
+  {
+    return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ax, bx),
+				       _mm256_mul_pd(ay, by)),
+			 _mm256_mul_pd(az, bz));
+  }
+
+  inline __m256d l2norm2_pd(const __m256d dx, const __m256d dy,
+			    const __m256d dz)
+  {
+    return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+				       _mm256_mul_pd(dy, dy)),
+			 _mm256_mul_pd(dz, dz));
+  }
+
+  // the edge (a, b) part of det_collision_tri_and_sphere. "on" is asserted
+  // if s projects on the edge, "near" is asserted if the projected point is
+  // within the sphere.
+  inline void det_collision_edge4_and_sphere(const __m256d ax, const __m256d ay,
+					     const __m256d az, const __m256d bx,
+					     const __m256d by, const __m256d bz,
+					     const __m256d sx, const __m256d sy,
+					     const __m256d sz, const __m256d r2,
+					     __m256d & on, __m256d & near)
+  {
+    __m256d ex = _mm256_sub_pd(bx, ax), ey = _mm256_sub_pd(by, ay),
+      ez = _mm256_sub_pd(bz, az);
+    __m256d n = _mm256_sqrt_pd(l2norm2_pd(ex, ey, ez));
+    __m256d invn = _mm256_div_pd(_mm256_set1_pd(1.0), n);
+    ex = _mm256_mul_pd(ex, invn);
+    ey = _mm256_mul_pd(ey, invn);
+    ez = _mm256_mul_pd(ez, invn);
+    __m256d t = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ex, _mm256_sub_pd(sx, ax)),
+					    _mm256_mul_pd(ey, _mm256_sub_pd(sy, ay))),
+			      _mm256_mul_pd(ez, _mm256_sub_pd(sz, az)));
+    on = _mm256_and_pd(_mm256_cmp_pd(t, _mm256_setzero_pd(), _CMP_GT_OQ),
+		       _mm256_cmp_pd(t, n, _CMP_LT_OQ));
+    __m256d px = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(ex, t), ax), sx);
+    __m256d py = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(ey, t), ay), sy);
+    __m256d pz = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(ez, t), az), sz);
+    near = _mm256_and_pd(on, _mm256_cmp_pd(l2norm2_pd(px, py, pz), r2,
+					   _CMP_LT_OQ));
+  }
+#endif
+
+  // det_collision_tri_and_sphere for four triangles. Returns the bit mask
+  // of the triangles colliding with the sphere (bit i for triangle i).
+  inline unsigned int det_collision_tri4_and_sphere(const s_tri4 & tri,
+						    const vec3 & s,
+						    const float r2)
+  {
+#if defined(__AVX__)
+    const __m256d sx = _mm256_set1_pd(s.x), sy = _mm256_set1_pd(s.y),
+      sz = _mm256_set1_pd(s.z), vr2 = _mm256_set1_pd(r2),
+      be2 = _mm256_set1_pd(BE * BE);
+    __m256d vx[3], vy[3], vz[3], d[3];
+    for (int i = 0; i < 3; i++) {
+      vx[i] = _mm256_loadu_pd(tri.x[i]);
+      vy[i] = _mm256_loadu_pd(tri.y[i]);
+      vz[i] = _mm256_loadu_pd(tri.z[i]);
+      d[i] = l2norm2_pd(_mm256_sub_pd(vx[i], sx), _mm256_sub_pd(vy[i], sy),
+			_mm256_sub_pd(vz[i], sz));
+    }
+
+    // a vertex is in the sphere
+    __m256d hit = _mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(d[0], vr2, _CMP_LT_OQ),
+					    _mm256_cmp_pd(d[1], vr2, _CMP_LT_OQ)),
+			       _mm256_cmp_pd(d[2], vr2, _CMP_LT_OQ));
+    // all the vertices are far from the sphere
+    __m256d far = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(d[0], be2, _CMP_GT_OQ),
+					      _mm256_cmp_pd(d[1], be2, _CMP_GT_OQ)),
+				_mm256_cmp_pd(d[2], be2, _CMP_GT_OQ));
+    
+    __m256d on01, near01, on02, near02, on12, near12;
+    det_collision_edge4_and_sphere(vx[0], vy[0], vz[0], vx[1], vy[1], vz[1],
+				   sx, sy, sz, vr2, on01, near01);
+    det_collision_edge4_and_sphere(vx[0], vy[0], vz[0], vx[2], vy[2], vz[2],
+				   sx, sy, sz, vr2, on02, near02);
+    det_collision_edge4_and_sphere(vx[1], vy[1], vz[1], vx[2], vy[2], vz[2],
+				   sx, sy, sz, vr2, on12, near12);
+    __m256d edge = _mm256_or_pd(_mm256_or_pd(near01, near02),
+				_mm256_or_pd(near12, _mm256_and_pd(on01, on02)));
+    hit = _mm256_or_pd(hit, _mm256_andnot_pd(far, edge));
+    return (unsigned int) _mm256_movemask_pd(hit);
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < 4; i++) {
+      if (det_collision_tri_and_sphere(tri.get(i, 0), tri.get(i, 1),
+				       tri.get(i, 2), s, r2))
+	mask |= (1 << i);
+    }
+    return mask;
+#endif
+  }
+
+  // det_collision for four triangles (t2, t1, t0) = (vertex 0, 1, 2) and
+  // the line from the origin to l1. Returns the bit mask of the triangles
+  // colliding with the line.
+  inline unsigned int det_collision_tri4(const s_tri4 & tri, const vec3 & l1,
+					 const double err = 0)
+  {
+#if defined(__AVX__)
+    __m256d vx[3], vy[3], vz[3];
+    for (int i = 0; i < 3; i++) {
+      vx[i] = _mm256_loadu_pd(tri.x[i]);
+      vy[i] = _mm256_loadu_pd(tri.y[i]);
+      vz[i] = _mm256_loadu_pd(tri.z[i]);
+    }
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d e1x = _mm256_sub_pd(vx[1], vx[2]), e1y = _mm256_sub_pd(vy[1], vy[2]),
+      e1z = _mm256_sub_pd(vz[1], vz[2]);
+    __m256d e2x = _mm256_sub_pd(vx[0], vx[2]), e2y = _mm256_sub_pd(vy[0], vy[2]),
+      e2z = _mm256_sub_pd(vz[0], vz[2]);
+    __m256d me3x = _mm256_set1_pd(-l1.x), me3y = _mm256_set1_pd(-l1.y),
+      me3z = _mm256_set1_pd(-l1.z);
+    __m256d e4x = _mm256_sub_pd(zero, vx[2]), e4y = _mm256_sub_pd(zero, vy[2]),
+      e4z = _mm256_sub_pd(zero, vz[2]);
+
+    // the determinants are given as scalar triple products sharing
+    // the cross products p = e2 x me3 and q = e4 x e1.
+    __m256d px = _mm256_sub_pd(_mm256_mul_pd(e2y, me3z), _mm256_mul_pd(e2z, me3y));
+    __m256d py = _mm256_sub_pd(_mm256_mul_pd(e2z, me3x), _mm256_mul_pd(e2x, me3z));
+    __m256d pz = _mm256_sub_pd(_mm256_mul_pd(e2x, me3y), _mm256_mul_pd(e2y, me3x));
+    __m256d qx = _mm256_sub_pd(_mm256_mul_pd(e4y, e1z), _mm256_mul_pd(e4z, e1y));
+    __m256d qy = _mm256_sub_pd(_mm256_mul_pd(e4z, e1x), _mm256_mul_pd(e4x, e1z));
+    __m256d qz = _mm256_sub_pd(_mm256_mul_pd(e4x, e1y), _mm256_mul_pd(e4y, e1x));
+    __m256d invD = _mm256_div_pd(_mm256_set1_pd(1.0),
+				 dot_pd(e1x, e1y, e1z, px, py, pz));
+    __m256d u = _mm256_mul_pd(dot_pd(e4x, e4y, e4z, px, py, pz), invD);
+    __m256d v = _mm256_mul_pd(dot_pd(qx, qy, qz, me3x, me3y, me3z),
+			      _mm256_sub_pd(zero, invD));
+    __m256d t = _mm256_mul_pd(dot_pd(e2x, e2y, e2z, qx, qy, qz), invD);
+    const __m256d lo = _mm256_set1_pd(-err), hi = _mm256_set1_pd(1. + err);
+    __m256d in = _mm256_and_pd(_mm256_cmp_pd(u, lo, _CMP_GE_OQ),
+			       _mm256_cmp_pd(u, hi, _CMP_LE_OQ));
+    in = _mm256_and_pd(in, _mm256_cmp_pd(v, lo, _CMP_GE_OQ));
+    in = _mm256_and_pd(in, _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+    in = _mm256_and_pd(in, _mm256_cmp_pd(_mm256_add_pd(u, v), hi, _CMP_LE_OQ));
+    in = _mm256_and_pd(in, _mm256_cmp_pd(t, lo, _CMP_GE_OQ));
+    return (unsigned int) _mm256_movemask_pd(in);
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < 4; i++) {
+      if (det_collision(tri.get(i, 0), tri.get(i, 1), tri.get(i, 2), l1,
+			vec3(0, 0, 0), err))
+	mask |= (1 << i);
+    }
+    return mask;
+#endif
+  }
+
   // Projects vector p to the triangle specified with two vectors v0 and v1 originated from ptri.
   // projected point is u * p or s*v0+t*v1+ptri
   inline void proj2tri(double &s, double & t, double & u,
@@ -359,6 +532,8 @@ namespace AWSMap2 {
   class LayerData;
   class LayerDataPtr;
 
+  #include "aws_map_pack.hpp"
+
   // MapDataBase provide access to the databese.
   // The nodes and their data is casched so that the total size is kept
   // less than their limits given. (The data least recently used is basically
@@ -380,7 +555,12 @@ namespace AWSMap2 {
   // If you need to modify the layer data, first erase the data, and then
   // insert newly created updated layer data.
 
-  // 
+  // Concurrency:
+  // "request" for layer data can be called from multiple threads at a time.
+  // Other methods, including "request" for node profiles that may create
+  // nodes, take the database exclusively. While reading, missing nodes and
+  // layer data are loaded one at a time, and the cache limits are not
+  // enforced until the next exclusive access (e.g. "restruct").
   class MapDataBase
   {
   private:
@@ -428,9 +608,63 @@ namespace AWSMap2 {
     static void setPath(const char * path);
     
   private:
+    friend class MapPrefetcher;
     Node * pNodes[20];     // 20 triangles of the first icosahedron
-    mutex mtx;
+    s_tri4 triRoots[5];    // triangles of pNodes for batch collision test
+    void setTriRoots();
+    c_rw_mutex mtx;        // shared by readers, exclusive for the others
+    static thread_local bool breading;
+    static thread_local bool bprefetching;
+
+    // cache hits and misses of the nodes and layer data in "request".
+    // The loads by MapPrefetcher are counted as numPrefetched.
+    static atomic<unsigned long long> numHits, numMisses, numPrefetched;
   public:
+    // true while the calling thread is in the shared "request".
+    static bool isReading()
+    {
+      return breading;
+    }
+
+    // count a cache access in "request". bhit is false if the node or
+    // the layer data had to be loaded.
+    static void countAccess(const bool bhit)
+    {
+      if (!breading)
+	return;
+      
+      if (bprefetching) {
+	if (!bhit)
+	  numPrefetched++;
+	return;
+      }
+      
+      if (bhit)
+	numHits++;
+      else
+	numMisses++;
+    }
+
+    static const unsigned long long getNumHits()
+    {
+      return numHits;
+    }
+
+    static const unsigned long long getNumMisses()
+    {
+      return numMisses;
+    }
+
+    static const unsigned long long getNumPrefetched()
+    {
+      return numPrefetched;
+    }
+
+    static void resetCounts()
+    {
+      numHits = numMisses = numPrefetched = 0;
+    }
+    
     MapDataBase();
     virtual ~MapDataBase();
     
@@ -467,6 +701,19 @@ namespace AWSMap2 {
     // is called for the merged layerData to meet the size limit of the
     // layerData.
     bool insert(const LayerData * layerData);
+
+    // Bulk version of insert for importing large layer data (e.g. the
+    // coast lines of a region) into the faces not holding any data yet.
+    // The data is partitioned down to the nodes within the size limit in
+    // parallel by at most nthreads threads (nthreads = 0 for the number
+    // of cores), then the data of each upper node is merged from its four
+    // downlinks and reduced once.
+    // The faces already holding data, and the layer types not supporting
+    // LayerData::partition, are inserted by "insert".
+    // Progress and throughput are printed if bverbose is asserted.
+    bool insertBulk(const LayerData * layerData,
+		    const unsigned int nthreads = 0,
+		    const bool bverbose = false);
     
     // remove the layerData, upperlayer data is recursively reconstructed.
     // layerData in leaf node is only allowed as the argument.
@@ -482,18 +729,82 @@ namespace AWSMap2 {
     // (this method should be called periodically)
     void restruct();
     
-    // save MapDataBase (only the nodes and data updated)
+    // save MapDataBase (only the nodes and data updated), and rebuild
+    // the packs of the faces saved.
     bool save();
+
+    // build the packs of all the faces from the directory tree.
+    bool pack();
+  };
+
+  // MapPrefetcher loads nodes and layer data along the route into the
+  // cache in its own thread, so that the requests on the route hit the
+  // cache (see MapDataBase::getNumHits/getNumMisses).
+  // The route is a polyline, typically the own ship position followed by
+  // the waypoints not yet reached (see ch_map::set_route). Circles of
+  // "width" radius are requested at "width" interval along the route up to
+  // "lookahead" meters, which covers the corridor of 0.87 width each side.
+  class MapPrefetcher
+  {
+  private:
+    MapDataBase * pmdb;
+    list<LayerType> layerTypes;
+    float width, lookahead, resolution;
+    
+    vector<vec3> route;
+    atomic<bool> bupdate, bstop;
+    mutex mtx;
+    condition_variable cv;
+    thread * th;
+    atomic<unsigned long long> numRequests;
+
+    void run();
+  public:
+    MapPrefetcher(MapDataBase * _pmdb);
+    ~MapPrefetcher();
+
+    void setLayerTypes(const list<LayerType> & _layerTypes);
+
+    // width: request radius (m), lookahead: corridor length (m)
+    void setCorridor(const float _width, const float _lookahead,
+		     const float _resolution = 0);
+
+    // give new route, the prefetch of the previous route is abandoned.
+    void setRoute(const list<vec3> & _route);
+
+    bool start();
+    void stop();
+
+    // sample request centers along the route.
+    static void sampleCorridor(const vector<vec3> & route, const float width,
+			       const float lookahead, vector<vec3> & centers);
+
+    // number of requests made for prefetching
+    const unsigned long long getNumRequests()
+    {
+      return numRequests;
+    }
   };
   
   class Node
   {
   private:
-    // Node list for memory management.
+    // Node list for memory management. The list keeps the nodes alive,
+    // and the order of the access is given by tAccess.
     static Node * head, * tail;
+    static recursive_mutex mtxList;
+    
+    // Mutex serializing loads of downlink nodes and layer data
+    static mutex mtxLoad;
+    
+    // Access counter, incremented on every access
+    static atomic<unsigned long long> countAccess;
     
     // Number of nodes in the node list.
-    static unsigned int numNodesAlive;
+    static atomic<unsigned int> numNodesAlive;
+
+    // Number of nodes built by buildLayerData.
+    static atomic<unsigned int> numNodesBuilt;
     
     // Insert newly instantiated node to the node list. 
     static void insert(Node * pNode);
@@ -501,9 +812,12 @@ namespace AWSMap2 {
     // Remove pNode from node list.
     static void pop(Node * pNode);
 
-    // Move pNode to the tail of the node list.
+    // Mark pNode as the most recently used.
     // called when the node is accessed.
-    static void accessed(Node * pNode); 
+    static void accessed(Node * pNode)
+    {
+      pNode->tAccess.store(++countAccess, memory_order_relaxed);
+    }
   public:
     
     // Remove nodes if the limit of  maximum number of nodes are violated.
@@ -512,14 +826,24 @@ namespace AWSMap2 {
 
     // Loads child node.
     static Node * load(Node * pNodeUp, unsigned int idChild);
+
+    // Loads child node from the index given as the stream.
+    static Node * load(Node * pNodeUp, unsigned int idChild, istream & findex);
     
     static const unsigned int getNumNodesAlive()
     {
       return numNodesAlive;
     }
+
+    // number of nodes built by buildLayerData
+    static const unsigned int getNumNodesBuilt()
+    {
+      return numNodesBuilt;
+    }
     
     static const int getMaxLevel()
     {
+      unique_lock<recursive_mutex> lock(mtxList);
       char maxLevel = 0;
       for (Node * pn = head; pn != NULL; pn = pn->next)
 	maxLevel = max((int)pn->level, (int)maxLevel);
@@ -528,16 +852,23 @@ namespace AWSMap2 {
     
   private:
     Node * prev, * next;// link pointers for memory management
+    atomic<unsigned long long> tAccess; // countAccess at the last access
     unsigned char level;
-    int refcount;
+    atomic<int> refcount;
     bool bupdate;		// update flag. asserted when the layerDataList or downLink is updated
     unsigned char id;	// id of the node in the upper node. (0 to 3 for ordinal nodes. 0 to 19 for top level nodes.)
     Node * upLink;		// Up link. NULL for top 20 nodes
     bool bdownLink;		// false until the downLink is created.
-    Node * downLink[4]; // Down link. 
+    atomic<Node*> downLink[4]; // Down link. 
+
+    // getDownLink returns idown-th downlink, loading it if not loaded.
+    Node * getDownLink(unsigned int idown);
     vec2 vtx_blh[3];	// blh coordinte of the node's triangle
     void calc_ecef();
     vec3 vtx_ecef[3];   // ecef coordinate of the node's triangle (calculated automatically in construction phase) 
+    s_tri4 tri_down;    // ecef coordinate of the downlink triangles (calculated with vtx_ecef)
+    void calc_mid_blh(vec2 * vtx_blh_mid);
+    void calc_downlink_ecef();
     vec3 vec_ecef[2];		// vtx_ecef[1] - vtx_ecef[0], vtx_ecef[2] - vtx_ecef[0]
     vec3 vtx_center; 
     
@@ -548,9 +879,6 @@ namespace AWSMap2 {
     // size limit of the layer type. 
     bool createDownLink();
     
-    // getPath(list<unsigned char>) helps getPath(char*, unsigned int) to generate path string to this node.
-    void getPath(list<unsigned char> & path_id);
-
     // reconstruct layer data of given type by merging downlink data.
     // This method is called when 
     void reconstructLayerDataFromDownlink(const LayerType layerType);
@@ -577,6 +905,12 @@ namespace AWSMap2 {
     {
       return bdownLink;
     }
+
+    // true if the node has neither downlinks nor layer data.
+    bool isEmpty()
+    {
+      return !bdownLink && layerDataList.empty();
+    }
     
     // setId(unsigned char) set node index in the upper layer.
     void setId(const unsigned char _id){
@@ -615,6 +949,10 @@ namespace AWSMap2 {
     // getPath(char*, unsigned int) returns the path string
     // the length is less than the specified limit.
     void getPath(char * path, unsigned int maxlen);
+
+    // getPath(list<unsigned char>) returns the ids of the nodes from the
+    // top level to this node. Also used as the key in MapPack.
+    void getPath(list<unsigned char> & path_id);
     
     // save Node data and layer data recursively for all downlinks
     // this function is called only from MapDataBase::save()
@@ -632,6 +970,10 @@ namespace AWSMap2 {
     // Finally, corresponding downlink indices to points are stored in inodes.
     const void collision_downlink(const vector<vec3> & pts, vector<char> & inodes);
 
+    // Determine which downlink nodes collide with the circle, returned as
+    // bit mask (bit i for downlink i). Downlinks need not to be loaded.
+    const unsigned int collision_downlink(const vec3 & center, const float radius);
+
     const float getRadius()
     {
       double d = dot(vec_ecef[0], vec_ecef[1]);
@@ -657,6 +999,11 @@ namespace AWSMap2 {
     void getLayerData(list<list<LayerDataPtr>> & layerData, 
 		      const list<LayerType> & layerType, const vec3 & center,
 		      const float radius, const float resolution = 0);
+
+    // getLayerData for the node already known to collide with the circle.
+    void collectLayerData(list<list<LayerDataPtr>> & layerData, 
+			  const list<LayerType> & layerType, const vec3 & center,
+			  const float radius, const float resolution = 0);
     
     void getNodeProfile(list<vector<vec3>> & tris,
 			list<list<unsigned char>> & paths,
@@ -668,6 +1015,19 @@ namespace AWSMap2 {
     // the function is invoked from LayerData::split, and the split is called from MapDataBase::insert
     // This function recursively call split() and itself so that the size of the layer data does not exceeds its limit.
     bool addLayerData(const LayerData & layerData);
+
+    // buildLayerData builds the subtree of the empty node for the layer
+    // data given (owned by the subtree afterwards), without touching the
+    // node and layer data lists. Nodes exceeding the size limit are split
+    // by LayerData::partition, and their layer data is merged from the
+    // downlinks and reduced. Downlinks are built in their own threads
+    // while depth_parallel > 0. Called from MapDataBase::insertBulk.
+    bool buildLayerData(LayerData * pLayerData,
+			const unsigned int depth_parallel = 0);
+
+    // attachLayerData inserts the nodes and the layer data of the type
+    // built by buildLayerData to the node and layer data lists.
+    void attachLayerData(const LayerType layerType);
     
     // deleteLayerData deletes the layer data given in the argument.
     // The method delete the layer data in the node when the pointer is exatly the same as that given in the argument.
@@ -681,15 +1041,30 @@ namespace AWSMap2 {
   class LayerData
   {
     friend class LayerDataPtr;
+    friend class Node;
     // static section
   private:
     static LayerData * head, * tail;
-    static unsigned int totalSize;
+    static recursive_mutex mtxList;
+    static atomic<unsigned long long> countAccess;
+    static atomic<unsigned int> totalSize;
+    
+    // striped mutexes to decide the deletion of the layer data detached
+    // from its node. (see unref())
+    static mutex mtxRef[16];
+    mutex & getRefMutex() const
+    {
+      return mtxRef[((size_t)this >> 6) & 15];
+    }
   protected:
     static void insert(LayerData * pLayerData);
     static void pop(LayerData * pLayerData);
   public:
-    static void accessed(LayerData * pLayerData);
+    static void accessed(LayerData * pLayerData)
+    {
+      pLayerData->tAccess.store(++countAccess, memory_order_relaxed);
+    }
+    
     static void resize(unsigned int size_diff)
     {
       totalSize += size_diff;
@@ -705,9 +1080,10 @@ namespace AWSMap2 {
     
   protected:
     LayerData * prev, * next;
-    int  refcount;
+    atomic<unsigned long long> tAccess; // countAccess at the last access
+    atomic<int> refcount;
     bool bupdate;
-    bool bactive;
+    atomic<bool> bactive;
     
     Node * pNode;
     
@@ -717,9 +1093,18 @@ namespace AWSMap2 {
       pNode->getPath(path, 2048);
       snprintf(fname, len_max, "%s/%s.dat", path, strLayerType[getLayerType()]);
     }
+
+    // called before writing the file, the pack of the face no longer
+    // has the latest data.
+    void invalidatePack()
+    {
+      list<unsigned char> path_id;
+      pNode->getPath(path_id);
+      MapPack::invalidate(path_id.front());
+    }
     
   public:
-    LayerData() : prev(NULL), next(NULL), pNode(NULL), refcount(0), bupdate(false), bactive(false) {};
+    LayerData() : prev(NULL), next(NULL), tAccess(0), pNode(NULL), refcount(0), bupdate(false), bactive(false) {};
     virtual ~LayerData() {};
     
     void setNode(Node * _pNode) { pNode = _pNode; };
@@ -746,6 +1131,14 @@ namespace AWSMap2 {
     void unlock() {
       refcount--;
     }
+
+    // unlock the layer data referenced by LayerDataPtr, and delete it if
+    // it is the last reference and the node has already gone.
+    static void unref(LayerData * pLayerData);
+
+    // detach the layer data from the node being deleted, and delete it if
+    // not referenced.
+    static void detach(LayerData * pLayerData);
     
     // major interfaces 
     virtual bool save();
@@ -776,11 +1169,21 @@ namespace AWSMap2 {
     // save data to ofile stream.
     virtual bool save(ofstream & ofile) = 0;
     
-    // load data from ifile stream.
-    virtual bool load(ifstream & ifile) = 0;
+    // load data from ifile stream (a file or a record in MapPack).
+    virtual bool load(istream & ifile) = 0;
 
     // split the layer data into nodes given
     virtual bool split(list<Node*> & nodes, Node * pParentNode = NULL) const = 0;
+
+    // partition the layer data into new instances for the nodes given
+    // (parts[i] for nodes[i], NULL if empty), without adding them to the
+    // nodes. Returns false if the layer type does not support it.
+    virtual bool partition(const vector<Node*> & nodes, Node * pParentNode,
+			   vector<LayerData*> & parts) const
+    {
+      return false;
+    }
+    
     // returns clone of the instance
     virtual LayerData * clone() const = 0;
     
@@ -815,22 +1218,30 @@ namespace AWSMap2 {
     
     LayerDataPtr(const LayerDataPtr & ldp) :ptr(ldp.ptr)
     {
-      const_cast<LayerData*>(ptr)->lock();
+      if (ptr)
+	const_cast<LayerData*>(ptr)->lock();
     }
     
     LayerDataPtr(const LayerData * _ptr) :ptr(_ptr)
     {
-      const_cast<LayerData*>(ptr)->lock();
+      if (ptr)
+	const_cast<LayerData*>(ptr)->lock();
     }
     
     ~LayerDataPtr()
     {
-      const_cast<LayerData*>(ptr)->accessed(const_cast<LayerData*>(ptr));
-      const_cast<LayerData*>(ptr)->unlock();
-      if (!const_cast<LayerData*>(ptr)->getNode()) {
-	  const_cast<LayerData*>(ptr)->pop(const_cast<LayerData*>(ptr));
-	  delete ptr;
-      }
+      if (ptr)
+	LayerData::unref(const_cast<LayerData*>(ptr));
+    }
+
+    LayerDataPtr & operator = (const LayerDataPtr & ldp)
+    {
+      if (ldp.ptr)
+	const_cast<LayerData*>(ldp.ptr)->lock();
+      if (ptr)
+	LayerData::unref(const_cast<LayerData*>(ptr));
+      ptr = ldp.ptr;
+      return *this;
     }
     
     const LayerData & operator * () const
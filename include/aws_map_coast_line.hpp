@@ -12,19 +12,113 @@
 
 // You should have received a copy of the GNU General Public License
 // along with aws_map_coast_line.hpp.  If not, see <http://www.gnu.org/licenses/>. 
+
+// SegmentIndex is a bounding volume hierarchy over the line segments in
+// ECEF. The segments are stored in flat arrays in the order of the leaves,
+// then the queries descend the hierarchy instead of scanning all the points.
+class SegmentIndex
+{
+public:
+  // segment from pts[ipt] to pts[ipt + 1] of the line iline.
+  // dist is the distance to the segment, or along the ray for ray().
+  struct s_hit{
+    unsigned int iline, ipt;
+    double dist;
+  };
+  
+private:
+  struct s_bvh_node{
+    vec3 bmin, bmax;    // bounding box
+    unsigned int first; // first segment for leaf, right child for inner node
+    unsigned int num;   // number of segments for leaf, 0 for inner node.
+                        // left child of inner node follows the node.
+  };
+
+  enum {
+    MAX_LEAF_SEGMENTS = 4
+  };
+  
+  vector<double> x0, y0, z0, x1, y1, z1;
+  vector<unsigned int> iline, ipt;
+  vector<s_bvh_node> nodes;
+
+  unsigned int build(vector<unsigned int> & order,
+		     const vector<vec3> & centroids,
+		     const unsigned int first, const unsigned int num);
+  
+  double dist2(const unsigned int iseg, const vec3 & pt) const;
+  
+  static double dist2(const s_bvh_node & node, const vec3 & pt)
+  {
+    double d = 0., t;
+    t = max(max(node.bmin.x - pt.x, pt.x - node.bmax.x), 0.); d += t * t;
+    t = max(max(node.bmin.y - pt.y, pt.y - node.bmax.y), 0.); d += t * t;
+    t = max(max(node.bmin.z - pt.z, pt.z - node.bmax.z), 0.); d += t * t;
+    return d;
+  }
+  
+public:
+  void clear();
+  
+  // add segments of the line pts with id
+  void add(const vector<vec3> & pts, const unsigned int id);
+
+  // build the hierarchy for the segments added
+  void build();
+
+  unsigned int getNumSegments() const
+  {
+    return (unsigned int) iline.size();
+  }
+  
+  // the segment nearest to pt.
+  bool nearest(const vec3 & pt, s_hit & hit) const;
+
+  // the segments within r from pt.
+  void radius(const vec3 & pt, const double r, vector<s_hit> & hits) const;
+
+  // the first segment crossed by the ray from org toward dir up to len.
+  // The ray and the segments are projected to the tangent plane at org.
+  bool ray(const vec3 & org, const vec3 & dir, const double len,
+	   s_hit & hit) const;
+};
+
 class CoastLine : public LayerData
 {
 protected:
-  static const vector<vec3> null_vec_vec3;
-  static const vector<vec2> null_vec_vec2;
+  // A point is the BLH coordinate quantized to int32 (PI / 2^31 rad, about
+  // 9mm step), not relative to the node triangle: lines are loaded before
+  // they belong to a node, and partition, merge and reduce move the points
+  // between the levels, which then copy them unchanged. Delta varints on
+  // disk keep the files as small as node relative offsets would. ECEF
+  // coordinates are calculated when needed, and cached only in the
+  // segment index built on query.
+  struct s_pt {
+    int lat, lon;
+
+    bool operator == (const s_pt & r) const
+    {
+      return lat == r.lat && lon == r.lon;
+    }
     
+    bool operator != (const s_pt & r) const
+    {
+      return !(*this == r);
+    }
+  };
+
+  static s_pt encode(const vec2 & pt);
+  static vec2 decode(const s_pt & pt);
+  static vec3 decode_ecef(const s_pt & pt);
+  
   struct s_line {
-    vector<vec2> pts;
-    vector<vec3> pts_ecef;
+    vector<s_pt> pts;
       
     size_t size() {
-      return sizeof(unsigned int) + (sizeof(vec2) + sizeof(vec3)) * pts.size();
+      return sizeof(unsigned int) + sizeof(s_pt) * pts.size();
     }
+
+    void getECEF(vector<vec3> & pts_ecef) const;
   };
   size_t total_size;
   double dist_min;
@@ -33,7 +127,13 @@ protected:
   vec2 pt_center_blh;
     
   vector<s_line*> lines;
-  void add(list<vec2> & line);
+
+  // segment index built on the first query, and cleared on update.
+  mutable mutex mtxIndex;
+  mutable atomic<bool> bindex;
+  mutable SegmentIndex index;
+  
+  void add(const s_pt * begin, const s_pt * end);
   int try_reduce(int nred);
   void update_properties();
 public:
@@ -44,22 +144,27 @@ public:
   {
     return lines.size();
   }
-    
-  const vector<vec3> & getPointsECEF(unsigned int id) const
-  {
-    if (id >= lines.size())
-      return null_vec_vec3;
-    return lines[id]->pts_ecef;
-  }
-    
-  const vector<vec2> & getPointsBLH(unsigned int id) const
+
+  const unsigned int getNumPoints(unsigned int id) const
   {
     if (id >= lines.size())
-      return null_vec_vec2;
-    return lines[id]->pts;
+      return 0;
+    return (unsigned int)lines[id]->pts.size();
   }
+
+  // points of the line id are decoded to pts.
+  void getPointsECEF(unsigned int id, vector<vec3> & pts) const;
+  void getPointsBLH(unsigned int id, vector<vec2> & pts) const;
     
   bool loadJPJIS(const char * fname);
+
+  // load JPGIS files at once. The files are read, then the lines
+  // (gml:posList) are parsed by nthreads threads (0 for the number of cores).
+  bool loadJPJIS(const list<string> & fnames, const unsigned int nthreads = 0);
+
+  // segment index for nearest, radius and ray queries. Built on the first
+  // call, then shared by the readers.
+  const SegmentIndex & getSegmentIndex() const;
 protected:
   virtual bool _reduce(const size_t sz_lim);
   virtual bool _merge(const LayerData & layerData);
@@ -68,8 +173,10 @@ protected:
 public:
   virtual const LayerType getLayerType() const { return lt_coast_line; };
   virtual bool save(ofstream & ofile);
-  virtual bool load(ifstream & ifile);
+  virtual bool load(istream & ifile);
   virtual bool split(list<Node*> & nodes, Node * pParentNode = NULL) const;
+  virtual bool partition(const vector<Node*> & nodes, Node * pParentNode,
+			 vector<LayerData*> & parts) const;
   virtual LayerData * clone() const;
   virtual size_t size() const;
   virtual float resolution() const;
@@ -25,6 +25,65 @@
 #define DEPTH_MAP_CHANNELS 4
 #define DEPTH_MAP_DEPTH 8
 
+// the bitmap is stored as the blocks of 64x64 pixels. Only the blocks
+// having written pixels are allocated, and the others are read as the
+// unknown points (-1, -1).
+#define DEPTH_MAP_BLOCK_SIZE 64
+#define DEPTH_MAP_BLOCK_SHIFT 6
+#define DEPTH_MAP_BLOCKS_X (DEPTH_MAP_WIDTH / DEPTH_MAP_BLOCK_SIZE)
+#define DEPTH_MAP_BLOCKS_Y (DEPTH_MAP_HEIGHT / DEPTH_MAP_BLOCK_SIZE)
+
+struct s_depth_bmp
+{
+  // a pixel is two shorts, meter and millimeter.
+  static const unsigned int size_of_block =
+    DEPTH_MAP_BLOCK_SIZE * DEPTH_MAP_BLOCK_SIZE * 2;
+  static const short pixel_unknown[2];
+  
+  vector<short*> blocks; // null if the block is not allocated
+
+  s_depth_bmp();
+  s_depth_bmp(const s_depth_bmp & bmp);
+  ~s_depth_bmp();
+  s_depth_bmp & operator = (const s_depth_bmp & bmp);
+  
+  // free all the blocks
+  void release();
+
+  static int get_block_index(const int i, const int j)
+  {
+    return (j >> DEPTH_MAP_BLOCK_SHIFT) * DEPTH_MAP_BLOCKS_X
+      + (i >> DEPTH_MAP_BLOCK_SHIFT);
+  }
+
+  static int get_offset(const int i, const int j)
+  {
+    return ((j & (DEPTH_MAP_BLOCK_SIZE - 1)) * DEPTH_MAP_BLOCK_SIZE
+	    + (i & (DEPTH_MAP_BLOCK_SIZE - 1))) * 2;
+  }
+  
+  // pixel (i, j). pixel_unknown is returned for the pixel not allocated.
+  const short * get(const int i, const int j) const
+  {
+    const short * pb = blocks[get_block_index(i, j)];
+    return pb ? pb + get_offset(i, j) : pixel_unknown;
+  }
+
+  // set pixel (i, j). The block is allocated unless the value is unknown.
+  void set(const int i, const int j, const short m, const short mm);
+  
+  unsigned int get_num_blocks() const;
+  
+  size_t get_data_size() const
+  {
+    return get_num_blocks() * size_of_block * sizeof(short);
+  }
+
+  // blocks are written with per block zlib compression.
+  bool write(ostream & ofile) const;
+  bool read(istream & ifile);
+};
+
 
 // This layer data is for storing depth map as bitmap data.
 // To insert the data into MapDataBase, we need to retrieve information of
@@ -33,7 +92,7 @@
 class Depth: public LayerData
 {
 protected:
-  s_aws_bmp bmp; // depth bitmap (as 4byte integer)
+  s_depth_bmp bmp; // depth bitmap (as 4byte integer)
   
   vec3 vtx[3];   // 3 points form valid triangle area.
   vec3 vec[3];   // corresponding vector
@@ -69,12 +128,12 @@ public:
   };
   
   // save data to ofile stream.
-  virtual bool save();
   virtual bool save(ofstream & ofile);
     
-  // load data from ifile stream.
+  // load data from ifile stream. The bitmap saved as png by the
+  // previous versions is also loaded.
   virtual bool load();
-  virtual bool load(ifstream & ifile);
+  virtual bool load(istream & ifile);
 
   // split the layer data into nodes given
   virtual bool split(list<Node*> & nodes, Node * pParentNode = NULL) const ;
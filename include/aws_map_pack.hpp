@@ -0,0 +1,130 @@
+// Copyright(c) 2020 Yohei Matsumoto, All right reserved.
+
+// aws_map_pack.hpp is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// aws_map_pack.hpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with aws_map_pack.hpp.  If not, see <http://www.gnu.org/licenses/>
+
+// MapPack is the packed tile store of a top level node (face).
+// All the index files and layer data files under "N%02d" directory of the
+// face are packed into a single file "N%02d.pack" at MapDataBase::getPath().
+// The pack is mapped to memory, and Node::load and LayerData::load read
+// the records in place instead of opening files for each node.
+//
+// The directory tree is still the primary storage, Node::save and
+// LayerData::save write there and invalidate the pack of the face.
+// MapDataBase::save rebuilds the packs invalidated.
+//
+// File layout:
+//   s_header, s_entry x num_entries (sorted by key and type), records
+// The key of a node (see getKey()) orders the records depth first, then
+// the records of a subtree are placed contiguously.
+class MapPack
+{
+public:
+  struct s_header{
+    char magic[8];		// "AWSPACK1"
+    unsigned int num_entries;
+    unsigned int reserved;
+  };
+
+  struct s_entry{
+    unsigned long long key;	// node key given by getKey()
+    unsigned int type;		// LayerType of the record. lt_undef for index
+    unsigned int size;		// record size in bytes
+    unsigned long long offset;	// record offset from the top of the file
+  };
+
+  enum {
+    MAX_LEVEL = 29		// the deepest level can be keyed.
+  };
+
+private:
+  static MapPack packs[20];
+  static atomic<unsigned long long> numHits, numMisses;
+  // guards invalidate(), which is called by Node::save from the threads of
+  // MapDataBase::insertBulk.
+  static mutex mtxInvalidate;
+
+  int fd;
+  const char * base;		// mapped address
+  size_t len;			// mapped length
+  const s_entry * entries;
+  unsigned int num_entries;
+  bool bdirty;			// asserted when the face is saved to files
+
+  static void genFileName(char * fname, size_t len_max, unsigned int iface);
+  void unmap();
+
+public:
+  MapPack() : fd(-1), base(NULL), len(0), entries(NULL), num_entries(0),
+	      bdirty(false)
+  {
+  }
+
+  ~MapPack()
+  {
+    unmap();
+  }
+
+  // key of the node given as the path from the face (see Node::getPath()).
+  // Downlink ids are placed from the top bit 2 bits each, and the level
+  // is placed in the lowest 6 bits. Returns false if the node is too deep.
+  static bool getKey(const list<unsigned char> & path_id,
+		     unsigned long long & key);
+
+  // map the pack of the face. returns false if the pack is not found.
+  static bool open(const unsigned int iface);
+
+  // unmap all the packs.
+  static void close();
+
+  // build the pack of the face from the directory tree, and map it.
+  static bool build(const unsigned int iface);
+
+  // unmap and remove the pack of the face, called when the face is saved
+  // to the directory tree. Thread safe, but find() for the face should not
+  // run concurrently.
+  static void invalidate(const unsigned int iface);
+
+  // returns true if the face has been saved after the pack built.
+  static bool isDirty(const unsigned int iface)
+  {
+    return iface < 20 && packs[iface].bdirty;
+  }
+
+  // find the record of type for the node. data points to the mapped record.
+  static bool find(const list<unsigned char> & path_id,
+		   const unsigned int type,
+		   const char * & data, unsigned int & size);
+
+  static const unsigned long long getNumHits()
+  {
+    return numHits;
+  }
+
+  static const unsigned long long getNumMisses()
+  {
+    return numMisses;
+  }
+};
+
+// read only stream buffer on a memory block, used to read records in packs
+// through istream.
+class MemBuf: public streambuf
+{
+public:
+  MemBuf(const char * data, const size_t size)
+  {
+    char * p = const_cast<char*>(data);
+    setg(p, p, p + size);
+  }
+};
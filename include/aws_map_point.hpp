@@ -36,7 +36,7 @@ public:
     
   virtual const LayerType getLayerType() const = 0;     // returns LayerType value.
   virtual bool save(ofstream & ofile) = 0;              // save data to ofile stream.
-  virtual bool load(ifstream & ifile) = 0;              // load data from ifile stream.
+  virtual bool load(istream & ifile) = 0;              // load data from ifile stream.
   virtual bool split(list<Node*> & nodes, Node * pParentNode = NULL) const = 0; // split the layer data into nodes given
   virtual LayerData * clone() const = 0;	// returns clone of the instance
   virtual size_t size() const = 0;		// returns size in memory 
@@ -148,8 +148,46 @@ public:
   
 };
 
+#include "aws_ais_bits.hpp"
 #include "aws_nmea_ais.hpp"
 
+// packs 3 characters of sentence id into an integer, used as switch label
+inline constexpr unsigned int nmea_sid(const char * id)
+{
+  return ((unsigned int)(unsigned char)id[0] << 16) |
+    ((unsigned int)(unsigned char)id[1] << 8) |
+    (unsigned int)(unsigned char)id[2];
+}
+
+// returns payload type of the 3 characters sentence id (talker stripped),
+// Payload_NONE for unsupported sentences. No allocation and no string
+// comparison.
+inline NMEA0183::Payload get_nmea0183_payload(const char * id)
+{
+  switch(nmea_sid(id)){
+  case nmea_sid("GGA"): return NMEA0183::Payload_GGA;
+  case nmea_sid("GSA"): return NMEA0183::Payload_GSA;
+  case nmea_sid("GSV"): return NMEA0183::Payload_GSV;
+  case nmea_sid("RMC"): return NMEA0183::Payload_RMC;
+  case nmea_sid("VTG"): return NMEA0183::Payload_VTG;
+  case nmea_sid("ZDA"): return NMEA0183::Payload_ZDA;
+  case nmea_sid("GLL"): return NMEA0183::Payload_GLL;
+  case nmea_sid("HDT"): return NMEA0183::Payload_HDT;
+  case nmea_sid("HEV"): return NMEA0183::Payload_HEV;
+  case nmea_sid("ROT"): return NMEA0183::Payload_ROT;
+  case nmea_sid("MDA"): return NMEA0183::Payload_MDA;
+  case nmea_sid("WMV"): return NMEA0183::Payload_WMV;
+  case nmea_sid("XDR"): return NMEA0183::Payload_XDR;
+  case nmea_sid("TTM"): return NMEA0183::Payload_TTM;
+  case nmea_sid("DBT"): return NMEA0183::Payload_DBT;
+  case nmea_sid("MTW"): return NMEA0183::Payload_MTW;
+  case nmea_sid("ABK"): return NMEA0183::Payload_ABK;
+  default:
+    break;
+  }
+  return NMEA0183::Payload_NONE;
+}
+
 // nmea decoder class 
 // Usage : Instantiate an object, and call decode method with NMEA string as an argument. 
 // * decode method returns an NMEA data object, the object is allocated in the decoder object.
@@ -157,63 +195,31 @@ public:
 class c_nmea_dec
 {
 protected:
-  struct s_nmea0183_obj{
-    char id[3]; // 3 characters
-    c_nmea_dat * dat;
-    s_nmea0183_obj():dat(nullptr)
-    {
-    }
-    s_nmea0183_obj(const char * id_, c_nmea_dat * dat_):dat(dat_)
-    {
-      id[0] = id_[0];      id[1] = id_[1];      id[2] = id_[2];
-    }
-    s_nmea0183_obj(s_nmea0183_obj && obj)      
-    {
-      dat = obj.dat;
-      obj.dat = nullptr;
-      id[0] = obj.id[0];      id[1] = obj.id[1];      id[2] = obj.id[2];
-    }
-    ~s_nmea0183_obj(){
-      if(dat){
-	delete dat;
-	dat = nullptr;
-      }
-    }
-    
-    bool match(const char * id_){
-      return id[0] == id_[0] && id[1] == id_[1] && id[2] == id_[2];
-    }    
-  };
-  
-  vector<s_nmea0183_obj> nmea0183_objs;
+  // decoder objects indexed by payload type
+  c_nmea_dat * nmea0183_objs[NMEA0183::Payload_MAX + 1];
 
-  c_nmea_dat * create_nmea0183_dat(const char * sentence_id)
+  c_nmea_dat * create_nmea0183_dat(const NMEA0183::Payload type)
   {
-    for(int i = 0; i <= NMEA0183::Payload_MAX; i++){
-      if(string(NMEA0183::EnumNamesPayload()[i]) == string(sentence_id)){
-	switch (i){
-	case NMEA0183::Payload_NONE:break;
-    	case NMEA0183::Payload_GGA:return new c_gga;
-    	case NMEA0183::Payload_GSA:return new c_gsa;
-    	case NMEA0183::Payload_GSV:return new c_gsv;
-    	case NMEA0183::Payload_RMC:return new c_rmc;
-    	case NMEA0183::Payload_VTG:return new c_vtg;
-    	case NMEA0183::Payload_ZDA:return new c_zda;
-    	case NMEA0183::Payload_GLL:return new c_gll;
-    	case NMEA0183::Payload_HDT:return new c_hdt;
-    	case NMEA0183::Payload_HEV:return new c_hev;
-    	case NMEA0183::Payload_ROT:return new c_rot;
-    	case NMEA0183::Payload_MDA:return new c_mda;
-    	case NMEA0183::Payload_WMV:return new c_wmv;
-    	case NMEA0183::Payload_XDR:return new c_xdr;
-    	case NMEA0183::Payload_TTM:return new c_ttm;
-    	case NMEA0183::Payload_DBT:return new c_dbt;
-    	case NMEA0183::Payload_MTW:return new c_mtw;
-    	case NMEA0183::Payload_ABK:return new c_abk;
-	default:
-	  break;
-	}
-      }
+    switch (type){
+    case NMEA0183::Payload_GGA:return new c_gga;
+    case NMEA0183::Payload_GSA:return new c_gsa;
+    case NMEA0183::Payload_GSV:return new c_gsv;
+    case NMEA0183::Payload_RMC:return new c_rmc;
+    case NMEA0183::Payload_VTG:return new c_vtg;
+    case NMEA0183::Payload_ZDA:return new c_zda;
+    case NMEA0183::Payload_GLL:return new c_gll;
+    case NMEA0183::Payload_HDT:return new c_hdt;
+    case NMEA0183::Payload_HEV:return new c_hev;
+    case NMEA0183::Payload_ROT:return new c_rot;
+    case NMEA0183::Payload_MDA:return new c_mda;
+    case NMEA0183::Payload_WMV:return new c_wmv;
+    case NMEA0183::Payload_XDR:return new c_xdr;
+    case NMEA0183::Payload_TTM:return new c_ttm;
+    case NMEA0183::Payload_DBT:return new c_dbt;
+    case NMEA0183::Payload_MTW:return new c_mtw;
+    case NMEA0183::Payload_ABK:return new c_abk;
+    default:
+      break;
     }
 
     return nullptr;
@@ -225,22 +231,38 @@ protected:
 public:
   c_nmea_dec()
   {
+    for(int i = 0; i <= NMEA0183::Payload_MAX; i++)
+      nmea0183_objs[i] = nullptr;
     vdodec.set_vdo();
   }
+
+  c_nmea_dec(const c_nmea_dec &) = delete;
+  c_nmea_dec & operator = (const c_nmea_dec &) = delete;
+  
+  ~c_nmea_dec()
+  {
+    for(int i = 0; i <= NMEA0183::Payload_MAX; i++){
+      if(nmea0183_objs[i])
+	delete nmea0183_objs[i];
+      nmea0183_objs[i] = nullptr;
+    }
+  }
   
   const c_nmea_dat * decode(const char * str, const long long t = -1);
   
   bool add_nmea0183_decoder(const char * sentence_id){
-    c_nmea_dat * dat = create_nmea0183_dat(sentence_id);
-    if(!dat)
+    if(strnlen(sentence_id, 4) != 3)
       return false;
     
-    for (int i = 0; i < nmea0183_objs.size(); i++)
-      if(nmea0183_objs[i].match(sentence_id))
-	return false; // the sentence has already been registered
-  
-    nmea0183_objs.push_back(s_nmea0183_obj(sentence_id, dat));
-    return true;
+    NMEA0183::Payload type = get_nmea0183_payload(sentence_id);
+    if(type == NMEA0183::Payload_NONE)
+      return false;
+    
+    if(nmea0183_objs[type])
+      return false; // the sentence has already been registered
+    
+    nmea0183_objs[type] = create_nmea0183_dat(type);
+    return nmea0183_objs[type] != nullptr;
   }
   
   bool add_nmea0183_vdm_decoder(int message_id)
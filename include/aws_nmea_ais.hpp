@@ -142,7 +142,8 @@ class c_vdm;
 
 struct s_pl{
   s_pl * pnext;
-  char payload[256];
+  char payload[AIS_MAX_PL_CHARS]; // 6bit values, one in a byte
+  unsigned char bits[AIS_BITS_SIZE]; // payload packed by pack()
   int pl_size;
   short fcounts; // number of frangments
   short fnumber; // fragment number
@@ -160,6 +161,13 @@ struct s_pl{
     return  fcounts == fnumber;
   }
   void dearmor(const char * str);
+
+  // packs payload into bits, then returns bits.
+  const unsigned char * pack()
+  {
+    ais_pack6(payload, pl_size, bits);
+    return bits;
+  }
 };
 
 class c_vdm: public c_nmea_dat
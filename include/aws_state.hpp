@@ -5,6 +5,8 @@
 #ifndef AWS_STATE_HPP
 #define AWS_STATE_HPP
 
+#include "aws_time_series.hpp"
+
 
 // this function calculate antenna rotation induced velocity variation
 inline void correct_velocity(const float u, const float v, const float w,
@@ -18,6 +20,66 @@ inline void correct_velocity(const float u, const float v, const float w,
 }
 
 
+// 10hz data resampled in batch (see c_aws1_state::resample_10hz_data).
+// The sample k (k = 0, ..., num - 1) is at t0 + k dt.
+struct s_aws1_10hz_data
+{
+  long long t0, dt;
+  int num;
+  vector<double> lat, lon;
+  vector<double> x, y, z;
+  vector<float> hev;
+  vector<float> u, v, w;
+  vector<float> ucor, vcor, wcor;
+  vector<float> du_dt, dv_dt;
+  vector<float> roll, pitch, yaw;
+  vector<float> dr_dt, dp_dt, dy_dt;
+  vector<float> rev;
+  vector<int> trim;
+  vector<int> eng, rud;
+
+  s_aws1_10hz_data() : t0(-1), dt(0), num(0)
+  {
+  }
+
+  void resize(const int n);
+};
+
+// a 10hz sample adjacent to a batch, used to differentiate the first and
+// the last samples of the batch (see differentiate_10hz_data).
+struct s_aws1_10hz_edge
+{
+  float roll, pitch, yaw;
+  float hev, u, v;
+
+  void get(const s_aws1_10hz_data & d, const int k)
+  {
+    roll = d.roll[k];
+    pitch = d.pitch[k];
+    yaw = d.yaw[k];
+    hev = d.hev[k];
+    u = d.u[k];
+    v = d.v[k];
+  }
+};
+
+// 1hz data resampled in batch (see c_aws1_state::resample_1hz_data)
+struct s_aws1_1hz_data
+{
+  long long t0, dt;
+  int num;
+  vector<float> tmpeng, valt, frate;
+  vector<double> hour;
+  vector<float> wdir, wspd, hmd, tmpa, dwpt, bar;
+  vector<float> depth;
+
+  s_aws1_1hz_data() : t0(-1), dt(0), num(0)
+  {
+  }
+
+  void resize(const int n);
+};
+
 class c_aws1_state;
 class c_aws1_state_sampler
 {
@@ -59,6 +121,11 @@ public:
 
   float xant, yant, zant;
 
+  // the last sample of the previous batch given to differentiate_10hz_data
+  // and its time (-1 if none).
+  s_aws1_10hz_edge prev10hz;
+  long long tprev10hz;
+
   c_aws1_state_sampler(int _size_buf, long long _dt);
 
   ~c_aws1_state_sampler()
@@ -88,87 +155,54 @@ public:
   {
     num1hz = tail1hz = 0;
     num10hz = tail10hz = 0;     
+    tprev10hz = -1;
   }
   
   void sample_10hz_data(c_aws1_state & st);
   void sample_1hz_data(c_aws1_state & st);
+
+  // calculates the derivatives and the corrected velocity of the batch
+  // d, the same as sample_10hz_data does sample by sample. The derivatives
+  // are symmetric differences. The first sample uses the last sample of
+  // the previous batch if d follows it, otherwise it has zero derivatives.
+  // The last sample uses next, the sample following d, if given, otherwise
+  // the backward difference. Then the batches chained have the same
+  // derivatives as the batch covering them.
+  void differentiate_10hz_data(s_aws1_10hz_data & d,
+			       const s_aws1_10hz_edge * next = nullptr);
 };
 
 class c_aws1_state
 {
 private:
   int size_buf;
-  vector<long long> trev;
-  vector<float> rev;
-  vector<int> trim;
-  
-  vector<long long> tgll;
-  vector<double> lat;
-  vector<double> lon;
-  vector<double> x, y, z;
-  
-  vector<long long> tvtg;
-  vector<float> sog;
-  vector<float> cog;
-
   long long tatt_delay;
-  vector<long long> thpr;
-  vector<float> roll;
-  vector<float> pitch;
-  vector<float> yaw;
- 
-  vector<long long> teng;
-  vector<int> eng;
-  
-  vector<long long> trud;
-  vector<int> rud;
-  
-  vector<long long> thev;
-  vector<float> hev;
-  
-  vector<long long> tmda;
-  vector<float> wdir;
-  vector<float> wspd;
-  vector<float> hmd;
-  vector<float> tmpa;
-  vector<float> dwpt;
-  vector<float> bar;
-  
-  vector<long long> tdbt;
-  vector<float> depth;
-  
-  vector<long long> tengd;
-  vector<float> tmpeng;
-  vector<float> valt;
-  vector<float> frate;
-  vector<double> hour;
-  
-  int num_rev, tail_rev;
-  long long trev_max, trev_min;
-  int num_gll, tail_gll;
-  long long tgll_max, tgll_min;
-  int num_vtg, tail_vtg;
-  long long tvtg_max, tvtg_min;
-  int num_hpr, tail_hpr;
-  long long thpr_max, thpr_min;
-  int num_eng, tail_eng;
-  long long teng_max, teng_min;
-  int num_rud, tail_rud;
-  long long trud_max, trud_min;
-  int num_hev, tail_hev;
-  long long thev_max, thev_min;
-  int num_mda, tail_mda;
-  long long tmda_max, tmda_min;
-  int num_dbt, tail_dbt;
-  long long tdbt_max, tdbt_min;
-  int num_engd, tail_engd;
-  long long tengd_max, tengd_min;
-  
-  template <class T> void append(vector<T> & hist, int tail, const T & val)
-  {
-    hist[tail] = val;
-  }
 
+  // histories of the sensor data
+  // engine rev and trim
+  time_series<ts_field<float>, ts_field<int> > hrev;
+  // position (lat, lon) and that in ECEF (x, y, z)
+  time_series<ts_field<double>, ts_field<double>, ts_field<double>,
+	      ts_field<double>, ts_field<double> > hgll;
+  // sog, cog
+  time_series<ts_field<float>, ts_field<float, ts_angle> > hvtg;
+  // roll, pitch, yaw
+  time_series<ts_field<float>, ts_field<float>, ts_field<float, ts_angle> >
+  hhpr;
+  // engine and rudder control
+  time_series<ts_field<int, ts_hold> > heng;
+  time_series<ts_field<int, ts_hold> > hrud;
+  // heave
+  time_series<ts_field<float> > hhev;
+  // wdir, wspd, hmd, tmpa, dwpt, bar
+  time_series<ts_field<float>, ts_field<float>, ts_field<float>,
+	      ts_field<float>, ts_field<float>, ts_field<float> > hmda;
+  // depth
+  time_series<ts_field<float> > hdbt;
+  // tmpeng, valt, frate, hour
+  time_series<ts_field<float>, ts_field<float>, ts_field<float>,
+	      ts_field<double> > hengd;
+  
   bool is_samplable(const long long tmax, const long long tmin, const long long tsample){    
     if(tsample > tmax || tsample < tmin)
       return false;
@@ -190,89 +224,50 @@ private:
       return false;    
     return true;
   }
-  
-  template <class T> void init(vector<T> & hist, const T val)
-  {
-    fill(hist.begin(), hist.end(), val);
-  }
- 
-  void find_sample_index(const vector<long long> & ts, const int tail,
-			 const long long & tsmpl,
-			 int & i0, int & i1)
-  {
-    i1 = tail - 1;
-    if(i1 < 0)
-      i1 += ts.size();
-
-    if(ts[i1] < tsmpl){    // tsmpl is larger than tmax
-      i0 = i1;
-      i1 = size_buf;
-      return;
-    }
 
-    if(ts[tail] > tsmpl){    // tsmpl is less than tmin
-      i0 = -1;
-      i1 = tail;
-      return;
-    }
-      
-    i0 = i1  - 1;
-    if(i0 < 0)
-      i0 += ts.size();    
-      
-    while(i1 != tail){
-      if(ts[i0] <= tsmpl && ts[i1] >= tsmpl)
-	break;
-      i1 -= 1;
-      if(i1 < 0)
-	i1 += ts.size();
-      i0 = i1  - 1;
-      if(i0 < 0)
-	i0 += ts.size();      
-    }
+  c_aws1_state_sampler sampler;
 
-    if(i1 == tail)
-      i0 = i1 = -1;
-    
+  // threads resampling the sensor channels in batch mode, and the minimum
+  // length of the batch resampled in parallel.
+  int num_resample_threads; // 0: hardware concurrency
+  int num_resample_min;
+public:
+  // the time of the next sample at or after t
+  const long long get_10hz_data_samplable_time(const long long t)
+  {
+    return t;
   }
 
-  void calc_sample_coef(const vector<long long> & ts, const long long & tsmpl,
-			const int i0, const int i1,
-			float & alpha, float & ialpha)
+  const long long get_1hz_data_samplable_time(const long long t)
   {
-    double dt_inv = 1.0/(double)(ts[i1] - ts[i0]);
-    alpha = (float)((double)(ts[i1] - tsmpl) * dt_inv);
-    ialpha = 1.0 - alpha;        
+    return t;
   }
 
-  c_aws1_state_sampler sampler;
-public:
-
   bool is_10hz_data_samplable(const long long t)    
   {
     // check if position data is samplable
-    if(!is_samplable(tgll_max, tgll_min, t))
+    if(!hgll.is_samplable(t))
       return false;
     
-    if(!is_samplable(thev_max, thev_min, t))
+    if(!hhev.is_samplable(t))
       return false;
 
     // check if kinetics data is samplable    
-    if(!is_samplable(tvtg_max, tvtg_min, t))
+    if(!hvtg.is_samplable(t))
       return false;
     
-    if(!is_samplable(thpr_max, thpr_min, t + tatt_delay))
+    if(!hhpr.is_samplable(t + tatt_delay))
       return false;
 
     // check if control data is samplable
-    if(teng_min < 0)
+    if(heng.get_tmin() < 0)
       return false;
 
-    if(trud_min < 0)
+    if(hrud.get_tmin() < 0)
       return false;
 
     
-    if(!is_samplable(trev_max, trev_min, t))
+    if(!hrev.is_samplable(t))
       return false;
 
     return true;
@@ -280,19 +275,19 @@ public:
 
   bool is_1hz_data_samplable(const long long t)
   {
-    if(tengd_min > t || tmda_min > t || tdbt_min > t){
+    if(hengd.get_tmin() > t || hmda.get_tmin() > t || hdbt.get_tmin() > t){
       cerr << "1hz data never be samplable." << endl;
       return false;
     }
 	    
-    if(!is_samplable(tengd_max, tengd_min, t))
+    if(!hengd.is_samplable(t))
       return false;
 
     // ehck if environment data is samplable
-    if(!is_samplable(tmda_max, tmda_min, t))
+    if(!hmda.is_samplable(t))
       return false;
 
-    if(!is_samplable(tdbt_max, tdbt_min, t))
+    if(!hdbt.is_samplable(t))
       return false;
     return true;
   }
@@ -335,6 +330,24 @@ public:
 		       float & _dwpt, float & _bar,
 		       float & _depth);
   
+  // batch mode of the sampler for the offline processing. At most n
+  // samples at t0 + k dt (k = 0, 1, ..., dt is the cycle time of the
+  // sampler) are resampled from the histories into d, up to the last
+  // samplable time. The sensor channels are resampled in parallel
+  // for long batches. Returns the number of the samples.
+  int resample_10hz_data(const long long t0, const int n,
+			 s_aws1_10hz_data & d);
+  int resample_1hz_data(const long long t0, const int n,
+			s_aws1_1hz_data & d);
+
+  // sets the number of threads for the batch mode (0: hardware
+  // concurrency), and the minimum batch length resampled in parallel.
+  void set_resample_threads(const int nth, const int nmin = 4096)
+  {
+    num_resample_threads = nth;
+    num_resample_min = nmin;
+  }
+  
   const long long get_time_10hz_data(int idx = 0)
   {
     return sampler.get_time_10hz_data(idx);
@@ -432,27 +445,16 @@ public:
 
   void clear()
   {
-    num_rev = 0; tail_rev = 0; trev_max = -1; trev_min = -1;
-    num_gll = 0; tail_gll = 0; tgll_max = -1; tgll_min = -1;
-    num_vtg = 0; tail_vtg = 0; tvtg_max = -1; tvtg_min = -1;
-    num_hpr = 0; tail_hpr = 0; thpr_max = -1; thpr_min = -1; 
-    num_eng = 0; tail_eng = 0; teng_max = -1; teng_min = -1;
-    num_rud = 0; tail_rud = 0; trud_max = -1; trud_min = -1;
-    num_hev = 0; tail_hev = 0; thev_max = -1; thev_min = -1;
-    num_mda = 0; tail_mda = 0; tmda_max = -1; tmda_min = -1;
-    num_dbt = 0; tail_dbt = 0; tdbt_max = -1; tdbt_min = -1;
-    num_engd = 0; tail_engd = 0; tengd_max = -1; tengd_min = -1;
-    
-    init<long long>(trev, -1);    
-    init<long long>(tgll, -1);
-    init<long long>(tvtg, -1);
-    init<long long>(thpr, -1);
-    init<long long>(teng, -1);
-    init<long long>(trud, -1);
-    init<long long>(thev, -1);
-    init<long long>(tmda, -1);
-    init<long long>(tdbt, -1);
-    init<long long>(tengd, -1);
+    hrev.clear();
+    hgll.clear();
+    hvtg.clear();
+    hhpr.clear();
+    heng.clear();
+    hrud.clear();
+    hhev.clear();
+    hmda.clear();
+    hdbt.clear();
+    hengd.clear();
     sampler.clear();
   }
   
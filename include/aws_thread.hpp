@@ -20,5 +20,459 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <pthread.h>
+
+// c_tick_scheduler wakes threads waiting for clock ticks. Each waiter is
+// registered with the tick count it should wake at, and tick() wakes only
+// the waiters due at the tick, instead of broadcasting to all the threads.
+class c_tick_scheduler
+{
+public:
+  struct s_waiter
+  {
+    std::condition_variable cnd;
+    bool bwait;   // true while registered in the scheduler
+    bool bcancel; // true if the wait is cancelled (sticky until reset())
+    s_waiter() : bwait(false), bcancel(false)
+    {
+    }
+  };
+
+private:
+  std::mutex mtx;
+  long long count_tick;
+  unsigned long long num_wakeups;
+  std::multimap<long long, s_waiter *> waiters; // keyed by the tick to wake
+
+  void wake(std::multimap<long long, s_waiter *>::iterator end)
+  {
+    for (auto itr = waiters.begin(); itr != end; itr++)
+    {
+      itr->second->bwait = false;
+      itr->second->cnd.notify_one();
+      num_wakeups++;
+    }
+    waiters.erase(waiters.begin(), end);
+  }
+
+public:
+  c_tick_scheduler() : count_tick(0), num_wakeups(0)
+  {
+  }
+
+  // blocks the caller until ntick ticks pass. returns false if cancelled.
+  bool wait(s_waiter &w, const long long ntick)
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (w.bcancel)
+      return false;
+    if (ntick <= 0)
+      return true;
+
+    w.bwait = true;
+    auto itr = waiters.insert(std::make_pair(count_tick + ntick, &w));
+    w.cnd.wait(lk, [&w]
+               { return !w.bwait || w.bcancel; });
+    if (w.bwait)
+    { // cancelled before the tick
+      waiters.erase(itr);
+      w.bwait = false;
+    }
+    return !w.bcancel;
+  }
+
+  // cancels the current and following waits of w until reset() is called.
+  void cancel(s_waiter &w)
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    w.bcancel = true;
+    w.cnd.notify_one();
+  }
+
+  void reset(s_waiter &w)
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    w.bcancel = false;
+  }
+
+  // advances tick count and wakes the waiters due.
+  void tick()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    count_tick++;
+    wake(waiters.upper_bound(count_tick));
+  }
+
+  // wakes all the waiters regardless of their ticks.
+  void wake_all()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    wake(waiters.end());
+  }
+
+  const long long get_count_tick()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    return count_tick;
+  }
+
+  const unsigned long long get_num_wakeups()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    return num_wakeups;
+  }
+
+  const size_t get_num_waiters()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    return waiters.size();
+  }
+};
+
+// c_work_stealing_pool executes tasks on a fixed number of worker threads.
+// Tasks pushed are distributed to the workers' queues in round robin. A
+// worker takes tasks from the back of its own queue, and steals from the
+// front of other workers' queues when its queue is empty.
+class c_work_stealing_pool
+{
+public:
+  typedef std::function<void()> task;
+
+private:
+  struct s_worker
+  {
+    std::mutex mtx;
+    std::deque<task> q;
+  };
+
+  std::vector<std::unique_ptr<s_worker>> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex mtx;
+  std::condition_variable cnd;      // signals queued tasks to the workers
+  std::condition_variable cnd_idle; // signals completion of all the tasks
+  bool bactive;
+  int num_queued;  // tasks in the queues
+  int num_pending; // tasks queued or running
+  unsigned int iworker_next;
+
+  std::atomic<unsigned long long> num_execs;
+  std::atomic<unsigned long long> num_steals;
+
+  bool pop(const int iworker, task &t)
+  {
+    {
+      s_worker &w = *workers[iworker];
+      std::lock_guard<std::mutex> lk(w.mtx);
+      if (!w.q.empty())
+      {
+        t = std::move(w.q.back());
+        w.q.pop_back();
+        return true;
+      }
+    }
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+      s_worker &w = *workers[(iworker + i) % workers.size()];
+      std::lock_guard<std::mutex> lk(w.mtx);
+      if (!w.q.empty())
+      {
+        t = std::move(w.q.front());
+        w.q.pop_front();
+        num_steals++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  struct s_waves
+  {
+    std::vector<std::vector<task>> waves;
+    size_t iwave;
+    std::atomic<int> num_running; // tasks not completed in the wave
+    task done;
+  };
+
+  void push_wave(std::shared_ptr<s_waves> w)
+  {
+    while (w->iwave < w->waves.size() && w->waves[w->iwave].empty())
+      w->iwave++;
+
+    if (w->iwave == w->waves.size())
+    {
+      if (w->done)
+        w->done();
+      return;
+    }
+
+    std::vector<task> &tasks = w->waves[w->iwave];
+    w->num_running = (int)tasks.size();
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+      task *t = &tasks[i];
+      push([this, w, t]()
+           {
+             (*t)();
+             if (--w->num_running == 0)
+             {
+               w->iwave++;
+               push_wave(w);
+             } });
+    }
+  }
+
+  void worker(const int iworker)
+  {
+    while (1)
+    {
+      {
+        std::unique_lock<std::mutex> lk(mtx);
+        cnd.wait(lk, [this]
+                 { return num_queued > 0 || !bactive; });
+        if (num_queued == 0)
+          break;
+        num_queued--;
+      }
+
+      task t;
+      while (!pop(iworker, t))
+        std::this_thread::yield(); // pushed but not yet visible in a queue
+      t();
+      num_execs++;
+
+      std::lock_guard<std::mutex> lk(mtx);
+      num_pending--;
+      if (num_pending == 0)
+        cnd_idle.notify_all();
+    }
+  }
+
+public:
+  c_work_stealing_pool() : bactive(false), num_queued(0), num_pending(0),
+                           iworker_next(0), num_execs(0), num_steals(0)
+  {
+  }
+
+  ~c_work_stealing_pool()
+  {
+    stop();
+  }
+
+  // starts num_workers threads. number of cores is used if num_workers <= 0
+  bool start(int num_workers)
+  {
+    if (bactive)
+      return false;
+    if (num_workers <= 0)
+      num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+
+    bactive = true;
+    for (int i = 0; i < num_workers; i++)
+      workers.push_back(std::unique_ptr<s_worker>(new s_worker));
+    for (int i = 0; i < num_workers; i++)
+      threads.push_back(std::thread(&c_work_stealing_pool::worker, this, i));
+    return true;
+  }
+
+  // stops the workers after all the queued tasks are executed.
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (!bactive)
+        return;
+      bactive = false;
+    }
+    cnd.notify_all();
+    for (auto &th : threads)
+      th.join();
+    threads.clear();
+    workers.clear();
+  }
+
+  void push(task t)
+  {
+    unsigned int iworker;
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      iworker = iworker_next++ % workers.size();
+      num_pending++;
+    }
+
+    {
+      s_worker &w = *workers[iworker];
+      std::lock_guard<std::mutex> lk(w.mtx);
+      w.q.push_back(std::move(t));
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      num_queued++;
+    }
+    cnd.notify_one();
+  }
+
+  // pushes waves of tasks. The tasks of a wave run in parallel, and the
+  // next wave is pushed by the last task completed in the previous wave, so
+  // the caller does not wait for the waves. done is called after the last
+  // wave.
+  void push_waves(std::vector<std::vector<task>> waves, task done = task())
+  {
+    std::shared_ptr<s_waves> w(new s_waves);
+    w->waves = std::move(waves);
+    w->iwave = 0;
+    w->done = std::move(done);
+    push_wave(w);
+  }
+
+  // blocks until all the tasks pushed are completed.
+  void wait_idle()
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    cnd_idle.wait(lk, [this]
+                  { return num_pending == 0; });
+  }
+
+  bool is_active()
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    return bactive;
+  }
+
+  const int get_num_workers()
+  {
+    return (int)threads.size();
+  }
+
+  const unsigned long long get_num_execs()
+  {
+    return num_execs;
+  }
+
+  const unsigned long long get_num_steals()
+  {
+    return num_steals;
+  }
+};
+
+// calc_wave_levels assigns each node of a graph, given as the successors of
+// the nodes, its wave, the longest path from the sources (Kahn's
+// algorithm). Nodes in loops cannot be ordered, and are given the wave
+// after the last. Returns the number of the nodes in loops.
+inline int calc_wave_levels(const std::vector<std::vector<int>> &succ,
+                            std::vector<int> &level)
+{
+  int n = (int)succ.size();
+  std::vector<int> indeg(n, 0);
+  for (int i = 0; i < n; i++)
+    for (auto j : succ[i])
+      indeg[j]++;
+
+  level.assign(n, 0);
+  std::deque<int> q;
+  for (int i = 0; i < n; i++)
+    if (indeg[i] == 0)
+      q.push_back(i);
+
+  int level_max = 0;
+  while (!q.empty())
+  {
+    int i = q.front();
+    q.pop_front();
+    level_max = std::max(level_max, level[i]);
+    for (auto j : succ[i])
+    {
+      level[j] = std::max(level[j], level[i] + 1);
+      if (--indeg[j] == 0)
+        q.push_back(j);
+    }
+  }
+
+  int num_loops = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (indeg[i] > 0)
+    {
+      level[i] = level_max + 1;
+      num_loops++;
+    }
+  }
+  return num_loops;
+}
+
+// c_rw_mutex is a reader/writer mutex preferring writers. lock()/unlock()
+// take exclusive ownership and can be used with std::unique_lock, and
+// lock_shared()/unlock_shared() are for readers (see c_shared_lock).
+class c_rw_mutex
+{
+private:
+  pthread_rwlock_t rwl;
+
+public:
+  c_rw_mutex()
+  {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&rwl, &attr);
+    pthread_rwlockattr_destroy(&attr);
+  }
+
+  ~c_rw_mutex()
+  {
+    pthread_rwlock_destroy(&rwl);
+  }
+
+  c_rw_mutex(const c_rw_mutex &) = delete;
+  c_rw_mutex &operator=(const c_rw_mutex &) = delete;
+
+  void lock()
+  {
+    pthread_rwlock_wrlock(&rwl);
+  }
+
+  void unlock()
+  {
+    pthread_rwlock_unlock(&rwl);
+  }
+
+  void lock_shared()
+  {
+    pthread_rwlock_rdlock(&rwl);
+  }
+
+  void unlock_shared()
+  {
+    pthread_rwlock_unlock(&rwl);
+  }
+};
+
+class c_shared_lock
+{
+private:
+  c_rw_mutex &mtx;
+
+public:
+  c_shared_lock(c_rw_mutex &_mtx) : mtx(_mtx)
+  {
+    mtx.lock_shared();
+  }
+
+  ~c_shared_lock()
+  {
+    mtx.unlock_shared();
+  }
+};
 
 #endif
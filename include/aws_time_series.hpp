@@ -0,0 +1,425 @@
+// Copyright(c) 2021 Yohei Matsumoto, All right reserved.
+
+// aws_time_series.hpp is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// aws_time_series.hpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with aws_time_series.hpp.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AWS_TIME_SERIES_HPP
+#define AWS_TIME_SERIES_HPP
+
+// Ring buffer of the time stamped sensor data. time_series<Fields...>
+// holds the time stamps and the fields in separate arrays (SoA). Each
+// field is given as ts_field<type, policy>, and the policy decides how the
+// field is interpolated in sampling:
+//   ts_linear  linear interpolation (default)
+//   ts_angle   interpolation of angles in radian
+//   ts_hold    the value of the sample before the time
+// e.g. time_series<ts_field<float>, ts_field<float, ts_angle> > for
+// speed and course.
+// The time stamps and each field are allocated at cache line boundaries
+// (ts_column), so a column never shares its first line with another.
+
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <vector>
+#include <tuple>
+
+#include "aws_math.hpp"
+
+struct ts_linear
+{
+  template <class T> static T interpolate(const T v0, const T v1,
+					  const float alpha, const float ialpha)
+  {
+    return (T)(v0 * alpha + v1 * ialpha);
+  }
+};
+
+struct ts_angle
+{
+  static float interpolate(const float v0, const float v1,
+			   const float alpha, const float ialpha)
+  {
+    return interpolate_angle_rad(v0, v1, alpha, ialpha);
+  }
+};
+
+struct ts_hold
+{
+  template <class T> static T interpolate(const T v0, const T v1,
+					  const float alpha, const float ialpha)
+  {
+    return v0;
+  }
+};
+
+// allocator of the columns aligned to Align bytes
+template <class T, std::size_t Align = 64> struct ts_aligned_allocator
+{
+  typedef T value_type;
+  template <class U> struct rebind
+  {
+    typedef ts_aligned_allocator<U, Align> other;
+  };
+
+  ts_aligned_allocator()
+  {
+  }
+
+  template <class U>
+  ts_aligned_allocator(const ts_aligned_allocator<U, Align> &)
+  {
+  }
+
+  T * allocate(const std::size_t n)
+  {
+    void * p = NULL;
+    if(posix_memalign(&p, Align, n * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return (T*)p;
+  }
+
+  void deallocate(T * p, const std::size_t)
+  {
+    free(p);
+  }
+};
+
+template <class T, class U, std::size_t Align>
+bool operator==(const ts_aligned_allocator<T, Align> &,
+		const ts_aligned_allocator<U, Align> &)
+{
+  return true;
+}
+
+template <class T, class U, std::size_t Align>
+bool operator!=(const ts_aligned_allocator<T, Align> &,
+		const ts_aligned_allocator<U, Align> &)
+{
+  return false;
+}
+
+template <class T> using ts_column = std::vector<T, ts_aligned_allocator<T> >;
+
+template <class T, class Interp = ts_linear> struct ts_field
+{
+  typedef T type;
+  typedef Interp interp;
+};
+
+// time stamps and the state of the ring, independent of the fields.
+class time_series_base
+{
+protected:
+  int size_buf;
+  int num, tail;
+  long long tmax, tmin;
+  int cursor; // i1 found last time (see find_sample_index)
+  ts_column<long long> ts;
+
+  // push the time stamp at tail, returns false if t is older than
+  // the latest.
+  bool push(const long long t)
+  {
+    if(t < tmax)
+      return false;
+    tmax = t;
+    ts[tail] = t;
+    return true;
+  }
+
+  // advance tail after the fields are written
+  void advance()
+  {
+    tail = (tail + 1) % size_buf;
+    if(num < size_buf){
+      tmin = ts[0];
+      num++;
+    }else
+      tmin = ts[tail];
+  }
+
+public:
+  time_series_base(const int _size_buf) : size_buf(_size_buf), ts(_size_buf)
+  {
+    clear();
+  }
+
+  void clear()
+  {
+    num = tail = 0;
+    tmax = tmin = -1;
+    cursor = -1;
+    std::fill(ts.begin(), ts.end(), -1);
+  }
+
+  int get_size() const
+  {
+    return size_buf;
+  }
+
+  int get_num() const
+  {
+    return num;
+  }
+
+  int get_tail() const
+  {
+    return tail;
+  }
+
+  long long get_tmax() const
+  {
+    return tmax;
+  }
+
+  long long get_tmin() const
+  {
+    return tmin;
+  }
+
+  const ts_column<long long> & get_times() const
+  {
+    return ts;
+  }
+
+  bool is_samplable(const long long tsmpl) const
+  {
+    return tsmpl <= tmax && tsmpl >= tmin;
+  }
+
+  // find the samples i0 and i1 bracketing tsmpl in the history ts, the
+  // oldest sample of which is at tail. If tsmpl is larger than the latest,
+  // i0 is the latest and i1 is ts.size(). If tsmpl is less than the
+  // oldest, i0 is -1 and i1 is tail.
+  // Linearized from tail, the history is sorted (unused slots are -1),
+  // then the newest pair is found. The search starts at cursor, the i1
+  // found last time, and steps forward a few samples for the sequential
+  // sampling; otherwise binary search is done.
+  template <class Column>
+  static void find_sample_index(const Column & ts,
+				const int tail, const long long & tsmpl,
+				int & i0, int & i1, int & cursor)
+  {
+    const int n = (int)ts.size();
+    i1 = tail - 1;
+    if(i1 < 0)
+      i1 += n;
+
+    if(ts[i1] < tsmpl){    // tsmpl is larger than tmax
+      i0 = i1;
+      i1 = n;
+      return;
+    }
+
+    if(ts[tail] > tsmpl){    // tsmpl is less than tmin
+      i0 = -1;
+      i1 = tail;
+      return;
+    }
+
+    if(n < 2){
+      i0 = i1 = -1;
+      return;
+    }
+
+    // k is the index from tail
+    auto at = [&ts, tail, n](int k) -> long long
+      {
+	k += tail;
+	return ts[k < n ? k : k - n];
+      };
+
+    int k = -1;
+    if(cursor >= 0 && cursor < n){
+      k = cursor - tail;
+      if(k < 0)
+	k += n;
+      for(int istep = 0; istep < 8 && k > 0 && k < n - 1 && at(k) <= tsmpl;
+	  istep++)
+	k++;
+      if(k <= 0 || at(k - 1) > tsmpl || (k < n - 1 && at(k) <= tsmpl))
+	k = -1;
+    }
+
+    if(k < 0){
+      // the first k in [1, n - 1] with ts > tsmpl, or n - 1.
+      int lo = 1, hi = n - 1;
+      while(lo < hi){
+	int mid = (lo + hi) >> 1;
+	if(at(mid) > tsmpl)
+	  hi = mid;
+	else
+	  lo = mid + 1;
+      }
+      k = lo;
+    }
+
+    i1 = k + tail;
+    if(i1 >= n)
+      i1 -= n;
+    i0 = i1 - 1;
+    if(i0 < 0)
+      i0 += n;
+    cursor = i1;
+  }
+
+  // samples i0, i1 and the weights alpha (of i0), ialpha (of i1) at tsmpl.
+  // Out of the history, the oldest or the latest sample is used.
+  void find(const long long tsmpl, int & i0, int & i1,
+	    float & alpha, float & ialpha)
+  {
+    find_sample_index(ts, tail, tsmpl, i0, i1, cursor);
+    if(i0 < 0 || i1 >= size_buf || ts[i1] == ts[i0]){
+      if(i0 < 0)
+	i0 = i1;
+      else
+	i1 = i0;
+      alpha = 1.0f;
+      ialpha = 0.0f;
+      return;
+    }
+
+    double dt_inv = 1.0 / (double)(ts[i1] - ts[i0]);
+    alpha = (float)((double)(ts[i1] - tsmpl) * dt_inv);
+    ialpha = 1.0 - alpha;
+  }
+};
+
+// index sequence of the fields
+template <int... I> struct ts_seq {};
+template <int N, int... I> struct ts_gen_seq : ts_gen_seq<N - 1, N - 1, I...> {};
+template <int... I> struct ts_gen_seq<0, I...>
+{
+  typedef ts_seq<I...> type;
+};
+
+template <class... Fields>
+class time_series : public time_series_base
+{
+public:
+  template <int I> struct field
+  {
+    typedef typename std::tuple_element<I, std::tuple<Fields...> >::type
+    type;
+  };
+
+private:
+  std::tuple<ts_column<typename Fields::type>...> vals;
+  typedef typename ts_gen_seq<sizeof...(Fields)>::type seq;
+
+  template <int... I> void resize(ts_seq<I...>)
+  {
+    int dummy[] = {0, (std::get<I>(vals).resize(size_buf), 0)...};
+    (void)dummy;
+  }
+
+  template <int... I> void set(ts_seq<I...>, const int i,
+			       const typename Fields::type & ... v)
+  {
+    int dummy[] = {0, (std::get<I>(vals)[i] = v, 0)...};
+    (void)dummy;
+  }
+
+  template <int... I> void interpolate(ts_seq<I...>, const int i0,
+				       const int i1, const float alpha,
+				       const float ialpha,
+				       typename Fields::type & ... v) const
+  {
+    int dummy[] = {0, (v = Fields::interp::interpolate(std::get<I>(vals)[i0],
+						       std::get<I>(vals)[i1],
+						       alpha, ialpha), 0)...};
+    (void)dummy;
+  }
+
+  // a field is resampled at the indices and the weights found.
+  template <int I> void resample_field(const int n, const int * i0,
+				       const int * i1, const float * alpha,
+				       const float * ialpha,
+				       typename field<I>::type::type * v) const
+  {
+    typedef typename field<I>::type::interp interp;
+    const typename field<I>::type::type * src = std::get<I>(vals).data();
+    for(int k = 0; k < n; k++)
+      v[k] = interp::interpolate(src[i0[k]], src[i1[k]], alpha[k], ialpha[k]);
+  }
+
+  template <int... I> void resample(ts_seq<I...>, const int n,
+				    const int * i0, const int * i1,
+				    const float * alpha, const float * ialpha,
+				    typename Fields::type * ... v) const
+  {
+    int dummy[] = {0, (resample_field<I>(n, i0, i1, alpha, ialpha, v), 0)...};
+    (void)dummy;
+  }
+
+public:
+  time_series(const int _size_buf) : time_series_base(_size_buf)
+  {
+    resize(seq());
+  }
+
+  // field I of the history
+  template <int I> ts_column<typename field<I>::type::type> & get()
+  {
+    return std::get<I>(vals);
+  }
+
+  template <int I>
+  const ts_column<typename field<I>::type::type> & get() const
+  {
+    return std::get<I>(vals);
+  }
+
+  // add the sample at t. false is returned if t is older than the latest.
+  bool add(const long long t, const typename Fields::type & ... v)
+  {
+    if(!push(t))
+      return false;
+    set(seq(), tail, v...);
+    advance();
+    return true;
+  }
+
+  // sample the fields at tsmpl
+  void sample(const long long tsmpl, typename Fields::type & ... v)
+  {
+    int i0, i1;
+    float alpha, ialpha;
+    find(tsmpl, i0, i1, alpha, ialpha);
+    interpolate(seq(), i0, i1, alpha, ialpha, v...);
+  }
+
+  // sample the fields at n points of time t0 + k dt (k = 0, ..., n - 1)
+  // into the arrays v. The samples are found first, then each field is
+  // resampled in a loop.
+  void resample(const long long t0, const long long dt, const int n,
+		typename Fields::type * ... v)
+  {
+    i0s.resize(n);
+    i1s.resize(n);
+    alphas.resize(n);
+    ialphas.resize(n);
+    for(int k = 0; k < n; k++)
+      find(t0 + dt * k, i0s[k], i1s[k], alphas[k], ialphas[k]);
+    resample(seq(), n, i0s.data(), i1s.data(), alphas.data(), ialphas.data(),
+	     v...);
+  }
+
+private:
+  // work buffers of resample
+  ts_column<int> i0s, i1s;
+  ts_column<float> alphas, ialphas;
+};
+
+#endif
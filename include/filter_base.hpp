@@ -398,6 +398,38 @@ protected:
     register_fpar_common(name, expl, par);
   }
   
+  // helper function for registering parameters of c_log's asynchronous
+  // and block compressed write modes. Parameter names are prefixed with
+  // name. (e.g. "<name>Async")
+  list<string> m_log_par_names;
+  const char * log_par_name(const char * name, const char * par)
+  {
+    m_log_par_names.push_back(string(name) + par);
+    return m_log_par_names.back().c_str();
+  }
+
+  // logs registered by register_fpar_log(). Their counters are copied to
+  // the parameters in get_par().
+  list<c_log*> m_logs;
+  void update_log_pars()
+  {
+    for(auto log : m_logs)
+      log->update_par_stats();
+  }
+
+  void register_fpar_log(const char * name, c_log * log){
+    m_logs.push_back(log);
+    register_fpar(log_par_name(name, "Async"), &log->basync, "Asynchronous write mode of the log. (y or n, set before run)");
+    register_fpar(log_par_name(name, "RingSize"), &log->size_ring, "Ring buffer size in bytes for asynchronous write mode.");
+    register_fpar(log_par_name(name, "SyncIntvl"), &log->intvl_sync, "Interval of fsync in msec. (0: never)");
+    register_fpar(log_par_name(name, "Block"), &log->bblock, "Block writing if the ring buffer is full, otherwise the record is dropped.");
+    register_fpar(log_par_name(name, "Drops"), &log->num_drops_par, "Number of records dropped.(Read only)");
+    register_fpar(log_par_name(name, "Stalls"), &log->num_stalls_par, "Number of writes blocked by the full ring buffer.(Read only)");
+    register_fpar(log_par_name(name, "RingUsedMax"), &log->size_ring_used_max, "Maximum usage of the ring buffer in bytes.(Read only)");
+    register_fpar(log_par_name(name, "Comp"), &log->bcomp, "Block compressed write mode of the log. (y or n, set before run)");
+    register_fpar(log_par_name(name, "CompRecs"), &log->num_block_recs, "Number of records in a compressed block.");
+  }
+  
   // find parameter index by its name
   int find_par(const char * parstr){
     for(int ipar = 0; ipar < m_pars.size(); ipar++){
@@ -415,6 +447,37 @@ protected:
   // thread body. called with m_fthread
   static void sfthread(f_base * filter);
   void fthread();
+
+  // executes proc() once under the command lock. returns false if proc()
+  // failed.
+  bool fproc();
+
+  // pooled execution mode. The filter has no dedicated thread, and
+  // dispatch_pooled() pushes proc() of the filters due at each tick to the
+  // worker pool. (enabled by c_aws's -workers option)
+  static c_work_stealing_pool * m_pool;
+  static mutex m_mutex_pooled;
+  static list<f_base*> m_filters_pooled; // running filters in pooled mode
+  static atomic<long long> m_count_tick_pooled;
+  atomic<bool> m_bqueued; // proc() is queued or running in the pool
+  long long m_tick_next;  // tick the filter should be dispatched next
+
+  // graph ordered dispatch in pooled mode. Filters are dispatched in waves
+  // of m_graph_level, determined by the channel wiring (m_chin/m_chout),
+  // so that a producer's proc() completes before its consumers' in a tick.
+  // dispatch_waves() runs on the pool, and each wave is pushed on the
+  // completion of the previous one, so the clock thread never waits.
+  static bool m_bgraph;
+  static atomic<bool> m_bgraph_dirty;
+  static atomic<bool> m_bwaves_running; // waves of the last tick not done
+  static atomic<unsigned long long> m_num_ticks_skipped;
+  int m_graph_level;
+  static void build_graph_levels();
+  static void collect_due(const long long tick, vector<f_base*> & due);
+  static void dispatch_waves();
+  void exec_pooled();
+  bool run_pooled();
+  bool stop_pooled();
   
   bool m_bactive; // if it is true, filter thread continues to loop
   
@@ -427,9 +490,10 @@ protected:
   double m_proc_rate; 
 
   
-  // mutex and signal for clocking
+  // mutex for clocking and the scheduler waking filters at their intervals
   static mutex m_mutex;
-  static condition_variable m_cond;
+  static c_tick_scheduler m_sched;
+  c_tick_scheduler::s_waiter m_waiter;
   
   virtual bool init_run()
   {
@@ -451,7 +515,11 @@ public:
     m_cycle = 0;
     m_count_pre = m_count_post = m_count_clock;
     m_start_clock = m_stop_clock = m_count_clock;
+
+    if(m_pool)
+      return run_pooled();
     
+    m_sched.reset(m_waiter);
     unique_lock<mutex> lk(m_mutex_cmd);
     m_fthread = new thread(sfthread, this);
     m_cnd_cmd.wait(lk);
@@ -514,10 +582,10 @@ protected:
   // clock counter
   static long long m_count_clock;
   
-  // wait signal from aws main loop clocked with hardware timer.
-  void clock_wait(){
-    unique_lock<mutex> lock(m_mutex);
-    m_cond.wait(lock);
+  // wait ntick clock signals from aws main loop clocked with hardware timer.
+  // returns false if the wait is cancelled by stop().
+  bool clock_wait(const int ntick){
+    return m_sched.wait(m_waiter, ntick);
   }
   
 public:
@@ -543,9 +611,37 @@ public:
   
   // clock signal issued by c_aws's main loop
   static void clock(long long cur_time);
+  static void set_pool(c_work_stealing_pool * pool, bool bgraph = false)
+  {
+    m_pool = pool;
+    m_bgraph = bgraph;
+    m_bgraph_dirty = true;
+  }
+
+  // notifies the change of channel wiring to the graph ordered dispatch.
+  static void invalidate_graph()
+  {
+    m_bgraph_dirty = true;
+  }
+
+  // pushes the filters due at this tick to the pool. called by c_aws's main
+  // loop after clock() in pooled execution mode.
+  static void dispatch_pooled();
+
+  // ticks skipped because the waves of the previous tick were running.
+  static const unsigned long long get_num_ticks_skipped()
+  {
+    return m_num_ticks_skipped;
+  }
+
   static void send_clock_signal()
   {
-    m_cond.notify_all();
+    m_sched.wake_all();
+  }
+
+  static const unsigned long long get_num_wakeups()
+  {
+    return m_sched.get_num_wakeups();
   }
   
   static void init_run_all(){
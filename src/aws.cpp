@@ -461,7 +461,8 @@ c_aws::c_aws(int argc, char ** argv):CmdAppBase(argc, argv),
 				     m_working_path(nullptr),
 				     m_config_file(nullptr),
 				     m_exit(false),
-				     m_time(0), m_time_zone_minute(540)
+				     m_time(0), m_time_zone_minute(540),
+				     m_num_workers(0), m_bgraph(false)
 {
   set_name_app("aws");
   set_version(1, 00);
@@ -477,6 +478,12 @@ c_aws::c_aws(int argc, char ** argv):CmdAppBase(argc, argv),
      
   add_arg("-tzm", "Time Zone in minutes.");
   add_val(&m_time_zone_minute, "int");
+
+  add_arg("-workers", "Number of worker threads executing filters. (0: a thread per filter (default), negative: number of cores)");
+  add_val(&m_num_workers, "int");
+
+  add_arg("-graph", "Filters on the worker threads are executed in waves ordered by the channel wiring in each cycle. (on|off, default off)");
+  add_val(&m_bgraph, "bool");
   
   // Initializing filter globals
   f_base::init(this);
@@ -763,7 +770,8 @@ bool c_aws::set_fltr_io_chs(const FltrIOChs * lst)
       f->set_ochan(ch);
     }      
   }
-  f->unlock_cmd();    
+  f->unlock_cmd();
+  f_base::invalidate_graph();
   return result;
 }
 
@@ -960,6 +968,12 @@ bool c_aws::main()
   thread server_thread([&](){server->Wait();});
   spdlog::info("Command service started on {}.", server_address);
   
+  if(m_num_workers != 0){
+    m_pool.start(m_num_workers);
+    f_base::set_pool(&m_pool, m_bgraph);
+    spdlog::info("Filters are executed on {} worker threads{}.", m_pool.get_num_workers(), (m_bgraph ? " in channel graph order" : ""));
+  }
+  
   f_base::set_tz(m_time_zone_minute);
   f_base::init_run_all();
   m_start_time = (long long) time(NULL) * SEC; 
@@ -975,6 +989,9 @@ bool c_aws::main()
       
       // sending clock signal to each filter thread. The time string for current time is generated simultaneously
       f_base::clock(m_time);
+
+      if(m_pool.is_active())
+	f_base::dispatch_pooled();
       
       if(m_time > m_end_time){
 	f_base::m_clk.stop();
@@ -985,6 +1002,14 @@ bool c_aws::main()
 
   server->Shutdown();
   server_thread.join();
+
+  if(m_pool.is_active()){
+    spdlog::info("Worker pool executed {} procs with {} steals.", m_pool.get_num_execs(), m_pool.get_num_steals());
+    if(m_bgraph)
+      spdlog::info("{} ticks skipped waiting for the waves of the previous tick.", f_base::get_num_ticks_skipped());
+    m_pool.stop();
+    f_base::set_pool(nullptr);
+  }
   
   return true;
 }
@@ -23,6 +23,8 @@
 #include <map>
 #include <algorithm>
 #include <mutex>
+#include <thread>
+#include <chrono>
 using namespace std;
 
 #include <string.h>
@@ -57,6 +59,11 @@ namespace AWSMap2 {
   unsigned int MapDataBase::maxTotalSizeLayerData = 0x4FFFFF0;
   
   char * MapDataBase::path = NULL;
+  thread_local bool MapDataBase::breading = false;
+  thread_local bool MapDataBase::bprefetching = false;
+  atomic<unsigned long long> MapDataBase::numHits(0);
+  atomic<unsigned long long> MapDataBase::numMisses(0);
+  atomic<unsigned long long> MapDataBase::numPrefetched(0);
   
   void MapDataBase::setPath(const char * _path)
   {
@@ -67,6 +74,7 @@ namespace AWSMap2 {
     
     path = new char[strnlen(_path, MAX_PATH_LEN - 1) + 1];
     strcpy(path, _path);
+    MapPack::close();
   }
   
   const char * MapDataBase::getPath()
@@ -76,6 +84,8 @@ namespace AWSMap2 {
 
   MapDataBase::MapDataBase()
   {
+    for (int i = 0; i < 20; i++)
+      pNodes[i] = NULL;
   }
   
   MapDataBase::~MapDataBase()
@@ -86,17 +96,20 @@ namespace AWSMap2 {
 
   bool MapDataBase::init()
   {
-    // Loading initial 20 nodes  
+    // Loading initial 20 nodes, from the packs if they exist.
     bool bloaded = true;
     for (unsigned int id = 0; id < 20; id++){
+      MapPack::open(id);
       pNodes[id] = Node::load(NULL, id);
       if (!pNodes[id])
 	bloaded = false;
     }
 
     // If failed to load, 20 nodes are created at the path.
-    if (bloaded)
+    if (bloaded) {
+      setTriRoots();
       return true;
+    }
     
     for (unsigned int id = 0; id < 20; id++){
       if (pNodes[id])
@@ -153,19 +166,36 @@ namespace AWSMap2 {
     for (unsigned int id = 0; id < 20; id++){
       pNodes[id]->setId((unsigned char)id);
     }
+    setTriRoots();
 
     return true;
   }
+
+  void MapDataBase::setTriRoots()
+  {
+    for (int id = 0; id < 20; id++)
+      triRoots[id / 4].set(id % 4, pNodes[id]->getVtxECEF(0),
+			   pNodes[id]->getVtxECEF(1),
+			   pNodes[id]->getVtxECEF(2));
+  }
   
   void MapDataBase::request(list<list<LayerDataPtr>> & layerDatum,
 			    const list<LayerType> & layerTypes,
 			    const vec3 & center, const float radius,
 			    const float resolution)
   {
-    unique_lock<mutex> lock(mtx);
-    for (int iface = 0; iface < 20; iface++)
-      pNodes[iface]->getLayerData(layerDatum, layerTypes,
-				  center, radius, resolution);
+    c_shared_lock lock(mtx);
+    breading = true;
+    for (int itri = 0; itri < 5; itri++) {
+      unsigned int mask = det_collision_tri4_and_sphere(triRoots[itri], center,
+							radius * radius);
+      for (int i = 0; i < 4; i++) {
+	if (mask & (1 << i))
+	  pNodes[itri * 4 + i]->collectLayerData(layerDatum, layerTypes,
+						 center, radius, resolution);
+      }
+    }
+    breading = false;
 
   }
 
@@ -175,7 +205,7 @@ namespace AWSMap2 {
 			     const vec3 & center, const float radius,
 			     const float radius_cc)
   {
-    unique_lock<mutex> lock(mtx);
+    unique_lock<c_rw_mutex> lock(mtx);
     for(int iface = 0; iface < 20; iface++)
       pNodes[iface]->getNodeProfile(tris, paths, types,
 				    center, radius, radius_cc);
@@ -183,7 +213,7 @@ namespace AWSMap2 {
   
   bool MapDataBase::insert(const LayerData * layerData)
   {
-    unique_lock<mutex> lock(mtx);    
+    unique_lock<c_rw_mutex> lock(mtx);    
     list<Node*> nodes;
     for (int iface = 0; iface < 20; iface++){
       if (!pNodes[iface]->collision(layerData->center(), layerData->radius()))
@@ -196,9 +226,104 @@ namespace AWSMap2 {
   }
   
 
+  bool MapDataBase::insertBulk(const LayerData * layerData,
+			       const unsigned int nthreads,
+			       const bool bverbose)
+  {
+    unique_lock<c_rw_mutex> lock(mtx);
+    auto tstart = chrono::steady_clock::now();
+    vector<Node*> nodes;
+    for (int iface = 0; iface < 20; iface++){
+      if (!pNodes[iface]->collision(layerData->center(), layerData->radius()))
+	continue;
+      nodes.push_back(pNodes[iface]);
+    }
+
+    vector<LayerData*> parts;
+    if (!layerData->partition(nodes, NULL, parts)) {
+      lock.unlock();
+      return insert(layerData);
+    }
+
+    // the faces holding data are added in the ordinary way.
+    vector<Node*> nodes_build;
+    vector<LayerData*> parts_build;
+    for (int inode = 0; inode < nodes.size(); inode++) {
+      if (!parts[inode])
+	continue;
+      if (nodes[inode]->isEmpty()) {
+	nodes_build.push_back(nodes[inode]);
+	parts_build.push_back(parts[inode]);
+	continue;
+      }
+      nodes[inode]->addLayerData(*parts[inode]);
+      delete parts[inode];
+    }
+
+    // at most nth threads build the faces. Each of the nworkers threads
+    // takes the faces in turn, and builds the subtree of a face with
+    // 4^depth_parallel <= nth / nworkers threads.
+    unsigned int nth = nthreads ? nthreads : thread::hardware_concurrency();
+    nth = max(nth, 1u);
+    unsigned int nworkers = min(nth, (unsigned int)nodes_build.size());
+    unsigned int depth_parallel = 0;
+    for (unsigned int n = 4; nworkers > 0 && n <= nth / nworkers; n *= 4)
+      depth_parallel++;
+
+    // the packs of the faces built are invalidated before the threads
+    // start, so that no thread reads a pack unmapped by the others.
+    for (int inode = 0; inode < nodes_build.size(); inode++)
+      MapPack::invalidate(nodes_build[inode]->getId());
+
+    unsigned int num_nodes_built = Node::getNumNodesBuilt();
+    atomic<unsigned int> iface_next(0), num_faces_built(0);
+    vector<thread> ths;
+    for (unsigned int iworker = 0; iworker < nworkers; iworker++) {
+      ths.push_back(thread([&nodes_build, &parts_build, depth_parallel,
+			    &iface_next, &num_faces_built]()
+			   {
+			     unsigned int iface;
+			     while ((iface = iface_next++) < nodes_build.size()) {
+			       nodes_build[iface]->buildLayerData(parts_build[iface],
+								  depth_parallel);
+			       num_faces_built++;
+			     }
+			   }));
+    }
+
+    // progress is polled only if it is printed.
+    auto tprint = chrono::steady_clock::now();
+    while (bverbose && num_faces_built < nodes_build.size()) {
+      this_thread::sleep_for(chrono::milliseconds(10));
+      if (chrono::steady_clock::now() - tprint > chrono::seconds(1)) {
+	tprint = chrono::steady_clock::now();
+	cout << "insertBulk: " << Node::getNumNodesBuilt() - num_nodes_built
+	     << " nodes built, " << num_faces_built << "/"
+	     << nodes_build.size() << " faces done" << endl;
+      }
+    }
+    for (auto itr = ths.begin(); itr != ths.end(); itr++)
+      itr->join();
+
+    for (int inode = 0; inode < nodes_build.size(); inode++)
+      nodes_build[inode]->attachLayerData(layerData->getLayerType());
+
+    if (bverbose) {
+      double t = chrono::duration<double>(chrono::steady_clock::now()
+					  - tstart).count();
+      double mb = (double)layerData->size() / (1024. * 1024.);
+      cout << "insertBulk: " << strLayerType[layerData->getLayerType()]
+	   << " " << mb << "MB in " << t << "s ("
+	   << mb / t << "MB/s), "
+	   << Node::getNumNodesBuilt() - num_nodes_built
+	   << " nodes built in " << nodes_build.size() << " faces" << endl;
+    }
+    return true;
+  }
+
   bool MapDataBase::remove(const LayerData * layerData)
   {
-    unique_lock<mutex> lock(mtx);
+    unique_lock<c_rw_mutex> lock(mtx);
     Node * pNode = layerData->getNode();    
     if(!pNode->hasDownlink())
       return false;
@@ -208,7 +333,7 @@ namespace AWSMap2 {
 
   bool MapDataBase::remove(const LayerData * layerData, const unsigned int id)
   {
-    unique_lock<mutex> lock(mtx);
+    unique_lock<c_rw_mutex> lock(mtx);
     Node * pNode = layerData->getNode();
     if(!pNode->hasDownlink())
       return false;
@@ -218,35 +343,177 @@ namespace AWSMap2 {
   
   void MapDataBase::restruct()
   {
-    unique_lock<mutex> lock(mtx);
+    unique_lock<c_rw_mutex> lock(mtx);
     LayerData::restruct();
     Node::restruct();
   }
   
   bool MapDataBase::save()
   {
-    unique_lock<mutex> lock(mtx);
+    unique_lock<c_rw_mutex> lock(mtx);
     bool result = true;
     for (int iface = 0; iface < 20; iface++){
       result &= pNodes[iface]->save();
+      if (MapPack::isDirty(iface))
+	result &= MapPack::build(iface);
     }
     
     return result;
   }
+
+  bool MapDataBase::pack()
+  {
+    unique_lock<c_rw_mutex> lock(mtx);
+    bool result = true;
+    for (int iface = 0; iface < 20; iface++){
+      result &= pNodes[iface]->save();
+      result &= MapPack::build(iface);
+    }
+
+    return result;
+  }
+  
+  //////////////////////////////////////////////////////////// MapPrefetcher
+  MapPrefetcher::MapPrefetcher(MapDataBase * _pmdb) : pmdb(_pmdb),
+						      width(2000.f),
+						      lookahead(20000.f),
+						      resolution(0.f),
+						      bupdate(false),
+						      bstop(false), th(NULL),
+						      numRequests(0)
+  {
+    layerTypes.push_back(lt_coast_line);
+  }
+
+  MapPrefetcher::~MapPrefetcher()
+  {
+    stop();
+  }
+
+  void MapPrefetcher::setLayerTypes(const list<LayerType> & _layerTypes)
+  {
+    unique_lock<mutex> lock(mtx);
+    layerTypes = _layerTypes;
+  }
+
+  void MapPrefetcher::setCorridor(const float _width, const float _lookahead,
+				  const float _resolution)
+  {
+    unique_lock<mutex> lock(mtx);
+    width = _width;
+    lookahead = _lookahead;
+    resolution = _resolution;
+  }
+
+  void MapPrefetcher::setRoute(const list<vec3> & _route)
+  {
+    unique_lock<mutex> lock(mtx);
+    route.assign(_route.begin(), _route.end());
+    bupdate = true;
+    cv.notify_one();
+  }
+
+  bool MapPrefetcher::start()
+  {
+    if (th)
+      return false;
+    bstop = false;
+    th = new thread(&MapPrefetcher::run, this);
+    return true;
+  }
+
+  void MapPrefetcher::stop()
+  {
+    if (!th)
+      return;
+    {
+      unique_lock<mutex> lock(mtx);
+      bstop = true;
+      cv.notify_one();
+    }
+    th->join();
+    delete th;
+    th = NULL;
+  }
+
+  void MapPrefetcher::sampleCorridor(const vector<vec3> & route,
+				     const float width, const float lookahead,
+				     vector<vec3> & centers)
+  {
+    centers.clear();
+    if (route.empty() || width <= 0.f)
+      return;
+
+    centers.push_back(route[0]);
+    double dist = 0.0, next = width; // distance along the route
+    for (unsigned int i = 1; i < route.size() && dist < lookahead; i++){
+      vec3 d = route[i] - route[i - 1];
+      double len = sqrt(dot(d, d));
+      if (len <= 0.0)
+	continue;
+      
+      for (; next <= dist + len && next <= lookahead; next += width)
+	centers.push_back(route[i - 1] + d * ((next - dist) / len));
+      dist += len;
+    }
+
+    // the end of the route within the lookahead
+    if (dist <= lookahead &&
+	l2Norm2(centers.back(), route.back()) > 0.25 * width * width)
+      centers.push_back(route.back());
+  }
+
+  // The thread requests the layer data on the corridor, and releases them
+  // immediately. The data stays in the cache until evicted by restruct.
+  // The corridor is abandoned if a new route is given.
+  void MapPrefetcher::run()
+  {
+    MapDataBase::bprefetching = true;
+    unique_lock<mutex> lock(mtx);
+    while (!bstop) {
+      cv.wait(lock, [this]{ return bupdate || bstop; });
+      if (bstop)
+	break;
+
+      vector<vec3> centers;
+      sampleCorridor(route, width, lookahead, centers);
+      list<LayerType> types = layerTypes;
+      float radius = width, res = resolution;
+      bupdate = false;
+      lock.unlock();
+      
+      for (auto itr = centers.begin();
+	   itr != centers.end() && !bupdate && !bstop; itr++){
+	list<list<LayerDataPtr>> datum;
+	pmdb->request(datum, types, *itr, radius, res);
+	numRequests++;
+      }
+      lock.lock();
+    }
+  }
   
   ///////////////////////////////////////////////////////////////////// Node
   Node * Node::head = NULL;
   Node * Node::tail = NULL;
-  unsigned int Node::numNodesAlive = 0;
+  recursive_mutex Node::mtxList;
+  mutex Node::mtxLoad;
+  atomic<unsigned long long> Node::countAccess(0);
+  atomic<unsigned int> Node::numNodesAlive(0);
+  atomic<unsigned int> Node::numNodesBuilt(0);
   
   void Node::insert(Node * pNode)
   {
     if (!pNode->upLink) // top nodes should not be managed in the list.
       return;
     
-    if (numNodesAlive >= MapDataBase::getMaxNumNodes())
+    // readers may be traversing the nodes, then the nodes are not released
+    // until the next exclusive access.
+    if (numNodesAlive >= MapDataBase::getMaxNumNodes() &&
+	!MapDataBase::isReading())
       restruct();
     
+    unique_lock<recursive_mutex> lock(mtxList);
+    accessed(pNode);
     numNodesAlive++;
     if (head == NULL && tail == NULL){
       pNode->next = pNode->prev = NULL;
@@ -261,6 +528,7 @@ namespace AWSMap2 {
   
   void Node::pop(Node * pNode)
   {
+    unique_lock<recursive_mutex> lock(mtxList);
     Node * prev = pNode->prev, *next = pNode->next;
     
     if (next == NULL){
@@ -276,20 +544,11 @@ namespace AWSMap2 {
     else{
       prev->next = next;
     }
+    pNode->prev = pNode->next = NULL;
     
     numNodesAlive--;
   }
   
-  void Node::accessed(Node * pNode)
-  {
-    if (!pNode->upLink) // top nodes are not in the list.
-      return;
-    
-    pop(pNode);
-    insert(pNode);
-  }
-  
-  
   bool Node::isLocked()
   {
     for (auto itr = layerDataList.begin(); itr != layerDataList.end(); itr++) {
@@ -301,19 +560,22 @@ namespace AWSMap2 {
   
   void Node::restruct()
   {
+    unique_lock<recursive_mutex> lock(mtxList);
     while (numNodesAlive >= MapDataBase::getMaxNumNodes())
       {
-	Node * itr = head;
-	for (; itr != NULL; itr = itr->next) {
-	  if (itr->isLocked())
+	// least recently used node without downlink
+	Node * itr = NULL;
+	for (Node * pn = head; pn != NULL; pn = pn->next) {
+	  if (pn->isLocked())
 	    continue;
-	  if (!itr->bdownLink ||
-	      (itr->downLink[0] == NULL &&
-	       itr->downLink[1] == NULL &&
-	       itr->downLink[2] == NULL &&
-	       itr->downLink[3] == NULL)) {
-	    break;
-	  }
+	  if (pn->bdownLink &&
+	      (pn->downLink[0] != NULL ||
+	       pn->downLink[1] != NULL ||
+	       pn->downLink[2] != NULL ||
+	       pn->downLink[3] != NULL))
+	    continue;
+	  if (itr == NULL || pn->tAccess < itr->tAccess)
+	    itr = pn;
 	}
 	
 	if (itr != NULL) {
@@ -322,11 +584,13 @@ namespace AWSMap2 {
 	  itr->getPath(path, 1024);
 	  cout << "Release node " << path << endl;
 #endif
+	  // the node is saved first, the directory of the node not saved
+	  // yet is created there, then the layer data can be saved.
+	  itr->save();
 	  itr->releaseLayerData();
 	  if (itr->upLink) {
 	    itr->upLink->downLink[itr->id] = NULL;
 	  }
-	  itr->save();
 	  pop(itr);
 	  delete itr;
 	}
@@ -397,7 +661,7 @@ namespace AWSMap2 {
     layerDataList.clear();
   }
   
-  Node::Node() : prev(NULL), next(NULL), level(0), upLink(NULL),
+  Node::Node() : prev(NULL), next(NULL), tAccess(0), level(0), upLink(NULL),
 		 bdownLink(false), bupdate(false), refcount(0)
   {
     downLink[0] = downLink[1] = downLink[2] = downLink[3] = NULL;
@@ -406,6 +670,7 @@ namespace AWSMap2 {
   Node::Node(const unsigned char _id, Node * _upLink, const vec2 vtx_blh0,
 	     const vec2 vtx_blh1, const vec2 vtx_blh2) : prev(NULL),
 							 next(NULL),
+							 tAccess(0),
 							 id(_id),
 							 upLink(_upLink),
 							 bupdate(true),
@@ -437,18 +702,22 @@ namespace AWSMap2 {
   Node::~Node()
   {
     save();
+
+    // the node deleted with its upper node is still in the list.
+    {
+      unique_lock<recursive_mutex> lock(mtxList);
+      if (prev != NULL || next != NULL || head == this)
+	pop(this);
+    }
     
     for (auto itr = layerDataList.begin(); itr != layerDataList.end(); itr++){
-      itr->second->setNode(NULL);
-      if (!itr->second->isLocked()) {
-	itr->second->release();
-	delete itr->second;
-      }
+      LayerData::detach(itr->second);
     }
     
     for (int i = 0; i < 4; i++) {
-      if (downLink[i])
-	delete downLink[i];
+      Node * pDown = downLink[i];
+      if (pDown)
+	delete pDown;
       downLink[i] = NULL;
     }
   }
@@ -497,7 +766,39 @@ namespace AWSMap2 {
       }
       
       bupdate = true;
-    }          
+    }
+    
+    calc_downlink_ecef();
+  }
+
+  // Calculate midpoints of the edges on the ground in BLH.
+  void Node::calc_mid_blh(vec2 * vtx_blh_mid)
+  {
+    vec3 vtx_ecef_mid[3];
+    double alt;
+    vtx_ecef_mid[0] = (vtx_ecef[0] + vtx_ecef[1]) * 0.5;
+    vtx_ecef_mid[1] = (vtx_ecef[1] + vtx_ecef[2]) * 0.5;
+    vtx_ecef_mid[2] = (vtx_ecef[2] + vtx_ecef[0]) * 0.5;
+    for (int i = 0; i < 3; i++)
+      eceftoblh(vtx_ecef_mid[i].x, vtx_ecef_mid[i].y,
+		vtx_ecef_mid[i].z, vtx_blh_mid[i].x, vtx_blh_mid[i].y, alt);
+  }
+
+  // Calculate the triangles of the downlinks in ECEF, the same as those
+  // the downlink nodes have, so that collisions are tested before loading
+  // them.
+  void Node::calc_downlink_ecef()
+  {
+    vec2 vtx_blh_mid[3];
+    vec3 vtx_ecef_mid[3];
+    calc_mid_blh(vtx_blh_mid);
+    for (int i = 0; i < 3; i++)
+      blhtoecef(vtx_blh_mid[i].x, vtx_blh_mid[i].y, 0.,
+		vtx_ecef_mid[i].x, vtx_ecef_mid[i].y, vtx_ecef_mid[i].z);
+    tri_down.set(0, vtx_ecef[0], vtx_ecef_mid[0], vtx_ecef_mid[2]);
+    tri_down.set(1, vtx_ecef[1], vtx_ecef_mid[1], vtx_ecef_mid[0]);
+    tri_down.set(2, vtx_ecef[2], vtx_ecef_mid[2], vtx_ecef_mid[1]);
+    tri_down.set(3, vtx_ecef_mid[0], vtx_ecef_mid[1], vtx_ecef_mid[2]);
   }
 
   // Save layerdata in the node and the downlink nodes.
@@ -512,6 +813,11 @@ namespace AWSMap2 {
     char fname[2048];
     getPath(path, 2048);
     snprintf(fname, 2048, "%s/N%02d.index", path, (int)id);
+
+    // the pack of the face is no longer consistent with the files.
+    list<unsigned char> path_id;
+    getPath(path_id);
+    MapPack::invalidate(path_id.front());
     
     ofstream ofile;
 #ifdef _AWS_MAP_DEBUG
@@ -557,8 +863,9 @@ namespace AWSMap2 {
     // Save downlink nodes recursively.
     if (bdownLink){
       for (int idown = 0; idown < 4; idown++){
-	if (downLink[idown])
-	  result &= downLink[idown]->save();
+	Node * pDown = downLink[idown];
+	if (pDown)
+	  result &= pDown->save();
       }
     }
   
@@ -571,9 +878,12 @@ namespace AWSMap2 {
   // Load child node of pNodeUp with specified id.
   // If pNodeUp is not given, idChild represents the id of root 20 nodes.
   // Then the root node is loaded.
+  // The index is read from the pack of the face if it has the node,
+  // otherwise from the index file.
   Node * Node::load(Node * pNodeUp, unsigned int idChild)
   {
     char fname[2048];
+    list<unsigned char> path_id;
   
     if (pNodeUp == NULL){
       if (idChild >= 20)
@@ -587,9 +897,20 @@ namespace AWSMap2 {
     else{
       char path[2048];
       pNodeUp->getPath(path, 2048);
+      pNodeUp->getPath(path_id);
       snprintf(fname, 2048, "%s/N%02d/N%02d.index",
 	       path, (int)idChild, (int)idChild);
     }
+    path_id.push_back(idChild);
+
+    const char * data;
+    unsigned int size;
+    if (MapPack::find(path_id, lt_undef, data, size)){
+      MemBuf buf(data, size);
+      istream findex(&buf);
+      return load(pNodeUp, idChild, findex);
+    }
+    
 #ifdef _AWS_MAP_DEBUG
     cout << "Loading " << fname << endl;
 #endif
@@ -598,7 +919,12 @@ namespace AWSMap2 {
     if (!findex.is_open()){
       return NULL;
     }
-  
+
+    return load(pNodeUp, idChild, findex);
+  }
+
+  Node * Node::load(Node * pNodeUp, unsigned int idChild, istream & findex)
+  {
     Node * pNode = new Node();
     pNode->bupdate = false;    
     pNode->upLink = pNodeUp;
@@ -633,15 +959,8 @@ namespace AWSMap2 {
   // then creates four downlink nodes corresponding to four sub-triangles.
   bool Node::createDownLink()
   {
-    vec3 vtx_ecef_mid[3];
     vec2 vtx_blh_mid[3];
-    double alt;
-    vtx_ecef_mid[0] = (vtx_ecef[0] + vtx_ecef[1]) * 0.5;
-    vtx_ecef_mid[1] = (vtx_ecef[1] + vtx_ecef[2]) * 0.5;
-    vtx_ecef_mid[2] = (vtx_ecef[2] + vtx_ecef[0]) * 0.5;
-    for (int i = 0; i < 3; i++)
-      eceftoblh(vtx_ecef_mid[i].x, vtx_ecef_mid[i].y,
-		vtx_ecef_mid[i].z, vtx_blh_mid[i].x, vtx_blh_mid[i].y, alt);
+    calc_mid_blh(vtx_blh_mid);
   
     downLink[0] = new Node(0, this, vtx_blh[0], vtx_blh_mid[0], vtx_blh_mid[2]);
     downLink[1] = new Node(1, this, vtx_blh[1], vtx_blh_mid[1], vtx_blh_mid[0]);
@@ -669,6 +988,26 @@ namespace AWSMap2 {
     return true;
   }
 
+  // Return the downlink node, loading it if not loaded yet. Concurrent
+  // readers may request the same downlink, then the load is serialized.
+  Node * Node::getDownLink(unsigned int idown)
+  {
+    Node * pDown = downLink[idown];
+    if (pDown) {
+      MapDataBase::countAccess(true);
+      return pDown;
+    }
+
+    MapDataBase::countAccess(false);
+    unique_lock<mutex> lock(mtxLoad);
+    pDown = downLink[idown];
+    if (!pDown) {
+      pDown = load(this, idown);
+      downLink[idown] = pDown;
+    }
+    return pDown;
+  }
+  
   // Get storage path to this node.
   void Node::getPath(char * path, unsigned int maxlen)
   {
@@ -707,16 +1046,14 @@ namespace AWSMap2 {
   
     list<Node*> nodes;
     for (int idown = 0; idown < 4; idown++){
-      if (!downLink[idown]){
-	downLink[idown] = Node::load(this, idown);
-      }
-      downLink[idown]->lock();
-      nodes.push_back(downLink[idown]);
+      Node * pDown = getDownLink(idown);
+      pDown->lock();
+      nodes.push_back(pDown);
     }
     layerData.split(nodes, this);
   
-    for (int idown = 0; idown < 4; idown++) {
-      downLink[idown]->unlock();
+    for (auto itr = nodes.begin(); itr != nodes.end(); itr++) {
+      (*itr)->unlock();
     }
     Node::restruct();
   
@@ -737,6 +1074,14 @@ namespace AWSMap2 {
 					center, radius * radius);
   }
 
+  // determine which downlinks collide with the sphere, returns bit mask.
+  // The downlinks need not to be loaded.
+  const unsigned int Node::collision_downlink(const vec3 & center,
+					      const float radius)
+  {
+    return det_collision_tri4_and_sphere(tri_down, center, radius * radius);
+  }
+
   const void Node::collision_downlink(const vector<vec3> & pts,
 				      vector<char> & inodes)
   {
@@ -789,7 +1134,15 @@ namespace AWSMap2 {
     
     if (!collision(center, radius))
       return;
-    
+
+    collectLayerData(layerData, layerType, center, radius, resolution);
+  }
+
+  void Node::collectLayerData(list<list<LayerDataPtr>> & layerData,
+			      const list<LayerType> & layerType,
+			      const vec3 & center, const float radius,
+			      const float resolution)
+  {
     if (layerData.size() != layerType.size()){
       layerData.resize(layerType.size());
     }
@@ -817,12 +1170,15 @@ namespace AWSMap2 {
     
     detailedLayerData.resize(layerType.size());
     if(bdownLink){
+      // only the downlinks colliding are loaded
+      unsigned int mask = collision_downlink(center, radius);
       for (int idown = 0; idown < 4; idown++){
-	if (downLink[idown] == NULL) {
-	  downLink[idown] = load(this, idown);
-	}
-	downLink[idown]->getLayerData(detailedLayerData, layerType,
-				      center, radius, resolution);
+	if (!(mask & (1 << idown)))
+	  continue;
+	Node * pDown = getDownLink(idown);
+	if (pDown)
+	  pDown->collectLayerData(detailedLayerData, layerType,
+				  center, radius, resolution);
       }
     }
 
@@ -882,11 +1238,10 @@ namespace AWSMap2 {
     }
     
     for (int idown = 0; idown < 4; idown++){
-      if (downLink[idown] == NULL) {
-	downLink[idown] = load(this, idown);
-      }
-      downLink[idown]->getNodeProfile(tris, paths, types, 
-				      center, radius, radius_cc);
+      Node * pDown = getDownLink(idown);
+      if (pDown)
+	pDown->getNodeProfile(tris, paths, types, 
+			      center, radius, radius_cc);
     }
     
   }
@@ -898,8 +1253,12 @@ namespace AWSMap2 {
       return NULL;
     
     LayerData * layerData = itrLayerData->second;
-    if (!layerData->isActive())
-      layerData->load();
+    MapDataBase::countAccess(layerData->isActive());
+    if (!layerData->isActive()) {
+      unique_lock<mutex> lock(mtxLoad);
+      if (!layerData->isActive())
+	layerData->load();
+    }
     Node::accessed(this);
     LayerData::accessed(layerData);
     return layerData;
@@ -911,20 +1270,111 @@ namespace AWSMap2 {
     if(itrDstLayerData == layerDataList.end())
       return;
 
-    delete itrDstLayerData->second;
     LayerData * pDstLayerData = LayerData::create(layerType);
-    itrDstLayerData->second = pDstLayerData;
+    pDstLayerData->setNode(this);
+    pDstLayerData->setActive();
+    pDstLayerData->lock();
     
     for (int i = 0; i < 4; i++){
-      if(!downLink[i]){
-	downLink[i] = Node::load(this, i);
-      }
-      pDstLayerData->merge(*(downLink[i]->getLayerData(layerType)));
+      Node * pDown = getDownLink(i);
+      if (!pDown)
+	continue;
+      LayerData * pDownLayerData = pDown->getLayerData(layerType);
+      if (pDownLayerData)
+	pDstLayerData->merge(*pDownLayerData);
     }
     
     if (pDstLayerData->size() >  MapDataBase::getMaxSizeLayerData(layerType)){
       pDstLayerData->reduce(MapDataBase::getMaxSizeLayerData(layerType));
     }
+    pDstLayerData->unlock();
+
+    LayerData::detach(itrDstLayerData->second);
+    itrDstLayerData->second = pDstLayerData;
+    bupdate = true;
+
+    // the upper nodes are reconstructed as well.
+    if (upLink)
+      upLink->reconstructLayerDataFromDownlink(layerType);
+  }
+  
+  bool Node::buildLayerData(LayerData * pLayerData,
+			    const unsigned int depth_parallel)
+  {
+    const LayerType layerType = pLayerData->getLayerType();
+    bupdate = true;
+    numNodesBuilt++;
+    pLayerData->setNode(this);
+    pLayerData->bupdate = true;
+    if (pLayerData->size() <= MapDataBase::getMaxSizeLayerData(layerType)) {
+      insertLayerData(pLayerData);
+      return true;
+    }
+
+    vec2 vtx_blh_mid[3];
+    calc_mid_blh(vtx_blh_mid);
+    downLink[0] = new Node(0, this, vtx_blh[0], vtx_blh_mid[0], vtx_blh_mid[2]);
+    downLink[1] = new Node(1, this, vtx_blh[1], vtx_blh_mid[1], vtx_blh_mid[0]);
+    downLink[2] = new Node(2, this, vtx_blh[2], vtx_blh_mid[2], vtx_blh_mid[1]);
+    downLink[3] = new Node(3, this, vtx_blh_mid[0],
+			   vtx_blh_mid[1], vtx_blh_mid[2]);
+    bdownLink = true;
+
+    vector<Node*> nodes(4);
+    for (int i = 0; i < 4; i++)
+      nodes[i] = downLink[i];
+    vector<LayerData*> parts;
+    pLayerData->partition(nodes, this, parts);
+    delete pLayerData;
+
+    if (depth_parallel > 0) {
+      vector<thread> ths;
+      for (int i = 1; i < 4; i++)
+	if (parts[i])
+	  ths.push_back(thread(&Node::buildLayerData, nodes[i], parts[i],
+			       depth_parallel - 1));
+      if (parts[0])
+	nodes[0]->buildLayerData(parts[0], depth_parallel - 1);
+      for (auto itr = ths.begin(); itr != ths.end(); itr++)
+	itr->join();
+    }
+    else {
+      for (int i = 0; i < 4; i++)
+	if (parts[i])
+	  nodes[i]->buildLayerData(parts[i]);
+    }
+
+    // the layer data of this node is merged from the downlinks, and reduced.
+    LayerData * pDstLayerData = LayerData::create(layerType);
+    pDstLayerData->setNode(this);
+    pDstLayerData->bupdate = true;
+    for (int i = 0; i < 4; i++) {
+      auto itr = nodes[i]->layerDataList.find(layerType);
+      if (itr != nodes[i]->layerDataList.end())
+	pDstLayerData->_merge(*itr->second);
+    }
+    pDstLayerData->_reduce(MapDataBase::getMaxSizeLayerData(layerType));
+    insertLayerData(pDstLayerData);
+    return true;
+  }
+
+  void Node::attachLayerData(const LayerType layerType)
+  {
+    lock();
+    Node::insert(this);
+    auto itr = layerDataList.find(layerType);
+    if (itr != layerDataList.end())
+      itr->second->setActive();
+    unlock();
+
+    if (!bdownLink)
+      return;
+
+    for (int i = 0; i < 4; i++) {
+      Node * pDown = downLink[i];
+      if (pDown)
+	pDown->attachLayerData(layerType);
+    }
   }
   
   void Node::insertLayerData(LayerData * pLayerData)
@@ -978,9 +1428,7 @@ namespace AWSMap2 {
   
     if (pDstLayerData){
       pDstLayerData->lock();
-      cout << "Merge: src size " << layerData.size() << " dst size " << pDstLayerData->size() << endl;
       pDstLayerData->merge(layerData);
-      cout << "Merged: size " << pDstLayerData->size() << endl;
       if (pDstLayerData->size() >
 	  MapDataBase::getMaxSizeLayerData(layerData.getLayerType())){ 
 	if (!bdownLink) {
@@ -1020,16 +1468,26 @@ namespace AWSMap2 {
   /////////////////////////////////////////////////////////////////// LayerData
   LayerData * LayerData::head = NULL;
   LayerData * LayerData::tail = NULL;
-  unsigned int LayerData::totalSize = 0;
+  recursive_mutex LayerData::mtxList;
+  atomic<unsigned long long> LayerData::countAccess(0);
+  atomic<unsigned int> LayerData::totalSize(0);
+  mutex LayerData::mtxRef[16];
 
   void LayerData::insert(LayerData * pLayerData)
   {
-    if (pLayerData->next != NULL || pLayerData->prev != NULL)
+    unique_lock<recursive_mutex> lock(mtxList);
+    if (pLayerData->next != NULL || pLayerData->prev != NULL ||
+	head == pLayerData)
       return; // the instance has already been loaded
-  
-    if (totalSize >= MapDataBase::getMaxTotalSizeLayerData())
+
+    // readers may be using the layer data, then the layer data is not
+    // released until the next exclusive access.
+    if (totalSize >= MapDataBase::getMaxTotalSizeLayerData() &&
+	!MapDataBase::isReading())
       restruct();
 
+    accessed(pLayerData);
+
     totalSize += (unsigned int) pLayerData->size();
   
     if (head == NULL && tail == NULL){
@@ -1045,6 +1503,11 @@ namespace AWSMap2 {
 
   void LayerData::pop(LayerData * pLayerData)
   {
+    unique_lock<recursive_mutex> lock(mtxList);
+    if (pLayerData->next == NULL && pLayerData->prev == NULL &&
+	head != pLayerData)
+      return; // not in the list
+    
     LayerData * prev = pLayerData->prev, *next = pLayerData->next;
     pLayerData->prev = pLayerData->next = NULL;
   
@@ -1061,26 +1524,52 @@ namespace AWSMap2 {
     totalSize -= (unsigned int) pLayerData->size();
   }
   
-  void LayerData::accessed(LayerData * pLayerData)
+  void LayerData::restruct()
   {
-    if (!pLayerData->isActive())
-      return;
+    unique_lock<recursive_mutex> lock(mtxList);
+    while (totalSize >= MapDataBase::getMaxTotalSizeLayerData())
+      {
+	// release least recently used one
+	LayerData * p = NULL;
+	for (LayerData * itr = head; itr != NULL; itr = itr->next) {
+	  if (itr->isLocked())
+	    continue;
+	  if (p == NULL || itr->tAccess < p->tAccess)
+	    p = itr;
+	}
+	
+	if (p == NULL)
+	  break;
+	p->release();
+      }
+  }
+
+  void LayerData::unref(LayerData * pLayerData)
+  {
+    accessed(pLayerData);
+    {
+      unique_lock<mutex> lock(pLayerData->getRefMutex());
+      if (--pLayerData->refcount > 0 || pLayerData->getNode())
+	return;
+    }
+
+    // the last reference to the layer data detached from the node.
+    unique_lock<recursive_mutex> lock(mtxList);
     pop(pLayerData);
-    insert(pLayerData);
+    delete pLayerData;
   }
 
-  void LayerData::restruct()
+  void LayerData::detach(LayerData * pLayerData)
   {
-    LayerData * p = head;
+    {
+      unique_lock<mutex> lock(pLayerData->getRefMutex());
+      pLayerData->setNode(NULL);
+      if (pLayerData->isLocked())
+	return; // deleted by the last LayerDataPtr
+    }
     
-    while (totalSize >= MapDataBase::getMaxTotalSizeLayerData() && p != NULL)
-      {
-	if (!p->isLocked()) {
-	  p->release();
-	  p = head;
-	}else
-	  p = p->next;
-      }
+    pLayerData->release();
+    delete pLayerData;
   }
   
   LayerData * LayerData::create(const LayerType layerType)
@@ -1107,6 +1596,7 @@ namespace AWSMap2 {
 #ifdef _AWS_MAP_DEBUG
     cout << "saving " << fname << endl;
 #endif
+    invalidatePack();
     ofstream ofile(fname, ios::binary);
     if (!ofile.is_open())
       return false;
@@ -1121,6 +1611,21 @@ namespace AWSMap2 {
   bool LayerData::load(){
     if (!pNode)
       return false;
+
+    list<unsigned char> path_id;
+    pNode->getPath(path_id);
+    const char * data;
+    unsigned int size;
+    if (MapPack::find(path_id, getLayerType(), data, size)){
+      MemBuf buf(data, size);
+      istream ifile(&buf);
+      if (!load(ifile))
+	return false;
+      
+      bupdate = false;
+      setActive();
+      return true;
+    }
     
     char fname[2048];
     genFileName(fname, 2048);
@@ -25,6 +25,8 @@
 #include <map>
 #include <algorithm>
 #include <mutex>
+#include <thread>
+#include <iterator>
 using namespace std;
 
 #include <string.h>
@@ -35,60 +37,449 @@ using namespace std;
 #include "aws_map.hpp"
 
 namespace AWSMap2{
+
+  //////////////////////////////////////////////////////////////// SegmentIndex
+  template <class T>
+  static void permute(vector<T> & v, const vector<unsigned int> & order)
+  {
+    vector<T> t(v.size());
+    for (unsigned int i = 0; i < order.size(); i++)
+      t[i] = v[order[i]];
+    v.swap(t);
+  }
+  
+  void SegmentIndex::clear()
+  {
+    x0.clear(); y0.clear(); z0.clear();
+    x1.clear(); y1.clear(); z1.clear();
+    iline.clear();
+    ipt.clear();
+    nodes.clear();
+  }
+  
+  void SegmentIndex::add(const vector<vec3> & pts, const unsigned int id)
+  {
+    for (unsigned int i = 0; i + 1 < pts.size(); i++) {
+      x0.push_back(pts[i].x); y0.push_back(pts[i].y); z0.push_back(pts[i].z);
+      x1.push_back(pts[i + 1].x); y1.push_back(pts[i + 1].y);
+      z1.push_back(pts[i + 1].z);
+      iline.push_back(id);
+      ipt.push_back(i);
+    }
+  }
+
+  // build the subtree of the segments order[first, first + num), and
+  // returns the index of the root node. The segments are split at the
+  // median of the centroids along the longest axis.
+  unsigned int SegmentIndex::build(vector<unsigned int> & order,
+				   const vector<vec3> & centroids,
+				   const unsigned int first,
+				   const unsigned int num)
+  {
+    unsigned int inode = (unsigned int) nodes.size();
+    nodes.push_back(s_bvh_node());
+    
+    vec3 bmin(DBL_MAX, DBL_MAX, DBL_MAX), bmax(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+    vec3 cmin = bmin, cmax = bmax;
+    for (unsigned int i = first; i < first + num; i++) {
+      unsigned int iseg = order[i];
+      bmin.x = min(bmin.x, min(x0[iseg], x1[iseg]));
+      bmin.y = min(bmin.y, min(y0[iseg], y1[iseg]));
+      bmin.z = min(bmin.z, min(z0[iseg], z1[iseg]));
+      bmax.x = max(bmax.x, max(x0[iseg], x1[iseg]));
+      bmax.y = max(bmax.y, max(y0[iseg], y1[iseg]));
+      bmax.z = max(bmax.z, max(z0[iseg], z1[iseg]));
+      const vec3 & c = centroids[iseg];
+      cmin.x = min(cmin.x, c.x); cmin.y = min(cmin.y, c.y);
+      cmin.z = min(cmin.z, c.z);
+      cmax.x = max(cmax.x, c.x); cmax.y = max(cmax.y, c.y);
+      cmax.z = max(cmax.z, c.z);
+    }
+    nodes[inode].bmin = bmin;
+    nodes[inode].bmax = bmax;
+    
+    if (num <= MAX_LEAF_SEGMENTS) {
+      nodes[inode].first = first;
+      nodes[inode].num = num;
+      return inode;
+    }
+
+    vec3 ext = cmax - cmin;
+    int axis = (ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2));
+    unsigned int half = num / 2;
+    nth_element(order.begin() + first, order.begin() + first + half,
+		order.begin() + first + num,
+		[&centroids, axis](const unsigned int l, const unsigned int r)
+		{
+		  const vec3 & cl = centroids[l], & cr = centroids[r];
+		  return (axis == 0 ? cl.x < cr.x :
+			  (axis == 1 ? cl.y < cr.y : cl.z < cr.z));
+		});
+    
+    build(order, centroids, first, half);
+    unsigned int iright = build(order, centroids, first + half, num - half);
+    nodes[inode].first = iright;
+    nodes[inode].num = 0;
+    return inode;
+  }
+  
+  void SegmentIndex::build()
+  {
+    nodes.clear();
+    unsigned int num = getNumSegments();
+    if (num == 0)
+      return;
+
+    vector<vec3> centroids(num);
+    vector<unsigned int> order(num);
+    for (unsigned int i = 0; i < num; i++) {
+      centroids[i] = vec3(x0[i] + x1[i], y0[i] + y1[i], z0[i] + z1[i]) * 0.5;
+      order[i] = i;
+    }
+    nodes.reserve(2 * (num / MAX_LEAF_SEGMENTS + 1));
+    build(order, centroids, 0, num);
+
+    // reorder the segment arrays in the order of the leaves
+    permute(x0, order); permute(y0, order); permute(z0, order);
+    permute(x1, order); permute(y1, order); permute(z1, order);
+    permute(iline, order); permute(ipt, order);
+  }
+
+  double SegmentIndex::dist2(const unsigned int iseg, const vec3 & pt) const
+  {
+    double dx = x1[iseg] - x0[iseg], dy = y1[iseg] - y0[iseg],
+      dz = z1[iseg] - z0[iseg];
+    double px = pt.x - x0[iseg], py = pt.y - y0[iseg], pz = pt.z - z0[iseg];
+    double l2 = dx * dx + dy * dy + dz * dz;
+    double t = (l2 > 0. ? (px * dx + py * dy + pz * dz) / l2 : 0.);
+    t = min(max(t, 0.), 1.);
+    px -= t * dx; py -= t * dy; pz -= t * dz;
+    return px * px + py * py + pz * pz;
+  }
+  
+  bool SegmentIndex::nearest(const vec3 & pt, s_hit & hit) const
+  {
+    if (nodes.empty())
+      return false;
+
+    double dmin = DBL_MAX;
+    unsigned int imin = 0;
+    unsigned int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+      const s_bvh_node & node = nodes[stack[--sp]];
+      if (dist2(node, pt) >= dmin)
+	continue;
+
+      if (node.num) {
+	for (unsigned int i = node.first; i < node.first + node.num; i++) {
+	  double d = dist2(i, pt);
+	  if (d < dmin) {
+	    dmin = d;
+	    imin = i;
+	  }
+	}
+	continue;
+      }
+
+      // visit the nearer child first
+      unsigned int il = (unsigned int)(&node - nodes.data()) + 1, ir = node.first;
+      if (dist2(nodes[il], pt) < dist2(nodes[ir], pt))
+	swap(il, ir);
+      stack[sp++] = il;
+      stack[sp++] = ir;
+    }
+    
+    hit.iline = iline[imin];
+    hit.ipt = ipt[imin];
+    hit.dist = sqrt(dmin);
+    return true;
+  }
+  
+  void SegmentIndex::radius(const vec3 & pt, const double r,
+			    vector<s_hit> & hits) const
+  {
+    if (nodes.empty())
+      return;
+
+    double r2 = r * r;
+    unsigned int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+      unsigned int inode = stack[--sp];
+      const s_bvh_node & node = nodes[inode];
+      if (dist2(node, pt) > r2)
+	continue;
+
+      if (node.num) {
+	for (unsigned int i = node.first; i < node.first + node.num; i++) {
+	  double d = dist2(i, pt);
+	  if (d <= r2) {
+	    s_hit hit;
+	    hit.iline = iline[i];
+	    hit.ipt = ipt[i];
+	    hit.dist = sqrt(d);
+	    hits.push_back(hit);
+	  }
+	}
+	continue;
+      }
+      stack[sp++] = inode + 1;
+      stack[sp++] = node.first;
+    }
+  }
+
+  bool SegmentIndex::ray(const vec3 & org, const vec3 & dir, const double len,
+			 s_hit & hit) const
+  {
+    if (nodes.empty())
+      return false;
+    
+    // tangent plane basis (e, n) at org
+    double norg = sqrt(dot(org, org));
+    if (norg == 0.)
+      return false;
+    vec3 up = org * (1.0 / norg);
+    vec3 e = cross(fabs(up.z) < 0.9 ? vec3(0, 0, 1) : vec3(1, 0, 0), up);
+    e *= 1.0 / sqrt(dot(e, e));
+    vec3 n = cross(up, e);
+    
+    double du = dot(dir, e), dv = dot(dir, n);
+    double ndir = sqrt(du * du + dv * dv);
+    if (ndir == 0.)
+      return false;
+    du /= ndir;
+    dv /= ndir;
+    vec3 end = org + (e * du + n * dv) * len;
+
+    // bounding box of the ray, with the margin of the drop of the earth
+    // surface from the tangent plane.
+    double margin = len * len / (2.0 * norg) + 1.0;
+    s_bvh_node box;
+    box.bmin = vec3(min(org.x, end.x) - margin, min(org.y, end.y) - margin,
+		    min(org.z, end.z) - margin);
+    box.bmax = vec3(max(org.x, end.x) + margin, max(org.y, end.y) + margin,
+		    max(org.z, end.z) + margin);
+
+    double tmin = DBL_MAX;
+    unsigned int imin = 0;
+    unsigned int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+      unsigned int inode = stack[--sp];
+      const s_bvh_node & node = nodes[inode];
+      if (node.bmin.x > box.bmax.x || node.bmax.x < box.bmin.x ||
+	  node.bmin.y > box.bmax.y || node.bmax.y < box.bmin.y ||
+	  node.bmin.z > box.bmax.z || node.bmax.z < box.bmin.z)
+	continue;
+      
+      if (node.num) {
+	for (unsigned int i = node.first; i < node.first + node.num; i++) {
+	  vec3 a(x0[i] - org.x, y0[i] - org.y, z0[i] - org.z);
+	  vec3 b(x1[i] - org.x, y1[i] - org.y, z1[i] - org.z);
+	  double au = dot(a, e), av = dot(a, n);
+	  double su = dot(b, e) - au, sv = dot(b, n) - av;
+	  // (du, dv) t = (au, av) + (su, sv) s
+	  double den = du * sv - dv * su;
+	  if (den == 0.)
+	    continue;
+	  double t = (au * sv - av * su) / den;
+	  double s = (au * dv - av * du) / den;
+	  if (t < 0. || t > len || s < 0. || s > 1.)
+	    continue;
+	  if (t < tmin) {
+	    tmin = t;
+	    imin = i;
+	  }
+	}
+	continue;
+      }
+      stack[sp++] = inode + 1;
+      stack[sp++] = node.first;
+    }
+
+    if (tmin == DBL_MAX)
+      return false;
+
+    hit.iline = iline[imin];
+    hit.ipt = ipt[imin];
+    hit.dist = tmin;
+    return true;
+  }
   
   /////////////////////////////////////////////////////////////////// CoastLine
-  const vector<vec3> CoastLine::null_vec_vec3;
-  const vector<vec2> CoastLine::null_vec_vec2;
+  // radian to the quantized value. +-PI is mapped to +-(2^31 - 1).
+  static const double coast_line_qscale = 2147483647.0 / PI;
+
+  // format tag of the layer data file. The first word of the files before
+  // the tag was introduced is the number of lines.
+  static const unsigned int coast_line_format_tag = 0xFFFFFFFF;
+  static const unsigned int coast_line_format_version = 1;
   
-  CoastLine::CoastLine() :dist_min(FLT_MAX), total_size(0)
+  CoastLine::s_pt CoastLine::encode(const vec2 & pt)
+  {
+    s_pt q;
+    q.lat = (int)floor(pt.lat * coast_line_qscale + 0.5);
+    q.lon = (int)floor(pt.lon * coast_line_qscale + 0.5);
+    return q;
+  }
+
+  vec2 CoastLine::decode(const s_pt & pt)
+  {
+    return vec2(pt.lat / coast_line_qscale, pt.lon / coast_line_qscale);
+  }
+
+  vec3 CoastLine::decode_ecef(const s_pt & pt)
+  {
+    vec3 pt_ecef;
+    blhtoecef(pt.lat / coast_line_qscale, pt.lon / coast_line_qscale, 0.,
+	      pt_ecef.x, pt_ecef.y, pt_ecef.z);
+    return pt_ecef;
+  }
+
+  void CoastLine::s_line::getECEF(vector<vec3> & pts_ecef) const
+  {
+    pts_ecef.resize(pts.size());
+    for (size_t ipt = 0; ipt < pts.size(); ipt++)
+      pts_ecef[ipt] = decode_ecef(pts[ipt]);
+  }
+
+  void CoastLine::getPointsECEF(unsigned int id, vector<vec3> & pts) const
+  {
+    if (id >= lines.size()) {
+      pts.clear();
+      return;
+    }
+    lines[id]->getECEF(pts);
+  }
+  
+  void CoastLine::getPointsBLH(unsigned int id, vector<vec2> & pts) const
+  {
+    pts.clear();
+    if (id >= lines.size())
+      return;
+    const vector<s_pt> & src = lines[id]->pts;
+    pts.resize(src.size());
+    for (size_t ipt = 0; ipt < src.size(); ipt++)
+      pts[ipt] = decode(src[ipt]);
+  }
+  
+  CoastLine::CoastLine() :dist_min(FLT_MAX), total_size(0), bindex(false)
   {
   }
   
   CoastLine::~CoastLine()
   {
+    for (auto itr = lines.begin(); itr != lines.end(); itr++)
+      delete (*itr);
   }
 
+  // signed integer to/from zigzag varint
+  static void write_varint(ofstream & ofile, const int v)
+  {
+    unsigned int u = ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+    char buf[5];
+    int len = 0;
+    while (u >= 0x80) {
+      buf[len++] = (char)(u | 0x80);
+      u >>= 7;
+    }
+    buf[len++] = (char)u;
+    ofile.write(buf, len);
+  }
+
+  static bool read_varint(istream & ifile, int & v)
+  {
+    unsigned int u = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      int c = ifile.get();
+      if (c == EOF)
+	return false;
+      u |= (unsigned int)(c & 0x7F) << shift;
+      if (!(c & 0x80)) {
+	v = (int)(u >> 1) ^ -(int)(u & 1);
+	return true;
+      }
+    }
+    return false;
+  }
+  
+  // The content is:
+  // format tag (0xFFFFFFFF), version, the number of lines (unsigned int),
+  // then for each line, the number of points (unsigned int) and the points
+  // as zigzag varints of lat and lon, the first point as is and the others
+  // as the differences from the previous points.
   bool CoastLine::save(ofstream & ofile)
   {
+    ofile.write((const char*)&coast_line_format_tag, sizeof(unsigned int));
+    ofile.write((const char*)&coast_line_format_version, sizeof(unsigned int));
     unsigned int nlines = (unsigned int) lines.size();
     ofile.write((const char*)&nlines, sizeof(unsigned int));
     for (auto itr = lines.begin(); itr != lines.end(); itr++){
-      vector<vec2> & pts = (*itr)->pts;
+      vector<s_pt> & pts = (*itr)->pts;
       unsigned int length = (unsigned int) pts.size();
       ofile.write((const char*)&length, sizeof(unsigned int));
-      for (auto itr_pt = pts.begin(); itr_pt != pts.end(); itr_pt++){	
-	vec2 pt = *itr_pt;
-	ofile.write((const char*)(&pt), sizeof(vec2));
+      s_pt pt_prev;
+      pt_prev.lat = pt_prev.lon = 0;
+      for (auto itr_pt = pts.begin(); itr_pt != pts.end(); itr_pt++){
+	write_varint(ofile, (int)((unsigned int)itr_pt->lat -
+				  (unsigned int)pt_prev.lat));
+	write_varint(ofile, (int)((unsigned int)itr_pt->lon -
+				  (unsigned int)pt_prev.lon));
+	pt_prev = *itr_pt;
       }
     }
     return true;
   }
 
-  bool CoastLine::load(ifstream & ifile)
+  bool CoastLine::load(istream & ifile)
   {
-    unsigned int nlines = 0;
+    unsigned int nlines = 0, version = 0;
     ifile.read((char*)&nlines, sizeof(unsigned int));
-    lines.resize(nlines);
+    if (nlines == coast_line_format_tag) {
+      ifile.read((char*)&version, sizeof(unsigned int));
+      ifile.read((char*)&nlines, sizeof(unsigned int));
+    }
+    if (!ifile)
+      return false;
     
-    for (auto itr = lines.begin(); itr != lines.end(); itr++){
-      (*itr) = new s_line;
+    lines.reserve(nlines);
+    for (unsigned int iline = 0; iline < nlines; iline++){
+      s_line * pline = new s_line;
+      lines.push_back(pline);
       
-      vector<vec2> & pts = (*itr)->pts;
-      vector<vec3> & pts_ecef = (*itr)->pts_ecef;
-      unsigned int length;
+      vector<s_pt> & pts = pline->pts;
+      unsigned int length = 0;
       ifile.read((char*)&length, sizeof(unsigned int));
+      if (!ifile)
+	return false;
       pts.resize(length);
-      pts_ecef.resize(length);
-      auto itr_pt_ecef = pts_ecef.begin();
-      for (auto itr_pt = pts.begin(); itr_pt != pts.end(); itr_pt++, itr_pt_ecef++){
-	vec2 pt;
-	vec3 pt_ecef;
-	ifile.read((char*)(&pt), sizeof(vec2));
-	blhtoecef(pt.lat, pt.lon, 0, pt_ecef.x, pt_ecef.y, pt_ecef.z);
-	(*itr_pt_ecef) = pt_ecef;
-	(*itr_pt) = pt;
+      if (version == 0) {
+	// points in vec2 
+	for (auto itr_pt = pts.begin(); itr_pt != pts.end(); itr_pt++){
+	  vec2 pt;
+	  ifile.read((char*)(&pt), sizeof(vec2));
+	  *itr_pt = encode(pt);
+	}
+	continue;
+      }
+      
+      s_pt pt;
+      pt.lat = pt.lon = 0;
+      for (auto itr_pt = pts.begin(); itr_pt != pts.end(); itr_pt++){
+	int dlat, dlon;
+	if (!read_varint(ifile, dlat) || !read_varint(ifile, dlon))
+	  return false;
+	pt.lat = (int)((unsigned int)pt.lat + (unsigned int)dlat);
+	pt.lon = (int)((unsigned int)pt.lon + (unsigned int)dlon);
+	*itr_pt = pt;
       }
     }
+    if (!ifile)
+      return false;
     
     update_properties();
     
@@ -115,6 +506,26 @@ namespace AWSMap2{
 	delete (*itr);
       }
     lines.clear();
+    bindex = false;
+    index.clear();
+  }
+
+  const SegmentIndex & CoastLine::getSegmentIndex() const
+  {
+    if (!bindex) {
+      unique_lock<mutex> lock(mtxIndex);
+      if (!bindex) {
+	index.clear();
+	vector<vec3> pts;
+	for (unsigned int iline = 0; iline < lines.size(); iline++) {
+	  lines[iline]->getECEF(pts);
+	  index.add(pts, iline);
+	}
+	index.build();
+	bindex = true;
+      }
+    }
+    return index;
   }
   
   size_t CoastLine::size() const
@@ -139,17 +550,35 @@ namespace AWSMap2{
   
   bool CoastLine::split(list<Node*> & nodes, Node * pParentNode) const
   {
-    vector<CoastLine> cls(nodes.size());
-    vector<Node*> vnodes(nodes.size()); // vector version of nodes
-    {
-      int inode = 0;
-      for (auto itr = nodes.begin(); itr != nodes.end(); itr++, inode++) {
-	vnodes[inode] = *itr;
-      }
+    vector<Node*> vnodes(nodes.begin(), nodes.end()); // vector version of nodes
+    vector<LayerData*> parts;
+    partition(vnodes, pParentNode, parts);
+    
+    for (int inode = 0; inode < vnodes.size(); inode++) {
+      if (!parts[inode])
+	continue;
+#ifdef _AWS_MAP_DEBUG
+      cout << "Adding layer data: " << endl;
+      parts[inode]->print();
+      cout << " \tsize: " << parts[inode]->size() << endl;
+#endif
+      vnodes[inode]->addLayerData(*parts[inode]);
+      delete parts[inode];
     }
     
+    return true;
+  }
+
+  bool CoastLine::partition(const vector<Node*> & nodes, Node * pParentNode,
+			    vector<LayerData*> & parts) const
+  {
+    vector<CoastLine*> cls(nodes.size());
+    for (int inode = 0; inode < nodes.size(); inode++)
+      cls[inode] = new CoastLine;
+    
+    vector<vec3> pts;
     for (int iline = 0; iline < lines.size(); iline++) {
-      vector<vec3> & pts = lines[iline]->pts_ecef;
+      lines[iline]->getECEF(pts);
       // Find correspondances between points in the line and nodes.
       
       vector<char> asgnc(pts.size(), -1);
@@ -158,14 +587,11 @@ namespace AWSMap2{
       }
       else {
 	for (int ipt = 0; ipt < pts.size() - 1; ipt++) {
-	  int inode = 0;
-	  for (auto itr = nodes.begin(); itr != nodes.end(); itr++) {
-	    Node * pNode = *itr;
-	    if (pNode->collision(pts[ipt])) {
+	  for (int inode = 0; inode < nodes.size(); inode++) {
+	    if (nodes[inode]->collision(pts[ipt])) {
 	      asgnc[ipt] = inode;
 	      break;
 	    }
-	    inode++;
 	  }
 	}
       }
@@ -177,7 +603,7 @@ namespace AWSMap2{
       int inn = -1;        // next node index 
       int ipts = 0;        // start point index      
       int ipte = 0;        // end point index
-      list<vec2> line_new; // newly added line partially extracted from lines[iline]
+      const s_pt * pts_src = lines[iline]->pts.data();
       for (int ipt = 1; ipt < pts.size(); ipt++) {
 	inn = asgnc[ipt];
 	
@@ -185,12 +611,9 @@ namespace AWSMap2{
 	  ipte = ipt + 1; // this "+1" allows to make overwrap on next part.
 	  
 	  // form new line contains points ipts to ipte.
-	  for (int iptl = ipts; iptl < ipte; iptl++) {
-	    line_new.push_back(lines[iline]->pts[iptl]);
+	  if (in >= 0) {
+	    cls[in]->add(pts_src + ipts, pts_src + ipte);
 	  }
-	  
-	  cls[in].add(line_new);
-	  line_new.clear();
 	  in = inn;
 	  ipts = ipt;
 	  continue;
@@ -198,178 +621,233 @@ namespace AWSMap2{
       }
     }
     
+    parts.resize(nodes.size());
     for (int inode = 0; inode < nodes.size(); inode++) {
-      cls[inode].update_properties();
-#ifdef _AWS_MAP_DEBUG
-      cout << "Adding layer data: " << endl;
-      cls[inode].print();
-      cout << " \tsize: " << cls[inode].size() << endl;
-#endif
-      if (cls[inode].size() > 0)
-	vnodes[inode]->addLayerData(cls[inode]);
+      cls[inode]->update_properties();
+      if (cls[inode]->size() > 0) {
+	parts[inode] = cls[inode];
+      }
+      else {
+	delete cls[inode];
+	parts[inode] = NULL;
+      }
     }
     
     return true;
   }
 
 
-  int CoastLine::try_reduce(int nred)
+  // indexed binary min-heap of the point costs. The position of each point
+  // in the heap is kept, then the cost of a point can be updated in place.
+  class CostHeap
   {
-    // select nred points with shortest distance to both sides in the line (excluding terminal points)
-    struct s_red_pt{
-      int iline;
-      int ipt;
-      double dist;
-      s_red_pt * prev, *next;
-      s_red_pt() :iline(-1), ipt(-1), dist(DBL_MAX), prev(NULL), next(NULL){};
-    };
-  
-    // creating distance data 
-    int npts_list = 0;
-    vector<s_red_pt*> redpts(lines.size());
-  
-    for (int iline = 0; iline < lines.size(); iline++){
-      redpts[iline] = NULL;
-      vector<vec3> & pts = lines[iline]->pts_ecef;
-      if(pts.size() > 3)
-	npts_list += (int)pts.size() - 3;
+  private:
+    vector<double> & cost;
+    vector<int> heap;
+    vector<int> pos; // position in heap, -1 if not in heap
+    
+    bool less(const int i, const int j) const
+    {
+      return cost[heap[i]] < cost[heap[j]];
     }
-  
-    // creating sort list
-    vector<s_red_pt> mblock(npts_list);
-    vector<s_red_pt*> sortlist(npts_list, NULL);
-    npts_list = 0;
-    for (int iline = 0; iline < lines.size(); iline++){
-      if (lines[iline]->pts.size() <= 3) {
-	vec2 &pt0 = lines[iline]->pts.front();
-	vec2 &pt1 = lines[iline]->pts.back();
-	if (pt0.x == pt1.x && pt0.y == pt1.y) {
-	  delete lines[iline];
-	  lines[iline] = NULL;
-	}
-	continue;
-      }
-      vector<vec3> & pts = lines[iline]->pts_ecef;
-      s_red_pt * redpt = NULL, * redpt_prev = NULL;
-      for (int ipt = 2; ipt < pts.size() - 1; ipt++){
-	redpt = &mblock[npts_list];
-	redpt->iline = iline;
-	redpt->ipt = ipt;
-	redpt->dist = l2Norm(pts[ipt], pts[ipt - 1]);
-	sortlist[npts_list] = redpt;
-	if (!redpt_prev) {
-	  redpts[iline] = redpt;
-	}
-	else {
-	  redpt_prev->next = redpt;
-	  redpt->prev = redpt_prev;
-	}
-	redpt_prev = redpt;
-	npts_list++;
+
+    void swap_at(const int i, const int j)
+    {
+      swap(heap[i], heap[j]);
+      pos[heap[i]] = i;
+      pos[heap[j]] = j;
+    }
+    
+    void up(int i)
+    {
+      while (i > 0) {
+	int ip = (i - 1) >> 1;
+	if (!less(i, ip))
+	  break;
+	swap_at(i, ip);
+	i = ip;
       }
     }
 
-    struct {
-      bool operator () (const s_red_pt * p0, const s_red_pt * p1) const
-      {
-	return p0->dist < p1->dist;
+    void down(int i)
+    {
+      const int n = (int)heap.size();
+      while (true) {
+	int il = 2 * i + 1, ir = il + 1, imin = i;
+	if (il < n && less(il, imin))
+	  imin = il;
+	if (ir < n && less(ir, imin))
+	  imin = ir;
+	if (imin == i)
+	  break;
+	swap_at(i, imin);
+	i = imin;
       }
-    } lessthan;
-  
-    sort(sortlist.begin(), sortlist.end(), lessthan);
+    }
+    
+  public:
+    CostHeap(vector<double> & _cost) : cost(_cost), pos(_cost.size(), -1)
+    {
+    }
+
+    void push(const int id)
+    {
+      pos[id] = (int)heap.size();
+      heap.push_back(id);
+    }
+
+    // build the heap after all the points are pushed
+    void make()
+    {
+      for (int i = (int)heap.size() / 2 - 1; i >= 0; i--)
+	down(i);
+    }
+    
+    bool empty() const
+    {
+      return heap.empty();
+    }
+    
+    int pop()
+    {
+      int id = heap[0];
+      swap_at(0, (int)heap.size() - 1);
+      heap.pop_back();
+      pos[id] = -1;
+      if (!heap.empty())
+	down(0);
+      return id;
+    }
+
+    bool contains(const int id) const
+    {
+      return pos[id] >= 0;
+    }
+    
+    void update(const int id, const double c)
+    {
+      double c_prev = cost[id];
+      cost[id] = c;
+      if (c < c_prev)
+	up(pos[id]);
+      else
+	down(pos[id]);
+    }
+  };
+
+  // area of the triangle (p0, p1, p2), the cost removing p1 from the line.
+  static double tri_area(const vec3 & p0, const vec3 & p1, const vec3 & p2)
+  {
+    vec3 a = cross(p0 - p1, p2 - p1);
+    return 0.5 * sqrt(dot(a, a));
+  }
   
-    // reduction phase
-#ifdef _AWS_MAP_DEBUG
+  int CoastLine::try_reduce(int nred)
+  {
+    // Visvalingam-Whyatt simplification over all the lines. The interior
+    // point forming the smallest triangle with its neighbors is removed
+    // one at a time, then the costs of the neighbors are updated.
+    // The end points are kept so that the lines can be connected in merge.
     int nredd = 0;
-    int prog = 0;	
-    cout << "Progress(";
-    cout << nred << "/" << sortlist.size() << "):";
-#endif
-    while (nredd < nred && nredd < sortlist.size()){
-      if(nredd % 100 == 0)
-	cout << "nredd = " << nredd << endl;
-#ifdef _AWS_MAP_DEBUG
-      if ((nredd * 10 / nred) > prog) {
-	prog ++;
-	cout << "*";
-      }
-#endif
-      s_red_pt * redpt = sortlist[nredd];
-      s_red_pt * redpt0 = redpt->prev;
-      s_red_pt * redpt1 = redpt->next;
-      int iline = redpt->iline;
-      int ipt = redpt->ipt;
-      int ipt0 = (redpt0 ? redpt0->ipt : 1);
-      int ipt1 = (redpt1 ? redpt1->ipt : lines[iline]->pts.size() - 1);
-    
-      s_line & line = *lines[iline];
-      vector<vec2> & pts = line.pts;
-      vector<vec3> & pts_ecef = line.pts_ecef;
-      vec2 pt_m;
-      vec3 pt_ecef_m;
-      pt_ecef_m = (pts_ecef[ipt0] + pts_ecef[ipt]);
-      pt_ecef_m *= 0.5;
-      double alt;
-      eceftoblh(pt_ecef_m.x, pt_ecef_m.y, pt_ecef_m.z, pt_m.lat, pt_m.lon, alt);
-    
-      if (redpt0){
-	int iptm1 = (redpt0->prev ? redpt0->prev->ipt : 1);
-	redpt0->dist = l2Norm(pt_ecef_m, pts_ecef[iptm1]);
-	redpt0->next = redpt1;
-      }
-      else {
-	redpts[iline] = redpt1;
+
+    // points are indexed as offset[iline] + ipt
+    vector<int> offset(lines.size() + 1, 0);
+    for (int iline = 0; iline < lines.size(); iline++) {
+      offset[iline + 1] = offset[iline] + (int)lines[iline]->pts.size();
+    }
+    const int npts = offset.back();
+    vector<int> prev(npts), next(npts), nleft(lines.size());
+    vector<double> cost(npts, DBL_MAX);
+    CostHeap heap(cost);
+
+    // ECEF points are decoded only while reducing
+    vector<vector<vec3> > pts_ecef(lines.size());
+    for (int iline = 0; iline < lines.size(); iline++) {
+      vector<vec3> & pts = pts_ecef[iline];
+      lines[iline]->getECEF(pts);
+      nleft[iline] = (int)pts.size();
+      
+      // closed lines with 3 points or less are removed.
+      if (pts.size() <= 3 && pts.front() == pts.back()) {
+	nredd += (int)pts.size();
+	delete lines[iline];
+	lines[iline] = NULL;
+	continue;
       }
-    
-      if (redpt1){
-	redpt1->dist = l2Norm(pt_ecef_m, pts_ecef[ipt1]);
-	redpt1->prev = redpt0;
+
+      const int i0 = offset[iline];
+      for (int ipt = 0; ipt < pts.size(); ipt++) {
+	prev[i0 + ipt] = i0 + ipt - 1;
+	next[i0 + ipt] = i0 + ipt + 1;
       }
-      pts[ipt0] = pt_m;
-      pts_ecef[ipt0] = pt_ecef_m;
-    
-      if (redpts[iline] == NULL) { // points has already been 3
-	vec2 & pt0 = pts.front();
-	vec2 & pt1 = pts.back();
-	if (pt0.x == pt1.x && pt0.y == pt1.y) {
-	  delete lines[iline];
-	  lines[iline] = NULL;
-	  nredd += 3;
-	}
+      for (int ipt = 1; ipt + 1 < pts.size(); ipt++) {
+	cost[i0 + ipt] = tri_area(pts[ipt - 1], pts[ipt], pts[ipt + 1]);
+	heap.push(i0 + ipt);
       }
+    }
+    heap.make();
+
+    // reduction phase
+    vector<char> removed(npts, 0);
+    vector<int> line_of(npts);
+    for (int iline = 0; iline < lines.size(); iline++)
+      for (int i = offset[iline]; i < offset[iline + 1]; i++)
+	line_of[i] = iline;
     
+    while (nredd < nred && !heap.empty()) {
+      int id = heap.pop();
+      int iline = line_of[id];
+      if (!lines[iline])
+	continue;
+      
+      const int i0 = offset[iline];
+      vector<vec3> & pts = pts_ecef[iline];
+      const double c = cost[id];
+      int ip = prev[id], in = next[id];
+      next[ip] = in;
+      prev[in] = ip;
+      removed[id] = 1;
+      nleft[iline]--;
       nredd++;
-    
-      sort(sortlist.begin() + nredd, sortlist.end(), lessthan);
-      if (sortlist.size() == 0)
-	break;
+
+      // a closed line reduced to 3 points is removed.
+      if (nleft[iline] <= 3 && pts.front() == pts.back()) {
+	nredd += nleft[iline];
+	delete lines[iline];
+	lines[iline] = NULL;
+	continue;
+      }
+      
+      // costs of the neighbors are not less than the removed one, then
+      // the removal order is kept monotonic.
+      if (heap.contains(ip))
+	heap.update(ip, max(c, tri_area(pts[prev[ip] - i0], pts[ip - i0],
+					 pts[in - i0])));
+      if (heap.contains(in))
+	heap.update(in, max(c, tri_area(pts[ip - i0], pts[in - i0],
+					 pts[next[in] - i0])));
     }
 #ifdef _AWS_MAP_DEBUG
-    cout << endl;
     if (nredd < nred) {
       cout << "Reduction is not completed because of many fragment" << endl;
     }
 #endif
+
+    // remove the points from the lines
     for (int iline = 0; iline < lines.size(); iline++) {
       if (!lines[iline])
 	continue;
-    
-      vector<vec2> & pts = lines[iline]->pts;
-      vector<vec3> & pts_ecef = lines[iline]->pts_ecef;
-    
-      if (pts.size() < 3)
-	continue;
-    
-      s_red_pt * redpt = redpts[iline];
-      int ipt = 2;
-      for (; redpt != NULL; redpt = redpt->next, ipt++){
-	pts[ipt] = pts[redpt->ipt];
-	pts_ecef[ipt] = pts_ecef[redpt->ipt];
+      
+      vector<s_pt> & pts = lines[iline]->pts;
+      const int i0 = offset[iline];
+      int jpt = 0;
+      for (int ipt = 0; ipt < pts.size(); ipt++) {
+	if (removed[i0 + ipt])
+	  continue;
+	pts[jpt] = pts[ipt];
+	jpt++;
       }
-      pts[ipt] = pts.back();
-      pts_ecef[ipt] = pts_ecef.back();
-      pts.resize(ipt + 1);
-      pts_ecef.resize(ipt + 1);
+      pts.resize(jpt);
     }
   
     update_properties();
@@ -385,7 +863,7 @@ namespace AWSMap2{
   
     // calculate nred; the number of points to be reduced
     unsigned int sz_pts_lim = (unsigned int)(sz_lim);	
-    unsigned int sz_pt = (unsigned int)(sizeof(vec2)+sizeof(vec3));
+    unsigned int sz_pt = (unsigned int)(sizeof(s_pt));
     unsigned int npts = 0;
     for (unsigned int iline = 0; iline < lines.size(); iline++){
       npts += (unsigned int) lines[iline]->pts.size();
@@ -411,8 +889,8 @@ namespace AWSMap2{
     for (int iline0 = 0; iline0 < lines_src.size(); iline0++){
     
       s_line & line_src = *lines_src[iline0];
-      vector<vec2> & pts_src = line_src.pts;
-      vec2 & pt_src_begin = pts_src.front() , & pt_src_end = pts_src.back();
+      vector<s_pt> & pts_src = line_src.pts;
+      s_pt & pt_src_begin = pts_src.front() , & pt_src_end = pts_src.back();
     
       // iline_con_begin is the line index of existing line connected with newly added line lines_src[iline0]
       // and bdst_begin_con_begin is true if lines[iline_con_begin] and lines_src[iline0] is connected with their starting points.
@@ -425,8 +903,8 @@ namespace AWSMap2{
 	if (!lines[iline1])
 	  continue;
 	s_line & line_dst = *lines[iline1];
-	vector<vec2> & pts_dst = line_dst.pts;
-	vec2 & pt_dst_begin = pts_dst.front(), & pt_dst_end = pts_dst.back();
+	vector<s_pt> & pts_dst = line_dst.pts;
+	s_pt & pt_dst_begin = pts_dst.front(), & pt_dst_end = pts_dst.back();
 	if (iline_con_begin < 0) {
 	  if (pt_src_begin == pt_dst_begin) {
 	    iline_con_begin = iline1;
@@ -467,18 +945,14 @@ namespace AWSMap2{
 	if (bdst_begin_con_begin){
 	  // if the connection is head to head, first reverse the lines[iline_con_begin]
 	  reverse(pline_begin->pts.begin(), pline_begin->pts.end());
-	  reverse(pline_begin->pts_ecef.begin(), pline_begin->pts_ecef.end());
 	}
 	// copy lines[iline_con_begin] to newly created object *pline_new
 	*pline_new = *pline_begin;
 	assert(pline_new->pts.back() == pts_src.front());
 	pline_new->pts.pop_back();
-	pline_new->pts_ecef.pop_back();
 	// insert lines_src[iline0] at the end of pline_new 
 	// note that the end point is exactly the point of lines_src[iline0]. This is very important later if the end point is connected with other line.
 	pline_new->pts.insert(pline_new->pts.end(), pts_src.begin(), pts_src.end());
-	pline_new->pts_ecef.insert(pline_new->pts_ecef.end(), line_src.pts_ecef.begin(),
-				   line_src.pts_ecef.end());
       
 	// delete old object lines[iline_con_begin] and replace it with pline_new
 	delete lines[iline_con_begin];
@@ -488,13 +962,11 @@ namespace AWSMap2{
       if (iline_con_end >= 0){
 	// the end point of lines_src[iline0] is connected with lines[iline_con_end]
 	pline_end = lines[iline_con_end];
-	vector<vec2> & pts = pline_end->pts;
-	vector<vec3> & pts_ecef = pline_end->pts_ecef;
+	vector<s_pt> & pts = pline_end->pts;
       
 	if (!bdst_begin_con_end){
 	  // if lines_src[iline0] is connected with the end point of lines[iline_con_end] reverse it.
 	  reverse(pts.begin(), pts.end());
-	  reverse(pts_ecef.begin(), pts_ecef.end());
 	}
       
 	if (iline_con_begin >= 0) {
@@ -510,9 +982,7 @@ namespace AWSMap2{
       
 	assert(pline_new->pts.back() == pts.front());
 	pline_new->pts.pop_back();
-	pline_new->pts_ecef.pop_back();
 	pline_new->pts.insert(pline_new->pts.end(), pts.begin()+1, pts.end());
-	pline_new->pts_ecef.insert(pline_new->pts_ecef.end(), pts_ecef.begin()+1, pts_ecef.end());
 	delete lines[iline_con_end];
 	lines[iline_con_end] = pline_new;
       }
@@ -572,33 +1042,19 @@ namespace AWSMap2{
     return pnew;
   }
   
-  void CoastLine::add(list<vec2> & line)
+  void CoastLine::add(const s_pt * begin, const s_pt * end)
   {
     s_line * pline = new s_line;
-    
-    pline->pts.resize(line.size());
-    pline->pts_ecef.resize(line.size());
-    list<vec2>::iterator itr_src = line.begin();
-    vector<vec2>::iterator itr_dst = pline->pts.begin();
-    vector<vec3>::iterator itr_dst_ecef = pline->pts_ecef.begin();
-    for (; itr_src != line.end(); itr_src++, itr_dst++, itr_dst_ecef++) {
-      *itr_dst = *itr_src;
-      blhtoecef(itr_dst->lat, itr_dst->lon, 0., itr_dst_ecef->x, itr_dst_ecef->y, itr_dst_ecef->z);
-    }
+    pline->pts.assign(begin, end);
     lines.push_back(pline);
-    
-    // calculating resolution and size
-    vector<vec3> & pts = pline->pts_ecef;
-    for (int i = 1; i < pts.size(); i++) {
-      vec3 & pt0 = pts[i - 1];
-      vec3 & pt1 = pts[i];
-      dist_min = min(dist_min, l2Norm(pt0, pt1));
-    }
     total_size += pline->size();
   }
   
   void CoastLine::update_properties()
   {
+    bindex = false;
+    index.clear();
+    
     // removing null line
     for (auto itr = lines.begin(); itr != lines.end();) {
       if (*itr == NULL)
@@ -610,8 +1066,9 @@ namespace AWSMap2{
     // calculating center 	
     pt_center = vec3(0, 0, 0);
     unsigned int num_total_points = 0;
+    vector<vec3> pts;
     for (int iline = 0; iline < lines.size(); iline++){
-      vector<vec3> & pts = lines[iline]->pts_ecef;
+      lines[iline]->getECEF(pts);
       for (int i = 0; i < pts.size(); i++){
 	pt_center += pts[i];
       }
@@ -627,7 +1084,7 @@ namespace AWSMap2{
     dist_min = DBL_MAX;
     for (int iline = 0; iline < lines.size(); iline++){
       // calculating resolution and size
-      vector<vec3> & pts = lines[iline]->pts_ecef;
+      lines[iline]->getECEF(pts);
       pt_radius = max(pt_radius, l2Norm(pt_center, pts[0]));
       for (int i = 2; i < pts.size()-1; i++) {
 	vec3 & pt0 = pts[i - 1];
@@ -635,6 +1092,7 @@ namespace AWSMap2{
 	double dist = l2Norm(pt0, pt1);
 	if (dist == 0) {
 	  pts.erase(pts.begin() + i);
+	  lines[iline]->pts.erase(lines[iline]->pts.begin() + i);
 	  i--;
 	  continue;
 	}
@@ -647,48 +1105,103 @@ namespace AWSMap2{
   
   bool CoastLine::loadJPJIS(const char * fname)
   {
-    ifstream fjpgis(fname);
-    if (!fjpgis.is_open()) {
-      cerr << "Failed to open file " << fname << "." << endl;
-      return false;
+    list<string> fnames;
+    fnames.push_back(fname);
+    return loadJPJIS(fnames);
+  }
+
+  // parse the points in the text of a gml:posList, one "lat lon" pair in
+  // degree a line.
+  static void parse_pos_list(const char * p, const char * end,
+			     vector<vec2> & line)
+  {
+    while (p < end) {
+      const char * eol = (const char*) memchr(p, '\n', end - p);
+      if (!eol)
+	eol = end;
+      
+      char * q;
+      double lat = strtod(p, &q);
+      if (q != p && q < eol) {
+	const char * r = q;
+	double lon = strtod(r, &q);
+	if (q != r && q <= eol) {
+	  line.push_back(vec2(lat * PI / 180., lon * PI / 180.));
+	}
+      }
+      p = eol + 1;
     }
-    
-    char buf[1024];
-    bool bline = false;
-    list<vec2> line;
-    while (!fjpgis.eof())
+  }
+  
+  bool CoastLine::loadJPJIS(const list<string> & fnames,
+			    const unsigned int nthreads)
+  {
+    // read the files, and find the lines. 
+    vector<string> texts(fnames.size());
+    vector<pair<const char*, const char*>> blocks;
+    int ifile = 0;
+    for (auto itr = fnames.begin(); itr != fnames.end(); itr++, ifile++) {
+      ifstream fjpgis(itr->c_str(), ios::binary);
+      if (!fjpgis.is_open()) {
+	cerr << "Failed to open file " << *itr << "." << endl;
+	return false;
+      }
+      texts[ifile].assign(istreambuf_iterator<char>(fjpgis),
+			  istreambuf_iterator<char>());
+
+      // a line is the text lines following the line of <gml:posList>
+      // up to the line of </gml:posList>
+      const char * p = texts[ifile].c_str();
+      while ((p = strstr(p, "<gml:posList>")) != NULL) {
+	const char * begin = strchr(p, '\n');
+	if (!begin)
+	  break;
+	begin++;
+	const char * end = strstr(begin, "</gml:posList>");
+	if (!end)
+	  break;
+	p = end;
+	while (end > begin && end[-1] != '\n')
+	  end--;
+	blocks.push_back(pair<const char*, const char*>(begin, end));
+      }
+    }
+
+    // parse the lines in parallel
+    vector<s_line*> lines_new(blocks.size(), NULL);
+    unsigned int nth = nthreads ? nthreads : thread::hardware_concurrency();
+    nth = max(1u, min(nth, (unsigned int)blocks.size()));
+    auto parse = [&blocks, &lines_new, nth](const unsigned int ith)
       {
-	fjpgis.getline(buf, 1024);
-	
-	if (!bline) {
-	  char * p = buf;
-	  for (; *p != '<' && *p != '\0'; p++);
-	  
-	  if (strncmp(p, "<gml:posList>", 13) == 0) {
-	    bline = true;
-	  }
-	}
-	else {
-	  char * p = buf;
-	  for (; *p != '<' && *p != '\0'; p++);
-	  if (strncmp(p, "</gml:posList>", 14) == 0) {
-	    add(line);
-	    line.clear();
-	    bline = false;
+	vector<vec2> line;
+	for (size_t iblk = ith; iblk < blocks.size(); iblk += nth) {
+	  line.clear();
+	  parse_pos_list(blocks[iblk].first, blocks[iblk].second, line);
+	  if (line.empty())
 	    continue;
-	  }
-	  
-	  vec2 pt;
-	  for (p = buf; *p != ' ' && *p != '\0'; p++);
-	  *p = '\0';
-	  p++;
-	  pt.x = (float)(atof(buf) * PI / 180.);
-	  pt.y = (float)(atof(p) * PI / 180.);
 	  
-	  if (line.size() == 0 || (pt.x != line.back().x || pt.y != line.back().y))
-	    line.push_back(pt);
+	  // duplicated points are removed after quantization
+	  s_line * pline = new s_line;
+	  pline->pts.reserve(line.size());
+	  for (size_t ipt = 0; ipt < line.size(); ipt++) {
+	    s_pt pt = encode(line[ipt]);
+	    if (pline->pts.empty() || pt != pline->pts.back())
+	      pline->pts.push_back(pt);
+	  }
+	  lines_new[iblk] = pline;
 	}
-      }
+      };
+    
+    vector<thread> ths;
+    for (unsigned int ith = 1; ith < nth; ith++)
+      ths.push_back(thread(parse, ith));
+    parse(0);
+    for (auto itr = ths.begin(); itr != ths.end(); itr++)
+      itr->join();
+
+    for (auto itr = lines_new.begin(); itr != lines_new.end(); itr++)
+      if (*itr)
+	lines.push_back(*itr);
     
     update_properties();
     return true;
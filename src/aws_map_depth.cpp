@@ -25,22 +25,144 @@
 #include <map>
 #include <algorithm>
 #include <mutex>
+#include <thread>
 using namespace std;
 
 #include <string.h>
 #include <assert.h>
+#include <zlib.h>
 
 #include "aws_coord.hpp"
 #include "aws_stdlib.hpp"
 #include "aws_map.hpp"
 
 namespace AWSMap2{
+  const short s_depth_bmp::pixel_unknown[2] = {-1, -1};
+
+  s_depth_bmp::s_depth_bmp() :
+    blocks(DEPTH_MAP_BLOCKS_X * DEPTH_MAP_BLOCKS_Y, nullptr)
+  {
+  }
+
+  s_depth_bmp::s_depth_bmp(const s_depth_bmp & bmp) :
+    blocks(DEPTH_MAP_BLOCKS_X * DEPTH_MAP_BLOCKS_Y, nullptr)
+  {
+    *this = bmp;
+  }
+
+  s_depth_bmp::~s_depth_bmp()
+  {
+    release();
+  }
+
+  s_depth_bmp & s_depth_bmp::operator = (const s_depth_bmp & bmp)
+  {
+    if (this == &bmp)
+      return *this;
+    
+    for (size_t ib = 0; ib < blocks.size(); ib++) {
+      if (!bmp.blocks[ib]) {
+	delete[] blocks[ib];
+	blocks[ib] = nullptr;
+	continue;
+      }
+      if (!blocks[ib])
+	blocks[ib] = new short[size_of_block];
+      memcpy(blocks[ib], bmp.blocks[ib], size_of_block * sizeof(short));
+    }
+    return *this;
+  }
+  
+  void s_depth_bmp::release()
+  {
+    for (size_t ib = 0; ib < blocks.size(); ib++) {
+      delete[] blocks[ib];
+      blocks[ib] = nullptr;
+    }
+  }
+
+  void s_depth_bmp::set(const int i, const int j, const short m,
+			const short mm)
+  {
+    short *& pb = blocks[get_block_index(i, j)];
+    if (!pb) {
+      if (m == pixel_unknown[0] && mm == pixel_unknown[1])
+	return;
+      pb = new short[size_of_block];
+      for (unsigned int ipx = 0; ipx < size_of_block; ipx++)
+	pb[ipx] = -1;
+    }
+    short * p = pb + get_offset(i, j);
+    p[0] = m;
+    p[1] = mm;
+  }
+  
+  unsigned int s_depth_bmp::get_num_blocks() const
+  {
+    unsigned int nblocks = 0;
+    for (size_t ib = 0; ib < blocks.size(); ib++)
+      if (blocks[ib])
+	nblocks++;
+    return nblocks;
+  }
+
+  // The content is:
+  // the number of blocks (unsigned int), then for each block,
+  // the block index, the compressed size (unsigned int) and the block
+  // compressed by zlib.
+  bool s_depth_bmp::write(ostream & ofile) const
+  {
+    unsigned int nblocks = get_num_blocks();
+    ofile.write((const char*)&nblocks, sizeof(unsigned int));
+    
+    const uLong len_src = size_of_block * sizeof(short);
+    vector<Bytef> buf(compressBound(len_src));
+    for (unsigned int ib = 0; ib < blocks.size(); ib++) {
+      if (!blocks[ib])
+	continue;
+      uLongf len = (uLongf)buf.size();
+      if (compress2(buf.data(), &len, (const Bytef*)blocks[ib], len_src,
+		    Z_BEST_SPEED) != Z_OK)
+	return false;
+      unsigned int len_comp = (unsigned int)len;
+      ofile.write((const char*)&ib, sizeof(unsigned int));
+      ofile.write((const char*)&len_comp, sizeof(unsigned int));
+      ofile.write((const char*)buf.data(), len_comp);
+    }
+    return !ofile.fail();
+  }
+
+  bool s_depth_bmp::read(istream & ifile)
+  {
+    release();
+    unsigned int nblocks = 0;
+    ifile.read((char*)&nblocks, sizeof(unsigned int));
+    if (!ifile || nblocks > blocks.size())
+      return false;
+
+    vector<Bytef> buf;
+    for (unsigned int iblk = 0; iblk < nblocks; iblk++) {
+      unsigned int ib = 0, len_comp = 0;
+      ifile.read((char*)&ib, sizeof(unsigned int));
+      ifile.read((char*)&len_comp, sizeof(unsigned int));
+      if (!ifile || ib >= blocks.size() || blocks[ib])
+	return false;
+      buf.resize(len_comp);
+      ifile.read((char*)buf.data(), len_comp);
+      if (!ifile)
+	return false;
+      
+      blocks[ib] = new short[size_of_block];
+      uLongf len = size_of_block * sizeof(short);
+      if (uncompress((Bytef*)blocks[ib], &len, buf.data(), len_comp) != Z_OK
+	  || len != size_of_block * sizeof(short))
+	return false;
+    }
+    return true;
+  }
+  
   Depth::Depth(): r(-1.0f)
   {
-    bmp.width = DEPTH_MAP_WIDTH;
-    bmp.height = DEPTH_MAP_HEIGHT;
-    bmp.channels = DEPTH_MAP_CHANNELS;
-    bmp.depth = DEPTH_MAP_DEPTH;
   }
 
   Depth::~Depth()
@@ -120,18 +242,12 @@ namespace AWSMap2{
 		   scale * (vtx1p.y - ymin) + ymini);
     vtxi[2] = vec2(scale * (vtx2p.x - xmin) + xmini,
 		   scale * (vtx2p.y - ymin) + ymini);
+    veci[0] = vec2(vtxi[1].x - vtxi[0].x, vtxi[1].y - vtxi[0].y);
+    veci[1] = vec2(vtxi[2].x - vtxi[0].x, vtxi[2].y - vtxi[0].y);
+    vtx_center = (vtx[0] + vtx[1] + vtx[2]) * (1.0 / 3.0);
 
-    if(!bmp.init(bmp.width, bmp.height, bmp.channels, bmp.depth)){
-      return false;
-    }
-
-    short * p = bmp.datai16;
-
-    for (int j = 0; j < bmp.height; j++){
-      for (int i = 0; i < bmp.width; i++, p+=2){	
-	p[0] = p[1] = -1;
-      }
-    }
+    // all the pixels are unknown
+    bmp.release();
     return true;
   }
 
@@ -143,6 +259,23 @@ namespace AWSMap2{
   }
 
   
+  // clip the range [imin, imax] to the pixels satisfying c0 + dc * i >= 0.
+  // The range is extended by one pixel so that the pixels on the edge are
+  // decided by the per-pixel test.
+  static void clip_span(const double c0, const double dc, int & imin, int & imax)
+  {
+    if (dc == 0) {
+      if (c0 < 0)
+	imax = imin - 1;
+      return;
+    }
+    double i = -c0 / dc;
+    if (dc > 0)
+      imin = max(imin, (int)floor(i) - 1);
+    else
+      imax = min(imax, (int)ceil(i) + 1);
+  }
+  
   bool Depth::_merge(const LayerData & layerData)
   {
     if(r < 0){// the object has not been initialized with node data.
@@ -157,72 +290,154 @@ namespace AWSMap2{
     }
 
     if(vtx_center == pdata->vtx_center){
-      memcpy(bmp.data, pdata->bmp.data, bmp.get_data_size());
+      bmp = pdata->bmp;
       return true;
     }
     
     // if a,b,c is in the effective triangle,
     // sample value around a veci[0] + b veci[1], and fill the pixel value.
-    unsigned int size_of_pixel = 2;
-    unsigned int size_of_rows = size_of_pixel * pdata->bmp.width;
+    const int width = DEPTH_MAP_WIDTH, height = DEPTH_MAP_HEIGHT;
+    const int xlim = width - 1, ylim = height - 1;
     
     double invD = 1.0 / (veci[0].x * veci[1].y - veci[0].y * veci[1].x);
     vec2 iv0(veci[1].y * invD, -veci[0].y * invD);
     vec2 iv1(-veci[1].x * invD, veci[0].x * invD);
+
+    // The pixel (i, j) is p = s vec[0] + t vec[1] + vtx[0], where s and t
+    // are affine in (i, j). The projection (a, b) of p to the triangle in
+    // layerData (see proj2tri) is the ratio of the affine values
+    //   a = -dot(p, A) / dot(p, C), b = -dot(p, B) / dot(p, C)
+    // then they are stepped incrementally along the rows.
+    const vec3 & ptri = pdata->vtx[0];
+    const vec3 & v0 = pdata->vec[0], & v1 = pdata->vec[1];
+    const vec3 A = cross(ptri, v1), B = cross(v0, ptri), C = cross(v0, v1);
+    const vec3 dp = vec[0] * iv0.x + vec[1] * iv0.y; // p step along a row
+    const double dna = -dot(dp, A), dnb = -dot(dp, B), dd = dot(dp, C);
+    const vec2 & vi0 = pdata->veci[0], & vi1 = pdata->veci[1];
+    const vec2 & vtxi0 = pdata->vtxi[0];
+
+    // rows covered by the triangle
+    const int jmin = max(0,
+      (int)floor(min(min(vtxi[0].y, vtxi[1].y), vtxi[2].y)));
+    const int jmax = min(height - 1,
+      (int)ceil(max(max(vtxi[0].y, vtxi[1].y), vtxi[2].y)));
+    
+    auto merge_rows = [&](const int jbegin, const int jend)
+      {
+	vector<double> xs(width), ys(width);
+	vector<char> valid(width);
+	for (int j = jbegin; j < jend; j++) {
+	  // s and t at i = 0, then the span inside the triangle.
+	  double y = (double)j - vtxi[0].y;
+	  double s0 = -iv0.x * vtxi[0].x + iv1.x * y;
+	  double t0 = -iv0.y * vtxi[0].x + iv1.y * y;
+	  int imin = 0, imax = width - 1;
+	  clip_span(s0, iv0.x, imin, imax);
+	  clip_span(t0, iv0.y, imin, imax);
+	  clip_span(1.0 - s0 - t0, -iv0.x - iv0.y, imin, imax);
+	  if (imin > imax)
+	    continue;
+	  
+	  vec3 p = vec[0] * s0 + vec[1] * t0 + vtx[0];
+	  const double na0 = -dot(p, A), nb0 = -dot(p, B), d0 = dot(p, C);
+
+	  // source pixel coordinates of the span. No branch in the loop
+	  // to be vectorized.
+	  const int n = imax - imin + 1;
+	  for (int k = 0; k < n; k++) {
+	    const double i = (double)(imin + k);
+	    const double s = s0 + iv0.x * i, t = t0 + iv0.y * i;
+	    const double invd = 1.0 / (d0 + dd * i);
+	    const double a = (na0 + dna * i) * invd;
+	    const double b = (nb0 + dnb * i) * invd;
+	    valid[k] = (s >= 0) & (s <= 1) & (t >= 0) & (t <= 1) & (s + t <= 1)
+	      & (a >= 0) & (a <= 1) & (b >= 0) & (b <= 1);
+	    xs[k] = vi0.x * a + vi1.x * b + vtxi0.x;
+	    ys[k] = vi0.y * a + vi1.y * b + vtxi0.y;
+	  }
+
+	  // sampling with bi-linear interpolation
+	  int ib_dst = -1;
+	  short * pb_dst = nullptr;
+	  for (int k = 0; k < n; k++) {
+	    if (!valid[k])
+	      continue;
+	    int x0 = int(xs[k]), y0 = int(ys[k]);
+	    if (x0 < 0 || y0 < 0 || x0 > xlim || y0 > ylim)
+	      continue;
+	    double alpha = xs[k] - (double)x0;
+	    double beta = ys[k] - (double)y0;
+	    double ialpha = 1.0 - alpha;
+	    double ibeta = 1.0 - beta;
+	    // the pixels on the last row and column are not interpolated.
+	    const int x1 = min(x0 + 1, xlim), y1 = min(y0 + 1, ylim);
+	    const short * pd00, * pd10, * pd01, * pd11;
+	    if (((x0 ^ x1) | (y0 ^ y1)) >> DEPTH_MAP_BLOCK_SHIFT) {
+	      // across the blocks
+	      pd00 = pdata->bmp.get(x0, y0);
+	      pd10 = pdata->bmp.get(x1, y0);
+	      pd01 = pdata->bmp.get(x0, y1);
+	      pd11 = pdata->bmp.get(x1, y1);
+	    }
+	    else {
+	      pd00 = pdata->bmp.get(x0, y0);
+	      const int dx = (pd00 == s_depth_bmp::pixel_unknown ? 0 : x1 - x0);
+	      const int dy = (pd00 == s_depth_bmp::pixel_unknown ? 0 : y1 - y0);
+	      pd10 = pd00 + dx * 2;
+	      pd01 = pd00 + dy * (DEPTH_MAP_BLOCK_SIZE * 2);
+	      pd11 = pd01 + dx * 2;
+	    }
+	    
+	    short m = ibeta * (ialpha * pd00[0] + alpha * pd10[0])
+	      + beta * (ialpha * pd01[0] + alpha * pd11[0]);
+	    short mm = ibeta * (ialpha * pd00[1] + alpha * pd10[1])
+	      + beta * (ialpha * pd01[1] + alpha * pd11[1]);
+	    m += mm / 1000;
+	    mm = mm % 1000;
+
+	    // the destination block is looked up when the row enters it
+	    const int i = imin + k;
+	    const int ib = s_depth_bmp::get_block_index(i, j);
+	    if (ib != ib_dst) {
+	      ib_dst = ib;
+	      pb_dst = bmp.blocks[ib];
+	    }
+	    if (!pb_dst) {
+	      bmp.set(i, j, m, mm);
+	      pb_dst = bmp.blocks[ib];
+	      continue;
+	    }
+	    short * ps = pb_dst + s_depth_bmp::get_offset(i, j);
+	    ps[0] = m;
+	    ps[1] = mm;
+	  }
+	}
+      };
+
+    // rows are merged in parallel. The rows of a thread are aligned to the
+    // blocks so that a block is allocated only by one thread.
+    const int bmin = jmin >> DEPTH_MAP_BLOCK_SHIFT;
+    const int nbrows = (jmax >> DEPTH_MAP_BLOCK_SHIFT) - bmin + 1;
+    int nth = (int)min(thread::hardware_concurrency(), 8u);
+    nth = max(1, min(nth, nbrows));
+    auto row_of = [&](const int ith)
+      {
+	return max(jmin, (bmin + nbrows * ith / nth) << DEPTH_MAP_BLOCK_SHIFT);
+      };
+    vector<thread> ths;
+    for (int ith = 1; ith < nth; ith++)
+      ths.push_back(thread(merge_rows, row_of(ith),
+			   min(jmax + 1, row_of(ith + 1))));
+    merge_rows(jmin, min(jmax + 1, row_of(1)));
+    for (auto itr = ths.begin(); itr != ths.end(); itr++)
+      itr->join();
     
-    // for all effective pixels in the bmp    
-    for (int j = 0; j < bmp.height; j++){    
-      for (int i = 0; i < bmp.width; i++){
-	// calculate pixel vector like as s veci[0] + t veci[1]
-	vec2 x((double)i - vtxi[0].x, (double)j - vtxi[0].y);
-	double s = iv0.x * x.x + iv1.x * x.y;
-	double t = iv0.y * x.x + iv1.y * x.y;	
-
-	if(s < 0 || s > 1 || t < 0 || t > 1 || s + t > 1) 
-	  continue;// is not inside triangle
-	
-	// if s,t is in the effective pixel,	
-	//  make point vector p as s vec[0] + t vec[1] + vtx[0]
-	
-	vec3 p = vec[0] * s + vec[1] * t + vtx[0];
-	
-	// find crossing point on the surface in layerData
-	// p' as the solution [ vec'[0], vec'[1], -p][a, b, c]^t = vtx'[0]
-	// where vec' and vtx' is the vec and vtx in layerData.
-	double a, b, c;
-	proj2tri(a, b, c, p, pdata->vtx[0], pdata->vec[0], pdata->vec[1]);
-	if(a < 0 || a > 1 || b < 0 || b > 1)
-	  continue;
-
-	x = pdata->veci[0] * a + pdata->veci[1] * b + pdata->vtxi[0];
-
-	// sampling at x with bi-linear interpolation
-	int x0 = int(x.x), y0 = int(x.y), x1 = x0 + 1, y1 = y0 + 1;
-	double alpha = x.x - (double)x0;
-	double beta = x.y - (double)y0;
-	double ialpha = 1.0 - alpha;
-	double ibeta = 1.0 - beta;
-	const short * pd00 = pdata->bmp.datai16 + x0 * size_of_pixel + y0 * size_of_rows;
-	const short * pd10 = pd00 + size_of_pixel;
-	const short * pd01 = pd00 + size_of_rows;
-	const short * pd11 = pd01 + size_of_pixel;
-       
-	short * ps = bmp.datai16 + i * size_of_pixel + j * size_of_rows;
-	ps[0] = ibeta * (ialpha * pd00[0] + alpha * pd10[0])
-	  + beta * (ialpha * pd01[0] + alpha * pd11[0]);
-	ps[1] = ibeta * (ialpha * pd00[1] + alpha * pd10[1])
-	  + beta * (ialpha * pd01[1] + alpha * pd11[1]);
-	ps[0] += ps[1] / 1000;
-	ps[1] = ps[1] % 1000;
-      }
-    }
     return true;
   }
 
   void Depth::_release()
   {
-    delete[] bmp.data;
-    bmp.data = nullptr;
+    bmp.release();
   }
 
   bool Depth::_remove(const unsigned int id)
@@ -230,48 +445,48 @@ namespace AWSMap2{
     return true;
   }
 
-  bool Depth::save()
-  {
-    if (!bupdate){
-      return true;
-    }
-    
-    if (!pNode)
-      return false;
-
-    if(!bmp.data)
-      return false;
-      
-    char fname[2048];
-    genFileName(fname, 2048);
-#ifdef _AWS_MAP_DEBUG
-    cout << "saving " << fname << endl;
-#endif
-    if(!bmp.write_png(fname))
-      return false;
-          
-    bupdate = false;
-    return true;
-  }
+  // format tag of the depth file ("DEP1"). The previous versions saved
+  // the bitmap as png.
+  static const unsigned int depth_format_tag = 0x31504544;
   
+  // The content is:
+  // format tag, the vertices of the triangle (3 vec3), then the bitmap
+  // (see s_depth_bmp::write).
   bool Depth::save(ofstream & ofile)
   {
-    return true;
+    ofile.write((const char*)&depth_format_tag, sizeof(unsigned int));
+    ofile.write((const char*)vtx, sizeof(vtx));
+    return bmp.write(ofile);
   }
 
   bool Depth::load()
   {
-     if (!pNode)
+    if (LayerData::load())
+      return true;
+
+    if (!pNode)
       return false;
     
+    // the bitmap saved as png
     char fname[2048];
     genFileName(fname, 2048);
-#ifdef _AWS_MAP_DEBUG
-    cout << "loading " << fname << endl;
-#endif
-    if(!bmp.read_png(fname))
+    s_aws_bmp bmp_png;
+    if(!bmp_png.read_png(fname))
+      return false;
+    if (bmp_png.width != DEPTH_MAP_WIDTH || bmp_png.height != DEPTH_MAP_HEIGHT
+	|| bmp_png.channels != DEPTH_MAP_CHANNELS
+	|| bmp_png.depth != DEPTH_MAP_DEPTH)
       return false;
     
+    if (!init())
+      return false;
+    const short * p = bmp_png.datai16;
+    for (int j = 0; j < DEPTH_MAP_HEIGHT; j++){
+      for (int i = 0; i < DEPTH_MAP_WIDTH; i++, p += 2){
+	bmp.set(i, j, p[0], p[1]);
+      }
+    }
+    
     bupdate = false;
     
     setActive();
@@ -279,9 +494,19 @@ namespace AWSMap2{
     return true;
   }
   
-  bool Depth::load(ifstream & ifile)
+  bool Depth::load(istream & ifile)
   {
-    return true;
+    unsigned int tag = 0;
+    ifile.read((char*)&tag, sizeof(unsigned int));
+    if (!ifile || tag != depth_format_tag)
+      return false;
+
+    vec3 _vtx[3];
+    ifile.read((char*)_vtx, sizeof(_vtx));
+    if (!ifile || !init(_vtx))
+      return false;
+    
+    return bmp.read(ifile);
   }
 
   // only digs down to the correct node to be added.
@@ -297,23 +522,28 @@ namespace AWSMap2{
   LayerData * Depth::clone() const
   {
     Depth * p = new Depth();
-    p->bmp.init(bmp.width, bmp.height, bmp.channels, bmp.depth);
-
-    memcpy(p->bmp.data, bmp.data, bmp.get_data_size());
+    p->bmp = bmp;
     
-    p->vtx[0] = vtx[0];
-    p->vtx[1] = vtx[1];
-    p->vtx[2] = vtx[2];
-    p->vtxi[0] = vtxi[0];
-    p->vtxi[1] = vtxi[1];
-    p->vtxi[2] = vtxi[2];
+    for(int i = 0; i < 3; i++){
+      p->vtx[i] = vtx[i];
+      p->vec[i] = vec[i];
+      p->vtxi[i] = vtxi[i];
+    }
+    p->veci[0] = veci[0];
+    p->veci[1] = veci[1];
+    p->zvec = zvec;
+    p->xvec = xvec;
+    p->yvec = yvec;
+    p->scale = scale;
+    p->vtx_center = vtx_center;
+    p->r = r;
     
     return p;
   }
 
   size_t Depth::size() const
   {    
-    unsigned int sz= sizeof(s_aws_bmp) + sizeof(vtx) + sizeof(vtxi);
+    size_t sz = sizeof(Depth);
     sz += bmp.get_data_size();
     return sz;
       
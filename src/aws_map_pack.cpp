@@ -0,0 +1,346 @@
+// Copyright(c) 2020 Yohei Matsumoto, All right reserved.
+
+// aws_map_pack.cpp is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// aws_map_pack.cpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with aws_map_pack.cpp.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <cmath>
+#include <climits>
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <mutex>
+using namespace std;
+
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aws_coord.hpp"
+#include "aws_stdlib.hpp"
+#include "aws_map.hpp"
+
+namespace AWSMap2 {
+
+  static const char pack_magic[8] = {'A', 'W', 'S', 'P', 'A', 'C', 'K', '1'};
+
+  MapPack MapPack::packs[20];
+  atomic<unsigned long long> MapPack::numHits(0);
+  atomic<unsigned long long> MapPack::numMisses(0);
+  mutex MapPack::mtxInvalidate;
+
+  void MapPack::genFileName(char * fname, size_t len_max, unsigned int iface)
+  {
+    snprintf(fname, len_max, "%s/N%02d.pack", MapDataBase::getPath(),
+	     (int)iface);
+  }
+
+  void MapPack::unmap()
+  {
+    if (base)
+      munmap((void*)base, len);
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+    base = NULL;
+    len = 0;
+    entries = NULL;
+    num_entries = 0;
+  }
+
+  bool MapPack::getKey(const list<unsigned char> & path_id,
+		       unsigned long long & key)
+  {
+    if (path_id.empty() || path_id.size() > MAX_LEVEL + 1)
+      return false;
+
+    unsigned long long level = path_id.size() - 1;
+    key = level;
+    int shift = 62;
+    auto itr = path_id.begin();
+    for (itr++; itr != path_id.end(); itr++, shift -= 2)
+      key |= ((unsigned long long)(*itr & 0x3) << shift);
+    return true;
+  }
+
+  bool MapPack::open(const unsigned int iface)
+  {
+    if (iface >= 20 || MapDataBase::getPath() == NULL)
+      return false;
+
+    MapPack & pack = packs[iface];
+    pack.unmap();
+
+    char fname[2048];
+    genFileName(fname, 2048, iface);
+    int fd = ::open(fname, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(s_header)) {
+      ::close(fd);
+      return false;
+    }
+
+    size_t len = (size_t)st.st_size;
+    void * p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+
+    pack.fd = fd;
+    pack.base = (const char*)p;
+    pack.len = len;
+
+    // validate the header and the entries.
+    const s_header * header = (const s_header*) pack.base;
+    size_t len_entries = sizeof(s_entry) * (size_t)header->num_entries;
+    if (memcmp(header->magic, pack_magic, sizeof(pack_magic)) != 0 ||
+	len_entries > len - sizeof(s_header)) {
+      cerr << "Invalid map pack " << fname << endl;
+      pack.unmap();
+      return false;
+    }
+
+    const s_entry * entries = (const s_entry*)(pack.base + sizeof(s_header));
+    for (unsigned int ient = 0; ient < header->num_entries; ient++) {
+      if (entries[ient].offset > len ||
+	  entries[ient].size > len - entries[ient].offset) {
+	cerr << "Invalid map pack " << fname << endl;
+	pack.unmap();
+	return false;
+      }
+    }
+
+    pack.entries = entries;
+    pack.num_entries = header->num_entries;
+    pack.bdirty = false;
+#ifdef _AWS_MAP_DEBUG
+    cout << "Mapped " << fname << " with " << pack.num_entries
+	 << " records" << endl;
+#endif
+    return true;
+  }
+
+  void MapPack::close()
+  {
+    for (int iface = 0; iface < 20; iface++) {
+      packs[iface].unmap();
+      packs[iface].bdirty = false;
+    }
+  }
+
+  void MapPack::invalidate(const unsigned int iface)
+  {
+    if (iface >= 20)
+      return;
+
+    lock_guard<mutex> lock(mtxInvalidate);
+    MapPack & pack = packs[iface];
+    if (pack.bdirty)
+      return;
+
+    pack.bdirty = true;
+    pack.unmap();
+    char fname[2048];
+    genFileName(fname, 2048, iface);
+    unlink(fname);
+  }
+
+  bool MapPack::find(const list<unsigned char> & path_id,
+		     const unsigned int type,
+		     const char * & data, unsigned int & size)
+  {
+    unsigned long long key;
+    if (path_id.empty() || path_id.front() >= 20 || !getKey(path_id, key)) {
+      numMisses++;
+      return false;
+    }
+
+    const MapPack & pack = packs[path_id.front()];
+    const s_entry * begin = pack.entries, * end = pack.entries + pack.num_entries;
+    const s_entry * itr = lower_bound(begin, end, key,
+				      [type](const s_entry & e,
+					     const unsigned long long k)
+				      {
+					return e.key < k ||
+					  (e.key == k && e.type < type);
+				      });
+    if (itr == end || itr->key != key || itr->type != type) {
+      numMisses++;
+      return false;
+    }
+
+    data = pack.base + itr->offset;
+    size = itr->size;
+    numHits++;
+    return true;
+  }
+
+  // Collect the index and layer data files of the node at path (directory),
+  // and those of the downlink nodes recursively.
+  static void collect_records(const char * path,
+			      list<unsigned char> & path_id,
+			      vector<MapPack::s_entry> & entries,
+			      vector<string> & fnames)
+  {
+    MapPack::s_entry entry;
+    if (!MapPack::getKey(path_id, entry.key))
+      return;
+
+    char fname[2048];
+    snprintf(fname, 2048, "%s/N%02d.index", path, (int)path_id.back());
+    ifstream findex(fname, ios::binary | ios::ate);
+    if (!findex.is_open())
+      return;
+
+    entry.type = (unsigned int)lt_undef;
+    entry.size = (unsigned int)findex.tellg();
+    entry.offset = 0;
+    entries.push_back(entry);
+    fnames.push_back(fname);
+
+    // read the index as Node::load does.
+    findex.seekg(0);
+    bool bdownLink = false;
+    vec2 vtx_blh[3];
+    unsigned int num_layer_datum = 0;
+    findex.read((char*)&bdownLink, sizeof(bool));
+    findex.read((char*)vtx_blh, sizeof(vec2) * 3);
+    findex.read((char*)&num_layer_datum, sizeof(unsigned int));
+    while (!findex.eof() && num_layer_datum != 0) {
+      LayerType layerType = lt_undef;
+      findex.read((char*)&layerType, sizeof(LayerType));
+      num_layer_datum--;
+      if (!findex || (unsigned int)layerType >= (unsigned int)lt_undef)
+	continue;
+
+      snprintf(fname, 2048, "%s/%s.dat", path, strLayerType[layerType]);
+      ifstream fdat(fname, ios::binary | ios::ate);
+      if (!fdat.is_open())
+	continue;
+
+      entry.type = (unsigned int)layerType;
+      entry.size = (unsigned int)fdat.tellg();
+      entries.push_back(entry);
+      fnames.push_back(fname);
+    }
+
+    if (!bdownLink)
+      return;
+
+    for (unsigned char idown = 0; idown < 4; idown++) {
+      char path_down[2048];
+      snprintf(path_down, 2048, "%s/N%02d", path, (int)idown);
+      path_id.push_back(idown);
+      collect_records(path_down, path_id, entries, fnames);
+      path_id.pop_back();
+    }
+  }
+
+  bool MapPack::build(const unsigned int iface)
+  {
+    if (iface >= 20 || MapDataBase::getPath() == NULL)
+      return false;
+
+    vector<s_entry> entries;
+    vector<string> fnames;
+    list<unsigned char> path_id;
+    path_id.push_back((unsigned char)iface);
+    char path[2048];
+    snprintf(path, 2048, "%s/N%02d", MapDataBase::getPath(), (int)iface);
+    collect_records(path, path_id, entries, fnames);
+    if (entries.empty())
+      return false;
+
+    // sort the records by key and type, then assign offsets aligned to 8.
+    vector<unsigned int> order(entries.size());
+    for (unsigned int i = 0; i < order.size(); i++)
+      order[i] = i;
+    sort(order.begin(), order.end(),
+	 [&entries](const unsigned int l, const unsigned int r)
+	 {
+	   return entries[l].key < entries[r].key ||
+	     (entries[l].key == entries[r].key &&
+	      entries[l].type < entries[r].type);
+	 });
+
+    vector<s_entry> sorted(entries.size());
+    unsigned long long offset = sizeof(s_header) +
+      sizeof(s_entry) * entries.size();
+    for (unsigned int i = 0; i < order.size(); i++) {
+      offset = (offset + 7) & ~7ULL;
+      sorted[i] = entries[order[i]];
+      sorted[i].offset = offset;
+      offset += sorted[i].size;
+    }
+
+    // write to temporary file, and replace the pack with it.
+    char fname[2048];
+    genFileName(fname, 2048, iface);
+    string fname_tmp = string(fname) + ".tmp";
+    ofstream ofile(fname_tmp.c_str(), ios::binary);
+    if (!ofile.is_open())
+      return false;
+
+    s_header header;
+    memcpy(header.magic, pack_magic, sizeof(pack_magic));
+    header.num_entries = (unsigned int)sorted.size();
+    header.reserved = 0;
+    ofile.write((const char*)&header, sizeof(header));
+    ofile.write((const char*)sorted.data(), sizeof(s_entry) * sorted.size());
+
+    vector<char> buf;
+    bool result = true;
+    for (unsigned int i = 0; i < order.size() && result; i++) {
+      const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      unsigned long long pos = (unsigned long long) ofile.tellp();
+      ofile.write(zeros, (streamsize)(sorted[i].offset - pos));
+
+      ifstream ifile(fnames[order[i]].c_str(), ios::binary);
+      buf.resize(sorted[i].size);
+      ifile.read(buf.data(), sorted[i].size);
+      if (!ifile) {
+	cerr << "Failed to read " << fnames[order[i]] << endl;
+	result = false;
+	break;
+      }
+      ofile.write(buf.data(), sorted[i].size);
+    }
+    ofile.close();
+
+    if (!result || !ofile) {
+      unlink(fname_tmp.c_str());
+      return false;
+    }
+
+    packs[iface].unmap();
+    if (rename(fname_tmp.c_str(), fname) != 0) {
+      unlink(fname_tmp.c_str());
+      return false;
+    }
+#ifdef _AWS_MAP_DEBUG
+    cout << "Packed " << sorted.size() << " records to " << fname << endl;
+#endif
+    return open(iface);
+  }
+}
@@ -105,17 +105,15 @@ const c_nmea_dat * c_nmea_dec::decode(const char * str, const long long t)
   c_nmea_dat * dat = nullptr;
 
   // first trying nmea0183 decoder
-  for(int i = 0; i < nmea0183_objs.size(); i++){
-    if(nmea0183_objs[i].match(str + 3)){
-      if(nmea0183_objs[i].dat->decode(str, t)){
-	dat = nmea0183_objs[i].dat;
-	dat->m_toker[0] = str[1];
-	dat->m_toker[1] = str[2];
-	dat->m_cs = true;
-	return dat;	
-      }
-      return nullptr;
-    }      
+  dat = nmea0183_objs[get_nmea0183_payload(str + 3)];
+  if(dat){
+    if(dat->decode(str, t)){
+      dat->m_toker[0] = str[1];
+      dat->m_toker[1] = str[2];
+      dat->m_cs = true;
+      return dat;	
+    }
+    return nullptr;
   }
 
   // VDM is not covered in the nmea0183 decoder list.
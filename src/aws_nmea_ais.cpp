@@ -165,13 +165,9 @@ char armor(char c)
 
 void s_pl::dearmor(const char * str)
 {
-  int i;
-
-  for(i = 0; str[i] != '\0' && pl_size < 256; i++, pl_size++){
-    payload[pl_size] = str[i] - 48;
-    if(payload[pl_size] > 40)
-      payload[pl_size] -= 8;
-  }
+  int len = (int) strnlen(str, AIS_MAX_PL_CHARS - pl_size);
+  ais_dearmor(str, payload + pl_size, len);
+  pl_size += len;
 }
 
 c_vdm * c_vdm_dec::decode(const char * str, const long long t)
@@ -310,75 +306,30 @@ void c_vdm_msg1::dec_payload(s_pl * ppl, const long long t)
 
 void c_vdm_msg1::dec_payload(s_pl * ppl)
 {
-  unsigned int tmpu;
-  char tmpc;
-  int tmpi;
-  char * dat = ppl->payload;
-
-  // decodes mmsi and repeat flag
-  c_vdm::dec_payload(ppl);
+  s_ais_pos_a pos;
+  pos.dec(ppl->pack());
 
-  m_status = (dat[6] & 0x0F);
+  m_is_chan_A = ppl->is_chan_A;
+  m_repeat = pos.repeat;
+  m_mmsi = pos.mmsi;
+  m_status = pos.status;
 
-  tmpc = ((dat[7] & 0x3F) << 2) | 
-    ((dat[8] & 0x30) >> 4);
+  // rate of turn is 4.733 * sqrt(ROT) with sign
+  m_turn = (float) (1.0 / 4.733) * pos.turn;
+  m_turn *= (pos.turn < 0 ? -m_turn : m_turn);
 
-  if(tmpc & 0x80){
-    m_turn = (float) (1.0 / 4.733) * ((~tmpc & 0xff) + 1);
-    m_turn *= -m_turn;
-  }else{
-    m_turn = (float) (1.0 / 4.733) * (tmpc);
-    m_turn *= m_turn;
-  }
-  
-  tmpu = ((dat[8] & 0x0F) << 6) |
-    (dat[9] & 0x3F);
-  m_speed = (float)((float) tmpu * (1.0/10.0));
-
-  m_accuracy = ((dat[10] & 0x20) >> 7);
-
-  tmpi = ((dat[10] & 0x1F) << 27) |
-    ((dat[11] & 0x3F) << 21) |
-    ((dat[12] & 0x3F) << 15) |
-    ((dat[13] & 0x3F) << 9) |
-    ((dat[14] & 0x3E) << 3);
-  tmpi >>= 4;
-  m_lon_min = (tmpi & 0x08000000 ? tmpi | 0xF0000000 : tmpi);
+  m_speed = (float)((float) pos.speed * (1.0/10.0));
+  m_accuracy = pos.accuracy;
+  m_lon_min = pos.lon;
   m_lon = (float) (m_lon_min * (1.0/600000.0));
-
-  tmpi = ((dat[14] & 0x01) << 31) |
-    ((dat[15] & 0x3F) << 25) | 
-    ((dat[16] & 0x3F) << 19) |
-    ((dat[17] & 0x3F) << 13) |
-    ((dat[18] & 0x3F) << 7) |
-    ((dat[19] & 0x30) << 1);
-  tmpi >>= 5;
-  m_lat_min = (tmpi & 0x04000000 ? tmpi | 0xF8000000 : tmpi);
+  m_lat_min = pos.lat;
   m_lat = (float) (m_lat_min * (1.0/600000.0));
-
-  tmpu = ((dat[19] & 0x0F) << 8) |
-    ((dat[20] & 0x3F) << 2) |
-    ((dat[21] & 0x30) >> 4);
-	
-  m_course = (float) (tmpu * (1.0/10.0));
-  m_heading = ((dat[21] & 0x0F) << 5) |
-    ((dat[22] & 0x3E) >> 1);
-
-  m_second =  ((dat[22] & 0x01) << 5) |
-    ((dat[23] & 0x3E) >> 1);
-
-  m_maneuver = ((dat[23] & 0x01) << 1) |
-    ((dat[24] & 0x20) >> 5);
-
-  // dat[24] & 0x0C is not used
-
-  m_raim = (dat[24] & 0x02) >> 1;
-
-  m_radio = ((dat[24] & 0x01) << 18) |
-    ((dat[25] & 0x3F) << 12) |
-    ((dat[26] & 0x3F) << 6) |
-    (dat[27] & 0x3F);
-
+  m_course = (float) (pos.course * (1.0/10.0));
+  m_heading = pos.heading;
+  m_second = pos.second;
+  m_maneuver = pos.maneuver;
+  m_raim = pos.raim;
+  m_radio = pos.radio;
 }
 
 
@@ -990,81 +941,29 @@ void c_vdm_msg18::dec_payload(s_pl * ppl, const long long t)
 
 void c_vdm_msg18::dec_payload(s_pl * ppl)
 {
-  unsigned int tmpu;
-  int tmpi;
-  char * dat = ppl->payload;
-
-  // decodes mmsi and repeat flag
-  c_vdm::dec_payload(ppl); // 0-37 bit consumed
-
-  // 38-45 bit reserved
-
-  // 46-55 speed over ground x10
-  tmpu = ((dat[7] & 0x03) << 8) |
-    (dat[8] << 2) |
-    ((dat[9] & 0x30) >> 4);
-
-  m_speed = (float)((float) tmpu * (1.0/10.0));
-
-  // 56 gps accuracy
-  m_accuracy = ((dat[9] & 0x08) >> 3);
-
-  // 57-84 lon
-  tmpi = ((dat[9] & 0x07) << 25) |
-    ((dat[10] & 0x3F) << 19) |
-    ((dat[11] & 0x3F) << 13) |
-    ((dat[12] & 0x3F) << 7) |
-    ((dat[13] & 0x3F) << 1) |
-    ((dat[14] & 0x20) >> 5);
-  m_lon_min = (tmpi & 0x08000000 ? tmpi | 0xF0000000 : tmpi);
+  s_ais_pos_b pos;
+  pos.dec(ppl->pack());
+
+  m_is_chan_A = ppl->is_chan_A;
+  m_repeat = pos.repeat;
+  m_mmsi = pos.mmsi;
+  m_speed = (float)((float) pos.speed * (1.0/10.0));
+  m_accuracy = pos.accuracy;
+  m_lon_min = pos.lon;
   m_lon = (float) (m_lon_min * (1.0/600000.0));
-
-  // 85-111 lat
-  tmpi = ((dat[14] & 0x1F) << 22) |
-    ((dat[15] & 0x3F) << 16) |
-    ((dat[16] & 0x3F) << 10) |
-    ((dat[17] & 0x3F) << 4) |
-    ((dat[18] & 0x3C) >> 2);
-  m_lat_min = (tmpi & 0x04000000 ? tmpi | 0xF8000000 : tmpi);
+  m_lat_min = pos.lat;
   m_lat = (float) (m_lat_min * (1.0/600000.0));
-
-  // 112-123
-  tmpu = ((dat[18] & 0x03) << 10) |
-    ((dat[19] & 0x3F) << 4) |
-    ((dat[20] & 0x3C) >> 2);
-  m_course = (float)((float) tmpu * (1.0/10.0));
-
-  // 124-132
-  tmpu = ((dat[20] & 0x03) << 7) |
-    ((dat[21] & 0x3F) << 1) |
-    ((dat[22] & 0x20) >> 5);
-  m_heading = tmpu;
-
-  m_second = ((dat[22] & 0x1F) << 1) |
-    ((dat[23] & 0x20) >> 5);
-
-  //139-140 reserved
-
-  //141
-  m_cs = (dat[23] & 0x04 ? true : false);
-
-  //142
-  m_disp = (dat[23] & 0x02 ? true : false);
-
-  //143
-  m_dsc = (dat[23] & 0x01 ? true : false);
-
-  // 144
-  m_band = (dat[24] & 0x20 ? true : false);
-
-  // 145
-  m_msg22 = (dat[24] & 0x10 ? true : false);
-
-  //146
-  m_assigned = (dat[24] & 0x08 ? true : false);
-
-  // 147
-  m_raim = (dat[24] & 0x04 ? true : false);
+  m_course = (float)((float) pos.course * (1.0/10.0));
+  m_heading = pos.heading;
+  m_second = pos.second;
+  m_cs = pos.cs;
+  m_disp = pos.disp;
+  m_dsc = pos.dsc;
+  m_band = pos.band;
+  m_msg22 = pos.msg22;
+  m_assigned = pos.assigned;
+  m_raim = pos.raim != 0;
+  m_radio = pos.radio;
 }
 
 ostream & c_vdm_msg18::show(ostream & out) const
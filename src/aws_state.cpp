@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <thread>
+#include <functional>
 
 using namespace std;
 #include "aws_coord.hpp"
@@ -11,86 +13,22 @@ using namespace std;
 
 //////////////////////////////////////////////////////////// class c_aws1_state
 c_aws1_state::c_aws1_state(int _size_buf, int size_sampler, long long dt_sampler):
-  size_buf(_size_buf), 
-  num_rev(0), tail_rev(0), trev_max(-1), trev_min(-1),
-  num_gll(0), tail_gll(0), tgll_max(-1), tgll_min(-1),
-  num_vtg(0), tail_vtg(0), tvtg_max(-1), tvtg_min(-1),
-  num_hpr(0), tail_hpr(0), thpr_max(-1), thpr_min(-1), tatt_delay(200 * MSEC),
-  num_eng(0), tail_eng(0), teng_max(-1), teng_min(-1),
-  num_rud(0), tail_rud(0), trud_max(-1), trud_min(-1),
-  num_hev(0), tail_hev(0), thev_max(-1), thev_min(-1),
-  num_mda(0), tail_mda(0), tmda_max(-1), tmda_min(-1),
-  num_dbt(0), tail_dbt(0), tdbt_max(-1), tdbt_min(-1),
-  num_engd(0), tail_engd(0), tengd_max(-1), tengd_min(-1),
-  sampler(size_sampler, dt_sampler)
+  size_buf(_size_buf), tatt_delay(200 * MSEC),
+  hrev(_size_buf), hgll(_size_buf), hvtg(_size_buf), hhpr(_size_buf),
+  heng(_size_buf), hrud(_size_buf), hhev(_size_buf), hmda(_size_buf),
+  hdbt(_size_buf), hengd(_size_buf),
+  sampler(size_sampler, dt_sampler),
+  num_resample_threads(0), num_resample_min(4096)
 {
-  trev.resize(size_buf);
-  rev.resize(size_buf);
-  trim.resize(size_buf);
-  tgll.resize(size_buf);
-  lat.resize(size_buf);
-  lon.resize(size_buf);
-  x.resize(size_buf);
-  y.resize(size_buf);
-  z.resize(size_buf);
-  tvtg.resize(size_buf);
-  sog.resize(size_buf);
-  cog.resize(size_buf);
-  thpr.resize(size_buf);
-  roll.resize(size_buf);
-  pitch.resize(size_buf);
-  yaw.resize(size_buf);
-  teng.resize(size_buf);
-  eng.resize(size_buf);
-  trud.resize(size_buf);
-  rud.resize(size_buf);
-  thev.resize(size_buf);
-  hev.resize(size_buf);
-  tmda.resize(size_buf);
-  wdir.resize(size_buf);
-  wspd.resize(size_buf);
-  hmd.resize(size_buf);
-  tmpa.resize(size_buf);
-  dwpt.resize(size_buf);
-  bar.resize(size_buf);
-  tdbt.resize(size_buf);
-  depth.resize(size_buf);
-  tengd.resize(size_buf);
-  tmpeng.resize(size_buf);
-  valt.resize(size_buf);
-  frate.resize(size_buf);
-  hour.resize(size_buf);
-
-  init<long long>(trev, -1);    
-  init<long long>(tgll, -1);
-  init<long long>(tvtg, -1);
-  init<long long>(thpr, -1);
-  init<long long>(teng, -1);
-  init<long long>(trud, -1);
-  init<long long>(thev, -1);
-  init<long long>(tmda, -1);
-  init<long long>(tdbt, -1);
-  init<long long>(tengd, -1);
 }
 
 
 void c_aws1_state::add_engr(const long long _trev, const float _rev,
 			    const int _trim)
 {
-  if(_trev < trev_max)
+  if(!hrev.add(_trev, _rev, _trim))
     return;
 
-  trev_max = _trev;
-  append(trev, tail_rev, _trev);
-  append(rev, tail_rev, _rev);
-  append(trim, tail_rev, _trim);
-  tail_rev = (tail_rev + 1) % size_buf;
-  if(num_rev < trev.size()){
-    trev_min = trev[0];
-    num_rev++;
-  }else
-    trev_min = trev[tail_rev];
-
   sampler.sample_10hz_data(*this);
 }
 
@@ -98,45 +36,18 @@ void c_aws1_state:: add_engd(const long long _tengd, const float _tmpeng,
 			     const float _valt, const float _frate,
 			     const double _hour)
 {
-  if(_tengd < tengd_max)
+  if(!hengd.add(_tengd, _tmpeng, _valt, _frate, _hour))
     return;
 
-  tengd_max = _tengd;
-  append(tengd, tail_engd, _tengd);
-  append(tmpeng, tail_engd, _tmpeng);
-  append(valt, tail_engd, _valt);
-  append(frate, tail_engd, _frate);
-  append(hour, tail_engd, _hour);
-  tail_engd = (tail_engd + 1) % size_buf;
-  if(num_engd < tengd.size()){
-    tengd_min = tengd[0];
-    num_engd++;
-  }else
-    tengd_min = tengd[tail_engd];
-
   sampler.sample_1hz_data(*this);  
 }
 
 void c_aws1_state::add_position(const long long _tpos, const double _lat, const double _lon)
 {
-  if(_tpos < tgll_max)
-    return;
-
-  tgll_max = _tpos;
-  append(tgll, tail_gll, _tpos);
-  append(lat, tail_gll, _lat);
-  append(lon, tail_gll, _lon);
   double _x, _y, _z;
   blhtoecef(_lat, _lon, 0, _x, _y, _z);
-  append(x, tail_gll, _x);
-  append(y, tail_gll, _y);
-  append(z, tail_gll, _z);
-  tail_gll = (tail_gll + 1) % size_buf;
-  if(num_gll < tgll.size()){
-    tgll_min = tgll[0];
-    num_gll++;
-  }else
-    tgll_min = tgll[tail_gll];
+  if(!hgll.add(_tpos, _lat, _lon, _x, _y, _z))
+    return;
   
   sampler.sample_10hz_data(*this);
 }
@@ -144,20 +55,9 @@ void c_aws1_state::add_position(const long long _tpos, const double _lat, const
 
 void c_aws1_state::add_velocity(const long long _tvel, const float _sog, const float _cog)
 {
-  if(_tvel < tvtg_max)
+  if(!hvtg.add(_tvel, _sog, _cog))
     return;
 
-  tvtg_max = _tvel;
-  append(tvtg, tail_vtg, _tvel);
-  append(sog, tail_vtg, _sog);
-  append(cog, tail_vtg, _cog);
-  tail_vtg = (tail_vtg + 1) % size_buf;
-  if(num_vtg < tvtg.size()){
-    tvtg_min = tvtg[0];
-    num_vtg++;
-  }else
-    tvtg_min = tvtg[tail_vtg];
-
   sampler.sample_10hz_data(*this);  
 }
   
@@ -165,39 +65,17 @@ void c_aws1_state::add_attitude(const long long _tatt,
 				const float _roll, const float _pitch,
 				const float _yaw)
 {
-  if(_tatt  < thpr_max)
+  if(!hhpr.add(_tatt, _roll, _pitch, _yaw))
     return;
 
-  thpr_max = _tatt;
-  append(thpr, tail_hpr, _tatt);
-  append(roll, tail_hpr, _roll);
-  append(pitch, tail_hpr, _pitch);
-  append(yaw, tail_hpr, _yaw);
-  tail_hpr = (tail_hpr + 1) % size_buf;
-  if(num_hpr < thpr.size()){
-    thpr_min = thpr[0];
-    num_hpr++;
-  }else
-    thpr_min = thpr[tail_hpr];
-
   sampler.sample_10hz_data(*this);  
 }
 
 void c_aws1_state::add_heave(const long long _thev, const float _hev)
 {
-  if(_thev < thev_max)
+  if(!hhev.add(_thev, _hev))
     return;
 
-  thev_max = _thev;
-  append(thev, tail_hev, _thev);
-  append(hev, tail_hev, _hev);
-  tail_hev = (tail_hev + 1) % size_buf;
-  if(num_hev < thev.size()){
-    thev_min = thev[0];
-    num_hev++;
-  }else
-    thev_min = thev[tail_hev];
-
   sampler.sample_10hz_data(*this);  
 }
 
@@ -207,80 +85,36 @@ void c_aws1_state::add_mda(const long long _tmda,
 			   const float _dwpt, const float _bar)
   
 {
-  if(_tmda < tmda_max)
+  if(!hmda.add(_tmda, _wdir, _wspd, _hmd, _tmpa, _dwpt, _bar))
     return;
 
-  tmda_max = _tmda;
-  append(tmda, tail_mda, _tmda);
-  append(wdir, tail_mda, _wdir);
-  append(wspd, tail_mda, _wspd);
-  append(hmd, tail_mda, _hmd);
-  append(tmpa, tail_mda, _tmpa);
-  append(dwpt, tail_mda, _dwpt);
-  append(bar, tail_mda, _bar);
-  tail_mda = (tail_mda + 1) % size_buf;
-  if(num_mda < tmda.size()){
-    tmda_min = tmda[0];
-    num_mda++;
-  }else
-    tmda_min = tmda[tail_mda];
-
   sampler.sample_1hz_data(*this);  
 }
   
 void c_aws1_state::add_depth(const long long _tdbt, const float _depth)
 {
-  if(_tdbt < tdbt_max)
+  if(!hdbt.add(_tdbt, _depth))
     return;
 
-  tdbt_max = _tdbt;
-  append(tdbt, tail_dbt, _tdbt);
-  append(depth, tail_dbt, _depth);    
-  tail_dbt = (tail_dbt + 1) % size_buf;
-  if(num_dbt < tdbt.size()){
-    tdbt_min = tdbt[0];
-    num_dbt++;
-  }else
-    tdbt_min = tdbt[tail_dbt];
-
   sampler.sample_1hz_data(*this);  
 }
 
 void c_aws1_state::add_eng(const long long _teng,  int _eng)
 {
-  if(_teng < teng_max)
+  if(!heng.add(_teng, _eng))
     return;
 
-  teng_max = _teng;
-  append(teng, tail_eng, _teng);
-  append(eng, tail_eng, _eng);    
-  tail_eng = (tail_eng + 1) % size_buf;
-  if(num_eng < teng.size()){
-    teng_min = teng[0];
-    num_eng++;
-  }else
-    teng_min = teng[tail_eng];
-
   sampler.sample_10hz_data(*this);  
 }
 
 void c_aws1_state::add_rud(const long long _trud, int _rud)
 {
-  if(_trud < trud_max)
+  if(!hrud.add(_trud, _rud))
     return;
 
-  trud_max = _trud;
-  append(trud, tail_rud, _trud);
-  append(rud, tail_rud, _rud);
-  tail_rud = (tail_rud + 1) % size_buf;
-  if(num_rud < trud.size()){
-    trud_min = trud[0];
-    num_rud++;
-  }else
-    trud_min = trud[tail_rud];
-
   sampler.sample_10hz_data(*this);  
 }
+
 void c_aws1_state::sample_10hz_data(const long long t,
 				    double & _lat, double & _lon, double & _hev,
 				    double & _x, double & _y, double & _z,
@@ -289,51 +123,24 @@ void c_aws1_state::sample_10hz_data(const long long t,
 				    float & _rev, int & _trim,
 				    int & _eng, int & _rud)
 {
-  int i0, i1;
-  float alpha, ialpha;
-  
-  find_sample_index(tgll, tail_gll, t, i0, i1);
-  calc_sample_coef(tgll, t, i0, i1, alpha, ialpha);
-
-  _lat = lat[i0] * alpha + lat[i1] * ialpha;
-  _lon = lon[i0] * alpha + lon[i1] * ialpha;
-  _x = x[i0] * alpha + x[i1] * ialpha;
-  _y = y[i0] * alpha + y[i1] * ialpha;
-  _z = z[i0] * alpha + z[i1] * ialpha;
+  hgll.sample(t, _lat, _lon, _x, _y, _z);
 
-  find_sample_index(thev, tail_hev, t, i0, i1);
-  calc_sample_coef(thev, t, i0, i1, alpha, ialpha);
+  float hev;
+  hhev.sample(t, hev);
+  _hev = hev;
 
-  _hev = hev[i0] * alpha + hev[i1] * ialpha;
-  find_sample_index(tvtg, tail_vtg, t, i0, i1);
-  calc_sample_coef(tvtg, t, i0, i1, alpha, ialpha);
+  float _sog, _cog;
+  hvtg.sample(t, _sog, _cog);
 
-  float _cog = interpolate_angle_rad(cog[i0], cog[i1], alpha, ialpha);
-  float _sog = sog[i0] * alpha + sog[i1] * ialpha;
-
-  long long tcor = t + tatt_delay;
-  find_sample_index(thpr, tail_hpr, tcor, i0, i1);
-  calc_sample_coef(thpr, tcor, i0, i1, alpha, ialpha);
-
-  _roll = roll[i0] * alpha + roll[i1] * ialpha;
-  _pitch = pitch[i0] * alpha + pitch[i1] * ialpha;
-  _yaw = interpolate_angle_rad(yaw[i0], yaw[i1], alpha, ialpha);
+  hhpr.sample(t + tatt_delay, _roll, _pitch, _yaw);
 
   double dir = _cog - _yaw;
   _u = cos(dir) * _sog;
   _v = sin(dir) * _sog;
-  
-  find_sample_index(trev, tail_rev, t, i0, i1);
-  calc_sample_coef(trev, t, i0, i1, alpha, ialpha);
-  _rev = rev[i0] * alpha + rev[i1] * ialpha;
-  _trim = trim[i0] * alpha + trim[i1] * ialpha;
 
-  find_sample_index(teng, tail_eng, t, i0, i1);
-  _eng = eng[i0];
-
-  find_sample_index(trud, tail_rud, t, i0, i1); 
-  _rud = rud[i0];
-  find_sample_index(tengd, tail_engd, t, i0, i1);
+  hrev.sample(t, _rev, _trim);
+  heng.sample(t, _eng);
+  hrud.sample(t, _rud);
 }
 
 void c_aws1_state::sample_1hz_data(const long long t, float & _tmpeng,
@@ -343,30 +150,140 @@ void c_aws1_state::sample_1hz_data(const long long t, float & _tmpeng,
 				   float & _dwpt, float & _bar,
 				   float & _depth)
 {
-  int i0, i1;
-  float alpha, ialpha;
-  find_sample_index(tengd, tail_engd, t, i0, i1);
-  calc_sample_coef(tengd, t, i0, i1, alpha, ialpha);
-  _tmpeng = tmpeng[i0] * alpha + tmpeng[i1] * ialpha;
-  _valt = valt[i0] * alpha + valt[i1] * ialpha;
-  _frate = frate[i0] * alpha + frate[i1] * ialpha;
-  _hour = hour[i0] * alpha + hour[i1] * ialpha;
-  
-  find_sample_index(tmda, tail_mda, t, i0, i1);
-  calc_sample_coef(tmda, t, i0, i1, alpha, ialpha);
+  hengd.sample(t, _tmpeng, _valt, _frate, _hour);
+  hmda.sample(t, _wdir, _wspd, _hmd, _tmpa, _dwpt, _bar);
+  hdbt.sample(t, _depth);
+}
+
+// runs the tasks resampling the sensor channels of n samples with nth
+// threads (0: hardware concurrency). Threads are used only for the batches
+// not shorter than nmin, long enough to hide their startup.
+static void run_resample_tasks(vector<function<void()> > & tasks, const int n,
+			       int nth, const int nmin)
+{
+  if(nth <= 0)
+    nth = (int)thread::hardware_concurrency();
+  nth = min(nth, (int)tasks.size());
+  if(n < nmin || nth < 2){
+    for(auto itr = tasks.begin(); itr != tasks.end(); itr++)
+      (*itr)();
+    return;
+  }
+
+  auto run = [&tasks, nth](const int ith)
+    {
+      for(int itask = ith; itask < (int)tasks.size(); itask += nth)
+	tasks[itask]();
+    };
+  vector<thread> ths;
+  for(int ith = 1; ith < nth; ith++)
+    ths.push_back(thread(run, ith));
+  run(0);
+  for(auto itr = ths.begin(); itr != ths.end(); itr++)
+    itr->join();
+}
+
+int c_aws1_state::resample_10hz_data(const long long t0, const int n,
+				     s_aws1_10hz_data & d)
+{
+  const long long dt = sampler.get_cycle_time();
+  d.t0 = t0;
+  d.dt = dt;
+  d.num = 0;
+  if(n <= 0 || !is_10hz_data_samplable(t0)){
+    d.resize(0);
+    return 0;
+  }
+
+  long long tlast = min(min(hgll.get_tmax(), hhev.get_tmax()),
+			min(hvtg.get_tmax(), hrev.get_tmax()));
+  tlast = min(tlast, hhpr.get_tmax() - tatt_delay);
+  const int num = (int)min((long long)n, (tlast - t0) / dt + 1);
+  d.resize(num);
+  d.num = num;
+
+  // sog and cog are resampled into u and v, then converted in place.
+  vector<function<void()> > tasks;
+  tasks.push_back([&](){
+      hgll.resample(t0, dt, num, d.lat.data(), d.lon.data(),
+		    d.x.data(), d.y.data(), d.z.data());
+    });
+  tasks.push_back([&](){ hhev.resample(t0, dt, num, d.hev.data()); });
+  tasks.push_back([&](){
+      hvtg.resample(t0, dt, num, d.u.data(), d.v.data());
+    });
+  tasks.push_back([&](){
+      hhpr.resample(t0 + tatt_delay, dt, num, d.roll.data(), d.pitch.data(),
+		    d.yaw.data());
+    });
+  tasks.push_back([&](){
+      hrev.resample(t0, dt, num, d.rev.data(), d.trim.data());
+    });
+  tasks.push_back([&](){ heng.resample(t0, dt, num, d.eng.data()); });
+  tasks.push_back([&](){ hrud.resample(t0, dt, num, d.rud.data()); });
+  run_resample_tasks(tasks, num, num_resample_threads, num_resample_min);
+
+  float * pu = d.u.data(), * pv = d.v.data();
+  const float * pyaw = d.yaw.data();
+  for(int k = 0; k < num; k++){
+    const float sog = pu[k];
+    double dir = pv[k] - pyaw[k];
+    pu[k] = cos(dir) * sog;
+    pv[k] = sin(dir) * sog;
+  }
+
+  // the sample following the batch is resampled for the derivatives of
+  // the last sample, if samplable.
+  const long long tnext = t0 + dt * num;
+  if(tnext > tlast){
+    sampler.differentiate_10hz_data(d);
+    return num;
+  }
   
-  _wdir = wdir[i0] * alpha + wdir[i1] * ialpha;
-  _wspd = wspd[i0] * alpha + wspd[i1] * ialpha;
-  _hmd = hmd[i0] * alpha + hmd[i1] * ialpha;
-  _tmpa = tmpa[i0] * alpha + tmpa[i1] * ialpha;
-  _dwpt = dwpt[i0] * alpha + dwpt[i1] * ialpha;
-  _bar = bar[i0] * alpha + bar[i1] * ialpha;
-
-  find_sample_index(tdbt, tail_dbt, t, i0, i1);
-  calc_sample_coef(tdbt, t, i0, i1, alpha, ialpha);
-  _depth = depth[i0] * alpha + depth[i1] * ialpha;   
+  s_aws1_10hz_edge next;
+  float sog, cog;
+  hhev.resample(tnext, dt, 1, &next.hev);
+  hvtg.resample(tnext, dt, 1, &sog, &cog);
+  hhpr.resample(tnext + tatt_delay, dt, 1, &next.roll, &next.pitch,
+		&next.yaw);
+  double dir = cog - next.yaw;
+  next.u = cos(dir) * sog;
+  next.v = sin(dir) * sog;
+  sampler.differentiate_10hz_data(d, &next);
+  return num;
 }
 
+int c_aws1_state::resample_1hz_data(const long long t0, const int n,
+				    s_aws1_1hz_data & d)
+{
+  const long long dt = sampler.get_cycle_time();
+  d.t0 = t0;
+  d.dt = dt;
+  d.num = 0;
+  if(n <= 0 || !is_1hz_data_samplable(t0)){
+    d.resize(0);
+    return 0;
+  }
+
+  long long tlast = min(min(hengd.get_tmax(), hmda.get_tmax()),
+			hdbt.get_tmax());
+  const int num = (int)min((long long)n, (tlast - t0) / dt + 1);
+  d.resize(num);
+  d.num = num;
+
+  vector<function<void()> > tasks;
+  tasks.push_back([&](){
+      hengd.resample(t0, dt, num, d.tmpeng.data(), d.valt.data(),
+		     d.frate.data(), d.hour.data());
+    });
+  tasks.push_back([&](){
+      hmda.resample(t0, dt, num, d.wdir.data(), d.wspd.data(), d.hmd.data(),
+		    d.tmpa.data(), d.dwpt.data(), d.bar.data());
+    });
+  tasks.push_back([&](){ hdbt.resample(t0, dt, num, d.depth.data()); });
+  run_resample_tasks(tasks, num, num_resample_threads, num_resample_min);
+  return num;
+}
 
 bool c_aws1_state::get_10hz_data(const int idx,
 				 double & _lat, double & _lon, double & _hev,
@@ -380,10 +297,11 @@ bool c_aws1_state::get_10hz_data(const int idx,
   if(idx > 0) // prediction is not sapported
     return false;
 
-  if(idx <= -sampler.num10hz) // past sample out of buffer
+  // past sample out of buffer
+  if(idx <= -sampler.num10hz || idx <= -sampler.size_buf)
     return false;
   
-  int i = sampler.tail10hz - idx - 1;
+  int i = sampler.tail10hz + idx - 1;
   if(i < 0)
     i += sampler.size_buf;
   i %= sampler.size_buf;
@@ -412,6 +330,7 @@ bool c_aws1_state::get_10hz_data(const int idx,
 
   _rev = sampler.rev[i];
   _trim = sampler.trim[i];  
+  return true;
 }
 
 bool c_aws1_state::get_1hz_data(const int idx, float & _tmpeng,
@@ -424,10 +343,11 @@ bool c_aws1_state::get_1hz_data(const int idx, float & _tmpeng,
   if(idx > 0) // prediction is not sapported
     return false;
 
-  if(idx <= -sampler.num1hz) // past sample out of buffer
+  // past sample out of buffer
+  if(idx <= -sampler.num1hz || idx <= -sampler.size_buf)
     return false;
   
-  int i = sampler.tail1hz - idx - 1;
+  int i = sampler.tail1hz + idx - 1;
   if(i < 0)
     i += sampler.size_buf;
   i %= sampler.size_buf;
@@ -444,6 +364,52 @@ bool c_aws1_state::get_1hz_data(const int idx, float & _tmpeng,
   _dwpt = sampler.dwpt[i];
   _bar = sampler.bar[i];
   _depth = sampler.depth[i];    
+  return true;
+}
+
+//////////////////////////////////////////////// struct s_aws1_10hz_data
+void s_aws1_10hz_data::resize(const int n)
+{
+  lat.resize(n);
+  lon.resize(n);
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  hev.resize(n);
+  u.resize(n);
+  v.resize(n);
+  w.resize(n);
+  ucor.resize(n);
+  vcor.resize(n);
+  wcor.resize(n);
+  du_dt.resize(n);
+  dv_dt.resize(n);
+  roll.resize(n);
+  pitch.resize(n);
+  yaw.resize(n);
+  dr_dt.resize(n);
+  dp_dt.resize(n);
+  dy_dt.resize(n);
+  rev.resize(n);
+  trim.resize(n);
+  eng.resize(n);
+  rud.resize(n);
+}
+
+///////////////////////////////////////////////// struct s_aws1_1hz_data
+void s_aws1_1hz_data::resize(const int n)
+{
+  tmpeng.resize(n);
+  valt.resize(n);
+  frate.resize(n);
+  hour.resize(n);
+  wdir.resize(n);
+  wspd.resize(n);
+  hmd.resize(n);
+  tmpa.resize(n);
+  dwpt.resize(n);
+  bar.resize(n);
+  depth.resize(n);
 }
 
 //////////////////////////////////////////////// class c_aws1_state_sampler
@@ -451,7 +417,7 @@ c_aws1_state_sampler::c_aws1_state_sampler(int _size_buf, long long _dt):
   size_buf(_size_buf), tail10hz(0), tail1hz(0),
   num10hz(0), num1hz(0), t10hz(-1), t1hz(-1),
   dt(_dt),
-  xant(0), yant(0), zant(-1.04)
+  xant(0), yant(0), zant(-1.04), tprev10hz(-1)
 {
   inv_dt_sec = (double) SEC / (double) dt ;
   
@@ -619,9 +585,9 @@ void c_aws1_state_sampler::sample_10hz_data(c_aws1_state & st)
       dr_dt[i0] = (float)(normalize_angle_rad(roll[ip] - roll[in]) * inv_2dt);
       dp_dt[i0] = (float)(normalize_angle_rad(pitch[ip] - pitch[in]) * inv_2dt);
       dy_dt[i0] = (float)(normalize_angle_rad(yaw[ip] - yaw[in]) * inv_2dt);
-      w[ip] = (float)((hev[ip] - hev[in]) * inv_2dt);
-      du_dt[ip] = (float)((u[ip] - u[in]) * inv_2dt);
-      dv_dt[ip] = (float)((v[ip] - v[in]) * inv_2dt);
+      w[i0] = (float)((hev[ip] - hev[in]) * inv_2dt);
+      du_dt[i0] = (float)((u[ip] - u[in]) * inv_2dt);
+      dv_dt[i0] = (float)((v[ip] - v[in]) * inv_2dt);
       float _ucor, _vcor, _wcor;
       correct_velocity(u[i0], v[i0], w[i0], dr_dt[i0], dp_dt[i0], dy_dt[i0],
 		       xant, yant, zant, _ucor, _vcor, _wcor);
@@ -633,5 +599,80 @@ void c_aws1_state_sampler::sample_10hz_data(c_aws1_state & st)
     tail10hz = (tail10hz + 1) % size_buf;
     t10hz = tnext;    
   }
-}  
-  
+}
+
+void c_aws1_state_sampler::differentiate_10hz_data(s_aws1_10hz_data & d,
+						   const s_aws1_10hz_edge * next)
+{
+  const int n = d.num;
+  if(n <= 0)
+    return;
+
+  const bool bprev = tprev10hz >= 0 && d.t0 == tprev10hz + d.dt;
+
+  const float * proll = d.roll.data(), * ppitch = d.pitch.data(),
+    * pyaw = d.yaw.data();
+  const float * phev = d.hev.data(), * pu = d.u.data(), * pv = d.v.data();
+  float * pdr = d.dr_dt.data(), * pdp = d.dp_dt.data(), * pdy = d.dy_dt.data();
+  float * pw = d.w.data(), * pdu = d.du_dt.data(), * pdv = d.dv_dt.data();
+
+  // symmetric difference
+  const double inv_2dt = 0.5 * inv_dt_sec;
+  for(int k = 1; k < n - 1; k++){
+    pdr[k] = (float)(normalize_angle_rad(proll[k + 1] - proll[k - 1]) * inv_2dt);
+    pdp[k] = (float)(normalize_angle_rad(ppitch[k + 1] - ppitch[k - 1]) * inv_2dt);
+    pdy[k] = (float)(normalize_angle_rad(pyaw[k + 1] - pyaw[k - 1]) * inv_2dt);
+  }
+  for(int k = 1; k < n - 1; k++){
+    pw[k] = (float)((phev[k + 1] - phev[k - 1]) * inv_2dt);
+    pdu[k] = (float)((pu[k + 1] - pu[k - 1]) * inv_2dt);
+    pdv[k] = (float)((pv[k + 1] - pv[k - 1]) * inv_2dt);
+  }
+
+  // the first and the last samples. The first one is not differentiable
+  // without the previous batch. The last one is the backward difference
+  // without the next sample.
+  for(int k = 0; k < n; k += max(n - 1, 1)){
+    if(k == 0 && !bprev){
+      pdr[0] = pdp[0] = pdy[0] = 0;
+      pw[0] = pdu[0] = pdv[0] = 0;
+      continue;
+    }
+    
+    s_aws1_10hz_edge s0, sp, sn;
+    s0.get(d, k);
+    if(k > 0)
+      sp.get(d, k - 1);
+    else
+      sp = prev10hz;
+    
+    bool bsym = true;
+    if(k < n - 1)
+      sn.get(d, k + 1);
+    else if(next)
+      sn = *next;
+    else{
+      sn = s0;
+      bsym = false;
+    }
+    const double inv = bsym ? inv_2dt : inv_dt_sec;
+    
+    pdr[k] = (float)(normalize_angle_rad(sn.roll - sp.roll) * inv);
+    pdp[k] = (float)(normalize_angle_rad(sn.pitch - sp.pitch) * inv);
+    pdy[k] = (float)(normalize_angle_rad(sn.yaw - sp.yaw) * inv);
+    pw[k] = (float)((sn.hev - sp.hev) * inv);
+    pdu[k] = (float)((sn.u - sp.u) * inv);
+    pdv[k] = (float)((sn.v - sp.v) * inv);
+  }
+
+  float * pucor = d.ucor.data(), * pvcor = d.vcor.data(),
+    * pwcor = d.wcor.data();
+  pucor[0] = pvcor[0] = pwcor[0] = 0;
+  for(int k = bprev ? 0 : 1; k < n; k++)
+    correct_velocity(pu[k], pv[k], pw[k], pdr[k], pdp[k], pdy[k],
+		     xant, yant, zant, pucor[k], pvcor[k], pwcor[k]);
+
+  // the last sample is kept for the next batch
+  prev10hz.get(d, n - 1);
+  tprev10hz = d.t0 + d.dt * (n - 1);
+}
@@ -51,6 +51,9 @@ void ch_base::register_factory()
 {
   register_factory<ch_sample>("sample");
   register_factory<ch_nmea>("nmea");
+  register_factory<ch_nmea_spsc>("nmea_spsc");
+  register_factory<ch_nmea_spsc_n<4096> >("nmea_spsc4k");
+  register_factory<ch_nmea_spsc_n<16384> >("nmea_spsc16k");
   
   register_factory<ch_ring<char, 1024> >("crbuf");
   register_factory<ch_ring<char, 2048> >("crbuf2k");
@@ -69,5 +72,7 @@ void ch_base::register_factory()
 
   register_factory<ch_nmea_data>("nmea_data");
   register_factory<ch_n2k_data>("n2k_data");
+  register_factory<ch_nmea_data_ring>("nmea_data_ring");
+  register_factory<ch_n2k_data_ring>("n2k_data_ring");
   register_factory<ch_ctrl_data>("ctrl_data");
 }
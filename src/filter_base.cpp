@@ -200,7 +200,7 @@ void f_base::s_fpar::get_info(string & expstr)
 
 ////////////////////////////////////////////////////// f_base members
 mutex f_base::m_mutex;
-condition_variable f_base::m_cond;
+c_tick_scheduler f_base::m_sched;
 long long f_base::m_cur_time = 0;
 long long f_base::m_count_clock = 0;
 int f_base::m_time_zone_minute = 540;
@@ -208,6 +208,14 @@ char f_base::m_time_str[32];
 tmex f_base::m_tm;
 c_clock f_base::m_clk;
 c_aws * f_base::m_paws = NULL;
+c_work_stealing_pool * f_base::m_pool = nullptr;
+mutex f_base::m_mutex_pooled;
+list<f_base*> f_base::m_filters_pooled;
+atomic<long long> f_base::m_count_tick_pooled(0);
+bool f_base::m_bgraph = false;
+atomic<bool> f_base::m_bgraph_dirty(true);
+atomic<bool> f_base::m_bwaves_running(false);
+atomic<unsigned long long> f_base::m_num_ticks_skipped(0);
 
 void f_base::set_lib(c_filter_lib * lib)
 {
@@ -234,30 +242,211 @@ void f_base::fthread()
   while(m_bactive){
     m_count_pre = m_count_clock;
     
-    while(m_cycle < (int) m_intvl){
-      clock_wait();
-      m_cycle++;
+    if(m_cycle < (int) m_intvl){
+      if(!clock_wait(m_intvl - m_cycle))
+	break;
+      m_cycle = m_intvl;
     }
-    lock_cmd();
-    update_table_objects();
-    
-    calc_time_diff();
-    
-    if(!proc()){
+
+    if(!fproc())
       break;
+  }
+  destroy();
+}
+
+bool f_base::fproc()
+{
+  lock_cmd();
+  update_table_objects();
+  
+  calc_time_diff();
+  
+  if(!proc()){
+    unlock_cmd();
+    return false;
+  }
+  
+  if(m_clk.is_run()){
+    m_count_proc++;
+    m_max_cycle = max(m_cycle, m_max_cycle);
+    m_count_post = m_count_clock;
+    m_cycle = (int)(m_count_post - m_count_pre);
+    m_cycle -= m_intvl;
+  }
+  
+  unlock_cmd();
+  return true;
+}
+
+bool f_base::run_pooled()
+{
+  {
+    lock_guard<mutex> lk(m_mutex_cmd);
+    m_bactive = init_run();
+  }
+  
+  if(!m_bactive){
+    spdlog::error("[{}] Initialization failed.", get_name());
+    return false;
+  }
+  spdlog::info("[{}] Initialization done.", get_name());
+
+  lock_guard<mutex> lk(m_mutex_pooled);
+  m_bqueued = false;
+  m_tick_next = m_count_tick_pooled + 1;
+  m_filters_pooled.push_back(this);
+  m_bgraph_dirty = true;
+  return true;
+}
+
+bool f_base::stop_pooled()
+{
+  bool bremoved = false;
+  {
+    lock_guard<mutex> lk(m_mutex_pooled);
+    for(auto itr = m_filters_pooled.begin(); itr != m_filters_pooled.end(); itr++){
+      if(*itr == this){
+	m_filters_pooled.erase(itr);
+	bremoved = true;
+	m_bgraph_dirty = true;
+	break;
+      }
     }
-    
-    if(m_clk.is_run()){
-      m_count_proc++;
-      m_max_cycle = max(m_cycle, m_max_cycle);
-      m_count_post = m_count_clock;
-      m_cycle = (int)(m_count_post - m_count_pre);
-      m_cycle -= m_intvl;
+  }
+
+  // the filter removed by dispatch_pooled() has already been destroyed.
+  if(!bremoved)
+    return true;
+
+  // wait for proc() queued
+  while(m_bqueued)
+    this_thread::sleep_for(chrono::milliseconds(1));
+  destroy();
+  return true;
+}
+
+void f_base::exec_pooled()
+{
+  if(m_bactive){
+    // m_count_pre is set as if the filter waited m_intvl cycles as in fthread
+    m_count_pre = m_count_clock - m_intvl;
+    if(!fproc())
+      m_bactive = false;
+  }
+  m_bqueued = false;
+}
+
+void f_base::build_graph_levels()
+{
+  vector<f_base*> fs(m_filters_pooled.begin(), m_filters_pooled.end());
+  int nf = (int) fs.size();
+
+  // edges from the producers to the consumers of each channel
+  map<ch_base*, vector<int>> producers;
+  for(int i = 0; i < nf; i++){
+    fs[i]->lock_cmd();
+    for(auto ch : fs[i]->m_chout)
+      producers[ch].push_back(i);
+    fs[i]->unlock_cmd();
+  }
+
+  vector<vector<int>> succ(nf);
+  for(int j = 0; j < nf; j++){
+    fs[j]->lock_cmd();
+    for(auto ch : fs[j]->m_chin){
+      auto itr = producers.find(ch);
+      if(itr == producers.end())
+	continue;
+      for(auto i : itr->second){
+	if(i == j)
+	  continue;
+	succ[i].push_back(j);
+      }
+    }
+    fs[j]->unlock_cmd();
+  }
+
+  vector<int> level;
+  int num_loops = calc_wave_levels(succ, level);
+
+  // filters in channel loops are dispatched in the last wave
+  int level_loop = 0;
+  if(num_loops > 0)
+    level_loop = *max_element(level.begin(), level.end());
+  for(int i = 0; i < nf; i++){
+    if(num_loops > 0 && level[i] == level_loop)
+      spdlog::warn("[{}] is in a loop of channels, dispatched in the last wave.", fs[i]->get_name());
+    fs[i]->m_graph_level = level[i];
+  }
+  m_bgraph_dirty = false;
+}
+
+void f_base::collect_due(const long long tick, vector<f_base*> & due)
+{
+  for(auto itr = m_filters_pooled.begin(); itr != m_filters_pooled.end();){
+    f_base * f = *itr;
+    if(f->m_bqueued){ // still running, the cycle is skipped
+      itr++;
+      continue;
+    }
+
+    if(!f->m_bactive){ // proc() failed
+      itr = m_filters_pooled.erase(itr);
+      m_bgraph_dirty = true;
+      f->destroy();
+      continue;
     }
     
-    unlock_cmd();
+    if(f->m_tick_next <= tick){
+      f->m_tick_next = tick + f->m_intvl;
+      f->m_bqueued = true;
+      due.push_back(f);
+    }
+    itr++;
   }
-  destroy();
+}
+
+void f_base::dispatch_waves()
+{
+  vector<vector<c_work_stealing_pool::task>> waves;
+  {
+    lock_guard<mutex> lk(m_mutex_pooled);
+    if(m_bgraph_dirty)
+      build_graph_levels();
+
+    vector<f_base*> due;
+    collect_due(m_count_tick_pooled, due);
+    for(auto f : due){
+      if((int) waves.size() <= f->m_graph_level)
+	waves.resize(f->m_graph_level + 1);
+      waves[f->m_graph_level].push_back([f](){f->exec_pooled();});
+    }
+  }
+
+  m_pool->push_waves(move(waves), [](){m_bwaves_running = false;});
+}
+
+void f_base::dispatch_pooled()
+{
+  if(m_bgraph){
+    // The waves are chained on the pool from the completion of the
+    // previous wave, and the clock thread only pushes dispatch_waves().
+    // The tick is skipped while the waves of the previous tick are running.
+    m_count_tick_pooled++;
+    if(m_bwaves_running.exchange(true)){
+      m_num_ticks_skipped++;
+      return;
+    }
+    m_pool->push(dispatch_waves);
+    return;
+  }
+
+  lock_guard<mutex> lk(m_mutex_pooled);
+  m_count_tick_pooled++;
+  vector<f_base*> due;
+  collect_due(m_count_tick_pooled, due);
+  for(auto f : due)
+    m_pool->push([f](){f->exec_pooled();});
 }
 
 // Filter thread function
@@ -277,6 +466,12 @@ bool f_base::stop()
     spdlog::info("Stopping {}.", m_name);
     m_bactive = false;
   }
+
+  if(m_pool)
+    return stop_pooled();
+
+  // the filter thread may be waiting for ticks of long interval.
+  m_sched.cancel(m_waiter);
      
   if(m_fthread){
     m_fthread->join();
@@ -305,12 +500,13 @@ void f_base::clock(long long cur_time)
 	   m_tm.tm_msec,
 	   m_tm.tm_year + 1900);
   lock.unlock();
-  m_cond.notify_all();
+  m_sched.tick();
 }
 
 f_base::f_base(const char * name):m_lib(nullptr),
 				  m_offset_time(0), m_bactive(false),
 				  m_fthread(NULL), m_intvl(1),
+				  m_bqueued(false), m_tick_next(0), m_graph_level(0),
 				  m_cmd(false), m_mutex_cmd()
 {
   m_name = new char[strlen(name) + 1];
@@ -354,12 +550,14 @@ bool f_base::get_par(const string & par, string & val)
     return false;
   }
 
+  update_log_pars();
   return m_pars[ipar].get(val);
 }
 
 bool f_base::get_par(const int ipar, string & par, string & val)
 {
   if(m_pars.size() > ipar && ipar >= 0){
+    update_log_pars();
     par = string(m_pars[ipar].name);
     return m_pars[ipar].get(val);
   }
@@ -374,6 +572,7 @@ bool f_base::get_par(const string & par, string & val, string & exp)
     return false;
   }
   
+  update_log_pars();
   m_pars[ipar].get_info(exp);
   return m_pars[ipar].get(val);  
 }
@@ -381,6 +580,7 @@ bool f_base::get_par(const string & par, string & val, string & exp)
 bool f_base::get_par(const int ipar, string & par,  string & val, string & exp)
 {
   if(m_pars.size() > ipar && ipar >= 0){
+    update_log_pars();
     par = string(m_pars[ipar].name);
     m_pars[ipar].get_info(exp);
     return m_pars[ipar].get(val);
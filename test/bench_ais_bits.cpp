@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+#include "benchmark/benchmark.h"
+#include "aws_ais_bits.hpp"
+
+// payloads of message 1 and 18
+static const char * payloads[2] = {
+  "13u?etPv2;0n:dDPwUM1U1Cb069D",
+  "B6CdCm0t3`tba35f@V9faHi7kP06"
+};
+
+static void BM_DearmorScalar(benchmark::State & state)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  const char * pl = payloads[0];
+  int len = (int) strlen(pl);
+  for(auto _ : state){
+    ais_dearmor_scalar(pl, c6, len);
+    benchmark::DoNotOptimize(c6);
+  }
+}
+BENCHMARK(BM_DearmorScalar);
+
+static void BM_DearmorPack(benchmark::State & state)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  unsigned char bits[AIS_BITS_SIZE];
+  const char * pl = payloads[0];
+  int len = (int) strlen(pl);
+  for(auto _ : state){
+    ais_dearmor(pl, c6, len);
+    ais_pack6(c6, len, bits);
+    benchmark::DoNotOptimize(bits);
+  }
+}
+BENCHMARK(BM_DearmorPack);
+
+// message 1 fields extracted bit by bit from 6bit values
+static void BM_Msg1BitByBit(benchmark::State & state)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  const char * pl = payloads[0];
+  int len = (int) strlen(pl);
+  ais_dearmor_scalar(pl, c6, len);
+  unsigned int sum = 0;
+  for(auto _ : state){
+    sum += ais_get_c6_ubits(c6, 8, 30);
+    sum += ais_get_c6_ubits(c6, 38, 4);
+    sum += ais_get_c6_ubits(c6, 42, 8);
+    sum += ais_get_c6_ubits(c6, 50, 10);
+    sum += ais_get_c6_ubits(c6, 61, 28);
+    sum += ais_get_c6_ubits(c6, 89, 27);
+    sum += ais_get_c6_ubits(c6, 116, 12);
+    sum += ais_get_c6_ubits(c6, 128, 9);
+    sum += ais_get_c6_ubits(c6, 137, 6);
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_Msg1BitByBit);
+
+static void BM_Msg1Packed(benchmark::State & state)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  unsigned char bits[AIS_BITS_SIZE];
+  const char * pl = payloads[0];
+  int len = (int) strlen(pl);
+  ais_dearmor(pl, c6, len);
+  ais_pack6(c6, len, bits);
+  s_ais_pos_a pos;
+  for(auto _ : state){
+    benchmark::DoNotOptimize(bits);
+    pos.dec(bits);
+    benchmark::DoNotOptimize(pos);
+  }
+}
+BENCHMARK(BM_Msg1Packed);
+
+static void BM_Msg18Packed(benchmark::State & state)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  unsigned char bits[AIS_BITS_SIZE];
+  const char * pl = payloads[1];
+  int len = (int) strlen(pl);
+  ais_dearmor(pl, c6, len);
+  ais_pack6(c6, len, bits);
+  s_ais_pos_b pos;
+  for(auto _ : state){
+    benchmark::DoNotOptimize(bits);
+    pos.dec(bits);
+    benchmark::DoNotOptimize(pos);
+  }
+}
+BENCHMARK(BM_Msg18Packed);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,129 @@
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#include "benchmark/benchmark.h"
+#include "ch_obj.hpp"
+
+// 1500 targets in Tokyo Bay. In a cycle, 100 of them report their
+// positions, then relative states and TCPA/DCPA are calculated while my
+// own ship moves.
+#define NUM_TARGETS 1500
+#define NUM_UPDATES 100
+
+struct s_target
+{
+  double lat, lon;
+  float cog, sog;
+};
+
+static void run_cycles(benchmark::State & state, const float range)
+{
+  srand(1);
+  ch_ais_obj chan("ais_obj");
+  vector<s_target> tgts(NUM_TARGETS);
+  for(int i = 0; i < NUM_TARGETS; i++){
+    s_target & tgt = tgts[i];
+    tgt.lat = 35.4 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    tgt.lon = 139.8 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    tgt.cog = (float)(rand() % 360);
+    tgt.sog = (float)(rand() % 20);
+    chan.push(SEC, i + 1, tgt.lat, tgt.lon, tgt.cog, tgt.sog, 511.f);
+  }
+
+  long long t = SEC;
+  double lon = 139.8;
+  for (auto _ : state) {
+    t += SEC;
+    for(int k = 0; k < NUM_UPDATES; k++){
+      // a target reports after about 15 sec.
+      int i = rand() % NUM_TARGETS;
+      s_target & tgt = tgts[i];
+      double d = tgt.sog * KNOT * 15. / 6378137.;
+      tgt.lat += d * cos(tgt.cog * (PI / 180.)) * (180. / PI);
+      tgt.lon += d * sin(tgt.cog * (PI / 180.)) * (180. / PI);
+      chan.push(t, i + 1, tgt.lat, tgt.lon, tgt.cog, tgt.sog, 511.f);
+    }
+
+    double x, y, z, R[9];
+    lon += 1e-5;
+    blhtoecef(35.4 * (PI / 180.), lon * (PI / 180.), 0., x, y, z);
+    getwrldrot(35.4 * (PI / 180.), lon * (PI / 180.), R);
+    if(range < 0)
+      chan.update_rel_pos_and_vel(R, (float)x, (float)y, (float)z);
+    else
+      chan.update_rel_pos_and_vel(R, (float)x, (float)y, (float)z, range);
+    chan.calc_tdcpa(t, 0.f, 5.f);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_AisCycleAll(benchmark::State & state)
+{
+  run_cycles(state, -1.f);
+}
+BENCHMARK(BM_AisCycleAll)->Unit(benchmark::kMicrosecond);
+
+static void BM_AisCycleRange(benchmark::State & state)
+{
+  run_cycles(state, 10000.f);
+}
+BENCHMARK(BM_AisCycleRange)->Unit(benchmark::kMicrosecond);
+
+// TCPA/DCPA and prediction of the targets, in the table at once or
+// object by object.
+static void fill_targets(ch_ais_obj & chan, const int n)
+{
+  srand(1);
+  for(int i = 0; i < n; i++){
+    double lat = 35.4 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    double lon = 139.8 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    chan.push(SEC, i + 1, lat, lon, (float)(rand() % 360),
+	      (float)(rand() % 20), 511.f);
+  }
+  double x, y, z, R[9];
+  blhtoecef(35.4 * (PI / 180.), 139.8 * (PI / 180.), 0., x, y, z);
+  getwrldrot(35.4 * (PI / 180.), 139.8 * (PI / 180.), R);
+  chan.update_rel_pos_and_vel(R, (float)x, (float)y, (float)z);
+}
+
+static void BM_AisTdcpaTable(benchmark::State & state)
+{
+  const int n = (int)state.range(0);
+  ch_ais_obj chan("ais_obj");
+  fill_targets(chan, n);
+  vector<float> x(n), y(n), s(n);
+  long long t = 2 * SEC;
+  for (auto _ : state) {
+    chan.calc_tdcpa(t, 0.f, 5.f);
+    chan.get_table().predict(t + 60 * SEC, x.data(), y.data(), s.data());
+    benchmark::DoNotOptimize(x.data());
+    t += 100 * MSEC;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_AisTdcpaTable)->Arg(1500)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+static void BM_AisTdcpaObject(benchmark::State & state)
+{
+  const int n = (int)state.range(0);
+  ch_ais_obj chan("ais_obj");
+  fill_targets(chan, n);
+  long long t = 2 * SEC;
+  for (auto _ : state) {
+    for(chan.begin(); !chan.is_end(); chan.next()){
+      c_ais_obj & obj = chan.cur();
+      obj.calc_tdcpa(t, 0.f, 5.f);
+      float x, y, s;
+      obj.get_prediction(t + 60 * SEC, x, y, s);
+      benchmark::DoNotOptimize(x);
+    }
+    t += 100 * MSEC;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_AisTdcpaObject)->Arg(1500)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <vector>
+#include <list>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+#if __GNUC__ < 9
+#include <experimental/filesystem>
+namespace fs = experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = filesystem;
+#endif
+
+#include <string.h>
+
+#include "benchmark/benchmark.h"
+#include "aws_coord.hpp"
+#include "aws_stdlib.hpp"
+#include "aws_map.hpp"
+
+using namespace AWSMap2;
+
+// random walks around 35N 139.7E as coast lines in ECEF
+static void gen_lines_ecef(vector<vector<vec3>> & lines, const int num_lines,
+			   const int num_pts)
+{
+  lines.resize(num_lines);
+  for (int iline = 0; iline < num_lines; iline++) {
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    for (int i = 0; i < num_pts; i++) {
+      lat += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      lon += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      vec3 pt;
+      blhtoecef(lat * PI / 180., lon * PI / 180., 0., pt.x, pt.y, pt.z);
+      lines[iline].push_back(pt);
+    }
+  }
+}
+
+static void gen_queries(vector<vec3> & pts, const int num_pts)
+{
+  pts.resize(num_pts);
+  for (int i = 0; i < num_pts; i++) {
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    blhtoecef(lat * PI / 180., lon * PI / 180., 0.,
+	      pts[i].x, pts[i].y, pts[i].z);
+  }
+}
+
+static double dist_seg(const vec3 & a, const vec3 & b, const vec3 & p)
+{
+  vec3 d = b - a;
+  double t = min(max(dot(p - a, d) / dot(d, d), 0.), 1.);
+  return l2Norm(a + d * t, p);
+}
+
+// nearest segment and segments within 1km by scanning all the segments,
+// the reference of the SegmentIndex queries.
+static void BM_SegmentScan(benchmark::State & state)
+{
+  srand(1);
+  vector<vector<vec3>> lines;
+  gen_lines_ecef(lines, 20, 500);
+  vector<vec3> pts;
+  gen_queries(pts, 100);
+
+  int iq = 0;
+  for (auto _ : state) {
+    const vec3 & pt = pts[iq++ % pts.size()];
+    double dmin = DBL_MAX;
+    unsigned int num_in_radius = 0;
+    for (int iline = 0; iline < (int)lines.size(); iline++) {
+      for (int i = 0; i + 1 < (int)lines[iline].size(); i++) {
+	double d = dist_seg(lines[iline][i], lines[iline][i + 1], pt);
+	dmin = min(dmin, d);
+	if (d <= 1000.)
+	  num_in_radius++;
+      }
+    }
+    benchmark::DoNotOptimize(dmin);
+    benchmark::DoNotOptimize(num_in_radius);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SegmentScan);
+
+// nearest segment and segments within 1km by SegmentIndex
+static void BM_SegmentIndex(benchmark::State & state)
+{
+  srand(1);
+  vector<vector<vec3>> lines;
+  gen_lines_ecef(lines, 20, 500);
+  vector<vec3> pts;
+  gen_queries(pts, 100);
+
+  SegmentIndex index;
+  for (int iline = 0; iline < (int)lines.size(); iline++)
+    index.add(lines[iline], iline);
+  index.build();
+
+  int iq = 0;
+  vector<SegmentIndex::s_hit> hits;
+  for (auto _ : state) {
+    const vec3 & pt = pts[iq++ % pts.size()];
+    SegmentIndex::s_hit hit;
+    index.nearest(pt, hit);
+    hits.clear();
+    index.radius(pt, 1000., hits);
+    benchmark::DoNotOptimize(hit.dist);
+    benchmark::DoNotOptimize(hits.size());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SegmentIndex);
+
+// exposes try_reduce
+class ReducibleCoastLine: public CoastLine
+{
+public:
+  int reduce_points(int nred)
+  {
+    return try_reduce(nred);
+  }
+};
+
+// reduces 20 x 5000 point lines by 90000 points.
+static void BM_CoastLineReduce(benchmark::State & state)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_bench_reduce";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  string fname = (work_path / "a.xml").string();
+
+  srand(3);
+  {
+    ofstream ofile(fname.c_str());
+    ofile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
+    ofile.precision(12);
+    for (int iline = 0; iline < 20; iline++) {
+      double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+	lon = 139.7 + 0.5 * rand() / RAND_MAX;
+      ofile << "<gml:Curve gml:id=\"cv" << iline << "\">" << endl;
+      ofile << "<gml:segments><gml:LineStringSegment>" << endl;
+      ofile << "<gml:posList>" << endl;
+      for (int i = 0; i < 5000; i++) {
+	lat += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+	lon += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+	ofile << lat << " " << lon << endl;
+      }
+      ofile << "</gml:posList>" << endl;
+      ofile << "</gml:LineStringSegment></gml:segments>" << endl;
+      ofile << "</gml:Curve>" << endl;
+    }
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ReducibleCoastLine * cl = new ReducibleCoastLine;
+    cl->loadJPJIS(fname.c_str());
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(cl->reduce_points(90000));
+    state.PauseTiming();
+    delete cl;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * 90000);
+  fs::remove_all(work_path);
+}
+BENCHMARK(BM_CoastLineReduce)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <vector>
+#include <list>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+#include <string.h>
+
+#include "benchmark/benchmark.h"
+#include "aws_coord.hpp"
+#include "aws_stdlib.hpp"
+#include "aws_map.hpp"
+
+using namespace AWSMap2;
+
+// sets of four neighboring triangles on the earth surface, as the downlink
+// triangles of a node, and the query points near them.
+#define NUM_TRI4 256
+
+struct s_bench_data
+{
+  vector<s_tri4> tris;
+  vector<vec3> pts;
+
+  s_bench_data() : tris(NUM_TRI4), pts(NUM_TRI4)
+  {
+    srand(1);
+    for (int i = 0; i < NUM_TRI4; i++) {
+      double lat0 = (rand() % 1000) * (0.001 * PI / 4);
+      double lon0 = (rand() % 1000) * (0.002 * PI);
+      double d = 0.001;
+      for (int itri = 0; itri < 4; itri++) {
+	vec3 v[3];
+	double lat = lat0 + (itri & 1) * d, lon = lon0 + (itri >> 1) * d;
+	blhtoecef(lat, lon, 0, v[0].x, v[0].y, v[0].z);
+	blhtoecef(lat + d, lon, 0, v[1].x, v[1].y, v[1].z);
+	blhtoecef(lat, lon + d, 0, v[2].x, v[2].y, v[2].z);
+	tris[i].set(itri, v[0], v[1], v[2]);
+      }
+      // query point around the four triangles
+      double lat = lat0 + (rand() % 1000 - 250) * (0.003 * d);
+      double lon = lon0 + (rand() % 1000 - 250) * (0.003 * d);
+      blhtoecef(lat, lon, 0, pts[i].x, pts[i].y, pts[i].z);
+    }
+  }
+};
+
+static const s_bench_data & get_data()
+{
+  static s_bench_data data;
+  return data;
+}
+
+static const float r2 = 1000.f * 1000.f;
+
+static void BM_TriSphereScalar(benchmark::State & state)
+{
+  const s_bench_data & data = get_data();
+  unsigned int sum = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_TRI4; i++) {
+      const s_tri4 & tri = data.tris[i];
+      for (int itri = 0; itri < 4; itri++)
+	if (det_collision_tri_and_sphere(tri.get(itri, 0), tri.get(itri, 1),
+					 tri.get(itri, 2), data.pts[i], r2))
+	  sum |= (1 << itri);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TRI4 * 4);
+}
+BENCHMARK(BM_TriSphereScalar);
+
+static void BM_TriSphereBatch(benchmark::State & state)
+{
+  const s_bench_data & data = get_data();
+  unsigned int sum = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_TRI4; i++)
+      sum |= det_collision_tri4_and_sphere(data.tris[i], data.pts[i], r2);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TRI4 * 4);
+}
+BENCHMARK(BM_TriSphereBatch);
+
+static void BM_TriLineScalar(benchmark::State & state)
+{
+  const s_bench_data & data = get_data();
+  unsigned int sum = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_TRI4; i++) {
+      const s_tri4 & tri = data.tris[i];
+      for (int itri = 0; itri < 4; itri++)
+	if (det_collision(tri.get(itri, 0), tri.get(itri, 1),
+			  tri.get(itri, 2), data.pts[i]))
+	  sum |= (1 << itri);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TRI4 * 4);
+}
+BENCHMARK(BM_TriLineScalar);
+
+static void BM_TriLineBatch(benchmark::State & state)
+{
+  const s_bench_data & data = get_data();
+  unsigned int sum = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_TRI4; i++)
+      sum |= det_collision_tri4(data.tris[i], data.pts[i]);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TRI4 * 4);
+}
+BENCHMARK(BM_TriLineBatch);
+
+BENCHMARK_MAIN();
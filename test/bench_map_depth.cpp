@@ -0,0 +1,80 @@
+#include <iostream>
+#include <vector>
+#include <list>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+#include <string.h>
+
+#include "benchmark/benchmark.h"
+#include "aws_coord.hpp"
+#include "aws_stdlib.hpp"
+#include "aws_map.hpp"
+
+using namespace AWSMap2;
+
+// exposes the bitmap and the merge of Depth
+class BenchDepth: public Depth
+{
+public:
+  s_depth_bmp & getBitmap()
+  {
+    return bmp;
+  }
+  
+  bool merge_data(const Depth & src)
+  {
+    return _merge(src);
+  }
+};
+
+static void blh_deg_to_ecef(const double lat, const double lon, vec3 & v)
+{
+  blhtoecef(lat * PI / 180., lon * PI / 180., 0., v.x, v.y, v.z);
+}
+
+// merges a tile of the parent triangle into a child triangle, as in the
+// construction of the finer layer data (arg 0), or into a triangle
+// sticking out of the source, as in DepthTest.Merge (arg 1).
+static void BM_DepthMerge(benchmark::State & state)
+{
+  vec3 vsrc[3], vdst[3];
+  blh_deg_to_ecef(35.0, 139.0, vsrc[0]);
+  blh_deg_to_ecef(36.0, 139.0, vsrc[1]);
+  blh_deg_to_ecef(35.0, 140.0, vsrc[2]);
+  if (state.range(0)) {
+    blh_deg_to_ecef(35.2, 139.2, vdst[0]);
+    blh_deg_to_ecef(35.8, 139.2, vdst[1]);
+    blh_deg_to_ecef(35.2, 139.9, vdst[2]);
+  }
+  else {
+    blh_deg_to_ecef(35.0, 139.0, vdst[0]);
+    blh_deg_to_ecef(35.5, 139.0, vdst[1]);
+    blh_deg_to_ecef(35.0, 139.5, vdst[2]);
+  }
+
+  BenchDepth src, dst;
+  src.init(vsrc);
+  dst.init(vdst);
+  s_depth_bmp & bsrc = src.getBitmap();
+  for (int j = 0; j < DEPTH_MAP_HEIGHT; j++)
+    for (int i = 0; i < DEPTH_MAP_WIDTH; i++)
+      bsrc.set(i, j, (short)(j % 100), (short)((i + j) % 1000));
+  
+  for (auto _ : state) {
+    dst.merge_data(src);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepthMerge)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,137 @@
+#include <iostream>
+#include <vector>
+#include <list>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+#if __GNUC__ < 9
+#include <experimental/filesystem>
+namespace fs = experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = filesystem;
+#endif
+
+#include <string.h>
+
+#include "benchmark/benchmark.h"
+#include "aws_coord.hpp"
+#include "aws_stdlib.hpp"
+#include "aws_map.hpp"
+
+using namespace AWSMap2;
+
+// random walks around 35N 139.7E written as a JPGIS coast line file
+static void write_lines(const string & fname, const int num_lines,
+			const int num_pts)
+{
+  ofstream ofile(fname.c_str());
+  ofile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
+  ofile.precision(12);
+  for(int iline = 0; iline < num_lines; iline++){
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    ofile << "<gml:Curve gml:id=\"cv" << iline << "\">" << endl;
+    ofile << "<gml:segments><gml:LineStringSegment>" << endl;
+    ofile << "<gml:posList>" << endl;
+    for(int i = 0; i < num_pts; i++){
+      lat += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      lon += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      ofile << lat << " " << lon << endl;
+    }
+    ofile << "</gml:posList>" << endl;
+    ofile << "</gml:LineStringSegment></gml:segments>" << endl;
+    ofile << "</gml:Curve>" << endl;
+  }
+}
+
+// the tree shared by the readers, with all the nodes and layer data on
+// the request centers loaded.
+static MapDataBase * pmdb = NULL;
+static vector<vec3> centers(64);
+
+static void setup_tree()
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_bench_request";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  MapDataBase::setPath(work_path.string().c_str());
+  MapDataBase::setMaxSizeLayerData(lt_coast_line, 8192);
+
+  srand(4);
+  string fname = (work_path / "a.xml").string();
+  write_lines(fname, 40, 500);
+  CoastLine cl;
+  cl.loadJPJIS(fname.c_str());
+  pmdb = new MapDataBase;
+  pmdb->init();
+  pmdb->insert(&cl);
+  pmdb->save();
+  pmdb->pack();
+
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  for(int i = 0; i < (int)centers.size(); i++){
+    double lat = (35.0 + 0.5 * (i + 0.5) / centers.size()) * PI / 180.0;
+    double lon = (139.7 + 0.5 * ((i * 7) % centers.size() + 0.5)
+		  / centers.size()) * PI / 180.0;
+    blhtoecef(lat, lon, 0., centers[i].x, centers[i].y, centers[i].z);
+    list<list<LayerDataPtr>> datum;
+    pmdb->request(datum, types, centers[i], 5000.f);
+  }
+}
+
+// layer data requests by 1 to 8 reader threads on the shared tree. The
+// throughput scales with the readers as far as the cores allow, since the
+// readers share the database lock.
+static void BM_MapRequest(benchmark::State & state)
+{
+  if (state.thread_index() == 0 && !pmdb)
+    setup_tree();
+
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  int i = state.thread_index() * 11;
+  for (auto _ : state) {
+    list<list<LayerDataPtr>> datum;
+    pmdb->request(datum, types, centers[i % centers.size()], 5000.f);
+    benchmark::DoNotOptimize(datum.size());
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MapRequest)->ThreadRange(1, 8)->UseRealTime();
+
+// requests on the centers by a new database instance, loading the nodes
+// and layer data from the packs (arg 1) or the files (arg 0).
+static void BM_MapColdRequest(benchmark::State & state)
+{
+  if (!pmdb)
+    setup_tree();
+
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  for (auto _ : state) {
+    MapDataBase cold;
+    cold.init();
+    if (!state.range(0))
+      MapPack::close();
+    for (int i = 0; i < (int)centers.size(); i++) {
+      list<list<LayerDataPtr>> datum;
+      cold.request(datum, types, centers[i], 5000.f);
+      benchmark::DoNotOptimize(datum.size());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * centers.size());
+}
+BENCHMARK(BM_MapColdRequest)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+#include "benchmark/benchmark.h"
+#include "aws_nmea.hpp"
+#include "ch_nmea.hpp"
+
+// recorded sentences. Each is also replayed with other talkers.
+static const char * recorded[] = {
+  "$GPRMC,085120.307,A,3541.1493,N,13945.3994,E,000.0,240.3,181211,,,A*6A",
+  "$GPGGA,085120.307,3541.1493,N,13945.3994,E,1,08,1.0,6.9,M,35.9,M,,0000*5E",
+  "$GPGSA,A,3,29,26,05,10,02,27,08,15,,,,,1.8,1.0,1.5*3E",
+  "$GPGSV,3,1,12,26,72,352,28,05,65,066,37,15,50,268,35,27,33,189,37*7F",
+  "$GPVTG,240.3,T,,M,000.0,N,000.0,K,A*08",
+  "$GPGLL,4916.45,N,12311.12,W,225444,A,*1D",
+  "$GPZDA,201530.00,04,07,2002,00,00*60",
+  "$PSAT,HPR,170921.60,27.77,-3.18,,N*24",
+  "!AIVDM,1,1,,A,13u?etPv2;0n:dDPwUM1U1Cb069D,0*24",
+  "!AIVDM,1,1,,A,B6CdCm0t3`tba35f@V9faHi7kP06,0*58",
+};
+
+static const char * talkers[] = {"GP", "GN", "GL", "II"};
+
+static void make_stream(vector<string> & stream)
+{
+  char buf[128];
+  for(int it = 0; it < 4; it++){
+    for(auto str : recorded){
+      if(str[1] != 'G'){
+	if(it == 0)
+	  stream.push_back(str);
+	continue;
+      }
+      snprintf(buf, sizeof(buf), "%s", str);
+      buf[1] = talkers[it][0];
+      buf[2] = talkers[it][1];
+      char * p = strchr(buf, '*');
+      snprintf(p + 1, 3, "%02X", calc_nmea_chksum(buf));
+      stream.push_back(buf);
+    }
+  }
+}
+
+static void BM_NmeaDecode(benchmark::State & state)
+{
+  c_nmea_dec dec;
+  const char * ids[] = {"RMC", "GGA", "GSA", "GSV", "VTG", "GLL", "ZDA",
+			"HDT", "ROT", "MDA", "XDR", "DBT", "MTW"};
+  for(auto id : ids)
+    dec.add_nmea0183_decoder(id);
+  dec.add_psat_decoder("HPR");
+  dec.add_nmea0183_vdm_decoder(1);
+  dec.add_nmea0183_vdm_decoder(18);
+  
+  vector<string> stream;
+  make_stream(stream);
+  
+  long long num_sentences = 0, num_decoded = 0;
+  for(auto _ : state){
+    for(auto & str : stream){
+      if(dec.decode(str.c_str()))
+	num_decoded++;
+    }
+    num_sentences += stream.size();
+  }
+  state.counters["sentences/s"] =
+    benchmark::Counter((double)num_sentences, benchmark::Counter::kIsRate);
+  state.counters["decoded"] = (double) num_decoded / (double) num_sentences;
+}
+BENCHMARK(BM_NmeaDecode);
+
+// dispatch only, sentence id to payload type
+static void BM_NmeaDispatch(benchmark::State & state)
+{
+  vector<string> stream;
+  make_stream(stream);
+  long long num_sentences = 0;
+  for(auto _ : state){
+    for(auto & str : stream){
+      benchmark::DoNotOptimize(get_nmea0183_payload(str.c_str() + 3));
+    }
+    num_sentences += stream.size();
+  }
+  state.counters["sentences/s"] =
+    benchmark::Counter((double)num_sentences, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_NmeaDispatch);
+
+// a producer thread passes sentences to the consumer through the lock free
+// spsc channel, or the locked ch_nmea.
+#define NUM_PASSED 100000
+
+static void BM_ChNmeaSpsc(benchmark::State & state)
+{
+  const int nsent = (int)(sizeof(recorded) / sizeof(recorded[0]));
+  for (auto _ : state) {
+    ch_nmea_spsc spsc("spsc");
+    thread prod([&](){
+		  for(int i = 0; i < NUM_PASSED;){
+		    if(spsc.push(recorded[i % nsent]))
+		      i++;
+		    else
+		      this_thread::yield();
+		  }
+		});
+    char buf[16][ch_nmea_spsc::slot_size];
+    for(int nrcvd = 0; nrcvd < NUM_PASSED;){
+      int n = spsc.pop_n(buf[0], 16);
+      nrcvd += n;
+      if(n == 0)
+	this_thread::yield();
+    }
+    prod.join();
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_PASSED);
+}
+BENCHMARK(BM_ChNmeaSpsc)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ChNmeaLocked(benchmark::State & state)
+{
+  const int nsent = (int)(sizeof(recorded) / sizeof(recorded[0]));
+  for (auto _ : state) {
+    ch_nmea locked("locked");
+    atomic<bool> bdone(false);
+    // ch_nmea overwrites the oldest sentence when full, then the consumer
+    // only drains until the producer finishes.
+    thread prod([&](){
+		  for(int i = 0; i < NUM_PASSED; i++)
+		    locked.push(recorded[i % nsent]);
+		  bdone = true;
+		});
+    char buf[ch_nmea_spsc::slot_size];
+    while(true){
+      if(!locked.pop(buf)){
+	if(bdone)
+	  break;
+	this_thread::yield();
+      }
+    }
+    prod.join();
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_PASSED);
+}
+BENCHMARK(BM_ChNmeaLocked)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
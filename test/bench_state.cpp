@@ -0,0 +1,105 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+#include "benchmark/benchmark.h"
+#include "aws_coord.hpp"
+#include "aws_clock.hpp"
+#include "aws_math.hpp"
+#include "aws_state.hpp"
+
+// one hour of the log. The state holds the whole hour as the history.
+#define LOG_SEC 3600
+#define SIZE_BUF (LOG_SEC * 20 + 64)
+
+// adds the sensor data of the time t; position, velocity, heave and engine
+// at 10hz, attitude at 20hz, engine and rudder control at 1hz.
+static void add_data(c_aws1_state & st, const long long t0, const long long t,
+		     const int stream)
+{
+  const long long ts = t0 + t;
+  switch(stream){
+  case 0:
+    st.add_attitude(ts, 0.01f, 0.02f, (float)(1e-3 * (double)(t / MSEC)));
+    break;
+  case 1:
+    st.add_position(ts, 0.6 + 1e-8 * (double)(t / MSEC), 2.4);
+    break;
+  case 2:
+    st.add_heave(ts, 0.1f);
+    break;
+  case 3:
+    st.add_velocity(ts, 3.f, 0.5f);
+    break;
+  case 4:
+    st.add_engr(ts, 700.f, 0);
+    break;
+  case 5:
+    if(t % SEC == 0)
+      st.add_eng(ts, 200);
+    break;
+  case 6:
+    if(t % SEC == 0)
+      st.add_rud(ts, 127);
+    break;
+  }
+}
+
+// the data of all the sensors arrive in time order, as on board.
+static void BM_StateResampleLive(benchmark::State & state)
+{
+  const long long t0 = 10 * SEC;
+  for (auto _ : state) {
+    c_aws1_state st(SIZE_BUF, 64);
+    st.set_time(t0);
+    for(long long t = 0; t <= LOG_SEC * SEC; t += 50 * MSEC)
+      for(int stream = 0; stream < 7; stream++)
+	if(stream == 0 || t % (100 * MSEC) == 0)
+	  add_data(st, t0, t, stream);
+    benchmark::DoNotOptimize(st.get_time_10hz_data(0));
+  }
+  state.SetItemsProcessed(state.iterations() * LOG_SEC * 10);
+}
+BENCHMARK(BM_StateResampleLive)->Unit(benchmark::kMillisecond);
+
+// the log is replayed stream by stream, then the sampler catches up
+// the whole hour while the last stream is added.
+static void BM_StateResampleReplay(benchmark::State & state)
+{
+  const long long t0 = 10 * SEC;
+  for (auto _ : state) {
+    c_aws1_state st(SIZE_BUF, 64);
+    st.set_time(t0);
+    for(int stream = 0; stream < 7; stream++)
+      for(long long t = 0; t <= LOG_SEC * SEC; t += 50 * MSEC)
+	if(stream == 0 || t % (100 * MSEC) == 0)
+	  add_data(st, t0, t, stream);
+    benchmark::DoNotOptimize(st.get_time_10hz_data(0));
+  }
+  state.SetItemsProcessed(state.iterations() * LOG_SEC * 10);
+}
+BENCHMARK(BM_StateResampleReplay)->Unit(benchmark::kMillisecond);
+
+// the whole hour is resampled at once from the histories.
+static void BM_StateResampleBatch(benchmark::State & state)
+{
+  const long long t0 = 10 * SEC;
+  c_aws1_state st(SIZE_BUF, 64);
+  st.set_time(t0);
+  for(long long t = 0; t <= LOG_SEC * SEC; t += 50 * MSEC)
+    for(int stream = 0; stream < 7; stream++)
+      if(stream == 0 || t % (100 * MSEC) == 0)
+	add_data(st, t0, t, stream);
+
+  s_aws1_10hz_data d;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(st.resample_10hz_data(t0 + 300 * MSEC,
+						   LOG_SEC * 10, d));
+  }
+  state.SetItemsProcessed(state.iterations() * LOG_SEC * 10);
+}
+BENCHMARK(BM_StateResampleBatch)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
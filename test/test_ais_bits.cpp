@@ -0,0 +1,112 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "aws_ais_bits.hpp"
+
+static const char * armor_chars =
+  "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVW`abcdefghijklmnopqrstuvw";
+
+class AISBitsTest: public ::testing::Test
+{
+protected:
+  char str[AIS_MAX_PL_CHARS + 1];
+  virtual void SetUp(){
+    srand(0);
+    for(int i = 0; i < AIS_MAX_PL_CHARS; i++)
+      str[i] = armor_chars[rand() % 64];
+    str[AIS_MAX_PL_CHARS] = '\0';
+  }
+};
+
+TEST_F(AISBitsTest, Dearmor)
+{
+  char c6[AIS_MAX_PL_CHARS], c6_ref[AIS_MAX_PL_CHARS];
+  for(int len = 0; len <= AIS_MAX_PL_CHARS; len += 7){
+    ais_dearmor_scalar(str, c6_ref, len);
+    ais_dearmor(str, c6, len);
+    ASSERT_TRUE(0 == memcmp(c6, c6_ref, len));
+    for(int i = 0; i < len; i++)
+      ASSERT_TRUE(c6[i] >= 0 && c6[i] < 64);
+  }
+}
+
+TEST_F(AISBitsTest, DearmorInvalid)
+{
+  // characters out of the armoring table, including '~' and 8bit chars,
+  // placed both in the vector body and the scalar tail.
+  const char bad[] = { 'X', '_', '~', ' ', '/', (char)0x7f, (char)0x80,
+		       (char)0xff };
+  char c6[AIS_MAX_PL_CHARS], c6_ref[AIS_MAX_PL_CHARS];
+  for(int i = 0; i < AIS_MAX_PL_CHARS; i++)
+    str[i] = bad[i % sizeof(bad)];
+  for(int len = 1; len <= AIS_MAX_PL_CHARS; len += 5){
+    ais_dearmor_scalar(str, c6_ref, len);
+    ais_dearmor(str, c6, len);
+    ASSERT_TRUE(0 == memcmp(c6, c6_ref, len));
+    for(int i = 0; i < len; i++)
+      ASSERT_TRUE(c6[i] >= 0 && c6[i] < 64);
+  }
+}
+
+TEST_F(AISBitsTest, PackExtract)
+{
+  char c6[AIS_MAX_PL_CHARS];
+  unsigned char bits[AIS_BITS_SIZE];
+  ais_dearmor(str, c6, AIS_MAX_PL_CHARS);
+  
+  for(int len = 1; len <= AIS_MAX_PL_CHARS; len += 13){
+    ASSERT_EQ(ais_pack6(c6, len, bits), len * 6);
+    for(int pos = 0; pos < len * 6; pos += 5){
+      for(int nbits = 1; nbits <= 32 && pos + nbits <= len * 6; nbits += 3){
+	unsigned int ref = ais_get_c6_ubits(c6, pos, nbits);
+	ASSERT_EQ(ais_get_ubits(bits, pos, nbits), ref);
+	int sref = (int)(ref << (32 - nbits)) >> (32 - nbits);
+	ASSERT_EQ(ais_get_sbits(bits, pos, nbits), sref);
+      }
+    }
+  }
+}
+
+TEST_F(AISBitsTest, PosReport)
+{
+  // !AIVDM,1,1,,A,13u?etPv2;0n:dDPwUM1U1Cb069D,0*24
+  const char * pl = "13u?etPv2;0n:dDPwUM1U1Cb069D";
+  char c6[AIS_MAX_PL_CHARS];
+  unsigned char bits[AIS_BITS_SIZE];
+  int len = (int) strlen(pl);
+  ais_dearmor(pl, c6, len);
+  ais_pack6(c6, len, bits);
+  
+  s_ais_pos_a pos;
+  pos.dec(bits);
+  ASSERT_EQ(pos.type, 1);
+  ASSERT_EQ(pos.repeat, 0);
+  ASSERT_EQ(pos.mmsi, 265547250);
+  ASSERT_EQ(pos.status, 0);
+  ASSERT_EQ(pos.turn, -8);
+  ASSERT_EQ(pos.speed, 139);
+  ASSERT_FLOAT_EQ((double)pos.lon / 600000., 11.8329767);
+  ASSERT_FLOAT_EQ((double)pos.lat / 600000., 57.6603533);
+  ASSERT_EQ(pos.course, 404);
+  ASSERT_EQ(pos.heading, 41);
+  ASSERT_EQ(pos.second, 53);
+  ASSERT_EQ(pos.maneuver, 0);
+  ASSERT_EQ(pos.raim, 0);
+
+  // !AIVDM,1,1,,A,B6CdCm0t3`tba35f@V9faHi7kP06,0*58
+  pl = "B6CdCm0t3`tba35f@V9faHi7kP06";
+  len = (int) strlen(pl);
+  ais_dearmor(pl, c6, len);
+  ais_pack6(c6, len, bits);
+  s_ais_pos_b posb;
+  posb.dec(bits);
+  ASSERT_EQ(posb.type, 18);
+  ASSERT_EQ(posb.mmsi, ais_get_c6_ubits(c6, 8, 30));
+  ASSERT_EQ(posb.speed, ais_get_c6_ubits(c6, 46, 10));
+  ASSERT_EQ(posb.heading, ais_get_c6_ubits(c6, 124, 9));
+  ASSERT_EQ(posb.radio, ais_get_c6_ubits(c6, 148, 20));
+}
@@ -0,0 +1,280 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "ch_obj.hpp"
+
+// targets scattered in Tokyo Bay, and my own ship at the center.
+class ChAisObjTest: public ::testing::Test
+{
+protected:
+  ch_ais_obj chan;
+  double lat0, lon0;
+  double x0, y0, z0;
+  double R[9];
+  
+  virtual void SetUp(){
+    srand(3);
+    lat0 = 35.4;
+    lon0 = 139.8;
+    blhtoecef(lat0 * (PI / 180.), lon0 * (PI / 180.), 0., x0, y0, z0);
+    getwrldrot(lat0 * (PI / 180.), lon0 * (PI / 180.), R);
+  }
+
+  void push_random(const long long t, const unsigned int mmsi)
+  {
+    double lat = lat0 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    double lon = lon0 + 0.5 * ((double)rand() / RAND_MAX - 0.5);
+    chan.push(t, mmsi, lat, lon, (float)(rand() % 360),
+	      (float)(rand() % 20), 511.f);
+  }
+
+  // relative states calculated for a copy of the target
+  void calc_rel(c_ais_obj & obj, const float range, bool & brel,
+		double & xr, double & yr, double & zr)
+  {
+    c_ais_obj ref(obj);
+    ref.set_ecef_from_blh();
+    ref.set_pos_rel_from_ecef(R, (float)x0, (float)y0, (float)z0);
+    ref.get_pos_rel(xr, yr, zr);
+    brel = range < 0 || xr * xr + yr * yr + zr * zr <= range * range;
+  }
+  
+public:
+  ChAisObjTest():chan("ais_obj"){};
+};
+
+TEST_F(ChAisObjTest, PushAndFind)
+{
+  for(unsigned int mmsi = 1; mmsi <= 2000; mmsi++)
+    push_random(SEC, mmsi);
+  ASSERT_EQ(chan.get_num_objs(), 2000);
+
+  // updates do not add targets
+  for(unsigned int mmsi = 1; mmsi <= 2000; mmsi += 3)
+    push_random(2 * SEC, mmsi);
+  ASSERT_EQ(chan.get_num_objs(), 2000);
+  ASSERT_FALSE(chan.find(2001));
+  ASSERT_TRUE(chan.find(4));
+  ASSERT_EQ(chan.cur().get_mmsi(), 4u);
+  ASSERT_EQ(chan.cur().get_time(), 2 * SEC);
+
+  // old targets are removed, the others are still found
+  chan.remove_old(2 * SEC);
+  ASSERT_EQ(chan.get_num_objs(), 667);
+  for(unsigned int mmsi = 1; mmsi <= 2000; mmsi++){
+    ASSERT_EQ(chan.find(mmsi), mmsi % 3 == 1);
+    if(mmsi % 3 == 1){
+      ASSERT_EQ(chan.cur().get_mmsi(), mmsi);
+    }
+  }
+
+  // every target is iterated once
+  int num = 0;
+  for(chan.begin(); !chan.is_end(); chan.next())
+    num++;
+  ASSERT_EQ(num, 667);
+
+  // the updates are read in order, except for those removed.
+  char buf[64];
+  chan.read_buf(buf);
+  c_ais_obj obj;
+  obj.write_buf(buf);
+  ASSERT_EQ(obj.get_mmsi(), 1u);
+  ASSERT_EQ(obj.get_time(), 2 * SEC);
+  chan.reset_updates();
+  chan.read_buf(buf);
+  obj.write_buf(buf);
+  ASSERT_EQ(obj.get_mmsi(), 0u);
+}
+
+TEST_F(ChAisObjTest, RelativeStateInRange)
+{
+  for(unsigned int mmsi = 1; mmsi <= 1500; mmsi++)
+    push_random(SEC, mmsi);
+
+  const float range = 10000.f;
+  for(int icycle = 0; icycle < 3; icycle++){
+    // my own ship stays in the second cycle, then moves in the third. 
+    for(unsigned int mmsi = 1 + icycle; mmsi <= 1500; mmsi += 7)
+      push_random((2 + icycle) * SEC, mmsi);
+    if(icycle == 2){
+      lon0 += 0.05;
+      blhtoecef(lat0 * (PI / 180.), lon0 * (PI / 180.), 0., x0, y0, z0);
+      getwrldrot(lat0 * (PI / 180.), lon0 * (PI / 180.), R);
+    }
+
+    chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0, range);
+    chan.calc_tdcpa((3 + icycle) * SEC, 0.f, 5.f);
+    int num_in_range = 0;
+    for(chan.begin(); !chan.is_end(); chan.next()){
+      c_ais_obj & obj = chan.cur();
+      bool brel;
+      double xr, yr, zr, x, y, z;
+      calc_rel(obj, range, brel, xr, yr, zr);
+      ASSERT_EQ(obj.get_pos_rel(x, y, z), brel);
+      float tcpa, dcpa;
+      ASSERT_EQ(chan.get_tdcpa(tcpa, dcpa), brel);
+      if(!brel)
+	continue;
+      ASSERT_EQ(x, xr);
+      ASSERT_EQ(y, yr);
+      ASSERT_EQ(z, zr);
+      num_in_range++;
+    }
+    ASSERT_GT(num_in_range, 10);
+    
+    vector<unsigned int> mmsis;
+    chan.find_in_range((float)x0, (float)y0, (float)z0, range, mmsis);
+    ASSERT_NEAR((int)mmsis.size(), num_in_range, 1);
+  }
+
+  // without range, all the targets are calculated.
+  chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0);
+  for(chan.begin(); !chan.is_end(); chan.next()){
+    double x, y, z;
+    ASSERT_TRUE(chan.cur().get_pos_rel(x, y, z));
+  }
+  chan.remove_out(range);
+  ASSERT_LT(chan.get_num_objs(), 1500);
+  for(chan.begin(); !chan.is_end(); chan.next()){
+    double x, y, z;
+    chan.cur().get_pos_rel(x, y, z);
+    ASSERT_LE(x * x + y * y + z * z, range * range * 1.0001);
+  }
+}
+
+// targets out of the range of the last range limited update are removed,
+// even though their relative states are not calculated.
+TEST_F(ChAisObjTest, RemoveOutRangeLimited)
+{
+  for(unsigned int mmsi = 1; mmsi <= 1500; mmsi++)
+    push_random(SEC, mmsi);
+
+  // nothing is removed before my own ship's position is given.
+  const float range = 10000.f;
+  chan.remove_out(range);
+  ASSERT_EQ(chan.get_num_objs(), 1500);
+  
+  for(int icycle = 0; icycle < 2; icycle++){
+    if(icycle == 1){
+      lon0 += 0.05;
+      blhtoecef(lat0 * (PI / 180.), lon0 * (PI / 180.), 0., x0, y0, z0);
+      getwrldrot(lat0 * (PI / 180.), lon0 * (PI / 180.), R);
+    }
+    chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0, range);
+    vector<unsigned int> mmsis;
+    chan.find_in_range((float)x0, (float)y0, (float)z0, range, mmsis);
+    ASSERT_GT((int)mmsis.size(), 10);
+    
+    chan.remove_out(range);
+    ASSERT_NEAR((int)chan.get_num_objs(), (int)mmsis.size(), 1);
+    for(chan.begin(); !chan.is_end(); chan.next()){
+      double x, y, z;
+      ASSERT_TRUE(chan.cur().get_pos_ecef(x, y, z));
+      x -= x0;
+      y -= y0;
+      z -= z0;
+      ASSERT_LE(x * x + y * y + z * z, range * range * 1.0001);
+    }
+  }
+}
+
+// TCPA/DCPA and prediction in the table are the same as those calculated
+// by the objects.
+TEST_F(ChAisObjTest, TableTdcpa)
+{
+  // 1003 targets, not a multiple of the SIMD width
+  for(unsigned int mmsi = 1; mmsi <= 1003; mmsi++)
+    push_random(SEC, mmsi);
+  chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0);
+  const long long t = 5 * SEC;
+  const float vx = 2.f, vy = 5.f;
+  chan.calc_tdcpa(t, vx, vy);
+
+  const s_obj_table & tbl = chan.get_table();
+  ASSERT_EQ(tbl.size(), 1003);
+  vector<float> xp(tbl.size()), yp(tbl.size()), sp(tbl.size());
+  tbl.predict(10 * SEC, xp.data(), yp.data(), sp.data());
+
+  int i = 0;
+  for(chan.begin(); !chan.is_end(); chan.next(), i++){
+    ASSERT_EQ(tbl.id[i], chan.cur().get_mmsi());
+    float tcpa, dcpa;
+    ASSERT_TRUE(chan.get_tdcpa(tcpa, dcpa));
+    
+    c_ais_obj ref(chan.cur());
+    ref.set_ecef_from_blh();
+    ref.set_pos_rel_from_ecef(R, (float)x0, (float)y0, (float)z0);
+    ref.set_vel_ecef_from_blh(R);
+    ref.set_vel_rel_from_blh();
+    ASSERT_TRUE(ref.calc_tdcpa(t, vx, vy));
+    float tcpa_ref, dcpa_ref;
+    ref.get_tdcpa(tcpa_ref, dcpa_ref);
+    ASSERT_NEAR(tcpa, tcpa_ref, 1e-3 * fabs(tcpa_ref) + 1e-3);
+    ASSERT_NEAR(dcpa, dcpa_ref, 1e-3 * dcpa_ref + 1e-2);
+
+    // the object has the same values as the table
+    float tcpa_obj, dcpa_obj;
+    ASSERT_TRUE(chan.cur().get_tdcpa(tcpa_obj, dcpa_obj));
+    ASSERT_EQ(tcpa_obj, tcpa);
+    ASSERT_EQ(dcpa_obj, dcpa);
+    
+    float x, y, s;
+    ASSERT_TRUE(chan.get_prediction(10 * SEC, x, y, s));
+    ASSERT_NEAR(xp[i], x, 1e-2);
+    ASSERT_NEAR(yp[i], y, 1e-2);
+    ASSERT_FLOAT_EQ(sp[i], s);
+  }
+
+  // the closest point of approach of a target heading to my own ship
+  s_obj_table tbl1;
+  tbl1.push_back(1);
+  tbl1.dtype[0] = EOD_POS_REL;
+  tbl1.xr[0] = 1000.f;
+  tbl1.yr[0] = 0.f;
+  tbl1.vxr[0] = -10.f;
+  tbl1.vyr[0] = 10.f;
+  tbl1.dtype[0] = EOD_POS_REL | EOD_VEL_REL;
+  tbl1.calc_tdcpa(0, 0.f, 0.f);
+  ASSERT_TRUE(tbl1.dtype[0] & EOD_TDCPA);
+  ASSERT_NEAR(tbl1.tcpa[0], 50.f, 1e-4);
+  ASSERT_NEAR(tbl1.dcpa[0], 500.f * sqrt(2.f), 1e-2);
+
+  // rows without relative velocity have no TCPA/DCPA
+  tbl1.dtype[0] = EOD_POS_REL;
+  tbl1.calc_tdcpa(0, 0.f, 0.f);
+  ASSERT_FALSE(tbl1.dtype[0] & EOD_TDCPA);
+}
+
+// TCPA/DCPA of the previous relative states are not returned after the
+// relative states are recalculated.
+TEST_F(ChAisObjTest, TdcpaClearedBySet)
+{
+  for(unsigned int mmsi = 1; mmsi <= 100; mmsi++)
+    push_random(SEC, mmsi);
+  chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0);
+  chan.calc_tdcpa(2 * SEC, 0.f, 5.f);
+
+  // my own ship moves, and all the relative states are recalculated.
+  lon0 += 0.01;
+  blhtoecef(lat0 * (PI / 180.), lon0 * (PI / 180.), 0., x0, y0, z0);
+  getwrldrot(lat0 * (PI / 180.), lon0 * (PI / 180.), R);
+  chan.update_rel_pos_and_vel(R, (float)x0, (float)y0, (float)z0);
+  for(chan.begin(); !chan.is_end(); chan.next()){
+    float tcpa, dcpa;
+    ASSERT_FALSE(chan.get_tdcpa(tcpa, dcpa));
+    ASSERT_FALSE(chan.cur().get_tdcpa(tcpa, dcpa));
+  }
+
+  chan.calc_tdcpa(3 * SEC, 0.f, 5.f);
+  for(chan.begin(); !chan.is_end(); chan.next()){
+    float tcpa, dcpa;
+    ASSERT_TRUE(chan.get_tdcpa(tcpa, dcpa));
+  }
+}
@@ -2,6 +2,7 @@
 #include <ctime>
 #include <cstring>
 #include <iostream>
+#include <thread>
 
 
 using namespace std;
@@ -83,3 +84,130 @@ TEST_F(ChBinaryDataQueueTest, ReadWriteBuf)
   delete[] buf;
 }
   
+
+TEST_F(ChBinaryDataQueueTest, WriteBufOverflow)
+{
+  // queue shorter than data size, write_buf beyond the queue length
+  // should keep the last 8 data.
+  ch_binary_data_queue<8, 32> chan2("chan2"), chan3("chan3");
+  unsigned int sz;
+  unsigned char buf[32];
+  unsigned char * sbuf = new unsigned char[chan2.get_dsize() * 2];
+  
+  for(int iloop = 0; iloop < 4; iloop++){
+    for(int i = 0; i < 6; i++){
+      chan2.push(data[i], len[i]);
+    }
+    chan2.read_buf((char*)sbuf);
+    chan3.write_buf((const char*)sbuf);
+  }
+  ASSERT_EQ(chan3.get_num_dat(), 8);
+  for(int i = 0; i < 8; i++){
+    chan3.pop(buf, sz);
+    ASSERT_EQ(sz, len[(i + 4) % 6]);
+    ASSERT_TRUE(0 == memcmp(buf, data[(i + 4) % 6], sz));
+  }
+  delete[] sbuf;
+}
+
+typedef ch_binary_data_ring<256> ch_test_ring;
+
+TEST_F(ChBinaryDataQueueTest, RingReserveCommit)
+{
+  ch_test_ring ring("ring");
+  unsigned int sz;
+
+  ASSERT_TRUE(ring.peek(sz) == NULL);
+  
+  // wraps around the ring several times with variable length data
+  for(int i = 0; i < 64; i++){
+    unsigned char * p = ring.reserve(32);
+    ASSERT_TRUE(p != NULL);
+    memcpy(p, data[i], len[i]);
+    ring.commit(len[i]);
+    
+    const unsigned char * q = ring.peek(sz);
+    ASSERT_TRUE(q != NULL);
+    ASSERT_EQ(sz, len[i]);
+    ASSERT_TRUE(0 == memcmp(q, data[i], sz));
+    ring.release();
+    ASSERT_EQ(ring.get_num_dat(), 0);
+    ASSERT_EQ(ring.get_used_size(), 0);
+  }
+
+  // fill until full, then the data is dropped
+  int n = 0;
+  while(ring.push(data[n % 64], 32))
+    n++;
+  // 36 bytes for each, the ring may skip its end
+  ASSERT_TRUE(n >= 256 / 36 - 1 && n <= 256 / 36);
+  ASSERT_EQ(ring.get_num_drops(), 1);
+  ASSERT_TRUE(ring.reserve(300) == NULL);
+  
+  unsigned char buf[32];
+  for(int i = 0; i < n; i++){
+    ring.pop(buf, sz);
+    ASSERT_EQ(sz, 32);
+    ASSERT_TRUE(0 == memcmp(buf, data[i], sz));
+  }
+  ring.pop(buf, sz);
+  ASSERT_EQ(sz, 0);
+}
+
+TEST_F(ChBinaryDataQueueTest, RingReadWriteBuf)
+{
+  ch_test_ring ring0("ring0"), ring1("ring1");
+  unsigned int sz0, sz1;
+  unsigned char * buf = new unsigned char[ring0.get_dsize()];
+
+  for(int iloop = 0; iloop < 8; iloop++){
+    int n = 0;
+    while(ring0.push(data[(iloop + n) % 64], len[(iloop + n) % 64]))
+      n++;
+    sz0 = ring0.read_buf((char*)buf);
+    ASSERT_TRUE(sz0 <= ring0.get_dsize());
+    sz1 = ring1.write_buf((const char*)buf);
+    ASSERT_EQ(sz0, sz1);
+    ASSERT_EQ(ring1.get_num_dat(), n);
+    for(int i = 0; i < n; i++){
+      ring1.pop(buf, sz0);
+      ASSERT_EQ(sz0, len[(iloop + i) % 64]);
+      ASSERT_TRUE(0 == memcmp(buf, data[(iloop + i) % 64], sz0));
+    }
+  }
+  delete[] buf;
+}
+
+TEST_F(ChBinaryDataQueueTest, RingProducerConsumer)
+{
+  ch_binary_data_ring<1024> ring("ring");
+  const int num_data = 100000;
+  bool bok = true;
+  thread prod([&](){
+		for(int i = 0; i < num_data;){
+		  unsigned char * p = ring.reserve(len[i % 64]);
+		  if(!p){
+		    this_thread::yield();
+		    continue;
+		  }
+		  memcpy(p, data[i % 64], len[i % 64]);
+		  ring.commit(len[i % 64]);
+		  i++;
+		}
+	      });
+  
+  for(int i = 0; i < num_data;){
+    unsigned int sz;
+    const unsigned char * q = ring.peek(sz);
+    if(!q){
+      this_thread::yield();
+      continue;
+    }
+    if(sz != len[i % 64] || memcmp(q, data[i % 64], sz) != 0)
+      bok = false;
+    ring.release();
+    i++;
+  }
+  prod.join();
+  ASSERT_TRUE(bok);
+}
@@ -0,0 +1,132 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "ch_nmea.hpp"
+
+class ChNmeaSpscTest: public ::testing::Test
+{
+protected:
+  ch_nmea_spsc chan;
+  char nmea[64][ch_nmea_spsc::slot_size];
+  virtual void SetUp(){
+    for(int i = 0; i < 64; i++){
+      snprintf(nmea[i], ch_nmea_spsc::slot_size,
+	       "$GPGGA,%06d,3500.0000,N,13900.0000,E,1,08,1.0,10.0,M,,,,*%02X",
+	       i, i);
+    }
+  }
+  
+public:
+  ChNmeaSpscTest():chan("chan", 16){};
+};
+
+TEST_F(ChNmeaSpscTest, PushPop)
+{
+  char buf[ch_nmea_spsc::slot_size];
+  ASSERT_EQ(chan.get_capacity(), 16);
+  ASSERT_FALSE(chan.pop(buf));
+  
+  for(int i = 0; i < 10; i++)
+    ASSERT_TRUE(chan.push(nmea[i]));
+  ASSERT_EQ(chan.get_num_nmeas(), 10);
+  
+  for(int i = 0; i < 10; i++){
+    ASSERT_TRUE(chan.pop(buf));
+    ASSERT_STREQ(buf, nmea[i]);
+  }
+  ASSERT_FALSE(chan.pop(buf));
+
+  // wrap around
+  for(int iloop = 0; iloop < 4; iloop++){
+    for(int i = 0; i < 12; i++)
+      ASSERT_TRUE(chan.push(nmea[i + iloop]));
+    for(int i = 0; i < 12; i++){
+      ASSERT_TRUE(chan.pop(buf));
+      ASSERT_STREQ(buf, nmea[i + iloop]);
+    }
+  }
+  ASSERT_EQ(chan.get_overruns(), 0);
+}
+
+TEST_F(ChNmeaSpscTest, Batch)
+{
+  const char * ptrs[64];
+  char buf[64][ch_nmea_spsc::slot_size];
+  for(int i = 0; i < 64; i++)
+    ptrs[i] = nmea[i];
+  
+  ASSERT_EQ(chan.push_n(ptrs, 8), 8);
+  ASSERT_EQ(chan.pop_n(buf[0], 5), 5);
+  ASSERT_EQ(chan.push_n(ptrs + 8, 8), 8);
+  ASSERT_EQ(chan.pop_n(buf[5], 64), 11);
+  for(int i = 0; i < 16; i++)
+    ASSERT_STREQ(buf[i], nmea[i]);
+}
+
+TEST_F(ChNmeaSpscTest, Overrun)
+{
+  const char * ptrs[64];
+  char buf[64][ch_nmea_spsc::slot_size];
+  for(int i = 0; i < 64; i++)
+    ptrs[i] = nmea[i];
+
+  // the full queue keeps the oldest sentences and counts the rest
+  ASSERT_EQ(chan.push_n(ptrs, 20), 16);
+  ASSERT_EQ(chan.get_overruns(), 4);
+  ASSERT_FALSE(chan.push(nmea[20]));
+  ASSERT_EQ(chan.get_overruns(), 5);
+  
+  ASSERT_EQ(chan.pop_n(buf[0], 64), 16);
+  for(int i = 0; i < 16; i++)
+    ASSERT_STREQ(buf[i], nmea[i]);
+
+  // too long sentence is rejected, and counted as an overrun
+  char lng[ch_nmea_spsc::slot_size + 1];
+  memset(lng, 'a', ch_nmea_spsc::slot_size);
+  lng[ch_nmea_spsc::slot_size] = '\0';
+  ASSERT_FALSE(chan.push(lng));
+  ASSERT_EQ(chan.get_num_nmeas(), 0);
+  ASSERT_EQ(chan.get_overruns(), 6);
+  const char * bufs[3] = {nmea[0], lng, nmea[1]};
+  ASSERT_EQ(chan.push_n(bufs, 3), 2);
+  ASSERT_EQ(chan.get_overruns(), 7);
+
+  // the capacity given by the factory type
+  ch_nmea_spsc_n<4096> chan4k("spsc4k");
+  ASSERT_EQ(chan4k.get_capacity(), 4096u);
+}
+
+TEST_F(ChNmeaSpscTest, ProducerConsumer)
+{
+  const int num_nmeas = 200000;
+  ch_nmea_spsc spsc("spsc");
+  
+  int nrcvd = 0;
+  bool bok = true;
+  thread prod([&](){
+		for(int i = 0; i < num_nmeas;){
+		  if(spsc.push(nmea[i & 63]))
+		    i++;
+		  else
+		    this_thread::yield();
+		}
+	      });
+  char buf[16][ch_nmea_spsc::slot_size];
+  while(nrcvd < num_nmeas){
+    int n = spsc.pop_n(buf[0], 16);
+    for(int i = 0; i < n; i++, nrcvd++){
+      if(strcmp(buf[i], nmea[nrcvd & 63]) != 0)
+	bok = false;
+    }
+    if(n == 0)
+      this_thread::yield();
+  }
+  prod.join();
+  ASSERT_TRUE(bok);
+  ASSERT_EQ(spsc.get_num_nmeas(), 0);
+}
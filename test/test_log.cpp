@@ -12,7 +12,7 @@ using namespace std;
 class LogTest: public ::testing::Test
 {
 protected:
-  const char * dir_name;
+  string dir_name;
   const char * prefix;
   size_t size_max, size_total;
   string path;
@@ -35,20 +35,29 @@ protected:
   
   vector<data_inf> data_list;
   
-  LogTest():dir_name("logtest"), prefix("logtest"), size_max(1024),
+  LogTest():prefix("logtest"), size_max(1024),
 	    size_total(size_max * 3),
 	    time_start(10000), time_end(10000), time_step(100)
   {
   }
   
   c_log olog, ilog;
+
+  // removes all the log files written in dir_name, and recreates it empty.
+  void clear_dir()
+  {
+    fs::remove_all(dir_name);
+    fs::create_directory(dir_name);
+    fs::permissions(dir_name, fs::perms::owner_all);
+  }
+  
   virtual void SetUp(){
 
-    // initialize environment
-    if(!fs::exists(dir_name)){
-      fs::create_directory(dir_name);
-      fs::permissions(dir_name, fs::perms::owner_all);
-    }
+    // initialize environment. Each test has its own directory
+    // "logtest_$test_name", so that no test reads files of the others.
+    dir_name = "logtest_";
+    dir_name += ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    clear_dir();
 
     // we set path as "$current_directory/$dir_name"
     getcwd(buf, sizeof(buf));
@@ -78,6 +87,13 @@ protected:
     rand();
     
   }
+
+  virtual void TearDown(){
+    for (int i = 0; i < data_list.size(); i++)
+      delete[] data_list[i].data;
+    data_list.clear();
+    fs::remove_all(dir_name);
+  }
 };
 
 TEST_F(LogTest, WriteRead)
@@ -106,8 +122,9 @@ TEST_F(LogTest, WriteRead)
       continue;
     }else{
       bool r = ilog.read(tread, (unsigned char*)buf, szread);
-      if(data_list.back().t >= t)
+      if(data_list.back().t >= t){
 	ASSERT_TRUE(r);
+      }
     }
 
     
@@ -143,3 +160,259 @@ TEST_F(LogTest, WriteRead)
   
 }
 
+
+TEST_F(LogTest, WriteReadMmap)
+{
+  olog.init(path, prefix, false, size_max);
+  for (int i = 0; i < data_list.size(); i++){
+    olog.write(data_list[i].t, data_list[i].data,  data_list[i].sz);
+  }
+  olog.destroy();
+
+  // read twice, the first builds the index files, the second loads them.
+  for(int itr = 0; itr < 2; itr++){
+    c_log mlog;
+    mlog.init(path, prefix, true, size_max, true);
+    long long t = 9800;
+    long long tstep = 25;
+    while(t < time_end){
+      long long tread = t;
+      unsigned int szread;
+      bool r = mlog.read(tread, (unsigned char*)buf, szread);
+      if(t < time_start || t % time_step != 0){
+	ASSERT_EQ(szread, 0);
+	t += tstep;
+	continue;
+      }
+      if(data_list.back().t >= t){
+	ASSERT_TRUE(r);
+      }
+
+      int irec = 0;
+      for(; irec < data_list.size(); irec++){
+	if(data_list[irec].t == tread)
+	  break;
+      }
+
+      if(data_list[irec].sz == 0){ // zero sized data is not written
+	t += tstep;
+	continue;
+      }
+      ASSERT_EQ(tread, t);
+      ASSERT_EQ(szread, data_list[irec].sz);
+      ASSERT_EQ(memcmp(buf, data_list[irec].data, szread), 0);
+      t += tstep;
+    }
+    mlog.destroy();
+  }
+}
+
+TEST_F(LogTest, SeekSpan)
+{
+  olog.init(path, prefix, false, size_max);
+  for (int i = 0; i < data_list.size(); i++){
+    olog.write(data_list[i].t, data_list[i].data,  data_list[i].sz);
+  }
+  olog.destroy();
+
+  c_log mlog;
+  mlog.init(path, prefix, true, size_max, true);
+
+  // seek backward from the last record to the first one.
+  for(int irec = data_list.size() - 1; irec >= 0; irec--){
+    if(data_list[irec].sz == 0)
+      continue;
+
+    long long tread = data_list[irec].t;
+    ASSERT_TRUE(mlog.seek(tread));
+
+    const unsigned char * span;
+    unsigned int szread;
+    ASSERT_TRUE(mlog.read_span(tread, span, szread));
+    ASSERT_EQ(tread, data_list[irec].t);
+    ASSERT_EQ(szread, data_list[irec].sz);
+    ASSERT_EQ(memcmp(span, data_list[irec].data, szread), 0);
+  }
+
+  // seek beyond the last record fails
+  ASSERT_FALSE(mlog.seek(time_end + time_step));
+  mlog.destroy();
+}
+
+TEST_F(LogTest, StaleIndex)
+{
+  olog.init(path, prefix, false, size_max);
+  for (int i = 0; i < data_list.size(); i++){
+    olog.write(data_list[i].t, data_list[i].data,  data_list[i].sz);
+  }
+  olog.destroy();
+
+  // build the index files
+  c_log mlog;
+  mlog.init(path, prefix, true, size_max, true);
+  long long tread = time_start;
+  unsigned int szread;
+  ASSERT_TRUE(mlog.read(tread, (unsigned char*)buf, szread));
+  mlog.destroy();
+
+  // rewrite the time stamp of the first record keeping the size and the
+  // modification time of the log file.
+  string fname_first;
+  for (const auto & p : fs::directory_iterator(path)){
+    string fname = p.path().string();
+    if (fname.size() > 4 && fname.substr(fname.size() - 4) == ".log" &&
+	(fname_first.empty() || fname < fname_first))
+      fname_first = fname;
+  }
+  ASSERT_FALSE(fname_first.empty());
+  auto mtime = fs::last_write_time(fname_first);
+  long long tfirst = time_start - 50;
+  {
+    fstream f(fname_first, ios_base::in | ios_base::out | ios_base::binary);
+    f.write((const char*)&tfirst, sizeof(tfirst));
+  }
+  fs::last_write_time(fname_first, mtime);
+
+  // the index not matching the log is rebuilt.
+  mlog.init(path, prefix, true, size_max, true);
+  tread = tfirst;
+  ASSERT_TRUE(mlog.read(tread, (unsigned char*)buf, szread));
+  ASSERT_EQ(tread, tfirst);
+  ASSERT_EQ(szread, data_list[0].sz);
+  mlog.destroy();
+}
+
+TEST_F(LogTest, AsyncWriteRead)
+{
+  c_log alog;
+  alog.set_async(true, 4096, 0, true); // block writes to drop nothing
+  alog.init(path, prefix, false, size_max);
+  for (int i = 0; i < data_list.size(); i++){
+    bool r = alog.write(data_list[i].t, data_list[i].data,  data_list[i].sz);
+    if(data_list[i].sz)
+      ASSERT_TRUE(r);
+    else
+      ASSERT_FALSE(r);
+  }
+  alog.destroy();
+  ASSERT_EQ(alog.get_num_drops(), 0);
+
+  ilog.init(path, prefix, true, size_max);
+  for (int i = 0; i < data_list.size(); i++){
+    if(data_list[i].sz == 0)
+      continue;
+    long long tread = data_list[i].t;
+    unsigned int szread;
+    ASSERT_TRUE(ilog.read(tread, (unsigned char*)buf, szread));
+    ASSERT_EQ(tread, data_list[i].t);
+    ASSERT_EQ(szread, data_list[i].sz);
+    ASSERT_EQ(memcmp(buf, data_list[i].data, szread), 0);
+  }
+  ilog.destroy();
+}
+
+TEST_F(LogTest, AsyncDrop)
+{
+  c_log alog;
+  alog.set_async(true, 4096, 0, false);
+  alog.init(path, prefix, false, size_max);
+
+  // a record larger than the ring buffer is dropped
+  vector<unsigned char> large(8192, 0);
+  ASSERT_FALSE(alog.write(time_end, large.data(), large.size()));
+  ASSERT_EQ(alog.get_num_drops(), 1);
+  alog.destroy();
+}
+
+TEST_F(LogTest, AsyncBlock)
+{
+  // writes many times the ring size. write() waits for the writer thread
+  // instead of dropping records.
+  c_log alog;
+  alog.set_async(true, 4096, 0, true);
+  alog.init(path, prefix, false, 1 << 20);
+  const int num_recs = 2000;
+  unsigned char rec[256];
+  for (int i = 0; i < num_recs; i++){
+    memset(rec, i & 0xff, sizeof(rec));
+    ASSERT_TRUE(alog.write(time_start + i, rec, sizeof(rec)));
+  }
+  alog.destroy();
+  ASSERT_EQ(alog.get_num_drops(), 0);
+  ASSERT_GT(alog.get_num_stalls(), 0);
+
+  ilog.init(path, prefix, true, 1 << 20);
+  for (int i = 0; i < num_recs; i++){
+    long long tread = time_start + i;
+    unsigned int szread;
+    ASSERT_TRUE(ilog.read(tread, (unsigned char*)buf, szread));
+    ASSERT_EQ(tread, time_start + i);
+    ASSERT_EQ(szread, sizeof(rec));
+    ASSERT_EQ(((unsigned char*)buf)[0], i & 0xff);
+  }
+  ilog.destroy();
+}
+
+TEST_F(LogTest, AsyncOpenFail)
+{
+  // records are counted as dropped if the log file cannot be opened.
+  c_log alog;
+  alog.set_async(true, 4096, 0, true);
+  alog.init(path + "/not_exist", prefix, false, size_max);
+  unsigned long long num_recs = 0;
+  for (int i = 0; i < data_list.size(); i++){
+    if (alog.write(data_list[i].t, data_list[i].data,  data_list[i].sz))
+      num_recs++;
+  }
+  alog.destroy();
+  ASSERT_GT(num_recs, 0);
+  ASSERT_EQ(alog.get_num_drops(), num_recs);
+}
+
+TEST_F(LogTest, CompWriteRead)
+{
+  // sync and async writers produce the same block compressed files
+  for(int basync = 0; basync < 2; basync++){
+    clear_dir();
+    c_log clog;
+    clog.set_async(basync == 1, 4096, 0, true);
+    clog.set_comp(true, 4);
+    clog.init(path, prefix, false, size_max);
+    for (int i = 0; i < data_list.size(); i++){
+      clog.write(data_list[i].t, data_list[i].data,  data_list[i].sz);
+    }
+    clog.destroy();
+
+    // read() through the old interface
+    c_log rlog;
+    rlog.init(path, prefix, true, size_max);
+    for (int i = 0; i < data_list.size(); i++){
+      if(data_list[i].sz == 0)
+	continue;
+      long long tread = data_list[i].t;
+      unsigned int szread;
+      ASSERT_TRUE(rlog.read(tread, (unsigned char*)buf, szread));
+      ASSERT_EQ(tread, data_list[i].t);
+      ASSERT_EQ(szread, data_list[i].sz);
+      ASSERT_EQ(memcmp(buf, data_list[i].data, szread), 0);
+    }
+    rlog.destroy();
+
+    // seek by block
+    c_log slog;
+    slog.init(path, prefix, true, size_max);
+    for(int irec = data_list.size() - 1; irec >= 0; irec--){
+      if(data_list[irec].sz == 0)
+	continue;
+      long long tread = data_list[irec].t;
+      ASSERT_TRUE(slog.seek(tread));
+      const unsigned char * span;
+      unsigned int szread;
+      ASSERT_TRUE(slog.read_span(tread, span, szread));
+      ASSERT_EQ(tread, data_list[irec].t);
+      ASSERT_EQ(szread, data_list[irec].sz);
+      ASSERT_EQ(memcmp(span, data_list[irec].data, szread), 0);
+    }
+    slog.destroy();
+  }
+}
@@ -9,6 +9,9 @@
 #include <map>
 #include <algorithm>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 using namespace std;
 
@@ -95,3 +98,951 @@ const char * MapTest::jpgis_list[4] =
 TEST_F(MapTest, Init)
 {   
 }
+
+TEST_F(MapTest, ConcurrentRequest)
+{
+  if(!is_data_found)
+    return;
+
+  const int num_centers = 16, num_requests = 64;
+  vector<vec3> centers(num_centers);
+  for(int i = 0; i < num_centers; i++){
+    double lat = (35.0 + 0.05 * i) * PI / 180.0;
+    double lon = (139.7 + 0.03 * i) * PI / 180.0;
+    blhtoecef(lat, lon, 0., centers[i].x, centers[i].y, centers[i].z);
+  }
+  
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  auto count_lines = [&](const vec3 & center) -> unsigned int
+    {
+      list<list<LayerDataPtr>> datum;
+      mdb.request(datum, types, center, 20000.f);
+      unsigned int n = 0;
+      for(auto itr = datum.begin(); itr != datum.end(); itr++)
+	for(auto itrd = itr->begin(); itrd != itr->end(); itrd++)
+	  n += ((const CoastLine&)(**itrd)).getNumLines();
+      return n;
+    };
+
+  vector<unsigned int> num_lines(num_centers);
+  for(int i = 0; i < num_centers; i++)
+    num_lines[i] = count_lines(centers[i]);
+
+  // the same results with any number of readers
+  for(int nthreads = 1; nthreads <= 8; nthreads *= 2){
+    atomic<int> num_errors(0);
+    vector<thread> threads;
+    for(int ith = 0; ith < nthreads; ith++){
+      threads.push_back(thread([&, ith](){
+				 for(int i = 0; i < num_requests; i++){
+				   int ic = (i + ith) % num_centers;
+				   if(count_lines(centers[ic]) != num_lines[ic])
+				     num_errors++;
+				 }
+			       }));
+    }
+    for(auto itr = threads.begin(); itr != threads.end(); itr++)
+      itr->join();
+    ASSERT_EQ(num_errors, 0);
+  }
+  mdb.restruct();
+}
+
+TEST_F(MapTest, PackedColdRequest)
+{
+  if(!is_data_found)
+    return;
+
+  ASSERT_TRUE(mdb.pack());
+
+  const int num_centers = 16;
+  vector<vec3> centers(num_centers);
+  for(int i = 0; i < num_centers; i++){
+    double lat = (35.0 + 0.05 * i) * PI / 180.0;
+    double lon = (139.7 + 0.03 * i) * PI / 180.0;
+    blhtoecef(lat, lon, 0., centers[i].x, centers[i].y, centers[i].z);
+  }
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+
+  // cold requests on a new database instance, with and without the packs.
+  unsigned int num_lines[2] = {0, 0};
+  for(int bpack = 0; bpack < 2; bpack++){
+    MapDataBase cold;
+    cold.init();
+    if(!bpack)
+      MapPack::close();
+    
+    for(int i = 0; i < num_centers; i++){
+      list<list<LayerDataPtr>> datum;
+      cold.request(datum, types, centers[i], 20000.f);
+      for(auto itr = datum.begin(); itr != datum.end(); itr++)
+	for(auto itrd = itr->begin(); itrd != itr->end(); itrd++)
+	  num_lines[bpack] += ((const CoastLine&)(**itrd)).getNumLines();
+    }
+  }
+  ASSERT_EQ(num_lines[0], num_lines[1]);
+}
+
+TEST(MapPackTest, Key)
+{
+  list<unsigned char> path_id;
+  unsigned long long key_face, key_child, key_grandchild;
+  path_id.push_back(3);
+  ASSERT_TRUE(MapPack::getKey(path_id, key_face));
+  ASSERT_EQ(key_face, 0ULL);
+
+  path_id.push_back(1);
+  ASSERT_TRUE(MapPack::getKey(path_id, key_child));
+  path_id.push_back(2);
+  ASSERT_TRUE(MapPack::getKey(path_id, key_grandchild));
+  ASSERT_EQ(key_grandchild, (1ULL << 62) | (2ULL << 60) | 2ULL);
+
+  // parents precede their subtrees
+  ASSERT_LT(key_face, key_child);
+  ASSERT_LT(key_child, key_grandchild);
+
+  while(path_id.size() <= MapPack::MAX_LEVEL)
+    path_id.push_back(0);
+  ASSERT_TRUE(MapPack::getKey(path_id, key_child));
+  path_id.push_back(0);
+  ASSERT_FALSE(MapPack::getKey(path_id, key_child));
+}
+
+TEST(MapPackTest, BuildAndLoad)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_pack_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  MapDataBase::setPath(work_path.string().c_str());
+
+  list<vector<vec3>> tris, tris_packed;
+  list<list<unsigned char>> paths;
+  list<list<LayerType>> types;
+  vec3 center;
+  blhtoecef(35.0 * PI / 180.0, 139.7 * PI / 180.0, 0.,
+	    center.x, center.y, center.z);
+  {
+    // the top level nodes are created and saved to the files, then packed.
+    MapDataBase mdb;
+    mdb.init();
+    ASSERT_TRUE(mdb.save());
+    mdb.request(tris, paths, types, center, 1e7f, 1e8f);
+  }
+
+  for(int iface = 0; iface < 20; iface++){
+    char fname[64];
+    snprintf(fname, sizeof(fname), "N%02d.pack", iface);
+    ASSERT_TRUE(fs::exists(work_path / fname));
+    ASSERT_FALSE(MapPack::isDirty(iface));
+  }
+
+  // the records are the same as the files
+  list<unsigned char> path_id;
+  path_id.push_back(5);
+  const char * data = NULL;
+  unsigned int size = 0;
+  ASSERT_TRUE(MapPack::find(path_id, lt_undef, data, size));
+  ifstream findex((work_path / "N05" / "N05.index").string().c_str(),
+		  ios::binary);
+  vector<char> buf(size);
+  findex.read(buf.data(), size);
+  ASSERT_TRUE((bool)findex);
+  ASSERT_EQ(memcmp(buf.data(), data, size), 0);
+  path_id.push_back(0);
+  ASSERT_FALSE(MapPack::find(path_id, lt_undef, data, size));
+
+  {
+    // the top level nodes are loaded from the packs
+    unsigned long long num_hits = MapPack::getNumHits();
+    MapDataBase mdb;
+    mdb.init();
+    ASSERT_EQ(MapPack::getNumHits() - num_hits, 20ULL);
+    mdb.request(tris_packed, paths, types, center, 1e7f, 1e8f);
+    ASSERT_EQ(tris.size(), tris_packed.size());
+    for(auto itr = tris.begin(), itr_packed = tris_packed.begin();
+	itr != tris.end(); itr++, itr_packed++)
+      for(int i = 0; i < 3; i++)
+	ASSERT_TRUE((*itr)[i] == (*itr_packed)[i]);
+
+    // writing to the files invalidates the pack, and save rebuilds it.
+    MapPack::invalidate(5);
+    ASSERT_TRUE(MapPack::isDirty(5));
+    ASSERT_FALSE(fs::exists(work_path / "N05.pack"));
+    ASSERT_TRUE(mdb.save());
+    ASSERT_FALSE(MapPack::isDirty(5));
+    ASSERT_TRUE(fs::exists(work_path / "N05.pack"));
+  }
+
+  MapPack::close();
+  fs::remove_all(work_path);
+}
+
+TEST_F(MapTest, Prefetch)
+{
+  if(!is_data_found)
+    return;
+
+  ASSERT_TRUE(mdb.pack());
+
+  // route passing through the request centers
+  const int num_centers = 16;
+  list<vec3> route;
+  for(int i = 0; i < num_centers; i++){
+    double lat = (35.0 + 0.05 * i) * PI / 180.0;
+    double lon = (139.7 + 0.03 * i) * PI / 180.0;
+    vec3 pt;
+    blhtoecef(lat, lon, 0., pt.x, pt.y, pt.z);
+    route.push_back(pt);
+  }
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+
+  MapDataBase cold;
+  cold.init();
+  MapPrefetcher prefetcher(&cold);
+  prefetcher.setLayerTypes(types);
+  prefetcher.setCorridor(20000.f, 200000.f);
+  vector<vec3> centers;
+  MapPrefetcher::sampleCorridor(vector<vec3>(route.begin(), route.end()),
+				20000.f, 200000.f, centers);
+  
+  MapDataBase::resetCounts();
+  ASSERT_TRUE(prefetcher.start());
+  prefetcher.setRoute(route);
+  while(prefetcher.getNumRequests() < centers.size())
+    this_thread::sleep_for(chrono::milliseconds(10));
+  prefetcher.stop();
+  cout << "prefetched: " << MapDataBase::getNumPrefetched() << endl;
+  
+  // requests on the route hit the cache
+  for(auto itr = route.begin(); itr != route.end(); itr++){
+    list<list<LayerDataPtr>> datum;
+    cold.request(datum, types, *itr, 20000.f);
+  }
+  cout << "hits: " << MapDataBase::getNumHits()
+       << " misses: " << MapDataBase::getNumMisses() << endl;
+  ASSERT_GT(MapDataBase::getNumHits(), 0ULL);
+  ASSERT_EQ(MapDataBase::getNumMisses(), 0ULL);
+}
+
+TEST(MapPrefetcherTest, SampleCorridor)
+{
+  vector<vec3> route, centers;
+  route.push_back(vec3(0., 0., 0.));
+  route.push_back(vec3(6000., 0., 0.));
+  route.push_back(vec3(6000., 4000., 0.));
+
+  // every 2 km up to the end of the route
+  MapPrefetcher::sampleCorridor(route, 2000.f, 20000.f, centers);
+  ASSERT_EQ(centers.size(), 6u);
+  ASSERT_NEAR(centers[3].x, 6000., 1e-6);
+  ASSERT_NEAR(centers[4].y, 2000., 1e-6);
+  ASSERT_NEAR(centers[5].y, 4000., 1e-6);
+  
+  // stops at the lookahead
+  MapPrefetcher::sampleCorridor(route, 2000.f, 5000.f, centers);
+  ASSERT_EQ(centers.size(), 3u);
+  ASSERT_NEAR(centers[2].x, 4000., 1e-6);
+
+  // the end of the route not on the interval, is added if it is apart
+  // from the last center more than half the width.
+  route.pop_back();
+  MapPrefetcher::sampleCorridor(route, 2500.f, 20000.f, centers);
+  ASSERT_EQ(centers.size(), 3u);
+  route.back().x = 7000.;
+  MapPrefetcher::sampleCorridor(route, 2500.f, 20000.f, centers);
+  ASSERT_EQ(centers.size(), 4u);
+  ASSERT_NEAR(centers[3].x, 7000., 1e-6);
+
+  MapPrefetcher::sampleCorridor(vector<vec3>(), 2000.f, 20000.f, centers);
+  ASSERT_TRUE(centers.empty());
+}
+
+TEST(MapPrefetcherTest, StartStop)
+{
+  MapDataBase mdb;
+  MapPrefetcher prefetcher(&mdb);
+  ASSERT_TRUE(prefetcher.start());
+  ASSERT_FALSE(prefetcher.start());
+  prefetcher.stop();
+  prefetcher.stop();
+  ASSERT_EQ(prefetcher.getNumRequests(), 0ULL);
+}
+
+TEST(SegmentIndexTest, Queries)
+{
+  // random walks around 35N 139.7E as coast lines
+  srand(1);
+  vector<vector<vec3>> lines(20);
+  for(int iline = 0; iline < (int)lines.size(); iline++){
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    for(int i = 0; i < 500; i++){
+      lat += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      lon += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      vec3 pt;
+      blhtoecef(lat * PI / 180., lon * PI / 180., 0., pt.x, pt.y, pt.z);
+      lines[iline].push_back(pt);
+    }
+  }
+  
+  SegmentIndex index;
+  for(int iline = 0; iline < (int)lines.size(); iline++)
+    index.add(lines[iline], iline);
+  index.build();
+  ASSERT_EQ(index.getNumSegments(), 20u * 499u);
+
+  auto dist_seg = [](const vec3 & a, const vec3 & b, const vec3 & p)
+    {
+      vec3 d = b - a;
+      double t = min(max(dot(p - a, d) / dot(d, d), 0.), 1.);
+      return l2Norm(a + d * t, p);
+    };
+  
+  for(int itest = 0; itest < 100; itest++){
+    vec3 pt;
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    blhtoecef(lat * PI / 180., lon * PI / 180., 0., pt.x, pt.y, pt.z);
+    
+    // brute force
+    double dmin = DBL_MAX;
+    unsigned int num_in_radius = 0;
+    const double r = 1000.;
+    for(int iline = 0; iline < (int)lines.size(); iline++){
+      for(int i = 0; i + 1 < (int)lines[iline].size(); i++){
+	double d = dist_seg(lines[iline][i], lines[iline][i + 1], pt);
+	dmin = min(dmin, d);
+	if(d <= r)
+	  num_in_radius++;
+      }
+    }
+    
+    SegmentIndex::s_hit hit;
+    ASSERT_TRUE(index.nearest(pt, hit));
+    vector<SegmentIndex::s_hit> hits;
+    index.radius(pt, r, hits);
+    
+    ASSERT_NEAR(hit.dist, dmin, 1e-6);
+    ASSERT_NEAR(dist_seg(lines[hit.iline][hit.ipt],
+			 lines[hit.iline][hit.ipt + 1], pt), dmin, 1e-6);
+    ASSERT_EQ(hits.size(), num_in_radius);
+  }
+  
+  // ray across a single line going east to west
+  SegmentIndex wall;
+  vector<vec3> line(2);
+  blhtoecef(35.0 * PI / 180., 139.8 * PI / 180., 0.,
+	    line[0].x, line[0].y, line[0].z);
+  blhtoecef(35.1 * PI / 180., 139.8 * PI / 180., 0.,
+	    line[1].x, line[1].y, line[1].z);
+  wall.add(line, 7);
+  wall.build();
+  
+  vec3 org, east;
+  blhtoecef(35.05 * PI / 180., 139.7 * PI / 180., 0., org.x, org.y, org.z);
+  blhtoecef(35.05 * PI / 180., 139.71 * PI / 180., 0.,
+	    east.x, east.y, east.z);
+  vec3 dir = east - org;
+  SegmentIndex::s_hit hit;
+  ASSERT_TRUE(wall.ray(org, dir, 20000., hit));
+  ASSERT_EQ(hit.iline, 7u);
+  ASSERT_EQ(hit.ipt, 0u);
+  // 0.1 deg of longitude at 35.05N is about 9.1 km
+  ASSERT_NEAR(hit.dist, 9120., 50.);
+  ASSERT_FALSE(wall.ray(org, dir, 5000., hit));
+  ASSERT_FALSE(wall.ray(org, dir * -1.0, 20000., hit));
+}
+
+TEST(CollisionTest, TriAndSphere)
+{
+  // a small triangle near 35N 139.7E
+  vec3 v[3];
+  blhtoecef(35.0 * PI / 180., 139.7 * PI / 180., 0., v[0].x, v[0].y, v[0].z);
+  blhtoecef(35.0 * PI / 180., 139.8 * PI / 180., 0., v[1].x, v[1].y, v[1].z);
+  blhtoecef(35.1 * PI / 180., 139.75 * PI / 180., 0., v[2].x, v[2].y, v[2].z);
+
+  // the sphere only around each vertex
+  for(int i = 0; i < 3; i++)
+    ASSERT_TRUE(det_collision_tri_and_sphere(v[0], v[1], v[2], v[i],
+					     100.f * 100.f));
+
+  // the sphere outside of vertex 0
+  vec3 c = (v[0] + v[1] + v[2]) * (1.0 / 3.0);
+  vec3 out = v[0] + (v[0] - c) * (1000. / l2Norm(v[0], c));
+  ASSERT_TRUE(det_collision_tri_and_sphere(v[0], v[1], v[2], out,
+					   1500.f * 1500.f));
+  ASSERT_FALSE(det_collision_tri_and_sphere(v[0], v[1], v[2], out,
+					    500.f * 500.f));
+
+  // the sphere on the middle of the edges
+  ASSERT_TRUE(det_collision_tri_and_sphere(v[0], v[1], v[2],
+					   (v[0] + v[1]) * 0.5, 100.f * 100.f));
+  ASSERT_TRUE(det_collision_tri_and_sphere(v[0], v[1], v[2],
+					   (v[0] + v[2]) * 0.5, 100.f * 100.f));
+  ASSERT_TRUE(det_collision_tri_and_sphere(v[0], v[1], v[2],
+					   (v[1] + v[2]) * 0.5, 100.f * 100.f));
+}
+
+TEST(CollisionTest, Batch)
+{
+  // random triangles and spheres around Japan, including far ones.
+  srand(2);
+  auto rand_pt = [](double lat0, double lon0, double range)
+    {
+      vec3 pt;
+      double lat = lat0 + range * ((double) rand() / RAND_MAX - 0.5);
+      double lon = lon0 + range * ((double) rand() / RAND_MAX - 0.5);
+      blhtoecef(lat * PI / 180., lon * PI / 180., 0., pt.x, pt.y, pt.z);
+      return pt;
+    };
+
+  int num_sphere_hits = 0, num_point_hits = 0;
+  for(int itest = 0; itest < 2000; itest++){
+    s_tri4 tri;
+    vec3 v[4][3];
+    for(int i = 0; i < 4; i++){
+      double lat0 = 35.0 + 2.0 * ((double) rand() / RAND_MAX - 0.5);
+      double lon0 = 139.7 + 2.0 * ((double) rand() / RAND_MAX - 0.5);
+      for(int j = 0; j < 3; j++)
+	v[i][j] = rand_pt(lat0, lon0, 1.0);
+      tri.set(i, v[i][0], v[i][1], v[i][2]);
+    }
+    vec3 s = rand_pt(35.0, 139.7, 3.0);
+    float r = (float)(50000. * rand() / RAND_MAX);
+
+    unsigned int mask_sphere = det_collision_tri4_and_sphere(tri, s, r * r);
+    unsigned int mask_point = det_collision_tri4(tri, s);
+    for(int i = 0; i < 4; i++){
+      bool bsphere = det_collision_tri_and_sphere(v[i][0], v[i][1], v[i][2],
+						  s, r * r);
+      bool bpoint = det_collision(v[i][0], v[i][1], v[i][2], s);
+      ASSERT_EQ(bsphere, (mask_sphere & (1 << i)) != 0);
+      ASSERT_EQ(bpoint, (mask_point & (1 << i)) != 0);
+      num_sphere_hits += bsphere;
+      num_point_hits += bpoint;
+    }
+  }
+  // both cases are covered
+  ASSERT_GT(num_sphere_hits, 100);
+  ASSERT_LT(num_sphere_hits, 7900);
+  ASSERT_GT(num_point_hits, 20);
+  ASSERT_LT(num_point_hits, 7980);
+}
+
+// writes lines (lat, lon in degree) as a JPGIS coast line file
+static void write_jpgis(const string & fname,
+			const vector<vector<vec2>> & lines)
+{
+  ofstream ofile(fname.c_str());
+  ofile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
+  ofile.precision(12);
+  for(int iline = 0; iline < (int)lines.size(); iline++){
+    ofile << "<gml:Curve gml:id=\"cv" << iline << "\">" << endl;
+    ofile << "<gml:segments><gml:LineStringSegment>" << endl;
+    ofile << "<gml:posList>" << endl;
+    for(int ipt = 0; ipt < (int)lines[iline].size(); ipt++)
+      ofile << lines[iline][ipt].x << " " << lines[iline][ipt].y << endl;
+    ofile << "</gml:posList>" << endl;
+    ofile << "</gml:LineStringSegment></gml:segments>" << endl;
+    ofile << "</gml:Curve>" << endl;
+  }
+}
+
+// random walks around 35N 139.7E as coast lines
+static void gen_lines(vector<vector<vec2>> & lines, const int num_lines,
+		      const int num_pts)
+{
+  lines.resize(num_lines);
+  for(int iline = 0; iline < num_lines; iline++){
+    double lat = 35.0 + 0.5 * rand() / RAND_MAX,
+      lon = 139.7 + 0.5 * rand() / RAND_MAX;
+    for(int i = 0; i < num_pts; i++){
+      lat += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      lon += 0.002 * ((double) rand() / RAND_MAX - 0.5);
+      lines[iline].push_back(vec2(lat, lon));
+    }
+  }
+}
+
+TEST(CoastLineTest, LoadJPJIS)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_jpgis_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+
+  srand(1);
+  vector<vector<vec2>> lines[2];
+  list<string> fnames;
+  for(int ifile = 0; ifile < 2; ifile++){
+    gen_lines(lines[ifile], 10, 100);
+    // duplicated points are removed
+    lines[ifile][0].insert(lines[ifile][0].begin() + 10, lines[ifile][0][10]);
+    fnames.push_back((work_path / (ifile ? "b.xml" : "a.xml")).string());
+    write_jpgis(fnames.back(), lines[ifile]);
+  }
+  
+  CoastLine cl;
+  ASSERT_TRUE(cl.loadJPJIS(fnames, 4));
+  ASSERT_EQ(cl.getNumLines(), 20u);
+  for(unsigned int iline = 0; iline < cl.getNumLines(); iline++){
+    vector<vec2> pts;
+    cl.getPointsBLH(iline, pts);
+    ASSERT_EQ(pts.size(), 100u);
+    // the lines are in the order of the files
+    const vector<vec2> & src = lines[iline / 10][iline % 10];
+    for(unsigned int ipt = 0, isrc = 0; ipt < pts.size(); ipt++, isrc++){
+      if(iline % 10 == 0 && ipt == 10)
+	isrc++;
+      // quantization step is PI / 2^31 
+      ASSERT_NEAR(pts[ipt].x, src[isrc].x * PI / 180., 1e-9);
+      ASSERT_NEAR(pts[ipt].y, src[isrc].y * PI / 180., 1e-9);
+    }
+  }
+
+  CoastLine cl_single;
+  ASSERT_TRUE(cl_single.loadJPJIS(fnames.front().c_str()));
+  ASSERT_EQ(cl_single.getNumLines(), 10u);
+  ASSERT_FALSE(cl_single.loadJPJIS((work_path / "c.xml").string().c_str()));
+  
+  fs::remove_all(work_path);
+}
+
+TEST(CoastLineTest, SaveLoad)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_save_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+
+  srand(4);
+  vector<vector<vec2>> lines;
+  gen_lines(lines, 10, 1000);
+  string fname = (work_path / "a.xml").string();
+  write_jpgis(fname, lines);
+  CoastLine cl;
+  ASSERT_TRUE(cl.loadJPJIS(fname.c_str()));
+
+  unsigned int npts = 0;
+  for(unsigned int iline = 0; iline < cl.getNumLines(); iline++)
+    npts += cl.getNumPoints(iline);
+  ASSERT_EQ(cl.size(), cl.getNumLines() * sizeof(unsigned int) + npts * 8);
+  
+  // compact format
+  string fdat = (work_path / "a.dat").string();
+  {
+    ofstream ofile(fdat, ios::binary);
+    ASSERT_TRUE(cl.save(ofile));
+  }
+  cout << "saved " << npts << " points in " << fs::file_size(fdat)
+       << " bytes" << endl;
+  ASSERT_LT(fs::file_size(fdat), npts * 8);
+  
+  // previous format, points in vec2 
+  string fdat_old = (work_path / "b.dat").string();
+  {
+    ofstream ofile(fdat_old, ios::binary);
+    unsigned int nlines = cl.getNumLines();
+    ofile.write((const char*)&nlines, sizeof(unsigned int));
+    vector<vec2> pts;
+    for(unsigned int iline = 0; iline < nlines; iline++){
+      cl.getPointsBLH(iline, pts);
+      unsigned int length = (unsigned int)pts.size();
+      ofile.write((const char*)&length, sizeof(unsigned int));
+      ofile.write((const char*)pts.data(), sizeof(vec2) * length);
+    }
+  }
+  
+  const string * fdats[2] = {&fdat, &fdat_old};
+  for(int i = 0; i < 2; i++){
+    CoastLine cl_load;
+    ifstream ifile(*fdats[i], ios::binary);
+    ASSERT_TRUE(cl_load.load(ifile));
+    ASSERT_EQ(cl_load.getNumLines(), cl.getNumLines());
+    ASSERT_EQ(cl_load.size(), cl.size());
+    vector<vec2> pts, src;
+    for(unsigned int iline = 0; iline < cl.getNumLines(); iline++){
+      cl.getPointsBLH(iline, src);
+      cl_load.getPointsBLH(iline, pts);
+      ASSERT_EQ(pts.size(), src.size());
+      for(unsigned int ipt = 0; ipt < pts.size(); ipt++){
+	ASSERT_EQ(pts[ipt].x, src[ipt].x);
+	ASSERT_EQ(pts[ipt].y, src[ipt].y);
+      }
+    }
+  }
+  
+  fs::remove_all(work_path);
+}
+
+TEST(MapBulkTest, InsertBulk)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_bulk_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  MapDataBase::setPath(work_path.string().c_str());
+  unsigned int max_size = MapDataBase::getMaxSizeLayerData(lt_coast_line);
+  MapDataBase::setMaxSizeLayerData(lt_coast_line, 8192);
+
+  srand(2);
+  vector<vector<vec2>> lines;
+  gen_lines(lines, 20, 500);
+  string fname = (work_path / "a.xml").string();
+  write_jpgis(fname, lines);
+  CoastLine cl;
+  ASSERT_TRUE(cl.loadJPJIS(fname.c_str()));
+
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  // every point of the source is found in the finest layer data
+  auto check = [&](MapDataBase & mdb)
+    {
+      for(unsigned int iline = 0; iline < cl.getNumLines(); iline += 7){
+	vector<vec3> src, pts;
+	cl.getPointsECEF(iline, src);
+	for(unsigned int ipt = 0; ipt < src.size(); ipt += 50){
+	  list<list<LayerDataPtr>> datum;
+	  mdb.request(datum, types, src[ipt], 100.f);
+	  ASSERT_EQ(datum.size(), 1u);
+	  ASSERT_FALSE(datum.front().empty());
+	  double dmin = DBL_MAX;
+	  for(auto itr = datum.front().begin(); itr != datum.front().end();
+	      itr++){
+	    const CoastLine & data = dynamic_cast<const CoastLine&>(**itr);
+	    ASSERT_LE(data.size(), 8192u);
+	    for(unsigned int jline = 0; jline < data.getNumLines(); jline++){
+	      data.getPointsECEF(jline, pts);
+	      for(unsigned int jpt = 0; jpt < pts.size(); jpt++)
+		dmin = min(dmin, l2Norm(pts[jpt], src[ipt]));
+	    }
+	  }
+	  ASSERT_LT(dmin, 1.0);
+	}
+      }
+    };
+  
+  {
+    // the packs built here are invalidated by the faces built in bulk, and
+    // rebuilt by save.
+    MapDataBase mdb;
+    mdb.init();
+    ASSERT_TRUE(mdb.save());
+    ASSERT_TRUE(mdb.insertBulk(&cl, 4, false));
+    ASSERT_GT(Node::getNumNodesBuilt(), 20u);
+    int num_dirty = 0;
+    for(int iface = 0; iface < 20; iface++)
+      num_dirty += MapPack::isDirty(iface) ? 1 : 0;
+    ASSERT_GT(num_dirty, 0);
+    check(mdb);
+    ASSERT_TRUE(mdb.save());
+    for(int iface = 0; iface < 20; iface++)
+      ASSERT_FALSE(MapPack::isDirty(iface));
+  }
+
+  {
+    // saved tree is loaded
+    MapDataBase mdb;
+    mdb.init();
+    check(mdb);
+  }
+
+  MapDataBase::setMaxSizeLayerData(lt_coast_line, max_size);
+  MapPack::close();
+  fs::remove_all(work_path);
+}
+
+// builds a tree of synthetic coast lines at work_path, which is loaded
+// lazily by MapDataBase::init. Returns the centers of the requests.
+static void build_synthetic_tree(const fs::path & work_path,
+				 vector<vec3> & centers)
+{
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  MapDataBase::setPath(work_path.string().c_str());
+
+  srand(4);
+  vector<vector<vec2>> lines;
+  gen_lines(lines, 40, 500);
+  string fname = (work_path / "a.xml").string();
+  write_jpgis(fname, lines);
+  CoastLine cl;
+  cl.loadJPJIS(fname.c_str());
+  MapDataBase mdb;
+  mdb.init();
+  mdb.insert(&cl);
+  mdb.save();
+
+  for(int i = 0; i < (int)centers.size(); i++){
+    double lat = (35.0 + 0.5 * (i + 0.5) / centers.size()) * PI / 180.0;
+    double lon = (139.7 + 0.5 * ((i * 7) % centers.size() + 0.5)
+		  / centers.size()) * PI / 180.0;
+    blhtoecef(lat, lon, 0., centers[i].x, centers[i].y, centers[i].z);
+  }
+}
+
+static unsigned int count_lines(MapDataBase & mdb, const vec3 & center)
+{
+  list<LayerType> types;
+  types.push_back(lt_coast_line);
+  list<list<LayerDataPtr>> datum;
+  mdb.request(datum, types, center, 5000.f);
+  unsigned int n = 0;
+  for(auto itr = datum.begin(); itr != datum.end(); itr++)
+    for(auto itrd = itr->begin(); itrd != itr->end(); itrd++)
+      n += ((const CoastLine&)(**itrd)).getNumLines();
+  return n;
+}
+
+// readers request concurrently on a tree loaded lazily, while a writer
+// evicts the nodes and the layer data. The readers race to load the same
+// downlinks (Node::getDownLink) and share the layer data (reference
+// counts), and are blocked by the writer (c_rw_mutex).
+TEST(MapConcurrentTest, SyntheticRequest)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_concurrent_test";
+  unsigned int max_size = MapDataBase::getMaxSizeLayerData(lt_coast_line);
+  unsigned int max_nodes = MapDataBase::getMaxNumNodes();
+  unsigned int max_total = MapDataBase::getMaxTotalSizeLayerData();
+  MapDataBase::setMaxSizeLayerData(lt_coast_line, 8192);
+  
+  const int num_centers = 16, num_requests = 32;
+  vector<vec3> centers(num_centers);
+  build_synthetic_tree(work_path, centers);
+  
+  vector<unsigned int> num_lines(num_centers);
+  {
+    MapDataBase mdb;
+    mdb.init();
+    unsigned int num_total = 0;
+    for(int i = 0; i < num_centers; i++){
+      num_lines[i] = count_lines(mdb, centers[i]);
+      num_total += num_lines[i];
+    }
+    ASSERT_GT(num_total, 0u);
+  }
+
+  // small cache lets the writer evict what the readers have loaded.
+  MapDataBase::setMaxNumNodes(64);
+  MapDataBase::setMaxTotalSizeLayerData(64 * 1024);
+  for(int nthreads = 2; nthreads <= 8; nthreads *= 2){
+    MapDataBase mdb;
+    mdb.init();
+    unsigned long long num_misses = MapDataBase::getNumMisses();
+    atomic<int> num_errors(0);
+    atomic<bool> bdone(false);
+    vector<thread> threads;
+    for(int ith = 0; ith < nthreads; ith++){
+      threads.push_back(thread([&, ith](){
+				 for(int i = 0; i < num_requests; i++){
+				   int ic = (i * 5 + ith) % num_centers;
+				   if(count_lines(mdb, centers[ic]) != num_lines[ic])
+				     num_errors++;
+				 }
+			       }));
+    }
+    thread writer([&](){
+		    while(!bdone){
+		      mdb.restruct();
+		      this_thread::sleep_for(chrono::milliseconds(1));
+		    }
+		  });
+    for(auto itr = threads.begin(); itr != threads.end(); itr++)
+      itr->join();
+    bdone = true;
+    writer.join();
+    ASSERT_EQ(num_errors, 0);
+    ASSERT_GT(MapDataBase::getNumMisses(), num_misses);
+  }
+
+  MapDataBase::setMaxSizeLayerData(lt_coast_line, max_size);
+  MapDataBase::setMaxNumNodes(max_nodes);
+  MapDataBase::setMaxTotalSizeLayerData(max_total);
+  MapPack::close();
+  fs::remove_all(work_path);
+}
+
+// exposes try_reduce
+class ReducibleCoastLine: public CoastLine
+{
+public:
+  int reduce_points(int nred)
+  {
+    return try_reduce(nred);
+  }
+};
+
+TEST(CoastLineTest, Reduce)
+{
+  fs::path work_path = fs::temp_directory_path() / "aws_map_reduce_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+
+  srand(3);
+  vector<vector<vec2>> lines;
+  gen_lines(lines, 20, 5000);
+  // a small island to be removed
+  vector<vec2> island;
+  island.push_back(vec2(35.2, 139.9));
+  island.push_back(vec2(35.2001, 139.9));
+  island.push_back(vec2(35.2001, 139.9001));
+  island.push_back(vec2(35.2, 139.9001));
+  island.push_back(vec2(35.2, 139.9));
+  lines.push_back(island);
+  string fname = (work_path / "a.xml").string();
+  write_jpgis(fname, lines);
+  
+  ReducibleCoastLine cl, cl_src;
+  ASSERT_TRUE(cl.loadJPJIS(fname.c_str()));
+  ASSERT_TRUE(cl_src.loadJPJIS(fname.c_str()));
+  ASSERT_EQ(cl.getNumLines(), 21u);
+  
+  unsigned int npts_src = 0;
+  for(unsigned int iline = 0; iline < cl.getNumLines(); iline++)
+    npts_src += cl.getNumPoints(iline);
+  
+  ASSERT_EQ(cl.reduce_points(90000), 0);
+
+  // the island has gone, end points are kept, and the points are
+  // those of the source.
+  ASSERT_EQ(cl.getNumLines(), 20u);
+  unsigned int npts = 0;
+  vector<vec3> pts, src;
+  for(unsigned int iline = 0; iline < cl.getNumLines(); iline++){
+    cl.getPointsECEF(iline, pts);
+    cl_src.getPointsECEF(iline, src);
+    ASSERT_EQ(cl.getNumPoints(iline), pts.size());
+    ASSERT_TRUE(pts.front() == src.front());
+    ASSERT_TRUE(pts.back() == src.back());
+    for(unsigned int ipt = 0, isrc = 0; ipt < pts.size(); ipt++, isrc++){
+      while(isrc < src.size() && !(src[isrc] == pts[ipt]))
+	isrc++;
+      ASSERT_LT(isrc, src.size());
+    }
+    npts += (unsigned int)pts.size();
+  }
+  // removing the island may exceed the number by 3
+  ASSERT_LE(npts, npts_src - 90000);
+  ASSERT_GE(npts, npts_src - 90003);
+
+  // lines can not be reduced beyond their end points.
+  ASSERT_EQ(cl.reduce_points(20000), 20000 - ((int)npts - 40));
+  
+  fs::remove_all(work_path);
+}
+
+// exposes the bitmap and the merge of Depth
+class MergeableDepth: public Depth
+{
+public:
+  s_depth_bmp & getBitmap()
+  {
+    return bmp;
+  }
+  
+  bool merge_data(const Depth & src)
+  {
+    return _merge(src);
+  }
+
+  // per pixel test of the original merge, true if the pixel (i, j) is in
+  // the triangle and projected into the triangle of src.
+  bool is_merged(const MergeableDepth & src, int i, int j) const
+  {
+    double invD = 1.0 / (veci[0].x * veci[1].y - veci[0].y * veci[1].x);
+    vec2 iv0(veci[1].y * invD, -veci[0].y * invD);
+    vec2 iv1(-veci[1].x * invD, veci[0].x * invD);
+    vec2 x((double)i - vtxi[0].x, (double)j - vtxi[0].y);
+    double s = iv0.x * x.x + iv1.x * x.y;
+    double t = iv0.y * x.x + iv1.y * x.y;
+    if(s < 0 || s > 1 || t < 0 || t > 1 || s + t > 1)
+      return false;
+    vec3 p = vec[0] * s + vec[1] * t + vtx[0];
+    double a, b, c;
+    proj2tri(a, b, c, p, src.vtx[0], src.vec[0], src.vec[1]);
+    return !(a < 0 || a > 1 || b < 0 || b > 1);
+  }
+};
+
+static void blh_deg_to_ecef(const double lat, const double lon, vec3 & v)
+{
+  blhtoecef(lat * PI / 180., lon * PI / 180., 0., v.x, v.y, v.z);
+}
+
+TEST(DepthTest, Merge)
+{
+  vec3 vsrc[3], vdst[3];
+  blh_deg_to_ecef(35.0, 139.0, vsrc[0]);
+  blh_deg_to_ecef(36.0, 139.0, vsrc[1]);
+  blh_deg_to_ecef(35.0, 140.0, vsrc[2]);
+  // the destination sticks out of the source
+  blh_deg_to_ecef(35.2, 139.2, vdst[0]);
+  blh_deg_to_ecef(35.8, 139.2, vdst[1]);
+  blh_deg_to_ecef(35.2, 139.9, vdst[2]);
+
+  MergeableDepth src, dst;
+  ASSERT_TRUE(src.init(vsrc));
+  ASSERT_TRUE(dst.init(vdst));
+  s_depth_bmp & bsrc = src.getBitmap();
+  for(int j = 0; j < DEPTH_MAP_HEIGHT; j++)
+    for(int i = 0; i < DEPTH_MAP_WIDTH; i++)
+      bsrc.set(i, j, 12, 345);
+
+  ASSERT_TRUE(dst.merge_data(src));
+
+  // the merged pixels are those of the per pixel test except for the
+  // few on the edges.
+  s_depth_bmp & bdst = dst.getBitmap();
+  unsigned int nmerged = 0, nmismatch = 0;
+  for(int j = 0; j < DEPTH_MAP_HEIGHT; j++){
+    for(int i = 0; i < DEPTH_MAP_WIDTH; i++){
+      const short * ps = bdst.get(i, j);
+      bool merged = ps[0] >= 0;
+      if(merged){
+	nmerged++;
+	ASSERT_EQ(ps[0], 12);
+	ASSERT_NEAR(ps[1], 345, 1);
+      }
+      else{
+	ASSERT_EQ(ps[0], -1);
+	ASSERT_EQ(ps[1], -1);
+      }
+      if(merged != dst.is_merged(src, i, j))
+	nmismatch++;
+    }
+  }
+  ASSERT_GT(nmerged, 100000u);
+  ASSERT_LT(nmismatch, 100u);
+
+  // only the blocks with the merged pixels are allocated
+  ASSERT_LT(bdst.get_num_blocks(), DEPTH_MAP_BLOCKS_X * DEPTH_MAP_BLOCKS_Y);
+  ASSERT_GE(bdst.get_num_blocks() * DEPTH_MAP_BLOCK_SIZE * DEPTH_MAP_BLOCK_SIZE,
+	    nmerged);
+  ASSERT_LT(dst.size(), src.size());
+
+  // save and load
+  fs::path work_path = fs::temp_directory_path() / "aws_map_depth_test";
+  fs::remove_all(work_path);
+  fs::create_directory(work_path);
+  string fname = (work_path / "depth.dat").string();
+  {
+    ofstream ofile(fname, ios::binary);
+    ASSERT_TRUE(dst.save(ofile));
+  }
+  cout << "saved " << bdst.get_num_blocks() << " blocks in "
+       << fs::file_size(fname) << " bytes" << endl;
+  MergeableDepth dst_load;
+  {
+    ifstream ifile(fname, ios::binary);
+    ASSERT_TRUE(dst_load.load(ifile));
+  }
+  s_depth_bmp & bload = dst_load.getBitmap();
+  ASSERT_EQ(bload.get_num_blocks(), bdst.get_num_blocks());
+  for(int j = 0; j < DEPTH_MAP_HEIGHT; j++){
+    for(int i = 0; i < DEPTH_MAP_WIDTH; i++){
+      ASSERT_EQ(bload.get(i, j)[0], bdst.get(i, j)[0]);
+      ASSERT_EQ(bload.get(i, j)[1], bdst.get(i, j)[1]);
+    }
+  }
+  fs::remove_all(work_path);
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 #include <cmath>
 #include <list>
 #include <utility>
@@ -161,6 +162,32 @@ TEST_F(NMEATest, GPGGATest)
   ASSERT_EQ(gga_dec.m_dgps_station, gga_enc.m_dgps_station);  
 }
 
+TEST_F(NMEATest, DispatchTest)
+{
+  ASSERT_EQ(get_nmea0183_payload("GGA"), NMEA0183::Payload_GGA);
+  ASSERT_EQ(get_nmea0183_payload("ABK"), NMEA0183::Payload_ABK);
+  ASSERT_EQ(get_nmea0183_payload("VDM"), NMEA0183::Payload_NONE);
+
+  c_nmea_dec dec1;
+  ASSERT_FALSE(dec1.add_nmea0183_decoder("XYZ"));
+  ASSERT_FALSE(dec1.add_nmea0183_decoder("GGAX"));
+  ASSERT_FALSE(dec1.add_nmea0183_decoder("GG"));
+  ASSERT_TRUE(dec1.add_nmea0183_decoder("GGA"));
+  ASSERT_FALSE(dec1.add_nmea0183_decoder("GGA"));
+  ASSERT_TRUE(dec1.decode(sentences[0]) == nullptr); // RMC not registered
+
+  // the talker is not a part of the dispatch key
+  char buf[85];
+  strcpy(buf, sentences[1]);
+  buf[1] = 'G'; buf[2] = 'N';
+  snprintf(strchr(buf, '*') + 1, 3, "%02X", calc_nmea_chksum(buf));
+  const c_nmea_dat * dat = dec1.decode(buf);
+  ASSERT_TRUE(dat != nullptr);
+  ASSERT_TRUE(dat->get_payload_type() == NMEA0183::Payload_GGA);
+  ASSERT_EQ(dat->m_toker[0], 'G');
+  ASSERT_EQ(dat->m_toker[1], 'N');
+}
+
 TEST_F(NMEATest, GPGSATest)
 {
   const c_nmea_dat * dat = dec.decode(sentences[2]);
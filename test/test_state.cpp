@@ -0,0 +1,335 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "aws_coord.hpp"
+#include "aws_clock.hpp"
+#include "aws_math.hpp"
+#include "aws_state.hpp"
+
+// linear search from the latest sample, as find_sample_index did before
+// the cursor and binary search were introduced.
+static void find_sample_index_linear(const vector<long long> & ts,
+				     const int tail, const long long & tsmpl,
+				     int & i0, int & i1)
+{
+  i1 = tail - 1;
+  if(i1 < 0)
+    i1 += ts.size();
+
+  if(ts[i1] < tsmpl){
+    i0 = i1;
+    i1 = ts.size();
+    return;
+  }
+
+  if(ts[tail] > tsmpl){
+    i0 = -1;
+    i1 = tail;
+    return;
+  }
+      
+  i0 = i1  - 1;
+  if(i0 < 0)
+    i0 += ts.size();    
+      
+  while(i1 != tail){
+    if(ts[i0] <= tsmpl && ts[i1] >= tsmpl)
+      break;
+    i1 -= 1;
+    if(i1 < 0)
+      i1 += ts.size();
+    i0 = i1  - 1;
+    if(i0 < 0)
+      i0 += ts.size();      
+  }
+
+  if(i1 == tail)
+    i0 = i1 = -1;
+}
+
+TEST(StateTest, FindSampleIndex)
+{
+  srand(1);
+  const int size_buf = 64;
+  vector<long long> ts(size_buf, -1);
+  int tail = 0;
+  long long t = 1000;
+  for(int iadd = 0; iadd < 300; iadd++){
+    // samples with the same time stamp are allowed
+    t += rand() % 4 == 0 ? 0 : rand() % 100;
+    ts[tail] = t;
+    tail = (tail + 1) % size_buf;
+
+    int cursor = -1;
+    // sequential queries with the cursor, then random ones.
+    for(int iq = 0; iq < 200; iq++){
+      long long tq = iq < 100 ? 900 + (t - 800) * iq / 100 :
+	900 + rand() % (t - 800);
+      int i0, i1, j0, j1;
+      time_series_base::find_sample_index(ts, tail, tq, i0, i1, cursor);
+      find_sample_index_linear(ts, tail, tq, j0, j1);
+      ASSERT_EQ(i0, j0);
+      ASSERT_EQ(i1, j1);
+    }
+  }
+}
+
+TEST(StateTest, TimeSeries)
+{
+  // speed, course and gear
+  time_series<ts_field<float>, ts_field<float, ts_angle>,
+	      ts_field<int, ts_hold> > h(16);
+  // the columns start at cache line boundaries
+  ASSERT_EQ((size_t)h.get_times().data() % 64, 0u);
+  ASSERT_EQ((size_t)h.get<0>().data() % 64, 0u);
+  ASSERT_EQ((size_t)h.get<1>().data() % 64, 0u);
+  ASSERT_EQ((size_t)h.get<2>().data() % 64, 0u);
+  ASSERT_TRUE(h.add(1000, 1.f, (float)(PI - 0.1), 1));
+  ASSERT_TRUE(h.add(2000, 3.f, (float)(-PI + 0.1), 2));
+  ASSERT_FALSE(h.add(1500, 0.f, 0.f, 0));
+  ASSERT_EQ(h.get_num(), 2);
+  ASSERT_EQ(h.get_tmin(), 1000);
+  ASSERT_EQ(h.get_tmax(), 2000);
+  ASSERT_FALSE(h.is_samplable(999));
+  ASSERT_TRUE(h.is_samplable(1500));
+
+  float spd, crs;
+  int gear;
+  h.sample(1500, spd, crs, gear);
+  ASSERT_NEAR(spd, 2.f, 1e-6);
+  // course is interpolated across +-PI
+  ASSERT_NEAR(fabs(crs), PI, 1e-5);
+  ASSERT_EQ(gear, 1);
+  h.sample(2000, spd, crs, gear);
+  ASSERT_NEAR(spd, 3.f, 1e-6);
+
+  // resampling at 10 points gives the same as sample at each time 
+  for(int i = 0; i < 20; i++)
+    h.add(2000 + 100 * (i + 1), (float)i, 0.1f * i, i);
+  vector<float> spds(10), crss(10);
+  vector<int> gears(10);
+  h.resample(1900, 150, 10, spds.data(), crss.data(), gears.data());
+  for(int k = 0; k < 10; k++){
+    h.sample(1900 + 150 * k, spd, crs, gear);
+    ASSERT_EQ(spds[k], spd);
+    ASSERT_EQ(crss[k], crs);
+    ASSERT_EQ(gears[k], gear);
+  }
+
+  // the ring is overwritten
+  ASSERT_EQ(h.get_num(), 16);
+  ASSERT_EQ(h.get_tmin(), 2000 + 100 * 5);
+  h.clear();
+  ASSERT_EQ(h.get_num(), 0);
+  ASSERT_EQ(h.get_tmax(), -1);
+}
+
+TEST(StateTest, Sample10Hz)
+{
+  c_aws1_state st(256, 256);
+  long long t0 = 10 * SEC;
+  st.set_time(t0);
+
+  // one minute of the sensor data at 10hz, but the attitude at 20hz
+  // and the engine and rudder at 1hz.
+  for(long long t = 0; t <= 60 * SEC; t += 50 * MSEC){
+    long long ts = t0 + t;
+    st.add_attitude(ts, 0.f, 0.f, 0.f);
+    if(t % (100 * MSEC) != 0)
+      continue;
+    double lat = 0.6 + 1e-7 * (double) (t / MSEC);
+    st.add_position(ts, lat, 2.4);
+    st.add_heave(ts, 0.f);
+    st.add_velocity(ts, 1.f, 0.f);
+    st.add_engr(ts, 700.f, 0);
+    if(t % SEC == 0){
+      st.add_eng(ts, 200);
+      st.add_rud(ts, 127);
+    }
+  }
+
+  // the latest sample is interpolated on the time
+  long long tlast = st.get_time_10hz_data(0);
+  ASSERT_GT(tlast, t0);
+  double lat, lon, hev, x, y, z;
+  float u, v, w, roll, pitch, yaw, dr_dt, dp_dt, dy_dt, rev;
+  int trim, eng, rud;
+  st.get_10hz_data(0, lat, lon, hev, x, y, z, u, v, w, roll, pitch, yaw,
+		   dr_dt, dp_dt, dy_dt, rev, trim, eng, rud);
+  ASSERT_EQ(eng, 200);
+  ASSERT_EQ(rud, 127);
+  ASSERT_NEAR(rev, 700.f, 1e-3);
+  ASSERT_NEAR(lon, 2.4, 1e-9);
+  ASSERT_GT(lat, 0.6);
+}
+
+// adds one minute of the sensor data with jitters from t0. The yaw turns
+// across +-PI.
+static void add_sensor_data(c_aws1_state & st, const long long t0)
+{
+  srand(2);
+  for(long long t = 0; t <= 60 * SEC; t += 50 * MSEC){
+    long long ts = t0 + t + rand() % (10 * MSEC);
+    float yaw = normalize_angle_rad((float)(3.0 + 1e-4 * (double)(t / MSEC)));
+    st.add_attitude(ts, 0.01f * (rand() % 10), 0.01f * (rand() % 10), yaw);
+    if(t % (100 * MSEC) != 0)
+      continue;
+    st.add_position(ts, 0.6 + 1e-7 * (double)(t / MSEC), 2.4);
+    st.add_heave(ts, 0.01f * (rand() % 10));
+    st.add_velocity(ts, 1.f + 0.1f * (rand() % 10), 0.1f * (rand() % 10));
+    st.add_engr(ts, 700.f + rand() % 10, rand() % 2);
+    if(t % SEC == 0){
+      st.add_eng(ts, rand() % 256);
+      st.add_rud(ts, rand() % 256);
+      st.add_engd(ts, 80.f + rand() % 10, 12.f, 1.f, 0.01 * (t / SEC));
+      st.add_mda(ts, 0.1f * (rand() % 10), 3.f, 50.f, 20.f, 10.f, 1013.f);
+      st.add_depth(ts, 10.f + rand() % 10);
+    }
+  }
+}
+
+// the batch resampling gives the same samples as the sampler does
+// sample by sample.
+TEST(StateTest, ResampleBatch)
+{
+  c_aws1_state st(4096, 1024);
+  long long t0 = 10 * SEC;
+  st.set_time(t0);
+  add_sensor_data(st, t0);
+
+  // the sampler starts at the time set plus the attitude delay
+  const long long tstart = t0 + 200 * MSEC + 100 * MSEC;
+  s_aws1_10hz_data d;
+  int n = st.resample_10hz_data(tstart, 100000, d);
+  ASSERT_GT(n, 500);
+  ASSERT_EQ(d.num, n);
+  ASSERT_EQ(st.get_time_10hz_data(0), d.t0 + d.dt * (n - 1));
+  for(int k = 0; k < n; k++){
+    double lat, lon, hev, x, y, z;
+    float u, v, w, roll, pitch, yaw, dr_dt, dp_dt, dy_dt, rev;
+    int trim, eng, rud;
+    ASSERT_TRUE(st.get_10hz_data(k - n + 1, lat, lon, hev, x, y, z,
+				 u, v, w, roll, pitch, yaw,
+				 dr_dt, dp_dt, dy_dt, rev, trim, eng, rud));
+    ASSERT_EQ(d.lat[k], lat);
+    ASSERT_EQ(d.lon[k], lon);
+    ASSERT_EQ(d.hev[k], hev);
+    ASSERT_EQ(d.x[k], x);
+    ASSERT_EQ(d.y[k], y);
+    ASSERT_EQ(d.z[k], z);
+    ASSERT_EQ(d.ucor[k], u);
+    ASSERT_EQ(d.vcor[k], v);
+    ASSERT_EQ(d.wcor[k], w);
+    ASSERT_EQ(d.roll[k], roll);
+    ASSERT_EQ(d.pitch[k], pitch);
+    ASSERT_EQ(d.yaw[k], yaw);
+    ASSERT_EQ(d.dr_dt[k], dr_dt);
+    ASSERT_EQ(d.dp_dt[k], dp_dt);
+    ASSERT_EQ(d.dy_dt[k], dy_dt);
+    ASSERT_EQ(d.rev[k], rev);
+    ASSERT_EQ(d.trim[k], trim);
+    ASSERT_EQ(d.eng[k], eng);
+    ASSERT_EQ(d.rud[k], rud);
+  }
+
+  s_aws1_1hz_data d1;
+  n = st.resample_1hz_data(tstart, 100000, d1);
+  ASSERT_GT(n, 500);
+  for(int k = 0; k < n; k++){
+    float tmpeng, valt, frate, wdir, wspd, hmd, tmpa, dwpt, bar, depth;
+    double hour;
+    ASSERT_TRUE(st.get_1hz_data(k - n + 1, tmpeng, valt, frate, hour,
+				wdir, wspd, hmd, tmpa, dwpt, bar, depth));
+    ASSERT_EQ(d1.tmpeng[k], tmpeng);
+    ASSERT_EQ(d1.hour[k], hour);
+    ASSERT_EQ(d1.wdir[k], wdir);
+    ASSERT_EQ(d1.bar[k], bar);
+    ASSERT_EQ(d1.depth[k], depth);
+  }
+
+  // not samplable before the histories
+  ASSERT_EQ(st.resample_10hz_data(t0 - SEC, 10, d), 0);
+}
+
+#define ASSERT_10HZ_DATA_EQ(d0, k0, d1, k1)	\
+  ASSERT_EQ(d0.roll[k0], d1.roll[k1]);		\
+  ASSERT_EQ(d0.u[k0], d1.u[k1]);		\
+  ASSERT_EQ(d0.w[k0], d1.w[k1]);		\
+  ASSERT_EQ(d0.ucor[k0], d1.ucor[k1]);		\
+  ASSERT_EQ(d0.vcor[k0], d1.vcor[k1]);		\
+  ASSERT_EQ(d0.wcor[k0], d1.wcor[k1]);		\
+  ASSERT_EQ(d0.du_dt[k0], d1.du_dt[k1]);	\
+  ASSERT_EQ(d0.dv_dt[k0], d1.dv_dt[k1]);	\
+  ASSERT_EQ(d0.dr_dt[k0], d1.dr_dt[k1]);	\
+  ASSERT_EQ(d0.dp_dt[k0], d1.dp_dt[k1]);	\
+  ASSERT_EQ(d0.dy_dt[k0], d1.dy_dt[k1]);
+
+// the batches chained give the same samples as the batch covering them.
+TEST(StateTest, ResampleChained)
+{
+  c_aws1_state st(4096, 1024);
+  long long t0 = 10 * SEC;
+  st.set_time(t0);
+  add_sensor_data(st, t0);
+
+  const long long tstart = t0 + 200 * MSEC + 100 * MSEC;
+  s_aws1_10hz_data d, dc;
+  int n = st.resample_10hz_data(tstart, 100000, d);
+  ASSERT_GT(n, 500);
+
+  // batches of various lengths, including single sample ones.
+  const int lens[] = {1, 7, 1, 100, 2, 250};
+  int k = 0;
+  for(int ib = 0; k < n; ib++){
+    int len = lens[ib % (sizeof(lens) / sizeof(int))];
+    int nc = st.resample_10hz_data(d.t0 + d.dt * k, len, dc);
+    ASSERT_EQ(nc, min(len, n - k));
+    for(int kc = 0; kc < nc; kc++, k++){
+      ASSERT_10HZ_DATA_EQ(d, k, dc, kc);
+    }
+  }
+}
+
+// the sensor channels resampled by the threads are the same as those
+// resampled sequentially.
+TEST(StateTest, ResampleThreads)
+{
+  c_aws1_state st(4096, 1024);
+  long long t0 = 10 * SEC;
+  st.set_time(t0);
+  add_sensor_data(st, t0);
+
+  const long long tstart = t0 + 200 * MSEC + 100 * MSEC;
+  s_aws1_10hz_data d, dth;
+  s_aws1_1hz_data d1, d1th;
+  st.set_resample_threads(1);
+  int n = st.resample_10hz_data(tstart, 100000, d);
+  int n1 = st.resample_1hz_data(tstart, 100000, d1);
+  ASSERT_GT(n, 500);
+  ASSERT_GT(n1, 500);
+
+  st.set_resample_threads(4, 0);
+  ASSERT_EQ(st.resample_10hz_data(tstart, 100000, dth), n);
+  ASSERT_EQ(st.resample_1hz_data(tstart, 100000, d1th), n1);
+  for(int k = 0; k < n; k++){
+    ASSERT_EQ(d.lat[k], dth.lat[k]);
+    ASSERT_EQ(d.x[k], dth.x[k]);
+    ASSERT_EQ(d.hev[k], dth.hev[k]);
+    ASSERT_EQ(d.yaw[k], dth.yaw[k]);
+    ASSERT_EQ(d.rev[k], dth.rev[k]);
+    ASSERT_EQ(d.eng[k], dth.eng[k]);
+    ASSERT_EQ(d.rud[k], dth.rud[k]);
+    ASSERT_10HZ_DATA_EQ(d, k, dth, k);
+  }
+  for(int k = 0; k < n1; k++){
+    ASSERT_EQ(d1.tmpeng[k], d1th.tmpeng[k]);
+    ASSERT_EQ(d1.hour[k], d1th.hour[k]);
+    ASSERT_EQ(d1.wdir[k], d1th.wdir[k]);
+    ASSERT_EQ(d1.depth[k], d1th.depth[k]);
+  }
+}
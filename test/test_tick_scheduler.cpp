@@ -0,0 +1,96 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "aws_thread.hpp"
+
+class TickSchedulerTest: public ::testing::Test{
+protected:
+  c_tick_scheduler sched;
+
+  // ticks after all the num_waiters threads are waiting, so that the
+  // number of wakeups does not depend on thread scheduling.
+  void tick_synced(size_t num_waiters)
+  {
+    while(sched.get_num_waiters() < num_waiters)
+      this_thread::yield();
+    sched.tick();
+  }
+};
+
+TEST_F(TickSchedulerTest, WaitTicks){
+  c_tick_scheduler::s_waiter w;
+  atomic<long long> tick_woken(-1);
+  thread th([&](){
+    ASSERT_TRUE(sched.wait(w, 3));
+    tick_woken = sched.get_count_tick();
+  });
+
+  for(int i = 0; i < 2; i++)
+    tick_synced(1);
+  this_thread::sleep_for(chrono::milliseconds(10));
+  EXPECT_EQ(tick_woken, -1);
+  tick_synced(1);
+  th.join();
+  EXPECT_EQ(tick_woken, 3);
+  EXPECT_EQ(sched.get_num_wakeups(), 1);
+}
+
+TEST_F(TickSchedulerTest, Cancel){
+  c_tick_scheduler::s_waiter w;
+  thread th([&](){
+    EXPECT_FALSE(sched.wait(w, 1000));
+  });
+  while(sched.get_num_waiters() < 1)
+    this_thread::yield();
+  sched.cancel(w);
+  th.join();
+  EXPECT_EQ(sched.get_num_waiters(), 0);
+
+  // cancel is sticky until reset
+  EXPECT_FALSE(sched.wait(w, 1));
+  sched.reset(w);
+  thread th2([&](){
+    EXPECT_TRUE(sched.wait(w, 1));
+  });
+  tick_synced(1);
+  th2.join();
+}
+
+// Compares wakeups per tick with the broadcast every tick, which wakes all
+// the filter threads regardless of their intervals.
+TEST_F(TickSchedulerTest, WakeupsPerTick){
+  const int num_threads = 40;
+  const int num_ticks = 1000;
+  vector<thread> ths;
+  vector<c_tick_scheduler::s_waiter> ws(num_threads);
+  long long num_expected = 0;
+  for(int i = 0; i < num_threads; i++){
+    int intvl = (i % 8) + 1;
+    num_expected += num_ticks / intvl;
+    ths.push_back(thread([&, i, intvl](){
+      while(sched.wait(ws[i], intvl));
+    }));
+  }
+
+  auto tstart = chrono::steady_clock::now();
+  for(int i = 0; i < num_ticks; i++)
+    tick_synced(num_threads);
+  auto tend = chrono::steady_clock::now();
+
+  for(int i = 0; i < num_threads; i++)
+    sched.cancel(ws[i]);
+  for(auto & th : ths)
+    th.join();
+
+  double wpt = (double) sched.get_num_wakeups() / (double) num_ticks;
+  double usec = chrono::duration<double, micro>(tend - tstart).count();
+  cout << "Wakeups per tick: " << wpt << " (broadcast: " << num_threads << ")"
+       << " Time per tick: " << usec / num_ticks << " usec" << endl;
+  EXPECT_EQ(sched.get_num_wakeups(), num_expected);
+  EXPECT_LT(wpt, num_threads / 2);
+}
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+using namespace std;
+
+#include "gtest/gtest.h"
+#include "aws_thread.hpp"
+
+class WorkStealingPoolTest: public ::testing::Test{
+protected:
+  c_work_stealing_pool pool;
+  virtual void SetUp(){
+    pool.start(4);
+  }
+};
+
+TEST_F(WorkStealingPoolTest, ExecuteAll){
+  const int num_tasks = 10000;
+  atomic<int> count(0);
+  for(int i = 0; i < num_tasks; i++)
+    pool.push([&count](){count++;});
+  pool.wait_idle();
+  EXPECT_EQ(count, num_tasks);
+  EXPECT_EQ(pool.get_num_execs(), num_tasks);
+}
+
+TEST_F(WorkStealingPoolTest, Steal){
+  // tasks are pushed in round robin, the long tasks occupy the first worker,
+  // then the short tasks queued for the worker are stolen.
+  atomic<int> count(0);
+  for(int i = 0; i < 40; i++){
+    if(i % 4 == 0)
+      pool.push([&count](){
+	this_thread::sleep_for(chrono::milliseconds(20));
+	count++;
+      });
+    else
+      pool.push([&count](){count++;});
+  }
+  pool.wait_idle();
+  EXPECT_EQ(count, 40);
+  EXPECT_GT(pool.get_num_steals(), 0);
+}
+
+TEST_F(WorkStealingPoolTest, SerializedByMutex){
+  // the tasks sharing a mutex are serialized as filters' proc() on the
+  // command mutex.
+  mutex mtx;
+  int shared = 0;
+  for(int i = 0; i < 1000; i++)
+    pool.push([&](){
+      lock_guard<mutex> lk(mtx);
+      shared++;
+    });
+  pool.wait_idle();
+  EXPECT_EQ(shared, 1000);
+}
+
+TEST_F(WorkStealingPoolTest, StopDrains){
+  atomic<int> count(0);
+  for(int i = 0; i < 100; i++)
+    pool.push([&count](){count++;});
+  pool.stop();
+  EXPECT_EQ(count, 100);
+  EXPECT_FALSE(pool.is_active());
+}
+
+TEST(WaveLevelsTest, Loop){
+  // 0 -> 1 -> 2, and 3 <-> 4 fed by 1
+  vector<vector<int>> succ = {{1}, {2, 3}, {}, {4}, {3}};
+  vector<int> level;
+  EXPECT_EQ(calc_wave_levels(succ, level), 2);
+  EXPECT_EQ(level[0], 0);
+  EXPECT_EQ(level[1], 1);
+  EXPECT_EQ(level[2], 2);
+  EXPECT_EQ(level[3], 3);
+  EXPECT_EQ(level[4], 3);
+}
+
+TEST_F(WorkStealingPoolTest, WavesInWiringOrder){
+  // channel wiring of filters: two sensors 0 and 1 feed a state estimator
+  // 2, the estimator feeds a controller 3 and a logger 5, and the
+  // controller and the sensor 0 feed an actuator 4. 6 is not wired.
+  vector<vector<int>> succ = {{2, 4}, {2}, {3, 5}, {4}, {}, {}, {}};
+  vector<int> level;
+  ASSERT_EQ(calc_wave_levels(succ, level), 0);
+  EXPECT_EQ(level[4], 3);
+
+  for(int itr = 0; itr < 20; itr++){
+    atomic<int> seq(0);
+    vector<int> tstart(succ.size(), -1), tend(succ.size(), -1);
+    vector<vector<c_work_stealing_pool::task>> waves;
+    for(int i = 0; i < (int) succ.size(); i++){
+      if((int) waves.size() <= level[i])
+	waves.resize(level[i] + 1);
+      waves[level[i]].push_back([&, i](){
+	  tstart[i] = seq++;
+	  if(i == 1) // a slow sensor
+	    this_thread::sleep_for(chrono::milliseconds(2));
+	  tend[i] = seq++;
+	});
+    }
+    atomic<bool> bdone(false);
+    pool.push_waves(waves, [&](){bdone = true;});
+    pool.wait_idle();
+    ASSERT_TRUE(bdone);
+    for(int i = 0; i < (int) succ.size(); i++){
+      ASSERT_GE(tend[i], 0);
+      for(auto j : succ[i])
+	ASSERT_LT(tend[i], tstart[j]) << i << " -> " << j;
+    }
+  }
+}
+
+TEST_F(WorkStealingPoolTest, WavesDoNotBlock){
+  // push_waves() returns while the first wave is running, as the clock
+  // thread dispatching the filters must not wait for proc().
+  mutex mtx;
+  condition_variable cnd;
+  bool brelease = false;
+  atomic<int> count(0);
+  vector<vector<c_work_stealing_pool::task>> waves(2);
+  waves[0].push_back([&](){
+      unique_lock<mutex> lk(mtx);
+      cnd.wait(lk, [&](){return brelease;});
+      count++;
+    });
+  waves[1].push_back([&](){count++;});
+  pool.push_waves(waves);
+  EXPECT_EQ(count, 0);
+  {
+    lock_guard<mutex> lk(mtx);
+    brelease = true;
+  }
+  cnd.notify_all();
+  pool.wait_idle();
+  EXPECT_EQ(count, 2);
+}